@@ -0,0 +1,219 @@
+#include <smasm/fatal.h>
+#include <smasm/sym.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+static void help(char const *name) {
+    fprintf(stderr,
+            "Expression interning benchmark\n"
+            "\n"
+            "Usage: %s [OPTIONS]\n"
+            "\n"
+            "Options:\n"
+            "  -n, --exprs <COUNT>          Expressions in the generated "
+            "source (default: 100000)\n"
+            "  -g, --generate <OUTPUT>      Only write the generated source\n"
+            "  -r, --runs <RUNS>            Runs to take the best of "
+            "(default: 5)\n"
+            "  -h, --help                   Print help\n",
+            name);
+}
+
+static U64 rng = 0x9E3779B97F4A7C15ull;
+
+static UInt rnd(UInt n) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng % n;
+}
+
+static char const OPS[] = {'+', '*', '&', '|', '^'};
+
+static void operand(FILE *hnd) {
+    switch (rnd(3)) {
+    case 0:
+        fprintf(hnd, "Sym%u", (unsigned)rnd(32));
+        break;
+    case 1:
+        fprintf(hnd, "$%02X", (unsigned)rnd(16));
+        break;
+    default:
+        fprintf(hnd, "%u", (unsigned)rnd(16));
+        break;
+    }
+}
+
+// Writes `count` two-operand expressions over a small pool of symbols and
+// numbers, so that many of them repeat the way they do in real code
+static void generate(FILE *hnd, UInt count) {
+    fprintf(hnd, "; generated expression benchmark source\n\n");
+    for (UInt i = 0; i < 32; ++i) {
+        fprintf(hnd, "Sym%u = %u\n", (unsigned)i, (unsigned)rnd(256));
+    }
+    for (UInt i = 0; i < count; ++i) {
+        // 16k words per section to stay inside the address space
+        if ((i % 16384) == 0) {
+            fprintf(hnd, "\n@SECTION \"DATA%u\"\n\n", (unsigned)(i / 16384));
+        }
+        fprintf(hnd, "    @DW ");
+        operand(hnd);
+        fprintf(hnd, " %c ", OPS[rnd(sizeof(OPS))]);
+        operand(hnd);
+        fprintf(hnd, "\n");
+    }
+    if (ferror(hnd)) {
+        smFatal("failed to write source: %s\n", strerror(errno));
+    }
+    fflush(hnd);
+}
+
+static SmExpr node(SmTokStream *ts, SmViewIntern *strs) {
+    switch (smTokStreamPeek(ts)) {
+    case SM_TOK_ID:
+        return (SmExpr){
+            .kind = SM_EXPR_LABEL,
+            .lbl  = {SM_ATOM_NULL, smViewAtom(strs, smTokStreamView(ts))},
+        };
+    case SM_TOK_NUM:
+        return (SmExpr){.kind = SM_EXPR_CONST, .num = smTokStreamNum(ts)};
+    default:
+        return (SmExpr){.kind = SM_EXPR_OP,
+                        .op   = {smTokStreamPeek(ts), false}};
+    }
+}
+
+// Turns every `@DW a op b` into the postfix run `a b op` that smasm would
+// intern for it. The stream closes `hnd` when done
+static UInt parse(FILE *hnd, SmExprBuf *nodes, SmViewIntern *strs) {
+    SmTokStream ts;
+    SmPosTab    positions = {};
+    smTokStreamFileInit(&ts, &positions, SM_VIEW("generated"), hnd);
+    UInt count = 0;
+    while (smTokStreamPeek(&ts) != SM_TOK_EOF) {
+        if (smTokStreamPeek(&ts) != SM_TOK_DW) {
+            smTokStreamEat(&ts);
+            continue;
+        }
+        smTokStreamEat(&ts);
+        SmExpr expr[3];
+        for (UInt i = 0; i < 3; ++i) {
+            expr[i] = node(&ts, strs);
+            smTokStreamEat(&ts);
+        }
+        smExprBufAdd(nodes, expr[0]);
+        smExprBufAdd(nodes, expr[2]);
+        smExprBufAdd(nodes, expr[1]);
+        ++count;
+    }
+    smTokStreamFini(&ts);
+    smPosTabFini(&positions);
+    return count;
+}
+
+// Everything the interner holds on to, including its unused capacity
+static UInt internBytes(SmExprIntern const *in) {
+    UInt bytes = (sizeof(SmExprBuf) * in->cap) +
+                 (sizeof(SmExprInternEntry) * in->entries_cap) +
+                 (sizeof(U32) * in->slots_cap);
+    for (UInt i = 0; i < in->len; ++i) {
+        bytes += sizeof(SmExpr) * in->bufs[i].cap;
+    }
+    return bytes;
+}
+
+static double cpuTime() {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static UInt parseUInt(char const *opt, char const *arg) {
+    char         *end;
+    unsigned long val = strtoul(arg, &end, 10);
+    if ((*arg == '\0') || (*end != '\0') || (val == 0)) {
+        smFatal("expected a positive number for %s: %s\n", opt, arg);
+    }
+    return val;
+}
+
+int main(int argc, char **argv) {
+    UInt        count     = 100000;
+    UInt        runs      = 5;
+    char const *generated = NULL;
+    for (int argi = 1; argi < argc; ++argi) {
+        char const *opt = argv[argi];
+        if (!strcmp(opt, "-h") || !strcmp(opt, "--help")) {
+            help(argv[0]);
+            return EXIT_SUCCESS;
+        }
+        ++argi;
+        if (argi == argc) {
+            smFatal("expected an argument for %s\n", opt);
+        }
+        if (!strcmp(opt, "-n") || !strcmp(opt, "--exprs")) {
+            count = parseUInt(opt, argv[argi]);
+        } else if (!strcmp(opt, "-g") || !strcmp(opt, "--generate")) {
+            generated = argv[argi];
+        } else if (!strcmp(opt, "-r") || !strcmp(opt, "--runs")) {
+            runs = parseUInt(opt, argv[argi]);
+        } else {
+            smFatal("unexpected option: %s\n", opt);
+        }
+    }
+
+    if (generated) {
+        FILE *hnd = fopen(generated, "wb");
+        if (!hnd) {
+            smFatal("failed to open %s: %s\n", generated, strerror(errno));
+        }
+        generate(hnd, count);
+        fclose(hnd);
+        return EXIT_SUCCESS;
+    }
+
+    FILE *hnd = tmpfile();
+    if (!hnd) {
+        smFatal("failed to create source: %s\n", strerror(errno));
+    }
+    generate(hnd, count);
+    SmViewIntern strs  = {};
+    SmExprBuf    nodes = {};
+    UInt         exprs = parse(hnd, &nodes, &strs);
+
+    double       best = 0.0;
+    SmExprIntern in   = {};
+    for (UInt i = 0; i < runs; ++i) {
+        smExprInternFini(&in);
+        double start = cpuTime();
+        for (UInt j = 0; j < nodes.view.len; j += 3) {
+            smExprIntern(&in, (SmExprView){nodes.view.items + j, 3});
+        }
+        double secs = cpuTime() - start;
+        if ((i == 0) || (secs < best)) {
+            best = secs;
+        }
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("generated: %" UINT_FMT " expressions, best of %" UINT_FMT
+           " runs\n",
+           exprs, runs);
+    printf("  intern secs    %14.6f\n"
+           "  ns/expression  %14.1f\n"
+           "  distinct       %14" UINT_FMT "\n"
+           "  EXPRS nodes    %14" UINT_FMT "\n"
+           "  EXPRS bytes    %14" UINT_FMT "\n"
+           "  peak RSS KiB   %14ld\n",
+           best, (best * 1e9) / exprs, in.entries_len, in.total,
+           internBytes(&in), usage.ru_maxrss);
+    smExprInternFini(&in);
+    smExprBufFini(&nodes);
+    smViewInternFini(&strs);
+    return EXIT_SUCCESS;
+}
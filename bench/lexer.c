@@ -0,0 +1,304 @@
+#include <smasm/fatal.h>
+#include <smasm/tok.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+static void help(char const *name) {
+    fprintf(stderr,
+            "Lexer throughput benchmark\n"
+            "\n"
+            "Usage: %s [OPTIONS] [SOURCE]\n"
+            "\n"
+            "Arguments:\n"
+            "  [SOURCE]  Source file to lex (default: a generated one)\n"
+            "\n"
+            "Options:\n"
+            "  -s, --size <MIB>             Size of the generated source "
+            "(default: 8)\n"
+            "  -g, --generate <OUTPUT>      Only write the generated source\n"
+            "  -r, --runs <RUNS>            Runs to take the best of "
+            "(default: 5)\n"
+            "  -b, --baseline <FILE>        Compare against a baseline file\n"
+            "  -t, --threshold <RATIO>      Fail below this ratio of the "
+            "baseline (default: 0.8)\n"
+            "  -u, --update                 Write the results to the "
+            "baseline file\n"
+            "  -h, --help                   Print help\n",
+            name);
+}
+
+typedef struct {
+    double toks_per_sec;
+    double bytes_per_sec;
+    double rss_kib;
+} Results;
+
+static U64 rng = 0x9E3779B97F4A7C15ull;
+
+static UInt rnd(UInt n) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng % n;
+}
+
+#define PICK(items) ((items)[rnd(sizeof(items) / sizeof((items)[0]))])
+
+static char const *const MNEMONICS[] = {
+    "ld a, b",      "ld hl, $C000", "ldi [hl], a",   "ld a, [de]",
+    "add a, c",     "sub a, $10",   "xor a, a",      "or a, l",
+    "and a, %1111", "cp a, 42",     "inc hl",        "dec bc",
+    "push af",      "pop de",       "bit 7, h",      "res 0, a",
+    "srl a",        "swap a",       "ld [$FF40], a", "nop",
+};
+
+static char const *const COMMENTS[] = {
+    "wait for the next vertical blank before touching video memory",
+    "the high byte of the pointer is always the same page here",
+    "café, naïve, über: comments are not always ASCII",
+    "TODO: unroll",
+};
+
+// Writes a source that looks like real code: sections, global and local
+// labels, instructions, data in every radix, strings with and without
+// escapes, macros and plenty of comments
+static void generate(FILE *hnd, UInt size) {
+    long start = ftell(hnd);
+    fprintf(hnd, "; generated lexer benchmark source\n\n"
+                 "@MACRO Copy\n"
+                 "    ld hl, @0 ; source\n"
+                 "    ld de, @1\n"
+                 "    ld bc, @2\n"
+                 "    call MemCopy\n"
+                 "@END\n\n");
+    for (UInt i = 0; (UInt)(ftell(hnd) - start) < size; ++i) {
+        if ((i % 64) == 0) {
+            fprintf(hnd, "\n@SECTION \"CODE%u\"\n\n", (unsigned)(i / 64));
+        }
+        fprintf(hnd, "Func%u::\n", (unsigned)i);
+        fprintf(hnd, "    ; %s\n", PICK(COMMENTS));
+        UInt body  = 4 + rnd(12);
+        UInt loops = 0;
+        for (UInt j = 0; j < body; ++j) {
+            switch (rnd(10)) {
+            case 0:
+                fprintf(hnd, ".loop%u:\n", (unsigned)loops);
+                ++loops;
+                break;
+            case 1:
+                if (loops > 0) {
+                    fprintf(hnd, "    jr nz, .loop%u\n", (unsigned)rnd(loops));
+                }
+                break;
+            case 2:
+                fprintf(hnd, "    Copy Data%u, $%04X, %u_%03u\n", (unsigned)i,
+                        (unsigned)(0x8000 + rnd(0x2000)), (unsigned)rnd(8),
+                        (unsigned)rnd(1000));
+                break;
+            default:
+                fprintf(hnd, "    %-20s ; %s\n", PICK(MNEMONICS),
+                        PICK(COMMENTS));
+                break;
+            }
+        }
+        fprintf(hnd, "    ret\n");
+        fprintf(hnd, "Data%u:\n", (unsigned)i);
+        fprintf(hnd, "    @DB $%02X, %%%08u, %u, 'x', '\\n'\n",
+                (unsigned)rnd(256), (unsigned)(rnd(2) * 10110011),
+                (unsigned)rnd(256));
+        fprintf(hnd, "    @DW Func%u, $%04X\n", (unsigned)i,
+                (unsigned)rnd(0x10000));
+        if (rnd(2)) {
+            fprintf(hnd, "    @DB \"Level %u\", 0\n", (unsigned)rnd(100));
+        } else {
+            fprintf(hnd, "    @DB \"line\\tone\\n\\\"two\\\"\", 0\n");
+        }
+    }
+    if (ferror(hnd)) {
+        smFatal("failed to write source: %s\n", strerror(errno));
+    }
+    fflush(hnd);
+}
+
+static double cpuTime() {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static Results run(FILE *hnd, char const *name, UInt runs) {
+    SmTokStream ts;
+    SmPosTab    positions = {};
+    smTokStreamFileInit(&ts, &positions, (SmView){(U8 *)name, strlen(name)},
+                        hnd);
+    UInt   bytes = ts.chardev.src.view.len;
+    UInt   toks  = 0;
+    double best  = 0.0;
+    for (UInt i = 0; i < runs; ++i) {
+        toks         = 0;
+        double start = cpuTime();
+        while (smTokStreamPeek(&ts) != SM_TOK_EOF) {
+            smTokStreamEat(&ts);
+            ++toks;
+        }
+        double secs = cpuTime() - start;
+        if ((i == 0) || (secs < best)) {
+            best = secs;
+        }
+        smTokStreamRewind(&ts);
+    }
+    smTokStreamFini(&ts);
+    smPosTabFini(&positions);
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("%s: %" UINT_FMT " bytes, %" UINT_FMT " tokens, best of %" UINT_FMT
+           " runs\n",
+           name, bytes, toks, runs);
+    return (Results){toks / best, bytes / best, usage.ru_maxrss};
+}
+
+static Results readBaseline(char const *name) {
+    FILE *hnd = fopen(name, "rb");
+    if (!hnd) {
+        smFatal("failed to open baseline %s: %s\n", name, strerror(errno));
+    }
+    Results base = {};
+    if (fscanf(hnd, "tokens/sec %lf\nbytes/sec %lf\npeak RSS KiB %lf\n",
+               &base.toks_per_sec, &base.bytes_per_sec, &base.rss_kib) != 3) {
+        smFatal("malformed baseline %s\n", name);
+    }
+    fclose(hnd);
+    return base;
+}
+
+static void writeBaseline(char const *name, Results res) {
+    FILE *hnd = fopen(name, "wb");
+    if (!hnd) {
+        smFatal("failed to open baseline %s: %s\n", name, strerror(errno));
+    }
+    fprintf(hnd, "tokens/sec %.0f\nbytes/sec %.0f\npeak RSS KiB %.0f\n",
+            res.toks_per_sec, res.bytes_per_sec, res.rss_kib);
+    if (fclose(hnd) == EOF) {
+        smFatal("failed to write baseline %s: %s\n", name, strerror(errno));
+    }
+}
+
+// Prints one result against the baseline and says whether it is still within
+// the threshold. Peak RSS regresses by going up rather than down
+static Bool compare(char const *what, double val, double base,
+                    double threshold, Bool lower_is_better) {
+    double ratio = lower_is_better ? (base / val) : (val / base);
+    Bool   ok    = ratio >= threshold;
+    printf("  %-14s %14.0f  (baseline %.0f, %3.0f%%)%s\n", what, val, base,
+           ratio * 100.0, ok ? "" : "  REGRESSED");
+    return ok;
+}
+
+static UInt parseUInt(char const *opt, char const *arg) {
+    char         *end;
+    unsigned long val = strtoul(arg, &end, 10);
+    if ((*arg == '\0') || (*end != '\0') || (val == 0)) {
+        smFatal("expected a positive number for %s: %s\n", opt, arg);
+    }
+    return val;
+}
+
+int main(int argc, char **argv) {
+    UInt        size      = 8;
+    UInt        runs      = 5;
+    double      threshold = 0.8;
+    Bool        update    = false;
+    char const *generated = NULL;
+    char const *baseline  = NULL;
+    char const *source    = NULL;
+    for (int argi = 1; argi < argc; ++argi) {
+        char const *opt = argv[argi];
+        if (!strcmp(opt, "-h") || !strcmp(opt, "--help")) {
+            help(argv[0]);
+            return EXIT_SUCCESS;
+        }
+        if (!strcmp(opt, "-u") || !strcmp(opt, "--update")) {
+            update = true;
+            continue;
+        }
+        if (opt[0] == '-') {
+            ++argi;
+            if (argi == argc) {
+                smFatal("expected an argument for %s\n", opt);
+            }
+            if (!strcmp(opt, "-s") || !strcmp(opt, "--size")) {
+                size = parseUInt(opt, argv[argi]);
+            } else if (!strcmp(opt, "-g") || !strcmp(opt, "--generate")) {
+                generated = argv[argi];
+            } else if (!strcmp(opt, "-r") || !strcmp(opt, "--runs")) {
+                runs = parseUInt(opt, argv[argi]);
+            } else if (!strcmp(opt, "-b") || !strcmp(opt, "--baseline")) {
+                baseline = argv[argi];
+            } else if (!strcmp(opt, "-t") || !strcmp(opt, "--threshold")) {
+                threshold = strtod(argv[argi], NULL);
+            } else {
+                smFatal("unexpected option: %s\n", opt);
+            }
+            continue;
+        }
+        source = opt;
+    }
+
+    if (generated) {
+        FILE *hnd = fopen(generated, "wb");
+        if (!hnd) {
+            smFatal("failed to open %s: %s\n", generated, strerror(errno));
+        }
+        generate(hnd, size * 1024 * 1024);
+        fclose(hnd);
+        return EXIT_SUCCESS;
+    }
+
+    FILE *hnd;
+    if (source) {
+        hnd = fopen(source, "rb");
+        if (!hnd) {
+            smFatal("failed to open %s: %s\n", source, strerror(errno));
+        }
+    } else {
+        hnd = tmpfile();
+        if (!hnd) {
+            smFatal("failed to create source: %s\n", strerror(errno));
+        }
+        generate(hnd, size * 1024 * 1024);
+        source = "generated";
+    }
+    Results res = run(hnd, source, runs);
+    printf("  tokens/sec     %14.0f\n"
+           "  bytes/sec      %14.0f\n"
+           "  peak RSS KiB   %14.0f\n",
+           res.toks_per_sec, res.bytes_per_sec, res.rss_kib);
+
+    if (!baseline) {
+        return EXIT_SUCCESS;
+    }
+    if (update) {
+        writeBaseline(baseline, res);
+        printf("updated %s\n", baseline);
+        return EXIT_SUCCESS;
+    }
+    Results base = readBaseline(baseline);
+    Bool    ok   = true;
+    printf("against %s:\n", baseline);
+    ok &= compare("tokens/sec", res.toks_per_sec, base.toks_per_sec,
+                  threshold, false);
+    ok &= compare("bytes/sec", res.bytes_per_sec, base.bytes_per_sec,
+                  threshold, false);
+    ok &= compare("peak RSS KiB", res.rss_kib, base.rss_kib, threshold, true);
+    if (!ok) {
+        fflush(stdout);
+        smFatal("lexer performance regressed past %.0f%% of the baseline\n",
+                threshold * 100.0);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,44 @@
+#ifndef SMASM_ARENA_H
+#define SMASM_ARENA_H
+
+#include <smasm/buf.h>
+
+// A bump allocator over a list of large chunks. Nothing is freed on its own:
+// everything goes at once with smArenaReset, or back to a mark with
+// smArenaRelease. Chunks are kept around after a reset so the next round of
+// allocations does not have to ask malloc again.
+typedef struct {
+    SmBuf *chunks;
+    UInt   len;
+    UInt   cap;
+    UInt   idx;
+    // allocations served vs. calls into malloc/realloc that were needed
+    UInt   allocs;
+    UInt   mallocs;
+} SmArena;
+
+typedef struct {
+    UInt idx;
+    UInt len;
+} SmArenaMark;
+
+void       *smArenaAlloc(SmArena *arena, UInt size);
+void       *smArenaRealloc(SmArena *arena, void *ptr, UInt size, UInt new_size);
+SmArenaMark smArenaMark(SmArena const *arena);
+void        smArenaRelease(SmArena *arena, SmArenaMark mark);
+void        smArenaReset(SmArena *arena);
+UInt        smArenaMallocsAvoided(SmArena const *arena);
+void        smArenaFini(SmArena *arena);
+
+#define SM_BUF_ARENA_ADD_IMPL()                                                \
+    if ((buf->cap - buf->view.len) == 0) {                                     \
+        UInt cap        = uIntMax(buf->cap * 2, 16);                           \
+        buf->view.items = smArenaRealloc(arena, buf->view.items,               \
+                                         sizeof(*buf->view.items) * buf->cap,  \
+                                         sizeof(*buf->view.items) * cap);      \
+        buf->cap        = cap;                                                 \
+    }                                                                          \
+    buf->view.items[buf->view.len] = item;                                     \
+    ++buf->view.len;
+
+#endif // SMASM_ARENA_H
@@ -19,6 +19,10 @@ Bool smViewEqual(SmView lhs, SmView rhs);
 Bool smViewEqualIgnoreAsciiCase(SmView lhs, SmView rhs);
 Bool smViewStartsWith(SmView view, SmView prefix);
 UInt smViewHash(SmView view);
+UInt smHashSpread(UInt hash);
+// Unlike smViewHash, reads every byte and is the same on every machine, so
+// it can be stored to check contents against later
+U64  smViewDigest(SmView view);
 UInt smViewParse(SmView view);
 
 typedef struct {
@@ -26,6 +30,7 @@ typedef struct {
     UInt   cap;
 } SmBuf;
 
+void smBufReserve(SmBuf *buf, UInt len);
 void smBufCat(SmBuf *buf, SmView view);
 void smBufFini(SmBuf *buf);
 
@@ -70,19 +75,98 @@ void smViewBufFini(SmViewBuf *buf);
     memset(buf, 0, sizeof(*buf));
 
 typedef struct {
-    SmBuf *bufs;
-    UInt   len;
-    UInt   cap;
+    SmView view;
+    UInt   hash;
+    UInt   offset;
+} SmViewInternEntry;
+
+typedef struct {
+    SmBuf             *bufs;
+    UInt               len;
+    UInt               cap;
+    UInt               total;
+    SmViewInternEntry *entries;
+    UInt               entries_len;
+    UInt               entries_cap;
+    U32               *slots;
+    UInt               slots_cap;
 } SmViewIntern;
 
-SmView smViewIntern(SmViewIntern *in, SmView view);
-void   smViewInternFini(SmViewIntern *in);
+SmView       smViewIntern(SmViewIntern *in, SmView view);
+UInt         smViewInternOffset(SmViewIntern const *in, SmView view);
+SmViewIntern smViewInternCompact(SmViewIntern const *in);
+void         smViewInternFini(SmViewIntern *in);
+
+// An atom numbers an interned view by the order it was first interned in,
+// starting at 1. 0 always stands for the empty view. Names that are kept as
+// atoms compare and hash as plain integers, and a compacted interner numbers
+// its views the same way as the one it was made from.
+typedef U32 SmAtom;
+
+static SmAtom const SM_ATOM_NULL = 0;
+
+SmAtom smViewAtom(SmViewIntern *in, SmView view);
+SmView smAtomView(SmViewIntern const *in, SmAtom atom);
+UInt   smAtomOffset(SmViewIntern const *in, SmAtom atom);
 
 #ifndef typeof
 #define typeof __typeof__
 #endif
 
-#define SM_INTERN_IMPL()                                                       \
+// Interns `view` by hash-consing: `HashFn` and `EqualFn` must agree on the
+// logical contents of a view (never raw struct bytes, since unions and padding
+// may hold garbage). Expects `in` to have `bufs`, `entries` (of `view` and
+// `hash`) and `slots`. Storage buffers are never reallocated so every view
+// handed out stays valid until the interner is finalized. Each entry records
+// its `offset` into the concatenation of all the buffers (`total` long).
+#define SM_INTERN_IMPL(HashFn, EqualFn)                                        \
+    if (!in->slots) {                                                          \
+        in->slots = calloc(64, sizeof(U32));                                   \
+        if (!in->slots) {                                                      \
+            smFatal("out of memory\n");                                        \
+        }                                                                      \
+        in->slots_cap = 64;                                                    \
+    }                                                                          \
+    if (((in->entries_len + 1) * 4) > (in->slots_cap * 3)) {                   \
+        free(in->slots);                                                       \
+        in->slots_cap *= 2;                                                    \
+        in->slots = calloc(in->slots_cap, sizeof(U32));                        \
+        if (!in->slots) {                                                      \
+            smFatal("out of memory\n");                                        \
+        }                                                                      \
+        for (UInt i = 0; i < in->entries_len; ++i) {                           \
+            UInt j = smHashSpread(in->entries[i].hash) & (in->slots_cap - 1);  \
+            while (in->slots[j] != 0) {                                        \
+                j = (j + 1) & (in->slots_cap - 1);                             \
+            }                                                                  \
+            in->slots[j] = i + 1;                                              \
+        }                                                                      \
+    }                                                                          \
+    if (!in->entries) {                                                        \
+        in->entries = malloc(sizeof(*in->entries) * 64);                       \
+        if (!in->entries) {                                                    \
+            smFatal("out of memory\n");                                        \
+        }                                                                      \
+        in->entries_len = 0;                                                   \
+        in->entries_cap = 64;                                                  \
+    }                                                                          \
+    if ((in->entries_cap - in->entries_len) == 0) {                            \
+        in->entries =                                                          \
+            realloc(in->entries, sizeof(*in->entries) * in->entries_cap * 2);  \
+        if (!in->entries) {                                                    \
+            smFatal("out of memory\n");                                        \
+        }                                                                      \
+        in->entries_cap *= 2;                                                  \
+    }                                                                          \
+    UInt hash = (HashFn)(view);                                                \
+    UInt slot = smHashSpread(hash) & (in->slots_cap - 1);                      \
+    while (in->slots[slot] != 0) {                                             \
+        typeof(*in->entries) *entry = in->entries + (in->slots[slot] - 1);     \
+        if ((entry->hash == hash) && (EqualFn)(entry->view, view)) {           \
+            return entry->view;                                                \
+        }                                                                      \
+        slot = (slot + 1) & (in->slots_cap - 1);                               \
+    }                                                                          \
     if (!in->bufs) {                                                           \
         in->bufs = malloc(sizeof(*in->bufs) * 16);                             \
         if (!in->bufs) {                                                       \
@@ -92,18 +176,10 @@ void   smViewInternFini(SmViewIntern *in);
         in->cap = 16;                                                          \
     }                                                                          \
     typeof(*in->bufs) *has_space = NULL;                                       \
-    for (UInt i = 0; i < in->len; ++i) {                                       \
-        typeof(*in->bufs)        *buf = in->bufs + i;                          \
-        typeof(*buf->view.items) *items =                                      \
-            memmem(buf->view.items, sizeof(*buf->view.items) * buf->view.len,  \
-                   view.items, sizeof(*buf->view.items) * view.len);           \
-        if (items) {                                                           \
-            return (typeof(buf->view)){items, view.len};                       \
-        }                                                                      \
-        if (!has_space) {                                                      \
-            if ((buf->cap - buf->view.len) >= view.len) {                      \
-                has_space = buf;                                               \
-            }                                                                  \
+    if (in->len > 0) {                                                         \
+        has_space = in->bufs + (in->len - 1);                                  \
+        if ((has_space->cap - has_space->view.len) < view.len) {               \
+            has_space = NULL;                                                  \
         }                                                                      \
     }                                                                          \
     if (!has_space) {                                                          \
@@ -116,9 +192,9 @@ void   smViewInternFini(SmViewIntern *in);
         }                                                                      \
         has_space = in->bufs + in->len;                                        \
         has_space->view.items =                                                \
-            malloc(sizeof(*has_space->view.items) * view.len);                 \
+            malloc(sizeof(*has_space->view.items) * uIntMax(view.len, 256));   \
         has_space->view.len = 0;                                               \
-        has_space->cap      = view.len;                                        \
+        has_space->cap      = uIntMax(view.len, 256);                          \
         if (!has_space->view.items) {                                          \
             smFatal("out of memory\n");                                        \
         }                                                                      \
@@ -128,7 +204,31 @@ void   smViewInternFini(SmViewIntern *in);
         has_space->view.items + has_space->view.len;                           \
     memcpy(items, view.items, sizeof(*has_space->view.items) * view.len);      \
     has_space->view.len += view.len;                                           \
-    return (typeof(has_space->view)){items, view.len};
+    in->entries[in->entries_len] =                                             \
+        (typeof(*in->entries)){{items, view.len}, hash, in->total};            \
+    in->total += view.len;                                                     \
+    ++in->entries_len;                                                         \
+    in->slots[slot] = in->entries_len;                                         \
+    return in->entries[in->entries_len - 1].view;
+
+// Finds the `offset` of an interned view in the concatenation of all the
+// buffers without searching them. The empty view can live anywhere.
+#define SM_INTERN_OFFSET_IMPL(HashFn, EqualFn)                                 \
+    if (view.len == 0) {                                                       \
+        return 0;                                                              \
+    }                                                                          \
+    if (in->slots) {                                                           \
+        UInt hash = (HashFn)(view);                                            \
+        UInt slot = smHashSpread(hash) & (in->slots_cap - 1);                  \
+        while (in->slots[slot] != 0) {                                         \
+            typeof(*in->entries) *entry = in->entries + (in->slots[slot] - 1); \
+            if ((entry->hash == hash) && (EqualFn)(entry->view, view)) {       \
+                return entry->offset;                                          \
+            }                                                                  \
+            slot = (slot + 1) & (in->slots_cap - 1);                           \
+        }                                                                      \
+    }                                                                          \
+    smFatal("view was never interned\n");
 
 #define SM_INTERN_FINI_IMPL(BufFiniFn)                                         \
     if (!in->bufs) {                                                           \
@@ -138,6 +238,8 @@ void   smViewInternFini(SmViewIntern *in);
         (BufFiniFn)(in->bufs + i);                                             \
     }                                                                          \
     free(in->bufs);                                                            \
+    free(in->entries);                                                         \
+    free(in->slots);                                                           \
     memset(in, 0, sizeof(*in));
 
 #endif // SMASM_BUF_H
@@ -1,6 +1,7 @@
 #ifndef SMASM_FATAL_H
 #define SMASM_FATAL_H
 
+#include <setjmp.h>
 #include <stdarg.h>
 
 #define SM_FORMAT(n)
@@ -11,6 +12,11 @@
 #endif
 #endif
 
+// Errors are reported on stderr and exit the process, unless the thread set
+// `smFatalJmp`. Then they longjmp there instead, and whoever set it has to
+// clean up after the work that was cut short.
+extern _Thread_local jmp_buf *smFatalJmp;
+
 SM_FORMAT(1) _Noreturn void smFatal(char const *fmt, ...);
 _Noreturn void smFatalV(char const *fmt, va_list args);
 
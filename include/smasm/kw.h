@@ -0,0 +1,29 @@
+#ifndef SMASM_KW_H
+#define SMASM_KW_H
+
+#include <smasm/buf.h>
+
+// A keyword in a perfect hash table. Names are upper case, at most 8 bytes
+// and zero padded.
+typedef struct {
+    char name[8];
+    U32  tok;
+} SmKw;
+
+// Every keyword of a class sits alone in slot (key * mul) >> (64 - bits),
+// where key is smKwKey of its name. The tables are generated at build time by
+// tools/kwgen from the `.kw` list next to the code that uses them. It
+// searches for an odd multiplier that puts no two keywords in the same slot,
+// so recognizing a name costs one hash and one compare.
+typedef struct {
+    SmKw const *slots;
+    U64         mul;
+    UInt        bits;
+} SmKwTab;
+
+// Packs the upper-cased name into a U64 one byte at a time, low byte first.
+// The name must be 1 to 8 bytes long.
+U64         smKwKey(SmView name);
+SmKw const *smKwFind(SmKwTab const *tab, SmView name);
+
+#endif // SMASM_KW_H
@@ -0,0 +1,27 @@
+#ifndef SMASM_MAP_H
+#define SMASM_MAP_H
+
+#include <smasm/buf.h>
+
+// A hash map from names to fixed-size entries. Every entry type must start
+// with its SmView name. Entries are kept densely in insertion order (iterate
+// 0..len) with their name hashes alongside, and `slots` is an
+// open-addressing index into them holding the entry index + 1 or 0 when
+// empty. Adding an entry may move the others around, so pointers into the
+// map only stay good until the next add.
+typedef struct {
+    void *entries;
+    UInt *hashes;
+    UInt  len;
+    UInt  cap;
+    UInt  size;
+    U32  *slots;
+    UInt  slots_cap;
+} SmMap;
+
+void *smMapAdd(SmMap *map, void const *entry, UInt size);
+void *smMapFind(SmMap const *map, SmView name);
+void *smMapAt(SmMap const *map, UInt idx);
+void  smMapFini(SmMap *map);
+
+#endif // SMASM_MAP_H
@@ -0,0 +1,28 @@
+#ifndef SMASM_NUM_H
+#define SMASM_NUM_H
+
+#include <smasm/buf.h>
+
+typedef enum {
+    SM_NUM_OK,
+    SM_NUM_EMPTY,
+    SM_NUM_INVALID,
+    SM_NUM_OVERFLOW,
+} SmNumResult;
+
+// Parses digits in a radix of up to 16, skipping `_` separators. Numbers are
+// 32 bits wide, anything larger overflows
+SmNumResult smNumParseDigits(SmView digits, U32 radix, U32 *num);
+
+// Parses a whole literal: `$` for hex, `%` for binary, plain decimal or a
+// quoted character with the same escapes as the assembler
+SmNumResult smNumParse(SmView view, U32 *num);
+
+// The value of the escape `\c` in a literal quoted by `quote`, which is the
+// only quote that may be escaped. Character literals and strings both go
+// through here
+Bool smNumEscape(U32 c, U32 quote, U32 *num);
+
+char const *smNumResultStr(SmNumResult res);
+
+#endif // SMASM_NUM_H
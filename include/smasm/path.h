@@ -2,12 +2,34 @@
 #define SMASM_PATH_H
 
 #include <smasm/buf.h>
+#include <smasm/map.h>
 
-SmView smPathIntern(SmViewIntern *in, SmView path);
+// What a path spelling resolves to. `path` is its realpath, or the spelling
+// itself if it does not resolve. `id` names the file itself: its device and
+// inode when it exists, otherwise the path. Two spellings of the same file
+// have the same `id` even through hard links.
+typedef struct {
+    SmView name;
+    SmView path;
+    SmView id;
+    Bool   exists;
+} SmPathEntry;
+
+// Resolving a spelling is memoized for the life of the thread, so only the
+// first lookup of each spelling costs a realpath and a stat
+SmPathEntry const *smPathResolve(SmView path);
+SmView             smPathIntern(SmViewIntern *in, SmView path);
+Bool               smPathExists(SmView path);
+// Forgets every spelling, for when files or the working directory may have
+// changed since, and before the thread exits. Paths handed out before are no
+// longer good.
+void               smPathCacheFini();
 
+// Paths in `bufs` are kept in the order they were first added. `ids` holds
+// the identities of the files in the set
 typedef struct {
-    SmViewIntern in;
-    SmViewBuf    bufs;
+    SmViewBuf bufs;
+    SmMap     ids;
 } SmPathSet;
 
 SmView smPathSetAdd(SmPathSet *set, SmView path);
@@ -0,0 +1,62 @@
+#ifndef SMASM_POS_H
+#define SMASM_POS_H
+
+#include <smasm/buf.h>
+
+// A source position: a file of an SmPosTab and a byte offset into it. Files
+// known only by name, like those of positions read back from objects, pack
+// the line and column into the offset instead.
+typedef struct {
+    U32 file;
+    U32 offset;
+} SmPos;
+
+// A position worked out into a line and column, for messages
+typedef struct {
+    SmView file;
+    UInt   line;
+    UInt   col;
+} SmPosInfo;
+
+// Where every line of a source starts
+typedef struct {
+    U32 *starts;
+    UInt len;
+} SmLineIndex;
+
+enum SmPosSrc {
+    SM_POS_SRC_NONE,
+    // the source is only borrowed and has to outlive the table
+    SM_POS_SRC_BORROWED,
+    // the table owns the source and frees or unmaps it
+    SM_POS_SRC_MALLOCED,
+    SM_POS_SRC_MAPPED,
+};
+
+typedef struct {
+    SmView      name;
+    SmView      src;
+    SmLineIndex lines;
+    UInt        hint;
+    U8          kind;
+} SmPosFile;
+
+// Every file positions can point into. Files are never removed, so their
+// index is a stable ID.
+typedef struct {
+    SmPosFile *files;
+    UInt       len;
+    UInt       cap;
+} SmPosTab;
+
+#define SM_POS_LINE_BITS 20
+#define SM_POS_COL_BITS  12
+
+U32       smPosTabAdd(SmPosTab *tab, SmView name, SmView src, U8 kind);
+U32       smPosTabAddName(SmPosTab *tab, SmView name);
+SmPos     smPosLineCol(U32 file, UInt line, UInt col);
+SmView    smPosTabName(SmPosTab const *tab, SmPos pos);
+SmPosInfo smPosTabInfo(SmPosTab *tab, SmPos pos);
+void      smPosTabFini(SmPosTab *tab);
+
+#endif // SMASM_POS_H
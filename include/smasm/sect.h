@@ -13,7 +13,7 @@ typedef struct {
     UInt       offset;
     U8         width;
     SmExprView value;
-    SmView     unit;
+    SmAtom     unit;
     SmPos      pos;
     U8         flags;
 } SmReloc;
@@ -31,11 +31,35 @@ typedef struct {
 void smRelocBufAdd(SmRelocBuf *buf, SmReloc reloc);
 void smRelocBufFini(SmRelocBuf *buf);
 
+// A range of section data that is left out of the object and copied from a
+// file by the linker instead. `hash` is the smViewDigest of its contents.
+typedef struct {
+    UInt   offset;
+    UInt   len;
+    SmView path;
+    U64    hash;
+} SmBlob;
+
+typedef struct {
+    SmBlob *items;
+    UInt    len;
+} SmBlobView;
+
+typedef struct {
+    SmBlobView view;
+    UInt       cap;
+} SmBlobBuf;
+
+void smBlobBufAdd(SmBlobBuf *buf, SmBlob blob);
+void smBlobBufFini(SmBlobBuf *buf);
+
+// The bytes of `blobs` in `data` are left uninitialized
 typedef struct {
     SmView     name;
     U32        pc;
     SmBuf      data;
     SmRelocBuf relocs;
+    SmBlobBuf  blobs;
 } SmSect;
 
 typedef struct {
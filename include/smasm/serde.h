@@ -3,16 +3,28 @@
 
 #include <smasm/sect.h>
 
+// When `arena` is set, deserialized sections, their data and relocations are
+// allocated from it instead of malloc and must not be finalized individually.
+// Positions are written out as a file index, line and column from
+// `positions`. Reading them back adds the object's files to `positions` by
+// name, the first of them at `files`.
 typedef struct {
-    FILE  *hnd;
-    SmView name;
+    FILE     *hnd;
+    SmView    name;
+    SmArena  *arena;
+    SmPosTab *positions;
+    U32       files;
+    U32       nfiles;
 } SmSerde;
 
 void smSerializeU8(SmSerde *ser, U8 byte);
 void smSerializeU16(SmSerde *ser, U16 word);
 void smSerializeU32(SmSerde *ser, U32 num);
+// Writes a number as LEB128, 7 bits a byte
+void smSerializeVar(SmSerde *ser, U32 num);
 void smSerializeView(SmSerde *ser, SmView view);
 
+void smSerializePosTab(SmSerde *ser);
 void smSerializeViewIntern(SmSerde *ser, SmViewIntern const *in);
 void smSerializeExprIntern(SmSerde *ser, SmExprIntern const *in,
                            SmViewIntern const *strin);
@@ -24,14 +36,28 @@ void smSerializeSectView(SmSerde *ser, SmSectView sects,
 U8   smDeserializeU8(SmSerde *ser);
 U16  smDeserializeU16(SmSerde *ser);
 U32  smDeserializeU32(SmSerde *ser);
+U32  smDeserializeVar(SmSerde *ser);
 void smDeserializeView(SmSerde *ser, SmView *view);
 
+// File names are interned into `atoms`
+void smDeserializePosTab(SmSerde *ser, SmViewIntern *atoms);
+// Labels, units and section names referenced from the string table `strin`
+// are read back as atoms of `atoms`
 SmViewIntern smDeserializeViewIntern(SmSerde *ser);
-SmExprIntern smDeserializeExprIntern(SmSerde *ser, SmViewIntern const *strin);
+SmExprIntern smDeserializeExprIntern(SmSerde *ser, SmViewIntern const *strin,
+                                     SmViewIntern *atoms);
 SmSymTab     smDeserializeSymTab(SmSerde *ser, SmViewIntern const *strin,
+                                 SmViewIntern *atoms,
                                  SmExprIntern const *exprin);
 SmSectBuf    smDeserializeSectBuf(SmSerde *ser, SmViewIntern const *strin,
+                                  SmViewIntern *atoms,
                                   SmExprIntern const *exprin);
 void         smDeserializeToEnd(SmSerde *ser, SmBuf *buf);
+// Maps the whole file when it is a regular one and reads the rest of it
+// otherwise. `mapped` tells whether to munmap or free the view afterwards.
+SmView       smDeserializeMap(SmSerde *ser, Bool *mapped);
+// The deserializers keep scratch space for the life of the thread, which a
+// thread should free before it exits
+void         smDeserializeFini();
 
 #endif // SMASM_SERDE_H
@@ -1,18 +1,41 @@
 #ifndef SMASM_SYM_H
 #define SMASM_SYM_H
 
+#include <smasm/arena.h>
 #include <smasm/tok.h>
 
+// The scope and name are atoms of the interner that owns the label
 typedef struct {
-    SmView scope;
-    SmView name;
+    SmAtom scope;
+    SmAtom name;
 } SmLbl;
 
 static SmLbl const SM_LBL_NULL = {};
 
 Bool   smLblEqual(SmLbl lhs, SmLbl rhs);
 Bool   smLblIsGlobal(SmLbl lbl);
+UInt   smLblHash(SmLbl lbl);
 SmView smLblFullName(SmLbl lbl, SmViewIntern *in);
+// Frees the scratch space full names are built in, before the thread exits
+void   smLblFullNameFini();
+
+// Remembers the interned `scope.name` of local labels so it is only built
+// once. Global labels are their own full name and never take up an entry.
+typedef struct {
+    SmLbl  lbl;
+    SmAtom name;
+} SmLblNameEntry;
+
+typedef struct {
+    SmLblNameEntry *entries;
+    UInt            len;
+    UInt            cap;
+    U32            *slots;
+    UInt            slots_cap;
+} SmLblNames;
+
+SmAtom smLblNamesGet(SmLblNames *names, SmLbl lbl, SmViewIntern *in);
+void   smLblNamesFini(SmLblNames *names);
 
 typedef struct {
     U32  tok;
@@ -30,6 +53,7 @@ typedef struct {
 } SmOpBuf;
 
 void smOpBufAdd(SmOpBuf *buf, SmOp op);
+void smOpBufFini(SmOpBuf *buf);
 
 enum SmExprKind {
     SM_EXPR_CONST,
@@ -73,12 +97,27 @@ void smExprBufAdd(SmExprBuf *buf, SmExpr expr);
 void smExprBufFini(SmExprBuf *buf);
 
 typedef struct {
-    SmExprBuf *bufs;
-    UInt       len;
-    UInt       cap;
+    SmExprView view;
+    UInt       hash;
+    UInt       offset;
+} SmExprInternEntry;
+
+typedef struct {
+    SmExprBuf         *bufs;
+    UInt               len;
+    UInt               cap;
+    UInt               total;
+    SmExprInternEntry *entries;
+    UInt               entries_len;
+    UInt               entries_cap;
+    U32               *slots;
+    UInt               slots_cap;
 } SmExprIntern;
 
+UInt       smExprViewHash(SmExprView view);
+Bool       smExprViewEqual(SmExprView lhs, SmExprView rhs);
 SmExprView smExprIntern(SmExprIntern *in, SmExprView view);
+UInt       smExprInternOffset(SmExprIntern const *in, SmExprView view);
 void       smExprInternFini(SmExprIntern *in);
 
 typedef struct {
@@ -92,6 +131,7 @@ typedef struct {
 } SmI32Buf;
 
 void smI32BufAdd(SmI32Buf *buf, I32 num);
+void smI32BufArenaAdd(SmI32Buf *buf, SmArena *arena, I32 num);
 void smI32BufFini(SmI32Buf *buf);
 
 enum SmSymFlags { SM_SYM_EQU = 1 << 0 };
@@ -99,20 +139,31 @@ enum SmSymFlags { SM_SYM_EQU = 1 << 0 };
 typedef struct {
     SmLbl      lbl;
     SmExprView value;
-    SmView     unit;
-    SmView     section;
+    SmAtom     unit;
+    SmAtom     section;
     SmPos      pos;
     U8         flags;
 } SmSym;
 
+// Symbols live densely in `syms` (iterate 0..len) with their label hashes
+// alongside. `slots` is an open-addressing index into them that holds the
+// index + 1, 0 for an empty slot or SM_SYM_TAB_TOMB for a removed one.
+// Removing a symbol moves the last one into its place.
 typedef struct {
     SmSym *syms;
+    UInt  *hashes;
     UInt   len;
     UInt   cap;
+    U32   *slots;
+    UInt   slots_cap;
+    UInt   tombs;
 } SmSymTab;
 
+#define SM_SYM_TAB_TOMB ((U32)-1)
+
 SmSym *smSymTabAdd(SmSymTab *tab, SmSym sym);
 SmSym *smSymTabFind(SmSymTab *tab, SmLbl lbl);
+Bool   smSymTabRemove(SmSymTab *tab, SmLbl lbl);
 void   smSymTabFini(SmSymTab *tab);
 
 #endif // SMASM_SYM_H
@@ -1,85 +0,0 @@
-#ifndef SMASM_TAB_H
-#define SMASM_TAB_H
-
-// TODO delete params from all the macros
-// and infer them like we do for the Buf macros
-#define SM_TAB_WHENCE_IMPL(Type, EntryType)                                    \
-    static EntryType *Type##Whence(Type *tab, SmView name) {                   \
-        UInt       hash  = smViewHash(name);                                   \
-        UInt       i     = hash % tab->cap;                                    \
-        EntryType *entry = tab->entries + i;                                   \
-        while (hash != smViewHash(entry->name)) {                              \
-            if (smViewEqual(entry->name, SM_VIEW_NULL)) {                      \
-                break;                                                         \
-            }                                                                  \
-            if (smViewEqual(entry->name, name)) {                              \
-                break;                                                         \
-            }                                                                  \
-            i     = (i + 1) % tab->cap;                                        \
-            entry = tab->entries + i;                                          \
-        }                                                                      \
-        return entry;                                                          \
-    }
-
-#define SM_TAB_TRYGROW_IMPL(Type, EntryType)                                   \
-    static void Type##TryGrow(Type *tab) {                                     \
-        if (!tab->entries) {                                                   \
-            tab->entries = calloc(16, sizeof(EntryType));                      \
-            if (!tab->entries) {                                               \
-                smFatal("out of memory\n");                                    \
-            }                                                                  \
-            tab->len = 0;                                                      \
-            tab->cap = 16;                                                     \
-        }                                                                      \
-        /* we always want at least 1 empty slot */                             \
-        if ((tab->cap - tab->len) == 0) {                                      \
-            EntryType *old_entries = tab->entries;                             \
-            UInt       old_cap     = tab->cap;                                 \
-            tab->cap *= 2;                                                     \
-            tab->entries = calloc(tab->cap, sizeof(EntryType));                \
-            if (!tab->entries) {                                               \
-                smFatal("out of memory\n");                                    \
-            }                                                                  \
-            for (UInt i = 0; i < old_cap; ++i) {                               \
-                EntryType *entry = old_entries + i;                            \
-                if (smViewEqual(entry->name, SM_VIEW_NULL)) {                  \
-                    continue;                                                  \
-                }                                                              \
-                *Type##Whence(tab, entry->name) = *entry;                      \
-            }                                                                  \
-            free(old_entries);                                                 \
-        }                                                                      \
-    }
-
-#define SM_TAB_ADD_IMPL(Type, EntryType)                                       \
-    Type##TryGrow(tab);                                                        \
-    EntryType *whence = Type##Whence(tab, entry.name);                         \
-    *whence           = entry;                                                 \
-    ++tab->len;                                                                \
-    return whence;
-
-#define SM_TAB_FIND_IMPL(Type, EntryType)                                      \
-    if (!tab->entries) {                                                       \
-        return NULL;                                                           \
-    }                                                                          \
-    EntryType *whence = Type##Whence(tab, name);                               \
-    if (smViewEqual(whence->name, SM_VIEW_NULL)) {                             \
-        return NULL;                                                           \
-    }                                                                          \
-    return whence;
-
-#define SM_TAB_FINI_IMPL(EntryFiniFn)                                          \
-    if (!tab->entries) {                                                       \
-        return;                                                                \
-    }                                                                          \
-    for (UInt i = 0; i < tab->cap; ++i) {                                      \
-        typeof(*tab->entries) *entry = tab->entries + i;                       \
-        if (smViewEqual(entry->name, SM_VIEW_NULL)) {                          \
-            continue;                                                          \
-        }                                                                      \
-        (EntryFiniFn)(entry);                                                  \
-    }                                                                          \
-    free(tab->entries);                                                        \
-    memset(tab, 0, sizeof(*tab));
-
-#endif // SMASM_TAB_H
@@ -1,8 +1,10 @@
 #ifndef SMASM_TOK_H
 #define SMASM_TOK_H
 
+#include <smasm/arena.h>
 #include <smasm/buf.h>
 #include <smasm/fatal.h>
+#include <smasm/pos.h>
 
 #include <stdio.h>
 
@@ -67,13 +69,11 @@ enum SmTok {
     SM_TOK_UNIQUE   = 0xF0053,
 };
 
+// Names of plain characters are interned for the life of the thread, which
+// should free them before it exits. Names handed out before are no longer
+// good.
 SmView smTokName(U32 c);
-
-typedef struct {
-    SmView file;
-    UInt   line;
-    UInt   col;
-} SmPos;
+void   smTokNamesFini();
 
 enum SmMacroTokKind {
     SM_MACRO_TOK_TOK,
@@ -107,15 +107,31 @@ typedef struct {
 } SmMacroTokBuf;
 
 void smMacroTokBufAdd(SmMacroTokBuf *buf, SmMacroTok tok);
+void smMacroTokBufArenaAdd(SmMacroTokBuf *buf, SmArena *arena, SmMacroTok tok);
 void smMacroTokBufFini(SmMacroTokBuf *buf);
 
 typedef struct {
-    SmMacroTokBuf *bufs;
-    UInt           len;
-    UInt           cap;
+    SmMacroTokView view;
+    UInt           hash;
+    UInt           offset;
+} SmMacroTokInternEntry;
+
+typedef struct {
+    SmMacroTokBuf         *bufs;
+    UInt                   len;
+    UInt                   cap;
+    UInt                   total;
+    SmMacroTokInternEntry *entries;
+    UInt                   entries_len;
+    UInt                   entries_cap;
+    U32                   *slots;
+    UInt                   slots_cap;
 } SmMacroTokIntern;
 
+UInt           smMacroTokViewHash(SmMacroTokView view);
+Bool           smMacroTokViewEqual(SmMacroTokView lhs, SmMacroTokView rhs);
 SmMacroTokView smMacroTokIntern(SmMacroTokIntern *in, SmMacroTokView view);
+void           smMacroTokInternFini(SmMacroTokIntern *in);
 
 typedef struct {
     SmMacroTokView *buf;
@@ -180,6 +196,46 @@ typedef struct {
 void smPosTokBufAdd(SmPosTokBuf *buf, SmPosTok tok);
 void smPosTokBufFini(SmPosTokBuf *buf);
 
+// A token as recorded from a file or view stream. The file is the same for
+// all of them, positions are byte offsets into it and identifiers and strings
+// are atoms of the record's interner, which keeps them at 12 bytes apiece.
+typedef struct {
+    U32 tok;
+    U32 offset;
+    union {
+        I32    num;
+        SmAtom atom;
+    };
+} SmRecordTok;
+
+typedef struct {
+    SmRecordTok *items;
+    UInt         len;
+} SmRecordTokView;
+
+typedef struct {
+    SmRecordTokView view;
+    UInt            cap;
+} SmRecordTokBuf;
+
+void smRecordTokBufAdd(SmRecordTokBuf *buf, SmRecordTok tok);
+void smRecordTokBufFini(SmRecordTokBuf *buf);
+
+// The tokens lexed from a file or view stream, kept to replay the same
+// source again without lexing it. `done` is set once the stream was read to
+// the end, at which point the last token is its SM_TOK_EOF. `file` is the
+// source's ID in the position table the stream was lexed with. Nothing else
+// ties a record to that table, so a finished one can be replayed into any
+// table the same source was added to.
+typedef struct {
+    U32            file;
+    SmViewIntern  *in;
+    SmRecordTokBuf toks;
+    Bool           done;
+} SmTokRecord;
+
+void smTokRecordFini(SmTokRecord *record);
+
 enum SmTokStreamKind {
     SM_TOK_STREAM_FILE,
     SM_TOK_STREAM_VIEW,
@@ -187,33 +243,42 @@ enum SmTokStreamKind {
     SM_TOK_STREAM_REPEAT,
     SM_TOK_STREAM_FMT,
     SM_TOK_STREAM_IFELSE,
+    SM_TOK_STREAM_REPLAY,
 };
 
+// Streams work out positions through `positions`, which also owns the
+// sources of file streams so positions into them stay valid after the stream
+// is finished
 typedef struct {
-    U8    kind;
-    SmPos pos;
+    U8        kind;
+    SmPos     pos;
+    SmPosTab *positions;
     union {
         struct {
-            union {
-                struct {
-                    FILE *hnd;
-                } file;
-
-                struct {
-                    SmView view;
-                    UInt   offset;
-                } src;
-            };
-            U32   stash;
-            Bool  stashed;
-            U32   cstash;
-            Bool  cstashed;
-            UInt  cline;
-            UInt  ccol;
-            U8    cbuf[4];
-            UInt  clen;
-            SmBuf buf;
-            I32   num;
+            // files are mapped (or read) whole up front and lexed from
+            // `src` just like views
+            struct {
+                FILE *hnd;
+                Bool  mapped;
+            } file;
+
+            struct {
+                SmView view;
+                UInt   offset;
+            } src;
+
+            U32          stash;
+            Bool         stashed;
+            U32          cstash;
+            Bool         cstashed;
+            // the current token's text. it points into the source unless
+            // it had escapes and was built up in `buf`
+            SmView       view;
+            SmBuf        buf;
+            I32          num;
+            // the last token peeked and where eaten tokens are recorded to
+            U32          last;
+            SmTokRecord *record;
         } chardev;
 
         struct {
@@ -241,6 +306,11 @@ typedef struct {
             SmPosTokBuf buf;
             UInt        pos;
         } ifelse;
+
+        struct {
+            SmTokRecord const *record;
+            UInt               pos;
+        } replay;
     };
 } SmTokStream;
 
@@ -255,15 +325,29 @@ _Noreturn void smTokStreamFatalV(SmTokStream *ts, char const *fmt,
 _Noreturn void smTokStreamFatalPosV(SmTokStream *ts, SmPos pos, char const *fmt,
                                     va_list args);
 
-void smTokStreamFileInit(SmTokStream *ts, SmView name, FILE *hnd);
-void smTokStreamViewInit(SmTokStream *ts, SmView name, SmView view);
-void smTokStreamMacroInit(SmTokStream *ts, SmView name, SmPos pos,
-                          SmMacroTokView view, SmMacroArgQueue args,
+// A file's source is handed to `positions`, a view's has to outlive it
+void smTokStreamFileInit(SmTokStream *ts, SmPosTab *positions, SmView name,
+                         FILE *hnd);
+void smTokStreamViewInit(SmTokStream *ts, SmPosTab *positions, SmView name,
+                         SmView view);
+// Lexes a source that is already in `positions` over again
+void smTokStreamSrcInit(SmTokStream *ts, SmPosTab *positions, U32 file);
+void smTokStreamMacroInit(SmTokStream *ts, SmPosTab *positions, SmView name,
+                          SmPos pos, SmMacroTokView view, SmMacroArgQueue args,
                           UInt nonce);
-void smTokStreamRepeatInit(SmTokStream *ts, SmPos pos, SmRepeatTokBuf buf,
-                           UInt cnt);
-void smTokStreamFmtInit(SmTokStream *ts, SmPos pos, SmView fmt, U32 tok);
-void smTokStreamIfElseInit(SmTokStream *ts, SmPos pos, SmPosTokBuf buf);
+void smTokStreamRepeatInit(SmTokStream *ts, SmPosTab *positions, SmPos pos,
+                           SmRepeatTokBuf buf, UInt cnt);
+void smTokStreamFmtInit(SmTokStream *ts, SmPosTab *positions, SmPos pos,
+                        SmView fmt, U32 tok);
+void smTokStreamIfElseInit(SmTokStream *ts, SmPosTab *positions, SmPos pos,
+                           SmPosTokBuf buf);
+// Replays a finished record, with positions into `file` of `positions`. The
+// record has to outlive the stream
+void smTokStreamReplayInit(SmTokStream *ts, SmPosTab *positions, U32 file,
+                           SmTokRecord const *record);
+// Starts recording every token eaten from a file or view stream into
+// `record`, with identifiers and strings interned into `in`
+void smTokStreamRecord(SmTokStream *ts, SmTokRecord *record, SmViewIntern *in);
 void smTokStreamFini(SmTokStream *ts);
 
 U32  smTokStreamPeek(SmTokStream *ts);
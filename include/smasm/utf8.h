@@ -7,6 +7,10 @@ U32 smUtf8Decode(SmView view, UInt *len);
 
 UInt smUtf8Encode(SmView view, U32 c);
 
+// Returns how many bytes from the start of the view are well-formed UTF-8,
+// which is the whole length if all of it is
+UInt smUtf8Valid(SmView view);
+
 UInt smUtf8Len(SmView view);
 
 void smUtf8Cat(SmBuf *buf, U32 c);
@@ -0,0 +1,118 @@
+#include <smasm/arena.h>
+#include <smasm/fatal.h>
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHUNK_SIZE (64 * 1024)
+
+static UInt align(UInt size) {
+    UInt const ALIGN = _Alignof(max_align_t);
+    return (size + (ALIGN - 1)) & ~(ALIGN - 1);
+}
+
+static SmBuf *addChunk(SmArena *arena, UInt size) {
+    if (!arena->chunks) {
+        arena->chunks = malloc(sizeof(SmBuf) * 16);
+        if (!arena->chunks) {
+            smFatal("out of memory\n");
+        }
+        arena->len = 0;
+        arena->cap = 16;
+    }
+    if ((arena->cap - arena->len) == 0) {
+        arena->chunks = realloc(arena->chunks, sizeof(SmBuf) * arena->cap * 2);
+        if (!arena->chunks) {
+            smFatal("out of memory\n");
+        }
+        arena->cap *= 2;
+    }
+    UInt   cap        = uIntMax(size, CHUNK_SIZE);
+    SmBuf *chunk      = arena->chunks + arena->len;
+    chunk->view.bytes = malloc(cap);
+    if (!chunk->view.bytes) {
+        smFatal("out of memory\n");
+    }
+    chunk->view.len = 0;
+    chunk->cap      = cap;
+    ++arena->mallocs;
+    return chunk;
+}
+
+void *smArenaAlloc(SmArena *arena, UInt size) {
+    size = align(size);
+    ++arena->allocs;
+    // find the first chunk from the current one on that still fits. chunks
+    // we step over stay unused until the arena is reset
+    for (; arena->idx < arena->len; ++arena->idx) {
+        SmBuf *chunk = arena->chunks + arena->idx;
+        if ((chunk->cap - chunk->view.len) >= size) {
+            U8 *ptr = chunk->view.bytes + chunk->view.len;
+            chunk->view.len += size;
+            return ptr;
+        }
+    }
+    SmBuf *chunk    = addChunk(arena, size);
+    arena->idx      = arena->len;
+    ++arena->len;
+    chunk->view.len = size;
+    return chunk->view.bytes;
+}
+
+void *smArenaRealloc(SmArena *arena, void *ptr, UInt size, UInt new_size) {
+    if (ptr && (arena->idx < arena->len)) {
+        // the last allocation can simply be extended in place
+        SmBuf *chunk = arena->chunks + arena->idx;
+        U8    *end   = chunk->view.bytes + chunk->view.len;
+        if ((((U8 *)ptr) + align(size)) == end) {
+            UInt offset = ((U8 *)ptr) - chunk->view.bytes;
+            if ((chunk->cap - offset) >= align(new_size)) {
+                ++arena->allocs;
+                chunk->view.len = offset + align(new_size);
+                return ptr;
+            }
+        }
+    }
+    void *new_ptr = smArenaAlloc(arena, new_size);
+    if (ptr) {
+        memcpy(new_ptr, ptr, uIntMin(size, new_size));
+    }
+    return new_ptr;
+}
+
+SmArenaMark smArenaMark(SmArena const *arena) {
+    if (arena->idx >= arena->len) {
+        return (SmArenaMark){arena->idx, 0};
+    }
+    return (SmArenaMark){arena->idx, arena->chunks[arena->idx].view.len};
+}
+
+void smArenaRelease(SmArena *arena, SmArenaMark mark) {
+    for (UInt i = mark.idx + 1; (i <= arena->idx) && (i < arena->len); ++i) {
+        arena->chunks[i].view.len = 0;
+    }
+    arena->idx = mark.idx;
+    if (arena->idx < arena->len) {
+        arena->chunks[arena->idx].view.len = mark.len;
+    }
+}
+
+void smArenaReset(SmArena *arena) {
+    for (UInt i = 0; i < arena->len; ++i) {
+        arena->chunks[i].view.len = 0;
+    }
+    arena->idx = 0;
+}
+
+UInt smArenaMallocsAvoided(SmArena const *arena) {
+    return arena->allocs - arena->mallocs;
+}
+
+void smArenaFini(SmArena *arena) {
+    for (UInt i = 0; i < arena->len; ++i) {
+        smBufFini(arena->chunks + i);
+    }
+    free(arena->chunks);
+    memset(arena, 0, sizeof(SmArena));
+}
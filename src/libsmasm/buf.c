@@ -1,5 +1,6 @@
 #include <smasm/buf.h>
 #include <smasm/fatal.h>
+#include <smasm/num.h>
 
 #include <ctype.h>
 #include <stdlib.h>
@@ -41,68 +42,112 @@ Bool smViewStartsWith(SmView view, SmView prefix) {
     return memcmp(view.bytes, prefix.bytes, prefix.len) == 0;
 }
 
+static U64 load64(U8 const *bytes) {
+    U64 word;
+    memcpy(&word, bytes, sizeof(U64));
+    return word;
+}
+
+static U64 load32(U8 const *bytes) {
+    U32 word;
+    memcpy(&word, bytes, sizeof(U32));
+    return word;
+}
+
+static U64 hashWord(U64 hash, U64 word) {
+    return (((hash << 5) | (hash >> 59)) ^ word) * 0x517CC1B727220A95ull;
+}
+
+// Hashes 8 bytes at a time. The tail is covered by one last load that
+// overlaps the previous word, short views are read as two overlapping 32-bit
+// words or a few single bytes. Folding words in with a rotate, xor and
+// multiply mixes the high bits well but not the low ones, so table lookups
+// still run the result through smHashSpread before masking.
 UInt smViewHash(SmView view) {
-    UInt hash = 5381;
-    for (UInt i = 0; i < view.len; ++i) {
-        hash = ((hash << 5) + hash) + view.bytes[i];
+    U8 const *bytes = view.bytes;
+    UInt      len   = view.len;
+    U64       hash  = len;
+    if (len >= 8) {
+        UInt i = 0;
+        for (; (i + 8) < len; i += 8) {
+            hash = hashWord(hash, load64(bytes + i));
+        }
+        hash = hashWord(hash, load64(bytes + (len - 8)));
+    } else if (len >= 4) {
+        hash = hashWord(hash, (load32(bytes) << 32) | load32(bytes + len - 4));
+    } else if (len > 0) {
+        hash = hashWord(hash, ((U64)bytes[0] << 16) |
+                                  ((U64)bytes[len / 2] << 8) | bytes[len - 1]);
     }
-    return hash;
+    return (UInt)(hash ^ (hash >> 32));
 }
 
-static char const DIGITS[] = "0123456789ABCDEF";
+// The view hashes above only stir the low bits a little per byte, so similar
+// names land in neighbouring slots. Mix all the bits down before masking.
+UInt smHashSpread(UInt hash) {
+    U64 x = hash;
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDull;
+    x ^= x >> 33;
+    return (UInt)x;
+}
+
+// Folds in 8 bytes at a time like smViewHash, but every one of them, then
+// mixes all the bits down at the end. Words are loaded in host order, which
+// like the object format assumes a little-endian host.
+U64 smViewDigest(SmView view) {
+    U64  hash = view.len;
+    UInt i    = 0;
+    for (; (i + 8) <= view.len; i += 8) {
+        hash = hashWord(hash, load64(view.bytes + i));
+    }
+    U64 word = 0;
+    for (UInt j = 0; (i + j) < view.len; ++j) {
+        word |= (U64)view.bytes[i + j] << (j * 8);
+    }
+    hash = hashWord(hash, word);
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDull;
+    hash ^= hash >> 33;
+    return hash;
+}
 
 UInt smViewParse(SmView view) {
-    if (view.len == 0) {
+    U32         num = 0;
+    SmNumResult res = smNumParse(view, &num);
+    switch (res) {
+    case SM_NUM_OK:
+        return num;
+    case SM_NUM_EMPTY:
         smFatal("empty number\n");
+    default:
+        smFatal("%s: %" SM_VIEW_FMT "\n", smNumResultStr(res),
+                SM_VIEW_FMT_ARG(view));
     }
-    I32  radix = 10;
-    UInt i     = 0;
-    if (view.bytes[0] == '%') {
-        radix = 2;
-        ++i;
-    } else if (view.bytes[0] == '$') {
-        radix = 16;
-        ++i;
-    }
-    if (i == view.len) {
-        smFatal("invalid number: %" SM_VIEW_FMT "\n", SM_VIEW_FMT_ARG(view));
-    }
-    UInt value = 0;
-    for (; i < view.len; ++i) {
-        for (UInt j = 0; j < (sizeof(DIGITS) / sizeof(DIGITS[0])); ++j) {
-            if (toupper(view.bytes[i]) == DIGITS[j]) {
-                if (j >= (UInt)radix) {
-                    smFatal("invalid number: %" SM_VIEW_FMT "\n",
-                            SM_VIEW_FMT_ARG(view));
-                }
-                value *= radix;
-                value += j;
-                goto next;
-            }
-        }
-        smFatal("invalid number: %" SM_VIEW_FMT "\n", SM_VIEW_FMT_ARG(view));
-    next:
-        (void)0;
-    }
-    return value;
 }
 
-void smBufCat(SmBuf *buf, SmView view) {
+void smBufReserve(SmBuf *buf, UInt len) {
     if (!buf->view.bytes) {
-        buf->view.bytes = malloc(view.len);
+        buf->view.bytes = malloc(uIntMax(len, 16));
         if (!buf->view.bytes) {
             smFatal("out of memory\n");
         }
         buf->view.len = 0;
-        buf->cap      = view.len;
+        buf->cap      = uIntMax(len, 16);
     }
-    if ((buf->view.len + view.len) > buf->cap) {
-        buf->view.bytes = realloc(buf->view.bytes, buf->cap + view.len);
+    if ((buf->cap - buf->view.len) < len) {
+        // grow geometrically so appending byte by byte stays linear
+        UInt cap        = uIntMax(buf->cap * 2, buf->view.len + len);
+        buf->view.bytes = realloc(buf->view.bytes, cap);
         if (!buf->view.bytes) {
             smFatal("out of memory\n");
         }
-        buf->cap += view.len;
+        buf->cap = cap;
     }
+}
+
+void smBufCat(SmBuf *buf, SmView view) {
+    smBufReserve(buf, view.len);
     memcpy(buf->view.bytes + buf->view.len, view.bytes, view.len);
     buf->view.len += view.len;
 }
@@ -133,7 +178,71 @@ static UInt roundUp(UInt num) {
     return num;
 }
 
-SmView smViewIntern(SmViewIntern *in, SmView view) {
+static U32 *internSlot(SmViewIntern const *in, SmView view, UInt hash) {
+    UInt mask = in->slots_cap - 1;
+    UInt i    = smHashSpread(hash) & mask;
+    while (true) {
+        U32 *slot = in->slots + i;
+        if (*slot == 0) {
+            return slot;
+        }
+        SmViewInternEntry *entry = in->entries + (*slot - 1);
+        if ((entry->hash == hash) && smViewEqual(entry->view, view)) {
+            return slot;
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+static void internTryGrow(SmViewIntern *in) {
+    if (!in->slots) {
+        in->slots = calloc(64, sizeof(U32));
+        if (!in->slots) {
+            smFatal("out of memory\n");
+        }
+        in->slots_cap = 64;
+    }
+    // keep the load factor under 3/4 so probe chains stay short
+    if (((in->entries_len + 1) * 4) > (in->slots_cap * 3)) {
+        free(in->slots);
+        in->slots_cap *= 2;
+        in->slots = calloc(in->slots_cap, sizeof(U32));
+        if (!in->slots) {
+            smFatal("out of memory\n");
+        }
+        for (UInt i = 0; i < in->entries_len; ++i) {
+            SmViewInternEntry *entry = in->entries + i;
+            *internSlot(in, entry->view, entry->hash) = i + 1;
+        }
+    }
+    if (!in->entries) {
+        in->entries = malloc(sizeof(SmViewInternEntry) * 64);
+        if (!in->entries) {
+            smFatal("out of memory\n");
+        }
+        in->entries_len = 0;
+        in->entries_cap = 64;
+    }
+    if ((in->entries_cap - in->entries_len) == 0) {
+        in->entries = realloc(in->entries,
+                              sizeof(SmViewInternEntry) * in->entries_cap * 2);
+        if (!in->entries) {
+            smFatal("out of memory\n");
+        }
+        in->entries_cap *= 2;
+    }
+}
+
+static void internAdd(SmViewIntern *in, U32 *slot, SmView view, UInt hash,
+                      UInt offset) {
+    in->entries[in->entries_len] = (SmViewInternEntry){view, hash, offset};
+    ++in->entries_len;
+    *slot = in->entries_len;
+}
+
+// Appends bytes to the last storage buffer. Buffers are never reallocated so
+// every view handed out stays valid until the interner is finalized.
+static U8 *internStore(SmViewIntern *in, SmView view) {
     if (!in->bufs) {
         in->bufs = malloc(sizeof(SmBuf) * 16);
         if (!in->bufs) {
@@ -142,21 +251,14 @@ SmView smViewIntern(SmViewIntern *in, SmView view) {
         in->len = 0;
         in->cap = 16;
     }
-    SmBuf *has_space = NULL;
-    for (UInt i = 0; i < in->len; ++i) {
-        SmBuf *buf = in->bufs + i;
-        U8    *bytes =
-            memmem(buf->view.bytes, buf->view.len, view.bytes, view.len);
-        if (bytes) {
-            return (SmView){bytes, view.len};
-        }
-        if (!has_space) {
-            if ((buf->cap - buf->view.len) >= view.len) {
-                has_space = buf;
-            }
+    SmBuf *buf = NULL;
+    if (in->len > 0) {
+        buf = in->bufs + (in->len - 1);
+        if ((buf->cap - buf->view.len) < view.len) {
+            buf = NULL;
         }
     }
-    if (!has_space) {
+    if (!buf) {
         if ((in->cap - in->len) == 0) {
             in->bufs = realloc(in->bufs, sizeof(SmBuf) * in->cap * 2);
             if (!in->bufs) {
@@ -164,20 +266,151 @@ SmView smViewIntern(SmViewIntern *in, SmView view) {
             }
             in->cap *= 2;
         }
-        UInt cap              = uIntMax(roundUp(view.len), 256);
-        has_space             = in->bufs + in->len;
-        has_space->view.bytes = malloc(cap);
-        if (!has_space->view.bytes) {
+        UInt cap        = uIntMax(roundUp(view.len), 4096);
+        buf             = in->bufs + in->len;
+        buf->view.bytes = malloc(cap);
+        if (!buf->view.bytes) {
             smFatal("out of memory\n");
         }
-        has_space->view.len = 0;
-        has_space->cap      = cap;
+        buf->view.len = 0;
+        buf->cap      = cap;
         ++in->len;
     }
-    U8 *bytes = has_space->view.bytes + has_space->view.len;
+    U8 *bytes = buf->view.bytes + buf->view.len;
     memcpy(bytes, view.bytes, view.len);
-    has_space->view.len += view.len;
-    return (SmView){bytes, view.len};
+    buf->view.len += view.len;
+    return bytes;
+}
+
+SmAtom smViewAtom(SmViewIntern *in, SmView view) {
+    if (view.len == 0) {
+        return SM_ATOM_NULL;
+    }
+    internTryGrow(in);
+    UInt hash = smViewHash(view);
+    U32 *slot = internSlot(in, view, hash);
+    if (*slot == 0) {
+        SmView interned = {internStore(in, view), view.len};
+        internAdd(in, slot, interned, hash, in->total);
+        in->total += view.len;
+    }
+    return *slot;
 }
 
-void smViewInternFini(SmViewIntern *in) { SM_INTERN_FINI_IMPL(smBufFini); }
+SmView smAtomView(SmViewIntern const *in, SmAtom atom) {
+    if (atom == SM_ATOM_NULL) {
+        return SM_VIEW_NULL;
+    }
+    return in->entries[atom - 1].view;
+}
+
+UInt smAtomOffset(SmViewIntern const *in, SmAtom atom) {
+    if (atom == SM_ATOM_NULL) {
+        return 0;
+    }
+    return in->entries[atom - 1].offset;
+}
+
+SmView smViewIntern(SmViewIntern *in, SmView view) {
+    return smAtomView(in, smViewAtom(in, view));
+}
+
+UInt smViewInternOffset(SmViewIntern const *in, SmView view) {
+    if (view.len == 0) {
+        return 0;
+    }
+    if (in->slots) {
+        U32 *slot = internSlot(in, view, smViewHash(view));
+        if (*slot != 0) {
+            return in->entries[*slot - 1].offset;
+        }
+    }
+    smFatal("view was never interned\n");
+}
+
+// orders views by their reversed bytes so that every view lands right before
+// the views it is a suffix of
+static int cmpReversed(void const *lhs, void const *rhs) {
+    SmView l = ((SmViewInternEntry const *)lhs)->view;
+    SmView r = ((SmViewInternEntry const *)rhs)->view;
+    UInt   n = uIntMin(l.len, r.len);
+    for (UInt i = 1; i <= n; ++i) {
+        int cmp = (int)l.bytes[l.len - i] - (int)r.bytes[r.len - i];
+        if (cmp) {
+            return cmp;
+        }
+    }
+    return (l.len > r.len) - (l.len < r.len);
+}
+
+SmViewIntern smViewInternCompact(SmViewIntern const *in) {
+    // a single buffer big enough for the worst case (nothing shared)
+    UInt         total = in->total;
+    SmViewIntern out   = {};
+    out.bufs           = malloc(sizeof(SmBuf) * 16);
+    if (!out.bufs) {
+        smFatal("out of memory\n");
+    }
+    out.len         = 1;
+    out.cap         = 16;
+    SmBuf *buf      = out.bufs;
+    buf->view.bytes = malloc(uIntMax(total, 1));
+    if (!buf->view.bytes) {
+        smFatal("out of memory\n");
+    }
+    buf->view.len             = 0;
+    buf->cap                  = uIntMax(total, 1);
+    SmViewInternEntry *sorted =
+        malloc(sizeof(SmViewInternEntry) * uIntMax(in->entries_len, 1));
+    SmView *views = malloc(sizeof(SmView) * uIntMax(in->entries_len, 1));
+    if (!sorted || !views) {
+        smFatal("out of memory\n");
+    }
+    memcpy(sorted, in->entries, sizeof(SmViewInternEntry) * in->entries_len);
+    // the offsets are about to be recomputed, so remember where every entry
+    // came from in their place
+    for (UInt i = 0; i < in->entries_len; ++i) {
+        sorted[i].offset = i;
+    }
+    qsort(sorted, in->entries_len, sizeof(SmViewInternEntry), cmpReversed);
+    SmView prev = SM_VIEW_NULL;
+    for (UInt i = in->entries_len; i > 0; --i) {
+        SmViewInternEntry *entry = sorted + (i - 1);
+        SmView             view;
+        if (prev.bytes && (prev.len >= entry->view.len) &&
+            (memcmp(prev.bytes + (prev.len - entry->view.len),
+                    entry->view.bytes, entry->view.len) == 0)) {
+            // share the tail of the last view we wrote out
+            view = (SmView){prev.bytes + (prev.len - entry->view.len),
+                            entry->view.len};
+        } else {
+            view = (SmView){buf->view.bytes + buf->view.len, entry->view.len};
+            memcpy(view.bytes, entry->view.bytes, view.len);
+            buf->view.len += view.len;
+            prev = view;
+        }
+        views[entry->offset] = view;
+    }
+    // add the entries back in their original order to keep the atoms
+    for (UInt i = 0; i < in->entries_len; ++i) {
+        SmView view = views[i];
+        UInt   hash = in->entries[i].hash;
+        internTryGrow(&out);
+        internAdd(&out, internSlot(&out, view, hash), view, hash,
+                  view.bytes - buf->view.bytes);
+    }
+    free(views);
+    free(sorted);
+    out.total = buf->view.len;
+    return out;
+}
+
+void smViewInternFini(SmViewIntern *in) {
+    for (UInt i = 0; i < in->len; ++i) {
+        smBufFini(in->bufs + i);
+    }
+    free(in->bufs);
+    free(in->entries);
+    free(in->slots);
+    memset(in, 0, sizeof(SmViewIntern));
+}
@@ -0,0 +1,35 @@
+// generated by tools/kwgen from src/libsmasm/directives.kw, do not edit
+
+static SmKw const DIRECTIVES_SLOTS[64] = {
+    [0] = {"SECTION", SM_TOK_SECTION},
+    [2] = {"DEFINED", SM_TOK_DEFINED},
+    [4] = {"UNION", SM_TOK_UNION},
+    [9] = {"FATAL", SM_TOK_FATAL},
+    [10] = {"PRINT", SM_TOK_PRINT},
+    [13] = {"MACRO", SM_TOK_MACRO},
+    [14] = {"IDFMT", SM_TOK_IDFMT},
+    [15] = {"NARG", SM_TOK_NARG},
+    [16] = {"STRUCT", SM_TOK_STRUCT},
+    [22] = {"TAG", SM_TOK_TAG},
+    [23] = {"STRLEN", SM_TOK_STRLEN},
+    [24] = {"ONCE", SM_TOK_ONCE},
+    [25] = {"DB", SM_TOK_DB},
+    [26] = {"INCBIN", SM_TOK_INCBIN},
+    [27] = {"END", SM_TOK_END},
+    [28] = {"INCLUDE", SM_TOK_INCLUDE},
+    [31] = {"DS", SM_TOK_DS},
+    [34] = {"STRFMT", SM_TOK_STRFMT},
+    [35] = {"REPEAT", SM_TOK_REPEAT},
+    [36] = {"IF", SM_TOK_IF},
+    [38] = {"SECTPUSH", SM_TOK_SECTPUSH},
+    [39] = {"ARG", SM_TOK_ARG},
+    [41] = {"ALLOC", SM_TOK_ALLOC},
+    [48] = {"SECTPOP", SM_TOK_SECTPOP},
+    [50] = {"REL", SM_TOK_REL},
+    [51] = {"DW", SM_TOK_DW},
+    [55] = {"ELSE", SM_TOK_ELSE},
+    [57] = {"UNIQUE", SM_TOK_UNIQUE},
+    [59] = {"SHIFT", SM_TOK_SHIFT},
+};
+
+static SmKwTab const DIRECTIVES = {DIRECTIVES_SLOTS, 0x91D40D3523B76225ull, 6};
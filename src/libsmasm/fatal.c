@@ -3,6 +3,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+_Thread_local jmp_buf *smFatalJmp = NULL;
+
 _Noreturn void smFatal(char const *fmt, ...) {
     va_list args;
     va_start(args, fmt);
@@ -11,5 +13,8 @@ _Noreturn void smFatal(char const *fmt, ...) {
 
 _Noreturn void smFatalV(char const *fmt, va_list args) {
     vfprintf(stderr, fmt, args);
+    if (smFatalJmp) {
+        longjmp(*smFatalJmp, 1);
+    }
     exit(EXIT_FAILURE);
 }
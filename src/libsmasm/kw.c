@@ -0,0 +1,29 @@
+#include <smasm/kw.h>
+
+#include <stddef.h>
+
+U64 smKwKey(SmView name) {
+    U64 key = 0;
+    for (UInt i = 0; i < name.len; ++i) {
+        U8 c = name.bytes[i];
+        if ((c >= 'a') && (c <= 'z')) {
+            c -= 'a' - 'A';
+        }
+        key |= ((U64)c) << (i * 8);
+    }
+    return key;
+}
+
+SmKw const *smKwFind(SmKwTab const *tab, SmView name) {
+    if ((name.len == 0) || (name.len > 8)) {
+        return NULL;
+    }
+    U64         key = smKwKey(name);
+    SmKw const *kw  = tab->slots + ((key * tab->mul) >> (64 - tab->bits));
+    for (UInt i = 0; i < 8; ++i) {
+        if ((U8)kw->name[i] != (U8)(key >> (i * 8))) {
+            return NULL;
+        }
+    }
+    return kw;
+}
@@ -0,0 +1,108 @@
+#include <smasm/fatal.h>
+#include <smasm/map.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+void *smMapAt(SmMap const *map, UInt idx) {
+    return ((U8 *)map->entries) + (idx * map->size);
+}
+
+static SmView nameAt(SmMap const *map, UInt idx) {
+    SmView name;
+    memcpy(&name, smMapAt(map, idx), sizeof(SmView));
+    return name;
+}
+
+static U32 *whence(SmMap const *map, SmView name, UInt hash) {
+    UInt mask = map->slots_cap - 1;
+    UInt i    = smHashSpread(hash) & mask;
+    while (true) {
+        U32 *slot = map->slots + i;
+        if (*slot == 0) {
+            return slot;
+        }
+        if ((map->hashes[*slot - 1] == hash) &&
+            smViewEqual(nameAt(map, *slot - 1), name)) {
+            return slot;
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+static void tryGrow(SmMap *map, UInt size) {
+    if (!map->entries) {
+        map->entries = malloc(size * 16);
+        map->hashes  = malloc(sizeof(UInt) * 16);
+        map->slots   = calloc(32, sizeof(U32));
+        if (!map->entries || !map->hashes || !map->slots) {
+            smFatal("out of memory\n");
+        }
+        map->len       = 0;
+        map->cap       = 16;
+        map->size      = size;
+        map->slots_cap = 32;
+    }
+    if (map->size != size) {
+        smFatal("map entries must all be the same size\n");
+    }
+    if ((map->cap - map->len) == 0) {
+        map->entries = realloc(map->entries, size * map->cap * 2);
+        map->hashes  = realloc(map->hashes, sizeof(UInt) * map->cap * 2);
+        if (!map->entries || !map->hashes) {
+            smFatal("out of memory\n");
+        }
+        map->cap *= 2;
+    }
+    // keep the load factor under 3/4 so every probe chain has an end
+    if (((map->len + 1) * 4) > (map->slots_cap * 3)) {
+        free(map->slots);
+        map->slots_cap *= 2;
+        map->slots = calloc(map->slots_cap, sizeof(U32));
+        if (!map->slots) {
+            smFatal("out of memory\n");
+        }
+        UInt mask = map->slots_cap - 1;
+        for (UInt i = 0; i < map->len; ++i) {
+            UInt j = smHashSpread(map->hashes[i]) & mask;
+            while (map->slots[j] != 0) {
+                j = (j + 1) & mask;
+            }
+            map->slots[j] = i + 1;
+        }
+    }
+}
+
+void *smMapAdd(SmMap *map, void const *entry, UInt size) {
+    tryGrow(map, size);
+    SmView name;
+    memcpy(&name, entry, sizeof(SmView));
+    UInt hash = smViewHash(name);
+    U32 *slot = whence(map, name, hash);
+    if (*slot == 0) {
+        map->hashes[map->len] = hash;
+        ++map->len;
+        *slot = map->len;
+    }
+    void *wh = smMapAt(map, *slot - 1);
+    memcpy(wh, entry, size);
+    return wh;
+}
+
+void *smMapFind(SmMap const *map, SmView name) {
+    if (!map->entries) {
+        return NULL;
+    }
+    U32 *slot = whence(map, name, smViewHash(name));
+    if (*slot == 0) {
+        return NULL;
+    }
+    return smMapAt(map, *slot - 1);
+}
+
+void smMapFini(SmMap *map) {
+    free(map->entries);
+    free(map->hashes);
+    free(map->slots);
+    memset(map, 0, sizeof(SmMap));
+}
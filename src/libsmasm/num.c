@@ -0,0 +1,119 @@
+#include <smasm/fatal.h>
+#include <smasm/num.h>
+#include <smasm/utf8.h>
+
+// Digit values plus one, so that zero means not a digit at all
+static U8 const DIGITS[256] = {
+    ['0'] = 1,  ['1'] = 2,  ['2'] = 3,  ['3'] = 4,  ['4'] = 5,  ['5'] = 6,
+    ['6'] = 7,  ['7'] = 8,  ['8'] = 9,  ['9'] = 10, ['A'] = 11, ['B'] = 12,
+    ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16, ['a'] = 11, ['b'] = 12,
+    ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+};
+
+SmNumResult smNumParseDigits(SmView digits, U32 radix, U32 *num) {
+    // wide enough that one more digit can never wrap it
+    U64  value = 0;
+    Bool any   = false;
+    for (UInt i = 0; i < digits.len; ++i) {
+        U8 c = digits.bytes[i];
+        if (c == '_') {
+            continue;
+        }
+        U32 digit = DIGITS[c] - 1u;
+        if (digit >= radix) {
+            return SM_NUM_INVALID;
+        }
+        value = (value * radix) + digit;
+        if (value > 0xFFFFFFFFull) {
+            return SM_NUM_OVERFLOW;
+        }
+        any = true;
+    }
+    if (!any) {
+        return digits.len ? SM_NUM_INVALID : SM_NUM_EMPTY;
+    }
+    *num = (U32)value;
+    return SM_NUM_OK;
+}
+
+Bool smNumEscape(U32 c, U32 quote, U32 *num) {
+    switch (c) {
+    case 'n':
+        *num = '\n';
+        return true;
+    case 'r':
+        *num = '\r';
+        return true;
+    case 't':
+        *num = '\t';
+        return true;
+    case '\\':
+        *num = '\\';
+        return true;
+    case '0':
+        *num = '\0';
+        return true;
+    default:
+        if (c != quote) {
+            return false;
+        }
+        *num = c;
+        return true;
+    }
+}
+
+static SmNumResult parseChar(SmView view, U32 *num) {
+    if ((view.len < 3) || (view.bytes[view.len - 1] != '\'')) {
+        return SM_NUM_INVALID;
+    }
+    SmView inner = {view.bytes + 1, view.len - 2};
+    if (inner.bytes[0] == '\\') {
+        if ((inner.len != 2) || !smNumEscape(inner.bytes[1], '\'', num)) {
+            return SM_NUM_INVALID;
+        }
+        return SM_NUM_OK;
+    }
+    if (smUtf8Valid(inner) != inner.len) {
+        return SM_NUM_INVALID;
+    }
+    UInt len = 0;
+    U32  c   = smUtf8Decode(inner, &len);
+    if (len != inner.len) {
+        return SM_NUM_INVALID;
+    }
+    *num = c;
+    return SM_NUM_OK;
+}
+
+SmNumResult smNumParse(SmView view, U32 *num) {
+    if (view.len == 0) {
+        return SM_NUM_EMPTY;
+    }
+    switch (view.bytes[0]) {
+    case '$':
+        return smNumParseDigits((SmView){view.bytes + 1, view.len - 1}, 16,
+                                num);
+    case '%':
+        return smNumParseDigits((SmView){view.bytes + 1, view.len - 1}, 2,
+                                num);
+    case '\'':
+        return parseChar(view, num);
+    default:
+        return smNumParseDigits(view, 10, num);
+    }
+}
+
+char const *smNumResultStr(SmNumResult res) {
+    switch (res) {
+    case SM_NUM_OK:
+        return "ok";
+    case SM_NUM_EMPTY:
+        return "empty number";
+    case SM_NUM_INVALID:
+        return "invalid number";
+    case SM_NUM_OVERFLOW:
+        return "number does not fit in 32 bits";
+    default:
+        SM_UNREACHABLE();
+    }
+}
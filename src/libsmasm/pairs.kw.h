@@ -0,0 +1,13 @@
+// generated by tools/kwgen from src/libsmasm/pairs.kw, do not edit
+
+static SmKw const PAIRS_SLOTS[8] = {
+    [0] = {"NC", SM_TOK_NC},
+    [1] = {"SP", SM_TOK_SP},
+    [2] = {"BC", SM_TOK_BC},
+    [3] = {"AF", SM_TOK_AF},
+    [4] = {"DE", SM_TOK_DE},
+    [5] = {"HL", SM_TOK_HL},
+    [7] = {"NZ", SM_TOK_NZ},
+};
+
+static SmKwTab const PAIRS = {PAIRS_SLOTS, 0x8F8EA9D349428D8Full, 3};
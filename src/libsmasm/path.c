@@ -2,44 +2,78 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
-SmView smPathIntern(SmViewIntern *in, SmView path) {
-    static SmBuf buf = {};
-    buf.view.len     = 0;
-    smBufCat(&buf, path);
-    smBufCat(&buf, SM_VIEW("\0"));
-    char *out = realpath((char *)buf.view.bytes, NULL);
+typedef struct {
+    SmViewIntern in;
+    SmMap        entries;
+    SmBuf        buf;
+} PathCache;
+
+static _Thread_local PathCache CACHE = {};
+
+typedef struct {
+    SmView name;
+} PathId;
+
+SmPathEntry const *smPathResolve(SmView path) {
+    SmPathEntry const *entry = smMapFind(&CACHE.entries, path);
+    if (entry) {
+        return entry;
+    }
+    SmBuf *buf    = &CACHE.buf;
+    buf->view.len = 0;
+    smBufCat(buf, path);
+    smBufCat(buf, SM_VIEW("\0"));
+    SmPathEntry resolved = {.name = smViewIntern(&CACHE.in, path)};
+    char       *out      = realpath((char *)buf->view.bytes, NULL);
     if (out == NULL) {
-        return smViewIntern(in, path);
+        resolved.path = resolved.name;
+    } else {
+        resolved.path =
+            smViewIntern(&CACHE.in, (SmView){(U8 *)out, strlen(out)});
+        free(out);
+    }
+    resolved.id = resolved.path;
+    struct stat st;
+    if (stat((char *)buf->view.bytes, &st) == 0) {
+        // a leading NUL keeps the ids apart from paths, which never have one
+        U8 id[1 + sizeof(st.st_dev) + sizeof(st.st_ino)] = {0};
+        memcpy(id + 1, &st.st_dev, sizeof(st.st_dev));
+        memcpy(id + 1 + sizeof(st.st_dev), &st.st_ino, sizeof(st.st_ino));
+        resolved.id     = smViewIntern(&CACHE.in, (SmView){id, sizeof(id)});
+        resolved.exists = true;
     }
-    SmView result = smViewIntern(in, (SmView){(U8 *)out, strlen(out)});
-    free(out);
-    return result;
+    return smMapAdd(&CACHE.entries, &resolved, sizeof(SmPathEntry));
+}
+
+SmView smPathIntern(SmViewIntern *in, SmView path) {
+    return smViewIntern(in, smPathResolve(path)->path);
+}
+
+Bool smPathExists(SmView path) { return smPathResolve(path)->exists; }
+
+void smPathCacheFini() {
+    smMapFini(&CACHE.entries);
+    smViewInternFini(&CACHE.in);
+    smBufFini(&CACHE.buf);
 }
 
 SmView smPathSetAdd(SmPathSet *set, SmView path) {
-    SmView view = smPathIntern(&set->in, path);
-    for (UInt i = 0; i < set->bufs.view.len; ++i) {
-        if (smViewEqual(set->bufs.view.items[i], view)) {
-            return view;
-        }
+    SmPathEntry const *entry = smPathResolve(path);
+    SmView             view  = entry->path;
+    if (!smMapFind(&set->ids, entry->id)) {
+        smMapAdd(&set->ids, &(PathId){entry->id}, sizeof(PathId));
+        smViewBufAdd(&set->bufs, view);
     }
-    smViewBufAdd(&set->bufs, view);
     return view;
 }
 
 Bool smPathSetContains(SmPathSet *set, SmView path) {
-    // we intern to abs/normalize the path
-    SmView view = smPathIntern(&set->in, path);
-    for (UInt i = 0; i < set->bufs.view.len; ++i) {
-        if (smViewEqual(set->bufs.view.items[i], view)) {
-            return true;
-        }
-    }
-    return false;
+    return smMapFind(&set->ids, smPathResolve(path)->id) != NULL;
 }
 
 void smPathSetFini(SmPathSet *set) {
     smViewBufFini(&set->bufs);
-    smViewInternFini(&set->in);
+    smMapFini(&set->ids);
 }
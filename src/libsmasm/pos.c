@@ -0,0 +1,136 @@
+#include <smasm/fatal.h>
+#include <smasm/pos.h>
+#include <smasm/utf8.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+// Finds the newlines with memchr, which is vectorized, and sizes the index up
+// front from a count of them
+static SmLineIndex lineIndexBuild(SmView src) {
+    if (src.len > U32_MAX) {
+        smFatal("source too large\n");
+    }
+    U8 const *end   = src.bytes + src.len;
+    UInt      count = 1;
+    for (U8 const *nl = src.bytes; nl && (nl < end);) {
+        nl = memchr(nl, '\n', end - nl);
+        if (nl) {
+            ++count;
+            ++nl;
+        }
+    }
+    SmLineIndex lines = {malloc(sizeof(U32) * count), 1};
+    if (!lines.starts) {
+        smFatal("out of memory\n");
+    }
+    lines.starts[0] = 0;
+    for (U8 const *nl = src.bytes; nl && (nl < end);) {
+        nl = memchr(nl, '\n', end - nl);
+        if (nl) {
+            ++nl;
+            lines.starts[lines.len] = nl - src.bytes;
+            ++lines.len;
+        }
+    }
+    return lines;
+}
+
+static U32 addFile(SmPosTab *tab, SmPosFile file) {
+    if (!tab->files) {
+        tab->files = malloc(sizeof(SmPosFile) * 16);
+        if (!tab->files) {
+            smFatal("out of memory\n");
+        }
+        tab->len = 0;
+        tab->cap = 16;
+    }
+    if ((tab->cap - tab->len) == 0) {
+        tab->files = realloc(tab->files, sizeof(SmPosFile) * tab->cap * 2);
+        if (!tab->files) {
+            smFatal("out of memory\n");
+        }
+        tab->cap *= 2;
+    }
+    if (tab->len >= U32_MAX) {
+        smFatal("too many source files\n");
+    }
+    tab->files[tab->len] = file;
+    ++tab->len;
+    return tab->len - 1;
+}
+
+U32 smPosTabAdd(SmPosTab *tab, SmView name, SmView src, U8 kind) {
+    return addFile(tab, (SmPosFile){
+                            .name  = name,
+                            .src   = src,
+                            .lines = lineIndexBuild(src),
+                            .kind  = kind,
+                        });
+}
+
+U32 smPosTabAddName(SmPosTab *tab, SmView name) {
+    return addFile(tab, (SmPosFile){.name = name, .kind = SM_POS_SRC_NONE});
+}
+
+SmPos smPosLineCol(U32 file, UInt line, UInt col) {
+    line = uIntMin(line, (1 << SM_POS_LINE_BITS) - 1);
+    col  = uIntMin(col, (1 << SM_POS_COL_BITS) - 1);
+    return (SmPos){file, (line << SM_POS_COL_BITS) | col};
+}
+
+SmView smPosTabName(SmPosTab const *tab, SmPos pos) {
+    return tab->files[pos.file].name;
+}
+
+// Positions are mostly asked for in order, so the line of the last one is
+// tried before searching the index
+SmPosInfo smPosTabInfo(SmPosTab *tab, SmPos pos) {
+    SmPosFile *file = tab->files + pos.file;
+    if (file->kind == SM_POS_SRC_NONE) {
+        return (SmPosInfo){file->name, pos.offset >> SM_POS_COL_BITS,
+                           pos.offset & ((1 << SM_POS_COL_BITS) - 1)};
+    }
+    SmLineIndex const *lines  = &file->lines;
+    UInt               offset = uIntMin(pos.offset, file->src.len);
+    UInt               line   = file->hint;
+    if ((line >= lines->len) || (lines->starts[line] > offset) ||
+        (((line + 1) < lines->len) && (lines->starts[line + 1] <= offset))) {
+        // the last line starting at or before the offset
+        UInt lo = 0;
+        UInt hi = lines->len;
+        while ((hi - lo) > 1) {
+            UInt mid = lo + ((hi - lo) / 2);
+            if (lines->starts[mid] <= offset) {
+                lo = mid;
+            } else {
+                hi = mid;
+            }
+        }
+        line = lo;
+    }
+    file->hint = line;
+    UInt at    = lines->starts[line];
+    UInt col   = smUtf8Len((SmView){file->src.bytes + at, offset - at});
+    return (SmPosInfo){file->name, line + 1, col + 1};
+}
+
+void smPosTabFini(SmPosTab *tab) {
+    for (UInt i = 0; i < tab->len; ++i) {
+        SmPosFile *file = tab->files + i;
+        switch (file->kind) {
+        case SM_POS_SRC_MALLOCED:
+            free(file->src.bytes);
+            break;
+        case SM_POS_SRC_MAPPED:
+            munmap(file->src.bytes, file->src.len);
+            break;
+        default:
+            break;
+        }
+        free(file->lines.starts);
+    }
+    free(tab->files);
+    memset(tab, 0, sizeof(SmPosTab));
+}
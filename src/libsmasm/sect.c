@@ -8,6 +8,10 @@ void smRelocBufAdd(SmRelocBuf *buf, SmReloc item) { SM_BUF_ADD_IMPL(); }
 
 void smRelocBufFini(SmRelocBuf *buf) { SM_BUF_FINI_IMPL(); }
 
+void smBlobBufAdd(SmBlobBuf *buf, SmBlob item) { SM_BUF_ADD_IMPL(); }
+
+void smBlobBufFini(SmBlobBuf *buf) { SM_BUF_FINI_IMPL(); }
+
 void smSectBufAdd(SmSectBuf *buf, SmSect item) { SM_BUF_ADD_IMPL(); }
 
 void smSectBufFini(SmSectBuf *buf) { SM_BUF_FINI_IMPL(); }
@@ -3,6 +3,8 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 static _Noreturn void fatal(SmSerde const *ser, char const *fmt, ...) {
     va_list args;
@@ -32,6 +34,17 @@ void smSerializeU32(SmSerde *ser, U32 num) {
     }
 }
 
+void smSerializeVar(SmSerde *ser, U32 num) {
+    do {
+        U8 byte = num & 0x7F;
+        num >>= 7;
+        if (num) {
+            byte |= 0x80;
+        }
+        smSerializeU8(ser, byte);
+    } while (num);
+}
+
 void smSerializeView(SmSerde *ser, SmView view) {
     if (fwrite(view.bytes, 1, view.len, ser->hnd) != view.len) {
         int err = ferror(ser->hnd);
@@ -50,35 +63,41 @@ void smSerializeViewIntern(SmSerde *ser, SmViewIntern const *in) {
     }
 }
 
-static UInt totalViewOffset(SmViewIntern const *in, SmView view) {
-    UInt total = 0;
-    for (UInt i = 0; i < in->len; ++i) {
-        SmBuf *buf = in->bufs + i;
-        U8    *offset =
-            memmem(buf->view.bytes, buf->view.len, view.bytes, view.len);
-        if (offset == NULL) {
-            total += buf->view.len;
-            continue;
-        }
-        total += offset - buf->view.bytes;
-        break;
+void smSerializePosTab(SmSerde *ser) {
+    SmPosTab const *tab = ser->positions;
+    smSerializeU32(ser, tab->len);
+    for (UInt i = 0; i < tab->len; ++i) {
+        SmView name = tab->files[i].name;
+        smSerializeU16(ser, name.len);
+        smSerializeView(ser, name);
     }
-    return total;
+}
+
+static void writePos(SmSerde *ser, SmPos pos) {
+    SmPosInfo at = smPosTabInfo(ser->positions, pos);
+    smSerializeVar(ser, pos.file);
+    smSerializeVar(ser, at.line);
+    smSerializeVar(ser, at.col);
 }
 
 static void writeViewRef(SmSerde *ser, SmViewIntern const *in, SmView view) {
-    smSerializeU32(ser, totalViewOffset(in, view));
+    smSerializeU32(ser, smViewInternOffset(in, view));
     smSerializeU16(ser, view.len);
 }
 
+static void writeAtomRef(SmSerde *ser, SmViewIntern const *in, SmAtom atom) {
+    smSerializeU32(ser, smAtomOffset(in, atom));
+    smSerializeU16(ser, smAtomView(in, atom).len);
+}
+
 static void writeLbl(SmSerde *ser, SmViewIntern const *in, SmLbl lbl) {
     if (!smLblIsGlobal(lbl)) {
         smSerializeU8(ser, 0);
-        writeViewRef(ser, in, lbl.scope);
+        writeAtomRef(ser, in, lbl.scope);
     } else {
         smSerializeU8(ser, 1);
     }
-    writeViewRef(ser, in, lbl.name);
+    writeAtomRef(ser, in, lbl.name);
 }
 
 void smSerializeExprIntern(SmSerde *ser, SmExprIntern const *in,
@@ -120,43 +139,22 @@ void smSerializeExprIntern(SmSerde *ser, SmExprIntern const *in,
     }
 }
 
-static UInt totalExprBufOffset(SmExprIntern const *in, SmExprView view) {
-    UInt total = 0;
-    for (UInt i = 0; i < in->len; ++i) {
-        SmExprBuf *buf = in->bufs + i;
-        SmExpr *offset = memmem(buf->view.items, sizeof(SmExpr) * buf->view.len,
-                                view.items, sizeof(SmExpr) * view.len);
-        if (offset == NULL) {
-            total += buf->view.len;
-            continue;
-        }
-        total += offset - buf->view.items;
-        break;
-    }
-    return total;
-}
-
 static void writeExprBufRef(SmSerde *ser, SmExprIntern const *in,
                             SmExprView buf) {
-    smSerializeU32(ser, totalExprBufOffset(in, buf));
+    smSerializeU32(ser, smExprInternOffset(in, buf));
     smSerializeU16(ser, buf.len);
 }
 
 void smSerializeSymTab(SmSerde *ser, SmSymTab const *tab,
                        SmViewIntern const *strin, SmExprIntern const *exprin) {
     smSerializeU32(ser, tab->len);
-    for (UInt i = 0; i < tab->cap; ++i) {
+    for (UInt i = 0; i < tab->len; ++i) {
         SmSym *sym = tab->syms + i;
-        if (smLblEqual(sym->lbl, SM_LBL_NULL)) {
-            continue;
-        }
         writeLbl(ser, strin, sym->lbl);
         writeExprBufRef(ser, exprin, sym->value);
-        writeViewRef(ser, strin, sym->unit);
-        writeViewRef(ser, strin, sym->section);
-        writeViewRef(ser, strin, sym->pos.file);
-        smSerializeU16(ser, sym->pos.line);
-        smSerializeU16(ser, sym->pos.col);
+        writeAtomRef(ser, strin, sym->unit);
+        writeAtomRef(ser, strin, sym->section);
+        writePos(ser, sym->pos);
         smSerializeU8(ser, sym->flags);
     }
 }
@@ -181,17 +179,33 @@ void smSerializeSectView(SmSerde *ser, SmSectView buf,
         }
         writeViewRef(ser, strin, sect->name);
         smSerializeU32(ser, sect->data.view.len);
-        smSerializeView(ser, sect->data.view);
+        smSerializeU32(ser, sect->blobs.view.len);
+        for (UInt j = 0; j < sect->blobs.view.len; ++j) {
+            SmBlob *blob = sect->blobs.view.items + j;
+            smSerializeU32(ser, blob->offset);
+            smSerializeU32(ser, blob->len);
+            smSerializeU32(ser, blob->hash & 0xFFFFFFFF);
+            smSerializeU32(ser, blob->hash >> 32);
+            writeViewRef(ser, strin, blob->path);
+        }
+        // everything around the blobs
+        UInt at = 0;
+        for (UInt j = 0; j < sect->blobs.view.len; ++j) {
+            SmBlob *blob = sect->blobs.view.items + j;
+            smSerializeView(ser, (SmView){sect->data.view.bytes + at,
+                                          blob->offset - at});
+            at = blob->offset + blob->len;
+        }
+        smSerializeView(ser, (SmView){sect->data.view.bytes + at,
+                                      sect->data.view.len - at});
         smSerializeU32(ser, sect->relocs.view.len);
         for (UInt j = 0; j < sect->relocs.view.len; ++j) {
             SmReloc *reloc = sect->relocs.view.items + j;
             smSerializeU16(ser, reloc->offset);
             smSerializeU8(ser, reloc->width);
             writeExprBufRef(ser, exprin, reloc->value);
-            writeViewRef(ser, strin, reloc->unit);
-            writeViewRef(ser, strin, reloc->pos.file);
-            smSerializeU16(ser, reloc->pos.line);
-            smSerializeU16(ser, reloc->pos.col);
+            writeAtomRef(ser, strin, reloc->unit);
+            writePos(ser, reloc->pos);
             smSerializeU8(ser, reloc->flags);
         }
     }
@@ -239,6 +253,18 @@ U32 smDeserializeU32(SmSerde *ser) {
     return num;
 }
 
+U32 smDeserializeVar(SmSerde *ser) {
+    U32 num = 0;
+    for (UInt shift = 0; shift < 32; shift += 7) {
+        U8 byte = smDeserializeU8(ser);
+        num |= (U32)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return num;
+        }
+    }
+    fatal(ser, "malformed number\n");
+}
+
 void smDeserializeView(SmSerde *ser, SmView *view) {
     if (fread(view->bytes, 1, view->len, ser->hnd) != view->len) {
         int err = ferror(ser->hnd);
@@ -251,49 +277,99 @@ void smDeserializeView(SmSerde *ser, SmView *view) {
     }
 }
 
+// Scratch space the deserializers keep for the life of the thread
+typedef struct {
+    SmBuf     strs;
+    SmBuf     names;
+    SmExprBuf exprs;
+} Scratch;
+
+static _Thread_local Scratch SCRATCH = {};
+
+void smDeserializeFini() {
+    smBufFini(&SCRATCH.strs);
+    smBufFini(&SCRATCH.names);
+    smExprBufFini(&SCRATCH.exprs);
+}
+
 SmViewIntern smDeserializeViewIntern(SmSerde *ser) {
-    static SmBuf buf = {};
-    UInt         len = smDeserializeU32(ser);
-    if (!buf.view.bytes) {
-        buf.view.bytes = malloc(len);
-        if (!buf.view.bytes) {
+    SmBuf *buf = &SCRATCH.strs;
+    UInt   len = smDeserializeU32(ser);
+    if (!buf->view.bytes) {
+        buf->view.bytes = malloc(len);
+        if (!buf->view.bytes) {
             smFatal("out of memory\n");
         }
-        buf.cap = len;
+        buf->cap = len;
     }
-    if (len > buf.cap) {
-        buf.view.bytes = realloc(buf.view.bytes, len);
-        if (!buf.view.bytes) {
+    if (len > buf->cap) {
+        buf->view.bytes = realloc(buf->view.bytes, len);
+        if (!buf->view.bytes) {
             smFatal("out of memory\n");
         }
-        buf.cap = len;
+        buf->cap = len;
     }
-    buf.view.len = len;
-    smDeserializeView(ser, &buf.view);
+    buf->view.len = len;
+    smDeserializeView(ser, &buf->view);
     SmViewIntern in = {};
-    smViewIntern(&in, buf.view);
+    smViewIntern(&in, buf->view);
     return in;
 }
 
+void smDeserializePosTab(SmSerde *ser, SmViewIntern *atoms) {
+    SmBuf *buf  = &SCRATCH.names;
+    UInt   len  = smDeserializeU32(ser);
+    ser->files  = ser->positions->len;
+    ser->nfiles = len;
+    for (UInt i = 0; i < len; ++i) {
+        buf->view.len = 0;
+        UInt namelen  = smDeserializeU16(ser);
+        smBufReserve(buf, namelen);
+        buf->view.len = namelen;
+        smDeserializeView(ser, &buf->view);
+        smPosTabAddName(ser->positions, smViewIntern(atoms, buf->view));
+    }
+}
+
+static SmPos readPos(SmSerde *ser) {
+    U32 file = smDeserializeVar(ser);
+    if (file >= ser->nfiles) {
+        fatal(ser, "position in unknown file: %" UINT_FMT "\n", (UInt)file);
+    }
+    UInt line = smDeserializeVar(ser);
+    UInt col  = smDeserializeVar(ser);
+    return smPosLineCol(ser->files + file, line, col);
+}
+
 static SmView readViewRef(SmSerde *ser, SmViewIntern const *in) {
     UInt offset = smDeserializeU32(ser);
     UInt len    = smDeserializeU16(ser);
+    if (len == 0) {
+        return SM_VIEW_NULL;
+    }
     return (SmView){in->bufs[0].view.bytes + offset, len};
 }
 
-static SmLbl readLbl(SmSerde *ser, SmViewIntern const *in) {
+static SmAtom readAtomRef(SmSerde *ser, SmViewIntern const *in,
+                          SmViewIntern *atoms) {
+    return smViewAtom(atoms, readViewRef(ser, in));
+}
+
+static SmLbl readLbl(SmSerde *ser, SmViewIntern const *in,
+                     SmViewIntern *atoms) {
     SmLbl lbl = {};
     if (smDeserializeU8(ser) == 0) {
-        lbl.scope = readViewRef(ser, in);
+        lbl.scope = readAtomRef(ser, in, atoms);
     }
-    lbl.name = readViewRef(ser, in);
+    lbl.name = readAtomRef(ser, in, atoms);
     return lbl;
 }
 
-SmExprIntern smDeserializeExprIntern(SmSerde *ser, SmViewIntern const *strin) {
-    static SmExprBuf buf = {};
-    buf.view.len         = 0;
-    UInt len             = smDeserializeU32(ser);
+SmExprIntern smDeserializeExprIntern(SmSerde *ser, SmViewIntern const *strin,
+                                     SmViewIntern *atoms) {
+    SmExprBuf *buf = &SCRATCH.exprs;
+    buf->view.len  = 0;
+    UInt len       = smDeserializeU32(ser);
     for (UInt i = 0; i < len; ++i) {
         U8     kind = smDeserializeU8(ser);
         SmExpr expr = {};
@@ -312,19 +388,19 @@ SmExprIntern smDeserializeExprIntern(SmSerde *ser, SmViewIntern const *strin) {
             break;
         case SM_EXPR_LABEL:
         case SM_EXPR_REL:
-            expr.lbl = readLbl(ser, strin);
+            expr.lbl = readLbl(ser, strin, atoms);
             break;
         case SM_EXPR_TAG:
-            expr.tag.lbl  = readLbl(ser, strin);
+            expr.tag.lbl  = readLbl(ser, strin, atoms);
             expr.tag.name = readViewRef(ser, strin);
             break;
         default:
             fatal(ser, "unrecognized expression kind: $%02X\n", kind);
         }
-        smExprBufAdd(&buf, expr);
+        smExprBufAdd(buf, expr);
     }
     SmExprIntern in = {};
-    smExprIntern(&in, buf.view);
+    smExprIntern(&in, buf->view);
     return in;
 }
 
@@ -335,18 +411,16 @@ static SmExprView readExprBufRef(SmSerde *ser, SmExprIntern const *in) {
 }
 
 SmSymTab smDeserializeSymTab(SmSerde *ser, SmViewIntern const *strin,
-                             SmExprIntern const *exprin) {
+                             SmViewIntern *atoms, SmExprIntern const *exprin) {
     SmSymTab tab = {};
     UInt     len = smDeserializeU32(ser);
     for (UInt i = 0; i < len; ++i) {
         SmSym sym    = {};
-        sym.lbl      = readLbl(ser, strin);
+        sym.lbl      = readLbl(ser, strin, atoms);
         sym.value    = readExprBufRef(ser, exprin);
-        sym.unit     = readViewRef(ser, strin);
-        sym.section  = readViewRef(ser, strin);
-        sym.pos.file = readViewRef(ser, strin);
-        sym.pos.line = smDeserializeU16(ser);
-        sym.pos.col  = smDeserializeU16(ser);
+        sym.unit     = readAtomRef(ser, strin, atoms);
+        sym.section  = readAtomRef(ser, strin, atoms);
+        sym.pos      = readPos(ser);
         sym.flags    = smDeserializeU8(ser);
         smSymTabAdd(&tab, sym);
     }
@@ -354,30 +428,78 @@ SmSymTab smDeserializeSymTab(SmSerde *ser, SmViewIntern const *strin,
 }
 
 SmSectBuf smDeserializeSectBuf(SmSerde *ser, SmViewIntern const *strin,
+                               SmViewIntern *atoms,
                                SmExprIntern const *exprin) {
     SmSectBuf buf = {};
     UInt      len = smDeserializeU32(ser);
+    if (ser->arena) {
+        buf.view.items = smArenaAlloc(ser->arena, sizeof(SmSect) * len);
+        buf.cap        = len;
+    }
     for (UInt i = 0; i < len; ++i) {
-        SmSect sect          = {};
-        sect.name            = readViewRef(ser, strin);
-        UInt len             = smDeserializeU32(ser);
-        sect.data.view.bytes = malloc(len);
-        if (!sect.data.view.bytes) {
-            smFatal("out of memory\n");
+        SmSect sect = {};
+        sect.name   = readViewRef(ser, strin);
+        UInt len    = smDeserializeU32(ser);
+        if (ser->arena) {
+            sect.data.view.bytes = smArenaAlloc(ser->arena, len);
+        } else {
+            sect.data.view.bytes = malloc(len);
+            if (!sect.data.view.bytes) {
+                smFatal("out of memory\n");
+            }
         }
         sect.data.cap      = len;
         sect.data.view.len = len;
-        smDeserializeView(ser, &sect.data.view);
+        len                = smDeserializeU32(ser);
+        if (ser->arena) {
+            sect.blobs.view.items =
+                smArenaAlloc(ser->arena, sizeof(SmBlob) * len);
+            sect.blobs.cap = len;
+        }
+        for (UInt j = 0; j < len; ++j) {
+            SmBlob blob = {};
+            blob.offset = smDeserializeU32(ser);
+            blob.len    = smDeserializeU32(ser);
+            blob.hash   = smDeserializeU32(ser);
+            blob.hash  |= (U64)smDeserializeU32(ser) << 32;
+            blob.path   = readViewRef(ser, strin);
+            if ((blob.offset > sect.data.view.len) ||
+                (blob.len > (sect.data.view.len - blob.offset))) {
+                fatal(ser, "blob out of section bounds\n");
+            }
+            smBlobBufAdd(&sect.blobs, blob);
+        }
+        // everything around the blobs
+        UInt at = 0;
+        for (UInt j = 0; j <= sect.blobs.view.len; ++j) {
+            UInt    end  = sect.data.view.len;
+            SmBlob *blob = NULL;
+            if (j < sect.blobs.view.len) {
+                blob = sect.blobs.view.items + j;
+                end  = blob->offset;
+            }
+            if (end < at) {
+                fatal(ser, "overlapping blobs\n");
+            }
+            SmView piece = {sect.data.view.bytes + at, end - at};
+            smDeserializeView(ser, &piece);
+            if (blob) {
+                at = blob->offset + blob->len;
+            }
+        }
         len = smDeserializeU32(ser);
+        if (ser->arena) {
+            sect.relocs.view.items =
+                smArenaAlloc(ser->arena, sizeof(SmReloc) * len);
+            sect.relocs.cap = len;
+        }
         for (UInt j = 0; j < len; ++j) {
             SmReloc reloc  = {};
             reloc.offset   = smDeserializeU16(ser);
             reloc.width    = smDeserializeU8(ser);
             reloc.value    = readExprBufRef(ser, exprin);
-            reloc.unit     = readViewRef(ser, strin);
-            reloc.pos.file = readViewRef(ser, strin);
-            reloc.pos.line = smDeserializeU16(ser);
-            reloc.pos.col  = smDeserializeU16(ser);
+            reloc.unit     = readAtomRef(ser, strin, atoms);
+            reloc.pos      = readPos(ser);
             reloc.flags    = smDeserializeU8(ser);
             smRelocBufAdd(&sect.relocs, reloc);
         }
@@ -386,8 +508,24 @@ SmSectBuf smDeserializeSectBuf(SmSerde *ser, SmViewIntern const *strin,
     return buf;
 }
 
+SmView smDeserializeMap(SmSerde *ser, Bool *mapped) {
+    struct stat st;
+    int         fd = fileno(ser->hnd);
+    if ((fstat(fd, &st) == 0) && S_ISREG(st.st_mode) && (st.st_size > 0)) {
+        void *bytes = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (bytes != MAP_FAILED) {
+            *mapped = true;
+            return (SmView){bytes, st.st_size};
+        }
+    }
+    SmBuf buf = {};
+    smDeserializeToEnd(ser, &buf);
+    *mapped = false;
+    return buf.view;
+}
+
 void smDeserializeToEnd(SmSerde *ser, SmBuf *buf) {
-    static U8 tmp[4096];
+    static _Thread_local U8 tmp[4096];
     while (true) {
         size_t read = fread(tmp, 1, sizeof(tmp), ser->hnd);
         if (read == sizeof(tmp)) {
@@ -0,0 +1,14 @@
+// generated by tools/kwgen from src/libsmasm/singles.kw, do not edit
+
+static SmKw const SINGLES_SLOTS[8] = {
+    [0] = {"Z", 'Z'},
+    [1] = {"D", 'D'},
+    [2] = {"A", 'A'},
+    [3] = {"H", 'H'},
+    [4] = {"C", 'C'},
+    [5] = {"E", 'E'},
+    [6] = {"L", 'L'},
+    [7] = {"B", 'B'},
+};
+
+static SmKwTab const SINGLES = {SINGLES_SLOTS, 0x97101DCE4E7BFB79ull, 3};
@@ -5,111 +5,330 @@
 #include <string.h>
 
 Bool smLblEqual(SmLbl lhs, SmLbl rhs) {
-    return smViewEqual(lhs.scope, rhs.scope) && smViewEqual(lhs.name, rhs.name);
+    return (lhs.scope == rhs.scope) && (lhs.name == rhs.name);
 }
 
-Bool smLblIsGlobal(SmLbl lbl) { return smViewEqual(lbl.scope, SM_VIEW_NULL); }
+Bool smLblIsGlobal(SmLbl lbl) { return lbl.scope == SM_ATOM_NULL; }
+
+UInt smLblHash(SmLbl lbl) {
+    return (UInt)((lbl.scope * 0x9E3779B97F4A7C15ull) ^ lbl.name);
+}
+
+// Where full names are put together, kept for the life of the thread
+static _Thread_local SmBuf FULL_NAME = {};
+
+void smLblFullNameFini() { smBufFini(&FULL_NAME); }
+
+static SmAtom fullNameAtom(SmLbl lbl, SmViewIntern *in) {
+    if (smLblIsGlobal(lbl)) {
+        return lbl.name;
+    }
+    FULL_NAME.view.len = 0;
+    smBufCat(&FULL_NAME, smAtomView(in, lbl.scope));
+    smBufCat(&FULL_NAME, SM_VIEW("."));
+    smBufCat(&FULL_NAME, smAtomView(in, lbl.name));
+    return smViewAtom(in, FULL_NAME.view);
+}
 
 SmView smLblFullName(SmLbl lbl, SmViewIntern *in) {
-    static SmBuf buf = {};
-    buf.view.len     = 0;
-    if (!smViewEqual(lbl.scope, SM_VIEW_NULL)) {
-        smBufCat(&buf, lbl.scope);
-        smBufCat(&buf, SM_VIEW("."));
+    return smAtomView(in, fullNameAtom(lbl, in));
+}
+
+static void lblNamesRehash(SmLblNames *names, UInt slots_cap) {
+    free(names->slots);
+    names->slots = calloc(slots_cap, sizeof(U32));
+    if (!names->slots) {
+        smFatal("out of memory\n");
+    }
+    names->slots_cap = slots_cap;
+    UInt mask        = slots_cap - 1;
+    for (UInt i = 0; i < names->len; ++i) {
+        UInt j = smHashSpread(smLblHash(names->entries[i].lbl)) & mask;
+        while (names->slots[j] != 0) {
+            j = (j + 1) & mask;
+        }
+        names->slots[j] = i + 1;
+    }
+}
+
+static void lblNamesTryGrow(SmLblNames *names) {
+    if (!names->entries) {
+        names->entries = malloc(sizeof(SmLblNameEntry) * 16);
+        if (!names->entries) {
+            smFatal("out of memory\n");
+        }
+        names->len = 0;
+        names->cap = 16;
+        lblNamesRehash(names, 32);
+    }
+    if ((names->cap - names->len) == 0) {
+        names->entries = realloc(names->entries,
+                                 sizeof(SmLblNameEntry) * names->cap * 2);
+        if (!names->entries) {
+            smFatal("out of memory\n");
+        }
+        names->cap *= 2;
+    }
+    if (((names->len + 1) * 4) > (names->slots_cap * 3)) {
+        lblNamesRehash(names, names->slots_cap * 2);
     }
-    smBufCat(&buf, lbl.name);
-    return smViewIntern(in, buf.view);
+}
+
+SmAtom smLblNamesGet(SmLblNames *names, SmLbl lbl, SmViewIntern *in) {
+    if (smLblIsGlobal(lbl)) {
+        return lbl.name;
+    }
+    lblNamesTryGrow(names);
+    UInt mask = names->slots_cap - 1;
+    UInt i    = smHashSpread(smLblHash(lbl)) & mask;
+    while (names->slots[i] != 0) {
+        SmLblNameEntry *entry = names->entries + (names->slots[i] - 1);
+        if (smLblEqual(entry->lbl, lbl)) {
+            return entry->name;
+        }
+        i = (i + 1) & mask;
+    }
+    SmAtom name                = fullNameAtom(lbl, in);
+    names->entries[names->len] = (SmLblNameEntry){lbl, name};
+    ++names->len;
+    names->slots[i] = names->len;
+    return name;
+}
+
+void smLblNamesFini(SmLblNames *names) {
+    if (!names->entries) {
+        return;
+    }
+    free(names->entries);
+    free(names->slots);
+    memset(names, 0, sizeof(SmLblNames));
 }
 
 void smOpBufAdd(SmOpBuf *buf, SmOp item) { SM_BUF_ADD_IMPL(); }
 
+void smOpBufFini(SmOpBuf *buf) { SM_BUF_FINI_IMPL(); }
+
 void smExprBufAdd(SmExprBuf *buf, SmExpr item) { SM_BUF_ADD_IMPL(); }
 
 void smExprBufFini(SmExprBuf *buf) { SM_BUF_FINI_IMPL(); }
 
-SmExprView smExprIntern(SmExprIntern *in, SmExprView view) { SM_INTERN_IMPL(); }
+static UInt hashMix(UInt hash, UInt num) { return ((hash << 5) + hash) + num; }
+
+UInt smExprViewHash(SmExprView view) {
+    UInt hash = 5381;
+    for (UInt i = 0; i < view.len; ++i) {
+        SmExpr *expr = view.items + i;
+        hash         = hashMix(hash, expr->kind);
+        switch ((enum SmExprKind)expr->kind) {
+        case SM_EXPR_CONST:
+            hash = hashMix(hash, (U32)expr->num);
+            break;
+        case SM_EXPR_ADDR:
+            hash = hashMix(hash, smViewHash(expr->addr.sect));
+            hash = hashMix(hash, expr->addr.pc);
+            break;
+        case SM_EXPR_OP:
+            hash = hashMix(hash, expr->op.tok);
+            hash = hashMix(hash, expr->op.unary);
+            break;
+        case SM_EXPR_LABEL:
+        case SM_EXPR_REL:
+            hash = hashMix(hash, smLblHash(expr->lbl));
+            break;
+        case SM_EXPR_TAG:
+            hash = hashMix(hash, smLblHash(expr->tag.lbl));
+            hash = hashMix(hash, smViewHash(expr->tag.name));
+            break;
+        }
+    }
+    return hash;
+}
+
+static Bool exprEqual(SmExpr const *lhs, SmExpr const *rhs) {
+    if (lhs->kind != rhs->kind) {
+        return false;
+    }
+    switch ((enum SmExprKind)lhs->kind) {
+    case SM_EXPR_CONST:
+        return lhs->num == rhs->num;
+    case SM_EXPR_ADDR:
+        return smViewEqual(lhs->addr.sect, rhs->addr.sect) &&
+               (lhs->addr.pc == rhs->addr.pc);
+    case SM_EXPR_OP:
+        return (lhs->op.tok == rhs->op.tok) &&
+               (lhs->op.unary == rhs->op.unary);
+    case SM_EXPR_LABEL:
+    case SM_EXPR_REL:
+        return smLblEqual(lhs->lbl, rhs->lbl);
+    case SM_EXPR_TAG:
+        return smLblEqual(lhs->tag.lbl, rhs->tag.lbl) &&
+               smViewEqual(lhs->tag.name, rhs->tag.name);
+    }
+    return false;
+}
+
+Bool smExprViewEqual(SmExprView lhs, SmExprView rhs) {
+    if (lhs.len != rhs.len) {
+        return false;
+    }
+    for (UInt i = 0; i < lhs.len; ++i) {
+        if (!exprEqual(lhs.items + i, rhs.items + i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+SmExprView smExprIntern(SmExprIntern *in, SmExprView view) {
+    SM_INTERN_IMPL(smExprViewHash, smExprViewEqual);
+}
+
+UInt smExprInternOffset(SmExprIntern const *in, SmExprView view) {
+    SM_INTERN_OFFSET_IMPL(smExprViewHash, smExprViewEqual);
+}
 
 void smExprInternFini(SmExprIntern *in) { SM_INTERN_FINI_IMPL(smExprBufFini); }
 
 void smI32BufAdd(SmI32Buf *buf, I32 item) { SM_BUF_ADD_IMPL(); }
 
+void smI32BufArenaAdd(SmI32Buf *buf, SmArena *arena, I32 item) {
+    SM_BUF_ARENA_ADD_IMPL();
+}
+
 void smI32BufFini(SmI32Buf *buf) { SM_BUF_FINI_IMPL(); }
 
-static UInt hashLbl(SmLbl lbl) {
-    UInt hash = 5381;
-    for (UInt i = 0; i < lbl.scope.len; ++i) {
-        hash = ((hash << 5) + hash) + lbl.scope.bytes[i];
+// Finds the slot holding `lbl`, or the slot it should be added at: the first
+// tombstone on the probe chain if there was one, otherwise the empty slot
+// that ended it.
+static U32 *whence(SmSymTab const *tab, SmLbl lbl, UInt hash) {
+    UInt mask = tab->slots_cap - 1;
+    UInt i    = smHashSpread(hash) & mask;
+    U32 *tomb = NULL;
+    while (true) {
+        U32 *slot = tab->slots + i;
+        if (*slot == 0) {
+            return tomb ? tomb : slot;
+        }
+        if (*slot == SM_SYM_TAB_TOMB) {
+            if (!tomb) {
+                tomb = slot;
+            }
+        } else if ((tab->hashes[*slot - 1] == hash) &&
+                   smLblEqual(tab->syms[*slot - 1].lbl, lbl)) {
+            return slot;
+        }
+        i = (i + 1) & mask;
     }
-    hash = ((hash << 5) + hash) + '.';
-    for (UInt i = 0; i < lbl.name.len; ++i) {
-        hash = ((hash << 5) + hash) + lbl.name.bytes[i];
+}
+
+// Finds the slot that points at the symbol at `idx`
+static U32 *slotOf(SmSymTab const *tab, UInt idx) {
+    UInt mask = tab->slots_cap - 1;
+    UInt i    = smHashSpread(tab->hashes[idx]) & mask;
+    while (tab->slots[i] != (idx + 1)) {
+        i = (i + 1) & mask;
     }
-    return hash;
+    return tab->slots + i;
 }
 
-static SmSym *whence(SmSymTab *tab, SmLbl lbl) {
-    UInt   hash = hashLbl(lbl);
-    UInt   i    = hash % tab->cap;
-    SmSym *sym  = tab->syms + i;
-    while (hash != hashLbl(sym->lbl)) {
-        if (smLblEqual(sym->lbl, SM_LBL_NULL)) {
-            break;
-        }
-        if (smLblEqual(sym->lbl, lbl)) {
-            break;
+static void rehash(SmSymTab *tab, UInt slots_cap) {
+    free(tab->slots);
+    tab->slots = calloc(slots_cap, sizeof(U32));
+    if (!tab->slots) {
+        smFatal("out of memory\n");
+    }
+    tab->slots_cap = slots_cap;
+    tab->tombs     = 0;
+    UInt mask      = slots_cap - 1;
+    for (UInt i = 0; i < tab->len; ++i) {
+        UInt j = smHashSpread(tab->hashes[i]) & mask;
+        while (tab->slots[j] != 0) {
+            j = (j + 1) & mask;
         }
-        i   = (i + 1) % tab->cap;
-        sym = tab->syms + i;
+        tab->slots[j] = i + 1;
     }
-    return sym;
 }
 
 static void tryGrow(SmSymTab *tab) {
     if (!tab->syms) {
-        tab->syms = calloc(16, sizeof(SmSym));
-        if (!tab->syms) {
+        tab->syms   = malloc(sizeof(SmSym) * 16);
+        tab->hashes = malloc(sizeof(UInt) * 16);
+        if (!tab->syms || !tab->hashes) {
             smFatal("out of memory\n");
         }
         tab->len = 0;
         tab->cap = 16;
+        rehash(tab, 32);
     }
-    // We always want at least 1 empty slot
-    if ((tab->cap - tab->len) == 1) {
-        SmSym *old_syms = tab->syms;
-        UInt   old_size = tab->cap;
-        tab->cap *= 2;
-        tab->syms = calloc(tab->cap, sizeof(SmSym));
-        if (!tab->syms) {
+    if ((tab->cap - tab->len) == 0) {
+        tab->syms   = realloc(tab->syms, sizeof(SmSym) * tab->cap * 2);
+        tab->hashes = realloc(tab->hashes, sizeof(UInt) * tab->cap * 2);
+        if (!tab->syms || !tab->hashes) {
             smFatal("out of memory\n");
         }
-        for (UInt i = 0; i < old_size; ++i) {
-            SmSym *sym = old_syms + i;
-            if (smLblEqual(sym->lbl, SM_LBL_NULL)) {
-                continue;
-            }
-            *whence(tab, sym->lbl) = *sym;
+        tab->cap *= 2;
+    }
+    // tombstones lengthen probe chains just like live symbols, so they count
+    // towards the 3/4 load factor. only grow if the live symbols need it,
+    // otherwise rebuilding at the same size is enough to clear them out
+    if (((tab->len + tab->tombs + 1) * 4) > (tab->slots_cap * 3)) {
+        if (((tab->len + 1) * 2) > tab->slots_cap) {
+            rehash(tab, tab->slots_cap * 2);
+        } else {
+            rehash(tab, tab->slots_cap);
         }
-        free(old_syms);
     }
 }
 
 SmSym *smSymTabAdd(SmSymTab *tab, SmSym sym) {
     tryGrow(tab);
-    SmSym *wh = whence(tab, sym.lbl);
-    *wh       = sym;
+    UInt hash = smLblHash(sym.lbl);
+    U32 *slot = whence(tab, sym.lbl, hash);
+    if ((*slot != 0) && (*slot != SM_SYM_TAB_TOMB)) {
+        SmSym *wh = tab->syms + (*slot - 1);
+        *wh       = sym;
+        return wh;
+    }
+    if (*slot == SM_SYM_TAB_TOMB) {
+        --tab->tombs;
+    }
+    tab->syms[tab->len]   = sym;
+    tab->hashes[tab->len] = hash;
     ++tab->len;
-    return wh;
+    *slot = tab->len;
+    return tab->syms + (tab->len - 1);
 }
 
 SmSym *smSymTabFind(SmSymTab *tab, SmLbl lbl) {
     if (!tab->syms) {
         return NULL;
     }
-    SmSym *wh = whence(tab, lbl);
-    if (smLblEqual(wh->lbl, SM_LBL_NULL)) {
+    U32 *slot = whence(tab, lbl, smLblHash(lbl));
+    if ((*slot == 0) || (*slot == SM_SYM_TAB_TOMB)) {
         return NULL;
     }
-    return wh;
+    return tab->syms + (*slot - 1);
+}
+
+Bool smSymTabRemove(SmSymTab *tab, SmLbl lbl) {
+    if (!tab->syms) {
+        return false;
+    }
+    U32 *slot = whence(tab, lbl, smLblHash(lbl));
+    if ((*slot == 0) || (*slot == SM_SYM_TAB_TOMB)) {
+        return false;
+    }
+    UInt idx = *slot - 1;
+    *slot    = SM_SYM_TAB_TOMB;
+    ++tab->tombs;
+    --tab->len;
+    if (idx != tab->len) {
+        // keep the symbols dense by moving the last one into the hole
+        *slotOf(tab, tab->len) = idx + 1;
+        tab->syms[idx]         = tab->syms[tab->len];
+        tab->hashes[idx]       = tab->hashes[tab->len];
+    }
+    return true;
 }
 
 void smSymTabFini(SmSymTab *tab) {
@@ -117,5 +336,7 @@ void smSymTabFini(SmSymTab *tab) {
         return;
     }
     free(tab->syms);
+    free(tab->hashes);
+    free(tab->slots);
     memset(tab, 0, sizeof(SmSymTab));
 }
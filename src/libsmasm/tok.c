@@ -1,4 +1,6 @@
 #include <smasm/fatal.h>
+#include <smasm/kw.h>
+#include <smasm/num.h>
 #include <smasm/tok.h>
 #include <smasm/utf8.h>
 
@@ -8,6 +10,12 @@
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "directives.kw.h"
+#include "pairs.kw.h"
+#include "singles.kw.h"
 
 static struct {
     U32    tok;
@@ -67,7 +75,7 @@ static struct {
     {SM_TOK_UNIQUE, SM_VIEW("@UNIQUE")},
 };
 
-static SmViewIntern CHAR_NAMES = {};
+static _Thread_local SmViewIntern CHAR_NAMES = {};
 
 SmView smTokName(U32 c) {
     for (size_t i = 0; i < (sizeof(TOK_NAMES) / sizeof(TOK_NAMES[0])); ++i) {
@@ -84,14 +92,84 @@ SmView smTokName(U32 c) {
     return view;
 }
 
+void smTokNamesFini() { smViewInternFini(&CHAR_NAMES); }
+
 void smMacroTokBufAdd(SmMacroTokBuf *buf, SmMacroTok item) {
     SM_BUF_ADD_IMPL();
 }
 
+void smMacroTokBufArenaAdd(SmMacroTokBuf *buf, SmArena *arena,
+                           SmMacroTok item) {
+    SM_BUF_ARENA_ADD_IMPL();
+}
+
 void smMacroTokBufFini(SmMacroTokBuf *buf) { SM_BUF_FINI_IMPL(); }
 
+static UInt hashMix(UInt hash, UInt num) { return ((hash << 5) + hash) + num; }
+
+UInt smMacroTokViewHash(SmMacroTokView view) {
+    UInt hash = 5381;
+    for (UInt i = 0; i < view.len; ++i) {
+        SmMacroTok *tok = view.items + i;
+        hash            = hashMix(hash, tok->kind);
+        hash            = hashMix(hash, tok->pos.file);
+        hash            = hashMix(hash, tok->pos.offset);
+        switch ((enum SmMacroTokKind)tok->kind) {
+        case SM_MACRO_TOK_TOK:
+            hash = hashMix(hash, tok->tok);
+            break;
+        case SM_MACRO_TOK_ID:
+        case SM_MACRO_TOK_STR:
+            hash = hashMix(hash, smViewHash(tok->view));
+            break;
+        case SM_MACRO_TOK_NUM:
+        case SM_MACRO_TOK_ARG:
+            hash = hashMix(hash, (U32)tok->num);
+            break;
+        default:
+            break;
+        }
+    }
+    return hash;
+}
+
+static Bool macroTokEqual(SmMacroTok const *lhs, SmMacroTok const *rhs) {
+    if ((lhs->kind != rhs->kind) || (lhs->pos.file != rhs->pos.file) ||
+        (lhs->pos.offset != rhs->pos.offset)) {
+        return false;
+    }
+    switch ((enum SmMacroTokKind)lhs->kind) {
+    case SM_MACRO_TOK_TOK:
+        return lhs->tok == rhs->tok;
+    case SM_MACRO_TOK_ID:
+    case SM_MACRO_TOK_STR:
+        return smViewEqual(lhs->view, rhs->view);
+    case SM_MACRO_TOK_NUM:
+    case SM_MACRO_TOK_ARG:
+        return lhs->num == rhs->num;
+    default:
+        return true;
+    }
+}
+
+Bool smMacroTokViewEqual(SmMacroTokView lhs, SmMacroTokView rhs) {
+    if (lhs.len != rhs.len) {
+        return false;
+    }
+    for (UInt i = 0; i < lhs.len; ++i) {
+        if (!macroTokEqual(lhs.items + i, rhs.items + i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
 SmMacroTokView smMacroTokIntern(SmMacroTokIntern *in, SmMacroTokView view) {
-    SM_INTERN_IMPL();
+    SM_INTERN_IMPL(smMacroTokViewHash, smMacroTokViewEqual);
+}
+
+void smMacroTokInternFini(SmMacroTokIntern *in) {
+    SM_INTERN_FINI_IMPL(smMacroTokBufFini);
 }
 
 void smMacroArgEnqueue(SmMacroArgQueue *q, SmMacroTokView toks) {
@@ -139,6 +217,17 @@ void smPosTokBufAdd(SmPosTokBuf *buf, SmPosTok item) { SM_BUF_ADD_IMPL(); }
 
 void smPosTokBufFini(SmPosTokBuf *buf) { SM_BUF_FINI_IMPL(); }
 
+void smRecordTokBufAdd(SmRecordTokBuf *buf, SmRecordTok item) {
+    SM_BUF_ADD_IMPL();
+}
+
+void smRecordTokBufFini(SmRecordTokBuf *buf) { SM_BUF_FINI_IMPL(); }
+
+void smTokRecordFini(SmTokRecord *record) {
+    smRecordTokBufFini(&record->toks);
+    record->done = false;
+}
+
 _Noreturn void smTokStreamFatal(SmTokStream *ts, char const *fmt, ...) {
     va_list args;
     va_start(args, fmt);
@@ -169,6 +258,8 @@ _Noreturn void smTokStreamFatalV(SmTokStream *ts, char const *fmt,
     case SM_TOK_STREAM_IFELSE:
         smTokStreamFatalPosV(ts, ts->ifelse.buf.view.items[ts->ifelse.pos].pos,
                              fmt, args);
+    case SM_TOK_STREAM_REPLAY:
+        smTokStreamFatalPosV(ts, smTokStreamPos(ts), fmt, args);
     default:
         SM_UNREACHABLE();
     }
@@ -176,14 +267,20 @@ _Noreturn void smTokStreamFatalV(SmTokStream *ts, char const *fmt,
 
 _Noreturn void smTokStreamFatalPosV(SmTokStream *ts, SmPos pos, char const *fmt,
                                     va_list args) {
-
+    SmPosInfo at = smPosTabInfo(ts->positions, pos);
+    SmPosInfo in = {};
+    if ((ts->kind == SM_TOK_STREAM_MACRO) ||
+        (ts->kind == SM_TOK_STREAM_REPEAT)) {
+        in = smPosTabInfo(ts->positions, ts->pos);
+    }
     switch (ts->kind) {
     case SM_TOK_STREAM_FILE:
     case SM_TOK_STREAM_VIEW:
     case SM_TOK_STREAM_FMT:
     case SM_TOK_STREAM_IFELSE:
+    case SM_TOK_STREAM_REPLAY:
         fprintf(stderr, "%" SM_VIEW_FMT ":%" UINT_FMT ":%" UINT_FMT ": ",
-                SM_VIEW_FMT_ARG(pos.file), pos.line, pos.col);
+                SM_VIEW_FMT_ARG(at.file), at.line, at.col);
         break;
     case SM_TOK_STREAM_MACRO:
         // TODO macro arg position
@@ -191,17 +288,17 @@ _Noreturn void smTokStreamFatalPosV(SmTokStream *ts, SmPos pos, char const *fmt,
                 "%" SM_VIEW_FMT ":%" UINT_FMT ":%" UINT_FMT
                 ": in macro %" SM_VIEW_FMT "\n\t%" SM_VIEW_FMT ":%" UINT_FMT
                 ":%" UINT_FMT ": ",
-                SM_VIEW_FMT_ARG(ts->pos.file), ts->pos.line, ts->pos.col,
-                SM_VIEW_FMT_ARG(ts->macro.name), SM_VIEW_FMT_ARG(pos.file),
-                pos.line, pos.col);
+                SM_VIEW_FMT_ARG(in.file), in.line, in.col,
+                SM_VIEW_FMT_ARG(ts->macro.name), SM_VIEW_FMT_ARG(at.file),
+                at.line, at.col);
         break;
     case SM_TOK_STREAM_REPEAT:
         fprintf(stderr,
                 "%" SM_VIEW_FMT ":%" UINT_FMT ":%" UINT_FMT
                 ": at repeat index %" UINT_FMT "\n\t%" SM_VIEW_FMT ":%" UINT_FMT
                 ":%" UINT_FMT ": ",
-                SM_VIEW_FMT_ARG(ts->pos.file), ts->pos.line, ts->pos.col,
-                ts->repeat.idx, SM_VIEW_FMT_ARG(pos.file), pos.line, pos.col);
+                SM_VIEW_FMT_ARG(in.file), in.line, in.col, ts->repeat.idx,
+                SM_VIEW_FMT_ARG(at.file), at.line, at.col);
         break;
     default:
         SM_UNREACHABLE();
@@ -209,72 +306,194 @@ _Noreturn void smTokStreamFatalPosV(SmTokStream *ts, SmPos pos, char const *fmt,
     smFatalV(fmt, args);
 }
 
-void smTokStreamFileInit(SmTokStream *ts, SmView name, FILE *hnd) {
+// Puts the peeked character back and returns the offset it starts at, so the
+// source can be scanned directly from there
+static UInt unpeek(SmTokStream *ts) {
+    if (!ts->chardev.cstashed) {
+        return ts->chardev.src.offset;
+    }
+    ts->chardev.cstashed = false;
+    U32 c                = ts->chardev.cstash;
+    if (c == SM_TOK_EOF) {
+        return ts->chardev.src.offset;
+    }
+    U8 tmp[4];
+    ts->chardev.src.offset -= smUtf8Encode((SmView){tmp, 4}, c);
+    return ts->chardev.src.offset;
+}
+
+// Reports an error at the character that was peeked last
+static _Noreturn void fatalChar(SmTokStream *ts, char const *fmt, ...) {
+    SmPosInfo at =
+        smPosTabInfo(ts->positions, (SmPos){ts->pos.file, unpeek(ts)});
+    fprintf(stderr, "%" SM_VIEW_FMT ":%" UINT_FMT ":%" UINT_FMT ": ",
+            SM_VIEW_FMT_ARG(at.file), at.line, at.col);
+    va_list args;
+    va_start(args, fmt);
+    smFatalV(fmt, args);
+}
+
+// Maps the whole file when it is a regular one. Anything else (pipes, empty
+// files) is read into memory in large blocks instead
+static void loadFile(SmTokStream *ts, SmView name) {
+    FILE       *hnd = ts->chardev.file.hnd;
+    struct stat st;
+    if ((fstat(fileno(hnd), &st) == 0) && S_ISREG(st.st_mode) &&
+        (st.st_size > 0)) {
+        void *bytes =
+            mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(hnd), 0);
+        if (bytes != MAP_FAILED) {
+            ts->chardev.src.view    = (SmView){bytes, st.st_size};
+            ts->chardev.file.mapped = true;
+            return;
+        }
+    }
+    SmBuf buf = {};
+    while (true) {
+        smBufReserve(&buf, 64 * 1024);
+        UInt read = fread(buf.view.bytes + buf.view.len, 1,
+                          buf.cap - buf.view.len, hnd);
+        buf.view.len += read;
+        if (read == 0) {
+            if (ferror(hnd)) {
+                int err = errno;
+                fprintf(stderr, "%" SM_VIEW_FMT ": ", SM_VIEW_FMT_ARG(name));
+                smFatal("failed to read file: %s\n", strerror(err));
+            }
+            break;
+        }
+    }
+    ts->chardev.src.view = buf.view;
+}
+
+// Checks the whole source is UTF-8 up front so that the lexer only has to
+// decode the odd non-ASCII character instead of validating every one
+static void validate(SmTokStream *ts) {
+    SmView view  = ts->chardev.src.view;
+    UInt   valid = smUtf8Valid(view);
+    if (valid == view.len) {
+        return;
+    }
+    // report the bad character
+    ts->chardev.src.offset = valid;
+    UInt len               = 0;
+    UInt left              = view.len - valid;
+    smUtf8Decode((SmView){view.bytes + valid, left}, &len);
+    if ((len == 0) && (left < 4)) {
+        fatalChar(ts, "unexpected end of file\n");
+    }
+    fatalChar(ts, "invalid UTF-8 data\n");
+}
+
+void smTokStreamFileInit(SmTokStream *ts, SmPosTab *positions, SmView name,
+                         FILE *hnd) {
     memset(ts, 0, sizeof(SmTokStream));
     ts->kind             = SM_TOK_STREAM_FILE;
-    ts->pos              = (SmPos){name, 1, 1};
+    ts->positions        = positions;
     ts->chardev.file.hnd = hnd;
-    ts->chardev.cline    = 1;
-    ts->chardev.ccol     = 1;
+    loadFile(ts, name);
+    U32 file = smPosTabAdd(positions, name, ts->chardev.src.view,
+                           ts->chardev.file.mapped ? SM_POS_SRC_MAPPED
+                                                   : SM_POS_SRC_MALLOCED);
+    ts->pos  = (SmPos){file, 0};
+    validate(ts);
 }
 
-void smTokStreamViewInit(SmTokStream *ts, SmView name, SmView view) {
+void smTokStreamViewInit(SmTokStream *ts, SmPosTab *positions, SmView name,
+                         SmView view) {
     memset(ts, 0, sizeof(SmTokStream));
     ts->kind             = SM_TOK_STREAM_VIEW;
-    ts->pos              = (SmPos){name, 1, 1};
+    ts->positions        = positions;
     ts->chardev.src.view = view;
-    ts->chardev.cline    = 1;
-    ts->chardev.ccol     = 1;
+    U32 file = smPosTabAdd(positions, name, view, SM_POS_SRC_BORROWED);
+    ts->pos  = (SmPos){file, 0};
+    validate(ts);
+}
+
+// The source was validated when it was first added
+void smTokStreamSrcInit(SmTokStream *ts, SmPosTab *positions, U32 file) {
+    memset(ts, 0, sizeof(SmTokStream));
+    ts->kind             = SM_TOK_STREAM_VIEW;
+    ts->positions        = positions;
+    ts->chardev.src.view = positions->files[file].src;
+    ts->pos              = (SmPos){file, 0};
 }
 
-void smTokStreamMacroInit(SmTokStream *ts, SmView name, SmPos pos,
-                          SmMacroTokView view, SmMacroArgQueue args,
+void smTokStreamMacroInit(SmTokStream *ts, SmPosTab *positions, SmView name,
+                          SmPos pos, SmMacroTokView view, SmMacroArgQueue args,
                           UInt nonce) {
     memset(ts, 0, sizeof(SmTokStream));
     ts->kind        = SM_TOK_STREAM_MACRO;
     ts->pos         = pos;
+    ts->positions   = positions;
     ts->macro.name  = name;
     ts->macro.view  = view;
     ts->macro.args  = args;
     ts->macro.nonce = nonce;
 }
 
-void smTokStreamRepeatInit(SmTokStream *ts, SmPos pos, SmRepeatTokBuf buf,
-                           UInt cnt) {
+void smTokStreamRepeatInit(SmTokStream *ts, SmPosTab *positions, SmPos pos,
+                           SmRepeatTokBuf buf, UInt cnt) {
     memset(ts, 0, sizeof(SmTokStream));
     ts->kind       = SM_TOK_STREAM_REPEAT;
     ts->pos        = pos;
+    ts->positions  = positions;
     ts->repeat.buf = buf;
     ts->repeat.cnt = cnt;
 }
 
-void smTokStreamFmtInit(SmTokStream *ts, SmPos pos, SmView fmt, U32 tok) {
+void smTokStreamFmtInit(SmTokStream *ts, SmPosTab *positions, SmPos pos,
+                        SmView fmt, U32 tok) {
     memset(ts, 0, sizeof(SmTokStream));
-    ts->kind     = SM_TOK_STREAM_FMT;
-    ts->pos      = pos;
-    ts->fmt.view = fmt;
-    ts->fmt.tok  = tok;
+    ts->kind      = SM_TOK_STREAM_FMT;
+    ts->pos       = pos;
+    ts->positions = positions;
+    ts->fmt.view  = fmt;
+    ts->fmt.tok   = tok;
 }
 
-void smTokStreamIfElseInit(SmTokStream *ts, SmPos pos, SmPosTokBuf buf) {
+void smTokStreamIfElseInit(SmTokStream *ts, SmPosTab *positions, SmPos pos,
+                           SmPosTokBuf buf) {
     memset(ts, 0, sizeof(SmTokStream));
     ts->kind       = SM_TOK_STREAM_IFELSE;
     ts->pos        = pos;
+    ts->positions  = positions;
     ts->ifelse.buf = buf;
 }
 
+void smTokStreamReplayInit(SmTokStream *ts, SmPosTab *positions, U32 file,
+                           SmTokRecord const *record) {
+    assert(record->done);
+    memset(ts, 0, sizeof(SmTokStream));
+    ts->kind          = SM_TOK_STREAM_REPLAY;
+    ts->pos           = (SmPos){file, 0};
+    ts->positions     = positions;
+    ts->replay.record = record;
+}
+
+void smTokStreamRecord(SmTokStream *ts, SmTokRecord *record, SmViewIntern *in) {
+    assert((ts->kind == SM_TOK_STREAM_FILE) ||
+           (ts->kind == SM_TOK_STREAM_VIEW));
+    record->file       = ts->pos.file;
+    record->in         = in;
+    ts->chardev.record = record;
+}
+
 void smTokStreamFini(SmTokStream *ts) {
     switch (ts->kind) {
     case SM_TOK_STREAM_FILE:
+        // the source stays with the position table
         if (fclose(ts->chardev.file.hnd) == EOF) {
-            int err = errno;
+            int       err = errno;
+            SmPosInfo at  = smPosTabInfo(ts->positions, ts->pos);
             fprintf(stderr, "%" SM_VIEW_FMT ":%" UINT_FMT ":%" UINT_FMT ": ",
-                    SM_VIEW_FMT_ARG(ts->pos.file), ts->pos.line, ts->pos.col);
+                    SM_VIEW_FMT_ARG(at.file), at.line, at.col);
             smFatal("failed to close file: %s\n", strerror(err));
         }
         smBufFini(&ts->chardev.buf);
         return;
     case SM_TOK_STREAM_VIEW:
+        smBufFini(&ts->chardev.buf);
         return;
     case SM_TOK_STREAM_MACRO:
         smMacroArgQueueFini(&ts->macro.args);
@@ -287,19 +506,13 @@ void smTokStreamFini(SmTokStream *ts) {
     case SM_TOK_STREAM_IFELSE:
         smPosTokBufFini(&ts->ifelse.buf);
         return;
+    case SM_TOK_STREAM_REPLAY:
+        return;
     default:
         SM_UNREACHABLE();
     }
 }
 
-static _Noreturn void fatalChar(SmTokStream *ts, char const *fmt, ...) {
-    fprintf(stderr, "%" SM_VIEW_FMT ":%" UINT_FMT ":%" UINT_FMT ": ",
-            SM_VIEW_FMT_ARG(ts->pos.file), ts->chardev.cline, ts->chardev.ccol);
-    va_list args;
-    va_start(args, fmt);
-    smFatalV(fmt, args);
-}
-
 static U32 peek(SmTokStream *ts) {
     assert((ts->kind == SM_TOK_STREAM_FILE) ||
            (ts->kind == SM_TOK_STREAM_VIEW));
@@ -307,77 +520,23 @@ static U32 peek(SmTokStream *ts) {
         return ts->chardev.cstash;
     }
     ts->chardev.cstashed = true;
-    if (ts->chardev.clen == 0) {
-        switch (ts->kind) {
-        case SM_TOK_STREAM_FILE:
-            ts->chardev.clen =
-                fread(ts->chardev.cbuf, 1, 1, ts->chardev.file.hnd);
-            if (ts->chardev.clen != 1) {
-                int err = ferror(ts->chardev.file.hnd);
-                if (err) {
-                    fatalChar(ts, "failed to read file: %s\n", strerror(err));
-                }
-                if (feof(ts->chardev.file.hnd)) {
-                    ts->chardev.cstash = SM_TOK_EOF;
-                    return ts->chardev.cstash;
-                }
-            }
-            break;
-        case SM_TOK_STREAM_VIEW:
-            if (ts->chardev.src.offset >= ts->chardev.src.view.len) {
-                ts->chardev.cstash = SM_TOK_EOF;
-                return ts->chardev.cstash;
-            }
-            ts->chardev.cbuf[0] =
-                ts->chardev.src.view.bytes[ts->chardev.src.offset];
-            ++ts->chardev.src.offset;
-            ts->chardev.clen = 1;
-            break;
-        default:
-            SM_UNREACHABLE();
-        }
+    SmView view          = ts->chardev.src.view;
+    UInt   offset        = ts->chardev.src.offset;
+    if (offset >= view.len) {
+        ts->chardev.cstash = SM_TOK_EOF;
+        return ts->chardev.cstash;
     }
-    UInt len = 0;
-    while (len == 0) {
-        ts->chardev.cstash =
-            smUtf8Decode((SmView){ts->chardev.cbuf, ts->chardev.clen}, &len);
-        ts->chardev.clen -= len;
-        memmove(ts->chardev.cbuf, ts->chardev.cbuf + len, ts->chardev.clen);
-        if (len == 0) {
-            if (ts->chardev.clen == 4) {
-                fatalChar(ts, "invalid UTF-8 data\n");
-            }
-            switch (ts->kind) {
-            case SM_TOK_STREAM_FILE: {
-                UInt read = fread(ts->chardev.cbuf + ts->chardev.clen, 1, 1,
-                                  ts->chardev.file.hnd);
-                if (read != 0) {
-                    int err = ferror(ts->chardev.file.hnd);
-                    if (err) {
-                        fatalChar(ts, "failed to read file: %s\n",
-                                  strerror(err));
-                    }
-                    if (feof(ts->chardev.file.hnd)) {
-                        fatalChar(ts, "unexpected end of file\n");
-                    }
-                }
-                ts->chardev.clen += read;
-                break;
-            }
-            case SM_TOK_STREAM_VIEW:
-                if (ts->chardev.src.offset >= ts->chardev.src.view.len) {
-                    fatalChar(ts, "unexpected end of file\n");
-                }
-                ts->chardev.cbuf[ts->chardev.clen] =
-                    ts->chardev.src.view.bytes[ts->chardev.src.offset];
-                ++ts->chardev.src.offset;
-                ts->chardev.clen += 1;
-                break;
-            default:
-                SM_UNREACHABLE();
-            }
-        }
+    // ASCII needs no decoding
+    if (view.bytes[offset] < 0x80) {
+        ts->chardev.cstash = view.bytes[offset];
+        ++ts->chardev.src.offset;
+        return ts->chardev.cstash;
     }
+    // the source was validated up front, so this always decodes
+    UInt len = 0;
+    ts->chardev.cstash =
+        smUtf8Decode((SmView){view.bytes + offset, view.len - offset}, &len);
+    ts->chardev.src.offset += len;
     return ts->chardev.cstash;
 }
 
@@ -385,86 +544,129 @@ static void eat(SmTokStream *ts) {
     assert((ts->kind == SM_TOK_STREAM_FILE) ||
            (ts->kind == SM_TOK_STREAM_VIEW));
     ts->chardev.cstashed = false;
-    ++ts->chardev.ccol;
-    if (ts->chardev.cstash == '\n') {
-        ++ts->chardev.cline;
-        ts->chardev.ccol = 1;
-    }
 }
 
 static void pushChar(SmTokStream *ts, U32 c) {
     assert((ts->kind == SM_TOK_STREAM_FILE) ||
            (ts->kind == SM_TOK_STREAM_VIEW));
+    SmBuf *buf = &ts->chardev.buf;
+    if (c < 0x80) {
+        smBufReserve(buf, 1);
+        buf->view.bytes[buf->view.len] = c;
+        ++buf->view.len;
+        return;
+    }
     U8   tmp[4];
     UInt len = smUtf8Encode((SmView){tmp, 4}, c);
-    smBufCat(&ts->chardev.buf, (SmView){tmp, len});
+    smBufCat(buf, (SmView){tmp, len});
 }
 
-static char const DIGITS[] = "0123456789ABCDEF";
+static Bool isBlank(U32 c) {
+    return (c == ' ') || (c == '\t') || (c == '\r') || (c == '\v') ||
+           (c == '\f');
+}
 
-static I32 parseChardev(SmTokStream *ts, I32 radix) {
-    I32     value = 0;
-    SmView *view  = &ts->chardev.buf.view;
-    if (view->len == 0) {
-        smTokStreamFatal(ts, "empty number\n");
+// Skips blanks and a comment up to the end of the line. This works on the
+// source bytes directly rather than a character at a time, with the comment
+// skipped by memchr
+static void skipBlank(SmTokStream *ts) {
+    Bool comment = false;
+    if (ts->chardev.cstashed) {
+        U32 c = ts->chardev.cstash;
+        if (!isBlank(c) && (c != ';')) {
+            return;
+        }
+        eat(ts);
+        comment = (c == ';');
     }
-    for (UInt i = 0; i < view->len; ++i) {
-        for (UInt j = 0; j < (sizeof(DIGITS) / sizeof(DIGITS[0])); ++j) {
-            if (toupper(view->bytes[i]) == DIGITS[j]) {
-                if (j >= (UInt)radix) {
-                    smTokStreamFatal(ts, "invalid number: %" SM_VIEW_FMT "\n",
-                                     SM_VIEW_FMT_ARG(*view));
-                }
-                value *= radix;
-                value += j;
-                goto next;
-            }
+    U8 const *bytes = ts->chardev.src.view.bytes;
+    UInt      len   = ts->chardev.src.view.len;
+    UInt      i     = ts->chardev.src.offset;
+    if (!comment) {
+        while ((i < len) && isBlank(bytes[i])) {
+            ++i;
         }
-        smTokStreamFatal(ts, "invalid number: %" SM_VIEW_FMT "\n",
-                         SM_VIEW_FMT_ARG(*view));
-    next:
-        (void)0;
+        if ((i < len) && (bytes[i] == ';')) {
+            comment = true;
+            ++i;
+        }
+    }
+    if (comment) {
+        U8 const *nl = memchr(bytes + i, '\n', len - i);
+        i            = nl ? (UInt)(nl - bytes) : len;
     }
-    return value;
+    ts->chardev.src.offset = i;
 }
 
-static struct {
-    char const *name;
-    U32         tok;
-} const DIRECTIVES[] = {
-    {"DB", SM_TOK_DB},
-    {"DW", SM_TOK_DW},
-    {"DS", SM_TOK_DS},
-    {"SECTION", SM_TOK_SECTION},
-    {"SECTPUSH", SM_TOK_SECTPUSH},
-    {"SECTPOP", SM_TOK_SECTPOP},
-    {"INCLUDE", SM_TOK_INCLUDE},
-    {"INCBIN", SM_TOK_INCBIN},
-    {"ONCE", SM_TOK_ONCE},
-    {"IF", SM_TOK_IF},
-    {"ELSE", SM_TOK_ELSE},
-    {"END", SM_TOK_END},
-    {"MACRO", SM_TOK_MACRO},
-    {"REPEAT", SM_TOK_REPEAT},
-    {"STRUCT", SM_TOK_STRUCT},
-    {"UNION", SM_TOK_UNION},
-    {"STRFMT", SM_TOK_STRFMT},
-    {"IDFMT", SM_TOK_IDFMT},
-    {"ALLOC", SM_TOK_ALLOC},
-    {"FATAL", SM_TOK_FATAL},
-    {"PRINT", SM_TOK_PRINT},
-
-    {"DEFINED", SM_TOK_DEFINED},
-    {"STRLEN", SM_TOK_STRLEN},
-    {"TAG", SM_TOK_TAG},
-    {"REL", SM_TOK_REL},
-
-    {"ARG", SM_TOK_ARG},
-    {"NARG", SM_TOK_NARG},
-    {"SHIFT", SM_TOK_SHIFT},
-    {"UNIQUE", SM_TOK_UNIQUE},
+enum {
+    CLASS_DIGIT = 1 << 0,
+    CLASS_ALNUM = 1 << 1,
+    CLASS_NUM   = 1 << 2,
+    CLASS_IDENT = 1 << 3,
 };
 
+static Bool inClass(U8 b, UInt cls) {
+    if (b >= 0x80) {
+        return (cls & CLASS_IDENT) != 0;
+    }
+    if (isdigit(b)) {
+        return true;
+    }
+    if (isalpha(b)) {
+        return cls != CLASS_DIGIT;
+    }
+    if (b == '_') {
+        return (cls & (CLASS_NUM | CLASS_IDENT)) != 0;
+    }
+    return (b == '.') && (cls & CLASS_IDENT);
+}
+
+// Eats the run of characters in the class and returns it as a view into the
+// source
+static SmView scanRun(SmTokStream *ts, UInt cls) {
+    U8  *bytes = ts->chardev.src.view.bytes;
+    UInt len   = ts->chardev.src.view.len;
+    UInt start = unpeek(ts);
+    UInt i     = start;
+    while ((i < len) && inClass(bytes[i], cls)) {
+        ++i;
+    }
+    ts->chardev.src.offset = i;
+    return (SmView){bytes + start, i - start};
+}
+
+// Eats a string up to and including the closing quote and returns its
+// contents as a view into the source. Strings with escapes have to be built
+// up a character at a time instead, so nothing is eaten for those
+static Bool scanString(SmTokStream *ts, SmView *view) {
+    U8       *bytes = ts->chardev.src.view.bytes;
+    UInt      len   = ts->chardev.src.view.len;
+    UInt      start = unpeek(ts);
+    U8 const *quote = memchr(bytes + start, '"', len - start);
+    if (!quote ||
+        memchr(bytes + start, '\\', (UInt)(quote - bytes) - start)) {
+        return false;
+    }
+    UInt end               = quote - bytes;
+    *view                  = (SmView){bytes + start, end - start};
+    ts->chardev.src.offset = end + 1;
+    return true;
+}
+
+static I32 parseChardev(SmTokStream *ts, SmView view, U32 radix) {
+    U32         num = 0;
+    SmNumResult res = smNumParseDigits(view, radix, &num);
+    switch (res) {
+    case SM_NUM_OK:
+        return (I32)num;
+    case SM_NUM_EMPTY:
+        smTokStreamFatal(ts, "empty number\n");
+    default:
+        smTokStreamFatal(ts, "%s: %" SM_VIEW_FMT "\n", smNumResultStr(res),
+                         SM_VIEW_FMT_ARG(view));
+    }
+}
+
 static struct {
     U8  digraph[3];
     U32 tok;
@@ -475,92 +677,59 @@ static struct {
     {"::", SM_TOK_DCOLON}, {"=:", SM_TOK_EXPEQU}, {"**", SM_TOK_DSTAR},
 };
 
-static struct {
-    U8  pair[3];
-    U32 tok;
-} const PAIRS[] = {
-    {"AF", SM_TOK_AF}, {"BC", SM_TOK_BC}, {"DE", SM_TOK_DE}, {"HL", SM_TOK_HL},
-    {"SP", SM_TOK_SP}, {"NC", SM_TOK_NC}, {"NZ", SM_TOK_NZ},
-};
-
-static U8 SINGLES[] = "ABCDEHLZ";
-
 static U32 peekChardev(SmTokStream *ts) {
     if (ts->chardev.stashed) {
         return ts->chardev.stash;
     }
     while (true) {
-        U32 c = peek(ts);
-        if ((c == SM_TOK_EOF) || !isspace(c) || (c == '\n')) {
+        skipBlank(ts);
+        ts->pos.offset = unpeek(ts);
+        if (peek(ts) != '\\') {
             break;
         }
         eat(ts);
-    }
-    if (peek(ts) == ';') {
-        while (true) {
-            U32 c = peek(ts);
-            if ((c == SM_TOK_EOF) || (c == '\n')) {
-                break;
-            }
-            eat(ts);
+        // line continuation
+        if (peek(ts) != '\n') {
+            ts->chardev.stashed = true;
+            ts->chardev.stash   = '\\';
+            return '\\';
         }
+        eat(ts);
     }
-    ts->pos.line = ts->chardev.cline;
-    ts->pos.col  = ts->chardev.ccol;
     if (peek(ts) == SM_TOK_EOF) {
         eat(ts);
         ts->chardev.stashed = true;
         ts->chardev.stash   = SM_TOK_EOF;
         return SM_TOK_EOF;
     }
-    if (peek(ts) == '\\') {
-        eat(ts);
-        if (peek(ts) == '\n') {
-            eat(ts);
-            return peek(ts); // yuck
-        }
-        ts->chardev.stashed = true;
-        ts->chardev.stash   = '\\';
-        return '\\';
-    }
     if (peek(ts) == '@') {
         eat(ts);
         // macro arg?
-        U32 c = peek(ts);
-        if (isdigit(c)) {
-            for (; isdigit(c); c = peek(ts)) {
-                pushChar(ts, toupper(c));
-                eat(ts);
-            }
-            ts->chardev.num     = parseChardev(ts, 10);
+        if (isdigit(peek(ts))) {
+            ts->chardev.view    = scanRun(ts, CLASS_DIGIT);
+            ts->chardev.num     = parseChardev(ts, ts->chardev.view, 10);
             ts->chardev.stashed = true;
             ts->chardev.stash   = SM_TOK_ARG;
             return SM_TOK_ARG;
         }
         // directive
-        for (c = peek(ts); isalnum(c); c = peek(ts)) {
-            pushChar(ts, toupper(c));
-            eat(ts);
-        }
-        SmView *view = &ts->chardev.buf.view;
-        for (UInt i = 0; i < (sizeof(DIRECTIVES) / sizeof(DIRECTIVES[0]));
-             ++i) {
-            char const *name = DIRECTIVES[i].name;
-            UInt        len  = strlen(name);
-            if (len != view->len) {
-                continue;
-            }
-            if (memcmp(name, view->bytes, view->len) == 0) {
-                ts->chardev.stashed = true;
-                ts->chardev.stash   = DIRECTIVES[i].tok;
-                return ts->chardev.stash;
-            }
+        SmView      view = scanRun(ts, CLASS_ALNUM);
+        SmKw const *kw   = smKwFind(&DIRECTIVES, view);
+        if (kw) {
+            ts->chardev.stashed = true;
+            ts->chardev.stash   = kw->tok;
+            return ts->chardev.stash;
         }
         smTokStreamFatal(ts, "unrecognized directive: @%" SM_VIEW_FMT "\n",
-                         SM_VIEW_FMT_ARG(*view));
+                         SM_VIEW_FMT_ARG(view));
     }
     if (peek(ts) == '"') {
         eat(ts);
+        if (scanString(ts, &ts->chardev.view)) {
+            ts->chardev.stashed = true;
+            ts->chardev.stash   = SM_TOK_STR;
+            return SM_TOK_STR;
+        }
         while (true) {
             U32 c = peek(ts);
             switch (c) {
@@ -569,32 +738,16 @@ static U32 peekChardev(SmTokStream *ts) {
             case '"':
                 eat(ts);
                 goto stringdone;
-            case '\\':
+            case '\\': {
                 eat(ts);
-                switch (peek(ts)) {
-                case 'n':
-                    pushChar(ts, '\n');
-                    break;
-                case 'r':
-                    pushChar(ts, '\r');
-                    break;
-                case 't':
-                    pushChar(ts, '\t');
-                    break;
-                case '\\':
-                    pushChar(ts, '\\');
-                    break;
-                case '"':
-                    pushChar(ts, '"');
-                    break;
-                case '0':
-                    pushChar(ts, '\0');
-                    break;
-                default:
+                U32 num;
+                if (!smNumEscape(peek(ts), '"', &num)) {
                     fatalChar(ts, "unrecognized character escape\n");
                 }
+                pushChar(ts, num);
                 eat(ts);
                 break;
+            }
             default:
                 pushChar(ts, c);
                 eat(ts);
@@ -602,6 +755,7 @@ static U32 peekChardev(SmTokStream *ts) {
             }
         }
     stringdone:
+        ts->chardev.view    = ts->chardev.buf.view;
         ts->chardev.stashed = true;
         ts->chardev.stash   = SM_TOK_STR;
         return SM_TOK_STR;
@@ -612,31 +766,15 @@ static U32 peekChardev(SmTokStream *ts) {
         switch (c) {
         case SM_TOK_EOF:
             fatalChar(ts, "unexpected end of file\n");
-        case '\\':
+        case '\\': {
             eat(ts);
-            switch (peek(ts)) {
-            case 'n':
-                ts->chardev.num = '\n';
-                break;
-            case 'r':
-                ts->chardev.num = '\r';
-                break;
-            case 't':
-                ts->chardev.num = '\t';
-                break;
-            case '\\':
-                ts->chardev.num = '\\';
-                break;
-            case '\'':
-                ts->chardev.num = '\'';
-                break;
-            case '0':
-                ts->chardev.num = '\0';
-                break;
-            default:
+            U32 num;
+            if (!smNumEscape(peek(ts), '\'', &num)) {
                 fatalChar(ts, "unrecognized character escape\n");
             }
+            ts->chardev.num = num;
             break;
+        }
         default:
             ts->chardev.num = c;
             break;
@@ -652,7 +790,7 @@ static U32 peekChardev(SmTokStream *ts) {
     } else {
         U32 c = peek(ts);
         if (isdigit(c) || (c == '%') || (c == '$')) {
-            I32 radix = 10;
+            U32 radix = 10;
             if (c == '%') {
                 radix = 2;
                 eat(ts);
@@ -666,85 +804,41 @@ static U32 peekChardev(SmTokStream *ts) {
             } else if (c == '$') {
                 radix = 16;
                 eat(ts);
-                c = peek(ts);
             }
-            while (true) {
-                // underscores in numbers
-                if (c == '_') {
-                    eat(ts);
-                    c = peek(ts);
-                    continue;
-                }
-                if (!isalnum(c)) {
-                    break;
-                }
-                pushChar(ts, c);
-                eat(ts);
-                c = peek(ts);
-            }
-            ts->chardev.num     = parseChardev(ts, radix);
+            // underscores in numbers are skipped by the parser
+            ts->chardev.view    = scanRun(ts, CLASS_NUM);
+            ts->chardev.num     = parseChardev(ts, ts->chardev.view, radix);
             ts->chardev.stashed = true;
             ts->chardev.stash   = SM_TOK_NUM;
             return SM_TOK_NUM;
         }
-        while (true) {
-            if (c == SM_TOK_EOF) {
-                break;
-            }
-            if (isascii(c) && !isalnum(c) && (c != '_') && (c != '.')) {
-                break;
-            }
-            pushChar(ts, c);
-            eat(ts);
-            c = peek(ts);
-        }
-        // doesn't start with ident symbol. digraph?
-        if (ts->chardev.buf.view.len == 0) {
-            eat(ts);
-            U32 nc = peek(ts);
-            for (UInt i = 0; i < (sizeof(DIGRAPHS) / sizeof(DIGRAPHS[0]));
-                 ++i) {
-                if ((DIGRAPHS[i].digraph[0] == c) &&
-                    (DIGRAPHS[i].digraph[1] == nc)) {
-                    eat(ts);
-                    ts->chardev.stashed = true;
-                    ts->chardev.stash   = DIGRAPHS[i].tok;
-                    return ts->chardev.stash;
-                }
+        // ident?
+        if ((c != SM_TOK_EOF) && (!isascii(c) || isalnum(c) || (c == '_') ||
+                                  (c == '.'))) {
+            ts->chardev.view = scanRun(ts, CLASS_IDENT);
+            // register or condition?
+            SmKw const *kw = NULL;
+            if (ts->chardev.view.len == 1) {
+                kw = smKwFind(&SINGLES, ts->chardev.view);
+            } else if (ts->chardev.view.len == 2) {
+                kw = smKwFind(&PAIRS, ts->chardev.view);
             }
-        }
-        // 1 char identifier?
-        if (ts->chardev.buf.view.len == 1) {
             ts->chardev.stashed = true;
-            U32 upper           = toupper(ts->chardev.buf.view.bytes[0]);
-            for (UInt i = 0; i < sizeof(SINGLES); ++i) {
-                if (SINGLES[i] == upper) {
-                    ts->chardev.stash = upper;
-                    return upper;
-                }
-            }
-            ts->chardev.stash = SM_TOK_ID;
+            ts->chardev.stash   = kw ? kw->tok : SM_TOK_ID;
             return ts->chardev.stash;
         }
-        // 2 char ident?
-        if (ts->chardev.buf.view.len == 2) {
-            ts->chardev.stashed = true;
-            U32 c0              = toupper(ts->chardev.buf.view.bytes[0]);
-            U32 c1              = toupper(ts->chardev.buf.view.bytes[1]);
-            for (UInt i = 0; i < (sizeof(PAIRS) / sizeof(PAIRS[0])); ++i) {
-                if ((PAIRS[i].pair[0] == c0) && (PAIRS[i].pair[1] == c1)) {
-                    ts->chardev.stashed = true;
-                    ts->chardev.stash   = PAIRS[i].tok;
-                    return ts->chardev.stash;
-                }
+        // digraph?
+        eat(ts);
+        U32 nc = peek(ts);
+        for (UInt i = 0; i < (sizeof(DIGRAPHS) / sizeof(DIGRAPHS[0])); ++i) {
+            if ((DIGRAPHS[i].digraph[0] == c) &&
+                (DIGRAPHS[i].digraph[1] == nc)) {
+                eat(ts);
+                ts->chardev.stashed = true;
+                ts->chardev.stash   = DIGRAPHS[i].tok;
+                return ts->chardev.stash;
             }
         }
-        // ident?
-        if (ts->chardev.buf.view.len != 0) {
-            ts->chardev.stashed = true;
-            ts->chardev.stash   = SM_TOK_ID;
-            return SM_TOK_ID;
-        }
         // else uppercase whatever the char is
         ts->chardev.stashed = true;
         ts->chardev.stash   = toupper(c);
@@ -824,11 +918,46 @@ static U32 peekIfElse(SmTokStream *ts) {
     return ts->ifelse.buf.view.items[ts->ifelse.pos].tok;
 }
 
+// Only identifiers and strings have a view and only numbers and macro
+// arguments a number, just like for the other recorded streams
+static void recordTok(SmTokStream *ts, U32 tok) {
+    SmTokRecord *record = ts->chardev.record;
+    SmRecordTok  rec    = {tok, ts->pos.offset, {0}};
+    switch (tok) {
+    case SM_TOK_ID:
+    case SM_TOK_STR:
+        rec.atom = smViewAtom(record->in, ts->chardev.view);
+        break;
+    case SM_TOK_NUM:
+    case SM_TOK_ARG:
+        rec.num = ts->chardev.num;
+        break;
+    default:
+        break;
+    }
+    smRecordTokBufAdd(&record->toks, rec);
+}
+
+static U32 peekRecorded(SmTokStream *ts) {
+    U32          tok    = peekChardev(ts);
+    SmTokRecord *record = ts->chardev.record;
+    ts->chardev.last    = tok;
+    if (record && (tok == SM_TOK_EOF) && !record->done) {
+        recordTok(ts, tok);
+        record->done = true;
+    }
+    return tok;
+}
+
+static SmRecordTok const *replayTok(SmTokStream *ts) {
+    return ts->replay.record->toks.view.items + ts->replay.pos;
+}
+
 U32 smTokStreamPeek(SmTokStream *ts) {
     switch (ts->kind) {
     case SM_TOK_STREAM_FILE:
     case SM_TOK_STREAM_VIEW:
-        return peekChardev(ts);
+        return peekRecorded(ts);
     case SM_TOK_STREAM_MACRO:
         return peekMacro(ts);
     case SM_TOK_STREAM_REPEAT:
@@ -837,6 +966,8 @@ U32 smTokStreamPeek(SmTokStream *ts) {
         return ts->fmt.tok;
     case SM_TOK_STREAM_IFELSE:
         return peekIfElse(ts);
+    case SM_TOK_STREAM_REPLAY:
+        return replayTok(ts)->tok;
     default:
         SM_UNREACHABLE();
     }
@@ -846,7 +977,11 @@ void smTokStreamEat(SmTokStream *ts) {
     switch (ts->kind) {
     case SM_TOK_STREAM_FILE:
     case SM_TOK_STREAM_VIEW:
+        if (ts->chardev.record && !ts->chardev.record->done) {
+            recordTok(ts, ts->chardev.last);
+        }
         ts->chardev.stashed      = false;
+        ts->chardev.view         = SM_VIEW_NULL;
         ts->chardev.buf.view.len = 0;
         return;
     case SM_TOK_STREAM_MACRO: {
@@ -883,6 +1018,12 @@ void smTokStreamEat(SmTokStream *ts) {
     case SM_TOK_STREAM_IFELSE:
         ++ts->ifelse.pos;
         return;
+    case SM_TOK_STREAM_REPLAY:
+        // stay on the trailing SM_TOK_EOF
+        if ((ts->replay.pos + 1) < ts->replay.record->toks.view.len) {
+            ++ts->replay.pos;
+        }
+        return;
     default:
         SM_UNREACHABLE();
     }
@@ -892,25 +1033,14 @@ void smTokStreamRewind(SmTokStream *ts) {
     smTokStreamEat(ts);
     switch (ts->kind) {
     case SM_TOK_STREAM_FILE:
-        if (fseek(ts->chardev.file.hnd, 0, SEEK_SET) < 0) {
-            int err = errno;
-            fprintf(stderr, "%" SM_VIEW_FMT ":%" UINT_FMT ":%" UINT_FMT ": ",
-                    SM_VIEW_FMT_ARG(ts->pos.file), ts->chardev.cline,
-                    ts->chardev.ccol);
-            smFatal("failed to rewind file: %s\n", strerror(err));
-        }
-        break;
     case SM_TOK_STREAM_VIEW:
         ts->chardev.src.offset = 0;
         break;
     default:
         SM_UNREACHABLE();
     }
-    ts->pos.line         = 1;
-    ts->pos.col          = 1;
     ts->chardev.cstashed = false;
-    ts->chardev.cline    = 1;
-    ts->chardev.ccol     = 1;
+    ts->pos.offset       = 0;
     return;
 }
 
@@ -918,7 +1048,7 @@ SmView smTokStreamView(SmTokStream *ts) {
     switch (ts->kind) {
     case SM_TOK_STREAM_FILE:
     case SM_TOK_STREAM_VIEW:
-        return ts->chardev.buf.view;
+        return ts->chardev.view;
     case SM_TOK_STREAM_MACRO: {
         SmMacroTok *tok = ts->macro.view.items + ts->macro.pos;
         switch (tok->kind) {
@@ -952,6 +1082,14 @@ SmView smTokStreamView(SmTokStream *ts) {
         return ts->fmt.view;
     case SM_TOK_STREAM_IFELSE:
         return ts->ifelse.buf.view.items[ts->ifelse.pos].view;
+    case SM_TOK_STREAM_REPLAY:
+        switch (replayTok(ts)->tok) {
+        case SM_TOK_ID:
+        case SM_TOK_STR:
+            return smAtomView(ts->replay.record->in, replayTok(ts)->atom);
+        default:
+            return SM_VIEW_NULL;
+        }
     default:
         SM_UNREACHABLE();
     }
@@ -996,6 +1134,14 @@ I32 smTokStreamNum(SmTokStream *ts) {
     }
     case SM_TOK_STREAM_IFELSE:
         return ts->ifelse.buf.view.items[ts->ifelse.pos].num;
+    case SM_TOK_STREAM_REPLAY:
+        switch (replayTok(ts)->tok) {
+        case SM_TOK_NUM:
+        case SM_TOK_ARG:
+            return replayTok(ts)->num;
+        default:
+            return 0;
+        }
     case SM_TOK_STREAM_FMT:
     default:
         SM_UNREACHABLE();
@@ -1016,6 +1162,8 @@ SmPos smTokStreamPos(SmTokStream *ts) {
         return ts->pos;
     case SM_TOK_STREAM_IFELSE:
         return ts->ifelse.buf.view.items[ts->ifelse.pos].pos;
+    case SM_TOK_STREAM_REPLAY:
+        return (SmPos){ts->pos.file, replayTok(ts)->offset};
     default:
         SM_UNREACHABLE();
     }
@@ -1,6 +1,12 @@
 #include <smasm/fatal.h>
 #include <smasm/utf8.h>
 
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 U32 smUtf8Decode(SmView view, UInt *len) {
     if ((view.len > 0) && (view.bytes[0] < 0x80)) {
         *len = 1;
@@ -57,14 +63,115 @@ UInt smUtf8Encode(SmView view, U32 c) {
     return 0;
 }
 
+static U64 load64(U8 const *bytes) {
+    U64 word;
+    memcpy(&word, bytes, sizeof(word));
+    return word;
+}
+
+// Skips from `i` over bytes that are plain ASCII, a block at a time
+static UInt asciiRun(SmView view, UInt i) {
+#ifdef __SSE2__
+    for (; (i + 16) <= view.len; i += 16) {
+        __m128i block = _mm_loadu_si128((__m128i const *)(view.bytes + i));
+        if (_mm_movemask_epi8(block) != 0) {
+            break;
+        }
+    }
+#endif
+    for (; (i + 8) <= view.len; i += 8) {
+        if (load64(view.bytes + i) & 0x8080808080808080ull) {
+            break;
+        }
+    }
+    while ((i < view.len) && (view.bytes[i] < 0x80)) {
+        ++i;
+    }
+    return i;
+}
+
+static Bool isCont(U8 byte) { return (byte & 0xC0) == 0x80; }
+
+UInt smUtf8Valid(SmView view) {
+    UInt i = 0;
+    while (true) {
+        i = asciiRun(view, i);
+        if (i >= view.len) {
+            return i;
+        }
+        // the range the second byte has to be in rules out overlong forms,
+        // surrogates and anything past U+10FFFF (RFC 3629)
+        U8   lead = view.bytes[i];
+        UInt len;
+        U8   lo = 0x80;
+        U8   hi = 0xBF;
+        if ((lead >= 0xC2) && (lead <= 0xDF)) {
+            len = 2;
+        } else if ((lead & 0xF0) == 0xE0) {
+            len = 3;
+            if (lead == 0xE0) {
+                lo = 0xA0;
+            } else if (lead == 0xED) {
+                hi = 0x9F;
+            }
+        } else if ((lead >= 0xF0) && (lead <= 0xF4)) {
+            len = 4;
+            if (lead == 0xF0) {
+                lo = 0x90;
+            } else if (lead == 0xF4) {
+                hi = 0x8F;
+            }
+        } else {
+            return i;
+        }
+        if ((view.len - i) < len) {
+            return i;
+        }
+        U8 second = view.bytes[i + 1];
+        if ((second < lo) || (second > hi)) {
+            return i;
+        }
+        for (UInt j = 2; j < len; ++j) {
+            if (!isCont(view.bytes[i + j])) {
+                return i;
+            }
+        }
+        i += len;
+    }
+}
+
 UInt smUtf8Len(SmView view) {
-    UInt len = 0;
-    for (UInt i = 0; i < view.len; ++i) {
-        if ((view.bytes[i] & 0xC0) != 0x80) {
-            ++len;
+    // every byte that is not a continuation byte starts a codepoint
+    UInt i    = 0;
+    UInt cont = 0;
+#ifdef __SSE2__
+    // as signed bytes, the continuation bytes are the ones below -64. the
+    // compare leaves -1 in each lane that has one, which we subtract into
+    // byte counters and sum up before they can overflow
+    __m128i const limit = _mm_set1_epi8(-64);
+    __m128i const zero  = _mm_setzero_si128();
+    while ((i + 16) <= view.len) {
+        __m128i counts = zero;
+        for (UInt n = 0; (n < 255) && ((i + 16) <= view.len); ++n, i += 16) {
+            __m128i block =
+                _mm_loadu_si128((__m128i const *)(view.bytes + i));
+            counts = _mm_sub_epi8(counts, _mm_cmplt_epi8(block, limit));
         }
+        __m128i sums = _mm_sad_epu8(counts, zero);
+        cont += (UInt)_mm_cvtsi128_si32(sums);
+        cont += (UInt)_mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+    }
+#endif
+    for (; (i + 8) <= view.len; i += 8) {
+        U64 word = load64(view.bytes + i);
+        // the low bit of each byte ends up set for 0b10xxxxxx
+        U64 bits = (word >> 7) & (~word >> 6) & 0x0101010101010101ull;
+        cont += (bits * 0x0101010101010101ull) >> 56;
+    }
+    for (; i < view.len; ++i) {
+        cont += isCont(view.bytes[i]);
     }
-    return len;
+    return view.len - cont;
 }
 
 void smUtf8Cat(SmBuf *buf, U32 c) {
@@ -5,10 +5,9 @@
 
 #include <assert.h>
 
-static SmExprBuf expr_stack = {};
-static SmOpBuf   op_stack   = {};
-
-static void pushExpr(SmExpr expr) { smExprBufAdd(&expr_stack, expr); }
+static void pushExpr(Asm *as, SmExpr expr) {
+    smExprBufAdd(&as->expr_stack, expr);
+}
 
 static U8 precedence(SmOp op) {
     if (op.unary) {
@@ -49,54 +48,58 @@ static U8 precedence(SmOp op) {
     }
 }
 
-static void pushApply(SmOp op) {
+static void pushApply(Asm *as, SmOp op) {
     // pratt parser magic
     if (op.tok == '(') {
-        smOpBufAdd(&op_stack, op);
+        smOpBufAdd(&as->op_stack, op);
         return;
     }
-    while (op_stack.view.len > 0) {
-        --op_stack.view.len;
-        SmOp top = op_stack.view.items[op_stack.view.len];
+    while (as->op_stack.view.len > 0) {
+        --as->op_stack.view.len;
+        SmOp top = as->op_stack.view.items[as->op_stack.view.len];
         if ((top.tok == '(') || precedence(top) >= precedence(op)) {
-            smOpBufAdd(&op_stack, top);
+            smOpBufAdd(&as->op_stack, top);
             break;
         }
-        pushExpr((SmExpr){.kind = SM_EXPR_OP, .op = top});
+        pushExpr(as, (SmExpr){.kind = SM_EXPR_OP, .op = top});
     }
-    smOpBufAdd(&op_stack, op);
+    smOpBufAdd(&as->op_stack, op);
 }
 
-static void pushApplyBinary(U32 tok) { pushApply((SmOp){tok, false}); }
+static void pushApplyBinary(Asm *as, U32 tok) {
+    pushApply(as, (SmOp){tok, false});
+}
 
-static void pushApplyUnary(U32 tok) { pushApply((SmOp){tok, true}); }
+static void pushApplyUnary(Asm *as, U32 tok) {
+    pushApply(as, (SmOp){tok, true});
+}
 
-SmExprView exprEat() {
-    expr_stack.view.len = 0;
-    op_stack.view.len   = 0;
-    Bool seen_value     = false;
-    UInt paren_depth    = 0;
+SmExprView exprEat(Asm *as) {
+    as->expr_stack.view.len = 0;
+    as->op_stack.view.len   = 0;
+    Bool seen_value         = false;
+    UInt paren_depth        = 0;
     while (true) {
-        switch (peek()) {
+        switch (peek(as)) {
         case '*':
-            eat();
+            eat(as);
             // * must be the relative PC
             if (!seen_value) {
-                pushExpr((SmExpr){.kind = SM_EXPR_CONST, .num = getPC()});
+                pushExpr(as, (SmExpr){.kind = SM_EXPR_CONST, .num = getPC(as)});
                 seen_value = true;
                 continue;
             }
-            pushApplyBinary('*');
+            pushApplyBinary(as, '*');
             seen_value = false;
             continue;
         case SM_TOK_DSTAR:
             // ** the absolute PC
             if (seen_value) {
-                fatal("expected an operator\n");
+                fatal(as, "expected an operator\n");
             }
-            eat();
-            pushExpr((SmExpr){.kind = SM_EXPR_ADDR,
-                              .addr = {sectGet()->name, getPC()}});
+            eat(as);
+            pushExpr(as, (SmExpr){.kind = SM_EXPR_ADDR,
+                                  .addr = {sectGet(as)->name, getPC(as)}});
             seen_value = true;
             continue;
         case '+':
@@ -106,18 +109,18 @@ SmExprView exprEat() {
         case '>':
             // sometimes unary
             if (seen_value) {
-                pushApplyBinary(peek());
+                pushApplyBinary(as, peek(as));
             } else {
-                pushApplyUnary(peek());
+                pushApplyUnary(as, peek(as));
             }
-            eat();
+            eat(as);
             seen_value = false;
             continue;
         case '!':
         case '~':
             // always unary
-            pushApplyUnary(peek());
-            eat();
+            pushApplyUnary(as, peek(as));
+            eat(as);
             seen_value = false;
             continue;
         case '&':
@@ -135,186 +138,191 @@ SmExprView exprEat() {
         case SM_TOK_NEQ:
             // binary
             if (!seen_value) {
-                fatal("expected a value\n");
+                fatal(as, "expected a value\n");
             }
-            pushApplyBinary(peek());
-            eat();
+            pushApplyBinary(as, peek(as));
+            eat(as);
             seen_value = false;
             continue;
         case SM_TOK_NUM:
             if (seen_value) {
-                fatal("expected an operator\n");
+                fatal(as, "expected an operator\n");
             }
-            pushExpr((SmExpr){.kind = SM_EXPR_CONST, .num = tokNum()});
-            eat();
+            pushExpr(as, (SmExpr){.kind = SM_EXPR_CONST, .num = tokNum(as)});
+            eat(as);
             seen_value = true;
             continue;
         case '(':
             if (seen_value) {
-                fatal("expected an operator\n");
+                fatal(as, "expected an operator\n");
             }
             ++paren_depth;
-            smOpBufAdd(&op_stack, (SmOp){'(', true});
-            eat();
+            smOpBufAdd(&as->op_stack, (SmOp){'(', true});
+            eat(as);
             seen_value = false;
             continue;
         case ')':
             if (!seen_value) {
-                fatal("expected a value\n");
+                fatal(as, "expected a value\n");
             }
             --paren_depth;
             while (true) {
-                if (op_stack.view.len == 0) {
-                    fatal("unmatched parentheses\n");
+                if (as->op_stack.view.len == 0) {
+                    fatal(as, "unmatched parentheses\n");
                 }
-                --op_stack.view.len;
-                SmOp op = op_stack.view.items[op_stack.view.len];
+                --as->op_stack.view.len;
+                SmOp op = as->op_stack.view.items[as->op_stack.view.len];
                 if (op.tok == '(') {
                     break;
                 }
-                pushExpr((SmExpr){.kind = SM_EXPR_OP, .op = op});
+                pushExpr(as, (SmExpr){.kind = SM_EXPR_OP, .op = op});
             }
-            eat();
+            eat(as);
             continue;
         case SM_TOK_ID: {
             if (seen_value) {
-                fatal("expected an operator\n");
+                fatal(as, "expected an operator\n");
             }
-            pushExpr((SmExpr){.kind = SM_EXPR_LABEL, .lbl = tokLbl()});
-            eat();
+            pushExpr(as, (SmExpr){.kind = SM_EXPR_LABEL, .lbl = tokLbl(as)});
+            eat(as);
             seen_value = true;
             continue;
         }
-        case SM_TOK_DEFINED: {
+        case SM_TOK_DEFINED:
             if (seen_value) {
-                fatal("expected an operator\n");
+                fatal(as, "expected an operator\n");
             }
-            eat();
-            expect(SM_TOK_ID);
-            SmLbl lbl = tokLbl();
-            pushExpr((SmExpr){.kind = SM_EXPR_CONST,
-                              .num  = (smSymTabFind(&SYMS, lbl) != NULL)});
-            eat();
+            eat(as);
+            expect(as, SM_TOK_ID);
+            pushExpr(as, (SmExpr){.kind = SM_EXPR_CONST,
+                                  .num  = definedAsk(as, tokLbl(as),
+                                                     tokPos(as))});
+            eat(as);
             seen_value = true;
             continue;
-        }
         case SM_TOK_STRLEN:
             if (seen_value) {
-                fatal("expected an operator\n");
+                fatal(as, "expected an operator\n");
             }
-            eat();
-            expect(SM_TOK_STR);
-            pushExpr((SmExpr){.kind = SM_EXPR_CONST, .num = tokView().len});
-            eat();
+            eat(as);
+            expect(as, SM_TOK_STR);
+            pushExpr(as,
+                     (SmExpr){.kind = SM_EXPR_CONST, .num = tokView(as).len});
+            eat(as);
             seen_value = true;
             continue;
         case SM_TOK_TAG: {
             if (seen_value) {
-                fatal("expected an operator\n");
+                fatal(as, "expected an operator\n");
             }
-            eat();
+            eat(as);
             Bool braced = false;
-            if (peek() == '{') {
-                eat();
+            if (peek(as) == '{') {
+                eat(as);
                 braced = true;
             }
-            expect(SM_TOK_ID);
-            SmLbl lbl = tokLbl();
-            eat();
-            expect(',');
-            eat();
-            expect(SM_TOK_STR);
-            pushExpr(
-                (SmExpr){.kind = SM_EXPR_TAG, .tag = {lbl, intern(tokView())}});
-            eat();
+            expect(as, SM_TOK_ID);
+            SmLbl lbl = tokLbl(as);
+            eat(as);
+            expect(as, ',');
+            eat(as);
+            expect(as, SM_TOK_STR);
+            pushExpr(as, (SmExpr){.kind = SM_EXPR_TAG,
+                                  .tag  = {lbl, intern(as, tokView(as))}});
+            eat(as);
             if (braced) {
-                expect('}');
-                eat();
+                expect(as, '}');
+                eat(as);
             }
             seen_value = true;
             continue;
         }
         case SM_TOK_REL:
             if (seen_value) {
-                fatal("expected an operator\n");
+                fatal(as, "expected an operator\n");
             }
-            eat();
-            expect(SM_TOK_ID);
-            pushExpr((SmExpr){.kind = SM_EXPR_REL, .lbl = tokLbl()});
-            eat();
+            eat(as);
+            expect(as, SM_TOK_ID);
+            pushExpr(as, (SmExpr){.kind = SM_EXPR_REL, .lbl = tokLbl(as)});
+            eat(as);
             seen_value = true;
             continue;
         default:
             if (!seen_value) {
-                fatal("expected a value\n");
+                fatal(as, "expected a value\n");
             }
             if (paren_depth > 0) {
-                fatal("unmatched parentheses\n");
+                fatal(as, "unmatched parentheses\n");
             }
             goto complete;
         }
     }
 complete:
-    while (op_stack.view.len > 0) {
-        --op_stack.view.len;
-        SmOp op = op_stack.view.items[op_stack.view.len];
-        pushExpr((SmExpr){.kind = SM_EXPR_OP, .op = op});
+    while (as->op_stack.view.len > 0) {
+        --as->op_stack.view.len;
+        SmOp op = as->op_stack.view.items[as->op_stack.view.len];
+        pushExpr(as, (SmExpr){.kind = SM_EXPR_OP, .op = op});
     }
-    return smExprIntern(&EXPRS, expr_stack.view);
+    return smExprIntern(&as->exprs, as->expr_stack.view);
 }
 
-SmExprView exprEatPos(SmPos *pos) {
+SmExprView exprEatPos(Asm *as, SmPos *pos) {
     // advance to get the location of the expr
-    peek();
-    *pos = tokPos();
-    return exprEat();
+    peek(as);
+    *pos = tokPos(as);
+    return exprEat(as);
 }
 
-I32 exprEatSolvedPos(SmPos *pos) {
+I32 exprEatSolvedPos(Asm *as, SmPos *pos) {
     I32 num;
-    if (!exprSolve(exprEatPos(pos), &num)) {
-        fatalPos(*pos, "expression must be constant\n");
+    if (!exprSolve(as, exprEatPos(as, pos), &num)) {
+        fatalPos(as, *pos, "expression must be constant\n");
     }
     return num;
 }
 
-U8 exprEatSolvedU8() {
+U8 exprEatSolvedU8(Asm *as) {
     SmPos pos;
-    I32   num = exprEatSolvedPos(&pos);
+    I32   num = exprEatSolvedPos(as, &pos);
     if (!exprCanReprU8(num)) {
-        fatalPos(pos, "expression does not fit in a byte: $%08X\n", num);
+        fatalPos(as, pos, "expression does not fit in a byte: $%08X\n", num);
     }
     return (U8)num;
 }
 
-U16 exprEatSolvedU16() {
+U16 exprEatSolvedU16(Asm *as) {
     SmPos pos;
-    I32   num = exprEatSolvedPos(&pos);
+    I32   num = exprEatSolvedPos(as, &pos);
     if (!exprCanReprU16(num)) {
-        fatalPos(pos, "expression does not fit in a word: $%08X\n", num);
+        fatalPos(as, pos, "expression does not fit in a word: $%08X\n", num);
     }
     return (U16)num;
 }
 
-static Bool exprSolveFull(SmExprView view, I32 *num, Bool relative) {
-    SmI32Buf stack = {};
+static void pushNum(Asm *as, SmI32Buf *stack, I32 num) {
+    smI32BufArenaAdd(stack, &as->pass, num);
+}
+
+static Bool exprSolveFull(Asm *as, SmExprView view, I32 *num, Bool relative) {
+    SmArenaMark mark  = smArenaMark(&as->pass);
+    SmI32Buf    stack = {};
     for (UInt i = 0; i < view.len; ++i) {
         SmExpr *expr = view.items + i;
         switch (expr->kind) {
         case SM_EXPR_CONST:
-            smI32BufAdd(&stack, expr->num);
+            pushNum(as, &stack, expr->num);
             break;
         case SM_EXPR_LABEL: {
-            SmSym *sym = smSymTabFind(&SYMS, expr->lbl);
+            SmSym *sym = smSymTabFind(&as->syms, expr->lbl);
             if (!sym) {
                 goto fail;
             }
             I32 num;
             // yuck
-            if (!exprSolveFull(sym->value, &num, relative)) {
+            if (!exprSolveFull(as, sym->value, &num, relative)) {
                 goto fail;
             }
-            smI32BufAdd(&stack, num);
+            pushNum(as, &stack, num);
             break;
         }
         case SM_EXPR_TAG:
@@ -325,25 +333,25 @@ static Bool exprSolveFull(SmExprView view, I32 *num, Bool relative) {
             if (expr->op.unary) {
                 switch (expr->op.tok) {
                 case '+':
-                    smI32BufAdd(&stack, rhs);
+                    pushNum(as, &stack, rhs);
                     break;
                 case '-':
-                    smI32BufAdd(&stack, -rhs);
+                    pushNum(as, &stack, -rhs);
                     break;
                 case '~':
-                    smI32BufAdd(&stack, ~rhs);
+                    pushNum(as, &stack, ~rhs);
                     break;
                 case '!':
-                    smI32BufAdd(&stack, !rhs);
+                    pushNum(as, &stack, !rhs);
                     break;
                 case '<':
-                    smI32BufAdd(&stack, ((U32)rhs) & 0xFF);
+                    pushNum(as, &stack, ((U32)rhs) & 0xFF);
                     break;
                 case '>':
-                    smI32BufAdd(&stack, ((U32)rhs & 0xFF00) >> 8);
+                    pushNum(as, &stack, ((U32)rhs & 0xFF00) >> 8);
                     break;
                 case '^':
-                    smI32BufAdd(&stack, ((U32)rhs & 0xFF0000) >> 16);
+                    pushNum(as, &stack, ((U32)rhs & 0xFF0000) >> 16);
                     break;
                 default:
                     SM_UNREACHABLE();
@@ -353,61 +361,61 @@ static Bool exprSolveFull(SmExprView view, I32 *num, Bool relative) {
                 I32 lhs = stack.view.items[stack.view.len];
                 switch (expr->op.tok) {
                 case '+':
-                    smI32BufAdd(&stack, lhs + rhs);
+                    pushNum(as, &stack, lhs + rhs);
                     break;
                 case '-':
-                    smI32BufAdd(&stack, lhs - rhs);
+                    pushNum(as, &stack, lhs - rhs);
                     break;
                 case '*':
-                    smI32BufAdd(&stack, lhs * rhs);
+                    pushNum(as, &stack, lhs * rhs);
                     break;
                 case '/':
-                    smI32BufAdd(&stack, lhs / rhs);
+                    pushNum(as, &stack, lhs / rhs);
                     break;
                 case '%':
-                    smI32BufAdd(&stack, lhs % rhs);
+                    pushNum(as, &stack, lhs % rhs);
                     break;
                 case SM_TOK_ASL:
-                    smI32BufAdd(&stack, lhs << rhs);
+                    pushNum(as, &stack, lhs << rhs);
                     break;
                 case SM_TOK_ASR:
-                    smI32BufAdd(&stack, lhs >> rhs);
+                    pushNum(as, &stack, lhs >> rhs);
                     break;
                 case SM_TOK_LSR:
-                    smI32BufAdd(&stack, ((U32)lhs) >> ((U32)rhs));
+                    pushNum(as, &stack, ((U32)lhs) >> ((U32)rhs));
                     break;
                 case '<':
-                    smI32BufAdd(&stack, lhs < rhs);
+                    pushNum(as, &stack, lhs < rhs);
                     break;
                 case SM_TOK_LTE:
-                    smI32BufAdd(&stack, lhs <= rhs);
+                    pushNum(as, &stack, lhs <= rhs);
                     break;
                 case '>':
-                    smI32BufAdd(&stack, lhs > rhs);
+                    pushNum(as, &stack, lhs > rhs);
                     break;
                 case SM_TOK_GTE:
-                    smI32BufAdd(&stack, lhs >= rhs);
+                    pushNum(as, &stack, lhs >= rhs);
                     break;
                 case SM_TOK_DEQ:
-                    smI32BufAdd(&stack, lhs == rhs);
+                    pushNum(as, &stack, lhs == rhs);
                     break;
                 case SM_TOK_NEQ:
-                    smI32BufAdd(&stack, lhs != rhs);
+                    pushNum(as, &stack, lhs != rhs);
                     break;
                 case '&':
-                    smI32BufAdd(&stack, lhs & rhs);
+                    pushNum(as, &stack, lhs & rhs);
                     break;
                 case '|':
-                    smI32BufAdd(&stack, lhs | rhs);
+                    pushNum(as, &stack, lhs | rhs);
                     break;
                 case '^':
-                    smI32BufAdd(&stack, lhs ^ rhs);
+                    pushNum(as, &stack, lhs ^ rhs);
                     break;
                 case SM_TOK_AND:
-                    smI32BufAdd(&stack, lhs && rhs);
+                    pushNum(as, &stack, lhs && rhs);
                     break;
                 case SM_TOK_OR:
-                    smI32BufAdd(&stack, lhs || rhs);
+                    pushNum(as, &stack, lhs || rhs);
                     break;
                 default:
                     SM_UNREACHABLE();
@@ -416,25 +424,25 @@ static Bool exprSolveFull(SmExprView view, I32 *num, Bool relative) {
             break;
         case SM_EXPR_ADDR:
             // absolute addresses can only be solved at link time
-            if (!smViewEqual(expr->addr.sect, sectGet()->name)) {
+            if (!smViewEqual(expr->addr.sect, sectGet(as)->name)) {
                 goto fail;
             }
             if (!relative) {
                 goto fail;
             }
-            smI32BufAdd(&stack, expr->addr.pc);
+            pushNum(as, &stack, expr->addr.pc);
             break;
         case SM_EXPR_REL: {
-            SmSym *sym = smSymTabFind(&SYMS, expr->lbl);
+            SmSym *sym = smSymTabFind(&as->syms, expr->lbl);
             if (!sym) {
                 goto fail;
             }
             I32 num;
             // yuck
-            if (!exprSolveFull(sym->value, &num, true)) {
+            if (!exprSolveFull(as, sym->value, &num, true)) {
                 goto fail;
             }
-            smI32BufAdd(&stack, num);
+            pushNum(as, &stack, num);
             break;
         }
         default:
@@ -443,19 +451,38 @@ static Bool exprSolveFull(SmExprView view, I32 *num, Bool relative) {
     }
     assert(stack.view.len == 1);
     *num = *stack.view.items;
-    smI32BufFini(&stack);
+    smArenaRelease(&as->pass, mark);
     return true;
 fail:
-    smI32BufFini(&stack);
+    smArenaRelease(&as->pass, mark);
     return false;
 }
 
-Bool exprSolve(SmExprView view, I32 *num) {
-    return exprSolveFull(view, num, false);
+Bool exprSolve(Asm *as, SmExprView view, I32 *num) {
+    return exprSolveFull(as, view, num, false);
 }
 
-Bool exprSolveRelative(SmExprView view, I32 *num) {
-    return exprSolveFull(view, num, true);
+Bool exprSolveRelative(Asm *as, SmExprView view, I32 *num) {
+    return exprSolveFull(as, view, num, true);
+}
+
+// Whether every symbol the expression refers to is defined yet. If so, and it
+// cannot be solved now, it never will be before linking
+Bool exprDefined(Asm *as, SmExprView view) {
+    for (UInt i = 0; i < view.len; ++i) {
+        SmExpr *expr = view.items + i;
+        switch (expr->kind) {
+        case SM_EXPR_LABEL:
+        case SM_EXPR_REL:
+            if (!smSymTabFind(&as->syms, expr->lbl)) {
+                return false;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    return true;
 }
 
 Bool exprCanReprU16(I32 num) { return (num >= 0) && (num <= U16_MAX); }
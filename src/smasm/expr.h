@@ -1,16 +1,17 @@
 #ifndef EXPR_H
 #define EXPR_H
 
-#include <smasm/sym.h>
+#include "state.h"
 
-SmExprView exprEat();
-SmExprView exprEatPos(SmPos *pos);
-I32        exprEatSolvedPos(SmPos *pos);
-U8         exprEatSolvedU8();
-U16        exprEatSolvedU16();
+SmExprView exprEat(Asm *as);
+SmExprView exprEatPos(Asm *as, SmPos *pos);
+I32        exprEatSolvedPos(Asm *as, SmPos *pos);
+U8         exprEatSolvedU8(Asm *as);
+U16        exprEatSolvedU16(Asm *as);
 
-Bool exprSolve(SmExprView view, I32 *num);
-Bool exprSolveRelative(SmExprView view, I32 *num);
+Bool exprSolve(Asm *as, SmExprView view, I32 *num);
+Bool exprSolveRelative(Asm *as, SmExprView view, I32 *num);
+Bool exprDefined(Asm *as, SmExprView view);
 
 Bool exprCanReprU16(I32 num);
 Bool exprCanReprU8(I32 num);
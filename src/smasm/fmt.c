@@ -3,6 +3,7 @@
 #include "state.h"
 
 #include <smasm/fatal.h>
+#include <smasm/num.h>
 #include <smasm/utf8.h>
 
 #include <ctype.h>
@@ -124,33 +125,36 @@ static void fmtInt(SmBuf *buf, I32 num, I32 radix, U8 flags, U16 width,
     fmtUInt(buf, num, radix, flags, width, prec, negative);
 }
 
-static UInt scanDigits(SmView fmt, U16 *num) {
+static UInt scanDigits(Asm *as, SmView fmt, U16 *num) {
     UInt len;
     for (len = 0; len < fmt.len; ++len) {
         if (!isdigit(fmt.bytes[len])) {
             break;
         }
     }
-    I32 bignum = smViewParse((SmView){fmt.bytes, len});
-    if (!exprCanReprU16(bignum)) {
-        fatal("expression does not fit in a word: $%08X\n", bignum);
+    SmView digits = {fmt.bytes, len};
+    U32    bignum = 0;
+    if ((smNumParseDigits(digits, 10, &bignum) != SM_NUM_OK) ||
+        !exprCanReprU16(bignum)) {
+        fatal(as, "expression does not fit in a word: %" SM_VIEW_FMT "\n",
+              SM_VIEW_FMT_ARG(digits));
     }
     *num = (U16)bignum;
     return len;
 }
 
-void fmtInvoke(U32 tok) {
-    SmPos pos = tokPos();
-    eat();
+void fmtInvoke(Asm *as, U32 tok) {
+    SmPos pos = tokPos(as);
+    eat(as);
     Bool braced = false;
-    if (peek() == '{') {
-        eat();
+    if (peek(as) == '{') {
+        eat(as);
         braced = true;
     }
-    expect(SM_TOK_STR);
+    expect(as, SM_TOK_STR);
     SmBuf fmt = {};
-    smBufCat(&fmt, tokView());
-    eat();
+    smBufCat(&fmt, tokView(as));
+    eat(as);
     SmBuf buf      = {};
     U8    stack[6] = {FMT_STATE_INIT};
     U8    top      = 0;
@@ -202,11 +206,12 @@ void fmtInvoke(U32 tok) {
         case FMT_STATE_WIDTH_OPT:
             --top;
             if (c == '*') {
-                expect(',');
-                eat();
-                width = exprEatSolvedU16();
+                expect(as, ',');
+                eat(as);
+                width = exprEatSolvedU16(as);
             } else if (isdigit(c)) {
-                i += scanDigits((SmView){fmt.view.bytes + i, fmt.view.len - i},
+                i += scanDigits(as,
+                                (SmView){fmt.view.bytes + i, fmt.view.len - i},
                                 &width) -
                      1;
             } else {
@@ -224,11 +229,12 @@ void fmtInvoke(U32 tok) {
         case FMT_STATE_PREC_OPT:
             --top;
             if (c == '*') {
-                expect(',');
-                eat();
-                prec = exprEatSolvedU16();
+                expect(as, ',');
+                eat(as);
+                prec = exprEatSolvedU16(as);
             } else if (isdigit(c)) {
-                i += scanDigits((SmView){fmt.view.bytes + i, fmt.view.len - i},
+                i += scanDigits(as,
+                                (SmView){fmt.view.bytes + i, fmt.view.len - i},
                                 &width) -
                      1;
             } else {
@@ -238,43 +244,43 @@ void fmtInvoke(U32 tok) {
         case FMT_STATE_SPEC: {
             --top;
             SmPos expr_pos;
-            expect(',');
-            eat();
+            expect(as, ',');
+            eat(as);
             switch (c) {
             case 'c': {
-                U32 c = exprEatSolvedPos(&expr_pos);
+                U32 c = exprEatSolvedPos(as, &expr_pos);
                 smUtf8Cat(&buf, c);
                 break;
             }
             case 'b':
-                fmtUInt(&buf, exprEatSolvedPos(&expr_pos), 2, flags, width,
+                fmtUInt(&buf, exprEatSolvedPos(as, &expr_pos), 2, flags, width,
                         prec, false);
                 break;
             case 'd':
             case 'i':
-                fmtInt(&buf, exprEatSolvedPos(&expr_pos), 10, flags, width,
+                fmtInt(&buf, exprEatSolvedPos(as, &expr_pos), 10, flags, width,
                        prec);
                 break;
             case 'u':
-                fmtUInt(&buf, exprEatSolvedPos(&expr_pos), 10, flags, width,
+                fmtUInt(&buf, exprEatSolvedPos(as, &expr_pos), 10, flags, width,
                         prec, false);
                 break;
             case 'X':
                 flags |= FMT_FLAG_UPPERCASE;
                 // fall through
             case 'x':
-                fmtUInt(&buf, exprEatSolvedPos(&expr_pos), 16, flags, width,
+                fmtUInt(&buf, exprEatSolvedPos(as, &expr_pos), 16, flags, width,
                         prec, false);
                 break;
             case 's':
-                if ((peek() != SM_TOK_STR) && (peek() != SM_TOK_ID)) {
-                    fatal("expected string or identifier\n");
+                if ((peek(as) != SM_TOK_STR) && (peek(as) != SM_TOK_ID)) {
+                    fatal(as, "expected string or identifier\n");
                 }
-                fmtStr(&buf, tokView(), flags, width, prec);
-                eat();
+                fmtStr(&buf, tokView(as), flags, width, prec);
+                eat(as);
                 break;
             default:
-                fatalPos(pos, "unrecognized format conversion: %c\n", c);
+                fatalPos(as, pos, "unrecognized format conversion: %c\n", c);
             }
             break;
         }
@@ -283,20 +289,21 @@ void fmtInvoke(U32 tok) {
         }
     }
     if (braced) {
-        expect('}');
-        eat();
+        expect(as, '}');
+        eat(as);
     }
     if (fmt.view.bytes) {
         free(fmt.view.bytes);
     }
-    ++ts;
-    if (ts >= (STACK + STACK_SIZE)) {
+    ++as->ts;
+    if (as->ts >= (as->stack + STACK_SIZE)) {
         smFatal("too many open files\n");
     }
     switch (tok) {
     case SM_TOK_STR:
     case SM_TOK_ID:
-        smTokStreamFmtInit(ts, pos, intern(buf.view), tok);
+        smTokStreamFmtInit(as->ts, &as->positions, pos, intern(as, buf.view),
+                           tok);
         return;
     default:
         SM_UNREACHABLE();
@@ -1,8 +1,8 @@
 #ifndef FMT_H
 #define FMT_H
 
-#include <smasm/tok.h>
+#include "state.h"
 
-void fmtInvoke(U32 tok);
+void fmtInvoke(Asm *as, U32 tok);
 
 #endif // FMT_H
@@ -3,15 +3,17 @@
 #include "expr.h"
 #include "state.h"
 
-void ifInvoke() {
-    SmPos pos = tokPos();
-    eat();
-    streamdef          = true;
-    Bool        ignore = (exprEatSolvedPos(&pos) == 0);
+void ifInvoke(Asm *as) {
+    SmPos pos = tokPos(as);
+    eat(as);
+    as->streamdef      = true;
+    UInt        owner  = definedIfBegin(as);
+    Bool        ignore = (exprEatSolvedPos(as, &pos) == 0);
     UInt        depth  = 0;
     SmPosTokBuf buf    = {};
+    definedIfEnd(as);
     while (true) {
-        switch (peek()) {
+        switch (peek(as)) {
         case SM_TOK_IF:
         case SM_TOK_MACRO:
         case SM_TOK_REPEAT:
@@ -21,53 +23,55 @@ void ifInvoke() {
             break;
         case SM_TOK_END:
             if (depth == 0) {
-                eat();
+                eat(as);
                 goto ifdone;
             }
             --depth;
             break;
         case SM_TOK_ELSE:
             if (depth == 0) {
-                eat();
+                eat(as);
                 ignore = !ignore;
             }
             break;
         default:
             break;
         }
-        switch (peek()) {
+        switch (peek(as)) {
         case SM_TOK_EOF:
-            fatal("unexpected end of file\n");
+            fatal(as, "unexpected end of file\n");
         case SM_TOK_ID:
         case SM_TOK_STR:
             if (!ignore) {
-                smPosTokBufAdd(&buf, (SmPosTok){.tok  = peek(),
-                                                .pos  = tokPos(),
-                                                .view = intern(tokView())});
+                smPosTokBufAdd(&buf,
+                               (SmPosTok){.tok  = peek(as),
+                                          .pos  = tokPos(as),
+                                          .view = intern(as, tokView(as))});
             }
             break;
         case SM_TOK_NUM:
         case SM_TOK_ARG:
             if (!ignore) {
-                smPosTokBufAdd(&buf, (SmPosTok){.tok = peek(),
-                                                .pos = tokPos(),
-                                                .num = tokNum()});
+                smPosTokBufAdd(&buf, (SmPosTok){.tok = peek(as),
+                                                .pos = tokPos(as),
+                                                .num = tokNum(as)});
             }
             break;
         default:
             if (!ignore) {
                 smPosTokBufAdd(&buf,
-                               (SmPosTok){.tok = peek(), .pos = tokPos()});
+                               (SmPosTok){.tok = peek(as), .pos = tokPos(as)});
             }
             break;
         }
-        eat();
+        eat(as);
     }
 ifdone:
-    streamdef = false;
-    ++ts;
-    if (ts >= (STACK + STACK_SIZE)) {
+    as->streamdef = false;
+    ++as->ts;
+    if (as->ts >= (as->stack + STACK_SIZE)) {
         smFatal("too many open files\n");
     }
-    smTokStreamIfElseInit(ts, pos, buf);
+    smTokStreamIfElseInit(as->ts, &as->positions, pos, buf);
+    definedIfPush(as, owner);
 }
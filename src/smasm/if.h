@@ -1,6 +1,8 @@
 #ifndef IF_H
 #define IF_H
 
-void ifInvoke();
+#include "state.h"
+
+void ifInvoke(Asm *as);
 
 #endif // IF_H
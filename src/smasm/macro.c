@@ -2,55 +2,47 @@
 #include "state.h"
 
 #include <smasm/fatal.h>
-#include <smasm/tab.h>
+#include <smasm/map.h>
 
 #include <stdlib.h>
 #include <string.h>
 
-SM_TAB_WHENCE_IMPL(MacroTab, Macro);
-SM_TAB_TRYGROW_IMPL(MacroTab, Macro);
-
-static MacroTab MACS = {};
-
-static void noop(Macro *entry) { (void)entry; }
-
-void macroTabFini() {
-    MacroTab *tab = &MACS;
-    SM_TAB_FINI_IMPL(noop);
+void macroTabFini(Asm *as) {
+    smMacroTokInternFini(&as->mtoks);
+    smMapFini(&as->macs);
 }
 
-Macro *macroFind(SmView name) {
-    MacroTab *tab = &MACS;
-    SM_TAB_FIND_IMPL(MacroTab, Macro);
-}
+Macro *macroFind(Asm *as, SmView name) { return smMapFind(&as->macs, name); }
 
-static SmMacroTokIntern MTOKS = {};
-
-static Macro *add(Macro entry) {
-    MacroTab *tab = &MACS;
-    SM_TAB_ADD_IMPL(MacroTab, Macro);
+static Macro *add(Asm *as, Macro entry) {
+    return smMapAdd(&as->macs, &entry, sizeof(Macro));
 }
 
-void macroAdd(SmView name, SmPos pos, SmMacroTokView view) {
-    add((Macro){
+void macroAdd(Asm *as, SmView name, SmPos pos, SmMacroTokView view) {
+    add(as, (Macro){
         name,
         pos,
-        smMacroTokIntern(&MTOKS, view),
+        smMacroTokIntern(&as->mtoks, view),
     });
 }
 
-void macroInvoke(Macro macro) {
-    SmPos pos = tokPos();
-    eat();
+static void addTok(Asm *as, SmMacroTokBuf *toks, SmMacroTok tok) {
+    smMacroTokBufArenaAdd(toks, &as->pass, tok);
+}
+
+void macroInvoke(Asm *as, Macro macro) {
+    SmPos pos = tokPos(as);
+    eat(as);
+    SmArenaMark     mark  = smArenaMark(&as->pass);
     SmMacroArgQueue args  = {};
     SmMacroTokBuf   toks  = {};
     UInt            depth = 0;
-    if (peek() == '{') {
-        eat();
+    if (peek(as) == '{') {
+        eat(as);
         ++depth;
     }
     while (true) {
-        switch (peek()) {
+        switch (peek(as)) {
         case '\n':
         case SM_TOK_EOF:
             if (depth == 0) {
@@ -58,53 +50,54 @@ void macroInvoke(Macro macro) {
             }
             break;
         case SM_TOK_ID:
-            smMacroTokBufAdd(&toks, (SmMacroTok){.kind = SM_MACRO_TOK_ID,
-                                                 .pos  = tokPos(),
-                                                 .view = intern(tokView())});
+            addTok(as, &toks, (SmMacroTok){.kind = SM_MACRO_TOK_ID,
+                                           .pos  = tokPos(as),
+                                           .view = intern(as, tokView(as))});
             break;
         case SM_TOK_NUM:
-            smMacroTokBufAdd(&toks, (SmMacroTok){.kind = SM_MACRO_TOK_NUM,
-                                                 .pos  = tokPos(),
-                                                 .num  = tokNum()});
+            addTok(as, &toks, (SmMacroTok){.kind = SM_MACRO_TOK_NUM,
+                                           .pos  = tokPos(as),
+                                           .num  = tokNum(as)});
             break;
         case SM_TOK_STR:
-            smMacroTokBufAdd(&toks, (SmMacroTok){.kind = SM_MACRO_TOK_STR,
-                                                 .pos  = tokPos(),
-                                                 .view = intern(tokView())});
+            addTok(as, &toks, (SmMacroTok){.kind = SM_MACRO_TOK_STR,
+                                           .pos  = tokPos(as),
+                                           .view = intern(as, tokView(as))});
             break;
         default:
             if (depth > 0) {
-                if (peek() == '{') {
+                if (peek(as) == '{') {
                     ++depth;
-                } else if (peek() == '}') {
+                } else if (peek(as) == '}') {
                     --depth;
                     if (depth == 0) {
-                        eat();
+                        eat(as);
                         goto flush;
                     }
                 }
             }
-            smMacroTokBufAdd(&toks, (SmMacroTok){.kind = SM_MACRO_TOK_TOK,
-                                                 .pos  = tokPos(),
-                                                 .tok  = peek()});
+            addTok(as, &toks, (SmMacroTok){.kind = SM_MACRO_TOK_TOK,
+                                           .pos  = tokPos(as),
+                                           .tok  = peek(as)});
             break;
         }
-        eat();
-        if (peek() == ',') {
-            eat();
-            smMacroArgEnqueue(&args, smMacroTokIntern(&MTOKS, toks.view));
+        eat(as);
+        if (peek(as) == ',') {
+            eat(as);
+            smMacroArgEnqueue(&args, smMacroTokIntern(&as->mtoks, toks.view));
             toks.view.len = 0;
         }
     }
 flush:
     if (toks.view.len > 0) {
-        smMacroArgEnqueue(&args, smMacroTokIntern(&MTOKS, toks.view));
+        smMacroArgEnqueue(&args, smMacroTokIntern(&as->mtoks, toks.view));
     }
-    smMacroTokBufFini(&toks);
-    ++ts;
-    if (ts >= (STACK + STACK_SIZE)) {
+    smArenaRelease(&as->pass, mark);
+    ++as->ts;
+    if (as->ts >= (as->stack + STACK_SIZE)) {
         smFatal("too many open files\n");
     }
-    ++nonce;
-    smTokStreamMacroInit(ts, macro.name, pos, macro.view, args, nonce);
+    ++as->nonce;
+    smTokStreamMacroInit(as->ts, &as->positions, macro.name, pos, macro.view,
+                         args, as->nonce);
 }
@@ -1,7 +1,7 @@
 #ifndef MACRO_H
 #define MACRO_H
 
-#include <smasm/tok.h>
+#include "state.h"
 
 typedef struct {
     SmView         name;
@@ -9,16 +9,10 @@ typedef struct {
     SmMacroTokView view;
 } Macro;
 
-typedef struct {
-    Macro *entries;
-    UInt   len;
-    UInt   cap;
-} MacroTab;
-
-void   macroTabFini();
-Macro *macroFind(SmView name);
-void   macroAdd(SmView name, SmPos pos, SmMacroTokView view);
+void   macroTabFini(Asm *as);
+Macro *macroFind(Asm *as, SmView name);
+void   macroAdd(Asm *as, SmView name, SmPos pos, SmMacroTokView view);
 
-void macroInvoke(Macro macro);
+void macroInvoke(Asm *as, Macro macro);
 
 #endif // MACRO_H
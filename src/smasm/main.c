@@ -2,64 +2,125 @@
 #include "fmt.h"
 #include "macro.h"
 #include "mne.h"
+#include "serve.h"
 #include "state.h"
 #include "struct.h"
 
 #include <smasm/fatal.h>
+#include <smasm/map.h>
 #include <smasm/serde.h>
 
 #include <assert.h>
 #include <errno.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 static void help(char const *name) {
     fprintf(stderr,
             "SMASM: An assembler for the SM83 (Gameboy) CPU\n"
             "\n"
-            "Usage: %s [OPTIONS] <SOURCE>\n"
+            "Usage: %s [OPTIONS] <SOURCE>...\n"
             "\n"
             "Arguments:\n"
-            "  <SOURCE>  Assembly source file\n"
+            "  <SOURCE>  Assembly source file, several are each assembled "
+            "into <SOURCE>.o\n"
             "\n"
             "Options:\n"
             "  -o, --output <OUTPUT>        Output file (default: stdout)\n"
             "  -D, --define <KEY1=val>      Pre-defined symbols (repeatable)\n"
             "  -I, --include <INCLUDE>      Search directories for included "
             "files (repeatable)\n"
+            "  -j, --jobs <N>               Assemble up to N sources at once "
+            "(default: 1)\n"
             "  -MD                          Output Makefile dependencies\n"
             "  -MF <DEPFILE>                Make dependencies file (default: "
             "<SOURCE>.d)\n"
+            "      --blob-refs <BYTES>      Leave @incbin files of at least "
+            "BYTES for the linker to copy\n"
+            "      --stats                  Print allocator statistics\n"
+            "      --serve <SOCKET>         Serve runs of smasm on a Unix "
+            "socket (must come first)\n"
+            "      --connect <SOCKET>       Have the server at SOCKET do this "
+            "run (must come first)\n"
             "  -h, --help                   Print help\n",
             name);
 }
 
-static SmExprView constExprBuf(I32 num);
+static SmExprView constExprBuf(Asm *as, I32 num);
 static FILE      *openFileCstr(char const *name, char const *modes);
 static void       closeFile(FILE *hnd);
-static void       pushFile(SmView path);
-static void       pass();
-static void       rewindPass();
-static void       writeDepend();
-static void       serialize();
-
-static FILE *infile       = NULL;
-static char *infile_name  = NULL;
-static FILE *outfile      = NULL;
-static char *outfile_name = NULL;
-static char *depfile_name = NULL;
-static Bool  makedepend   = false;
+static FILE      *openTemp(SmBuf *temp, SmView name);
+static void       commitTemp(FILE *hnd, SmBuf *temp, char const *name);
+static void       dropTemp(FILE **hnd, SmBuf *temp);
+static void       pushFile(Asm *as, SmView path);
+static SmView     loadBlob(Asm *as, SmView path);
+static void       pass(Asm *as);
+static void       resolveFixups(Asm *as);
+static void       writeDepend(Asm *as);
+static void       serialize(Asm *as);
+static void      *worker(void *arg);
+static void      *spawned(void *arg);
+static void       assemble(Asm *as, char const *name);
+static void       unitFini(Asm *as);
+static void       catBaseName(SmBuf *buf, char const *path);
+
+// options, shared by every unit
+static char     *output       = NULL;
+static char     *depfile_name = NULL;
+static Bool      makedepend   = false;
+static Bool      stats        = false;
+static UInt      blob_refs    = 0;
+static UInt      jobs         = 1;
+static SmViewBuf DEFINES      = {};
+static SmViewBuf UNITS        = {};
+
+// the index of the next unit to be picked up by a worker, and whether one of
+// them failed
+static _Atomic UInt next_unit = 0;
+static _Atomic Bool failed    = false;
+// numbers the temporary files of the process
+static _Atomic UInt next_temp = 0;
 
 int main(int argc, char **argv) {
-    outfile = stdout;
     if (argc == 1) {
         help(argv[0]);
         return EXIT_SUCCESS;
     }
-    DEFINES_SECTION = intern(SM_VIEW("@DEFINES"));
-    CODE_SECTION    = intern(SM_VIEW("CODE"));
-    STATIC_UNIT     = intern(SM_VIEW("@STATIC"));
-    EXPORT_UNIT     = intern(SM_VIEW("@EXPORT"));
+    if (!strcmp(argv[1], "--serve")) {
+        if (argc != 3) {
+            smFatal("expected socket path\n");
+        }
+        return serve(argv[2]);
+    }
+    if (!strcmp(argv[1], "--connect")) {
+        if (argc < 3) {
+            smFatal("expected socket path\n");
+        }
+        return serveConnect(argv[2], argc, argv);
+    }
+    return run(argc, argv);
+}
+
+int run(int argc, char **argv) {
+    output       = NULL;
+    depfile_name = NULL;
+    makedepend   = false;
+    stats        = false;
+    blob_refs    = 0;
+    jobs         = 1;
+    next_unit    = 0;
+    failed       = false;
+    smViewBufFini(&DEFINES);
+    smViewBufFini(&UNITS);
+    smPathSetFini(&IPATHS);
+    if (argc == 1) {
+        help(argv[0]);
+        return EXIT_SUCCESS;
+    }
     for (int argi = 1; argi < argc; ++argi) {
         if ((strcmp(argv[argi], "-h") == 0) ||
             (strcmp(argv[argi], "--help") == 0)) {
@@ -72,7 +133,7 @@ int main(int argc, char **argv) {
             if (argi == argc) {
                 smFatal("expected file name\n");
             }
-            outfile_name = argv[argi];
+            output = argv[argi];
             continue;
         }
         if (!strcmp(argv[argi], "-D") || !strcmp(argv[argi], "--define")) {
@@ -80,26 +141,11 @@ int main(int argc, char **argv) {
             if (argi == argc) {
                 smFatal("expected symbol definition\n");
             }
-            char const *offset = strchr(argv[argi], '=');
-            if (!offset) {
+            if (!strchr(argv[argi], '=')) {
                 smFatal("expected `=` in %s\n", argv[argi]);
             }
-            UInt   name_len  = offset - argv[argi];
-            SmView name      = intern((SmView){(U8 *)argv[argi], name_len});
-            UInt   value_len = strlen(argv[argi]) - name_len - 1;
-            // TODO: should expose general-purpose expression parsing
-            // for use here and for expressions in the linker scripts
-            // Could even use a tok stream here.
-            UInt   num       = smViewParse(
-                (SmView){(U8 *)(argv[argi] + name_len + 1), value_len});
-            smSymTabAdd(&SYMS, (SmSym){
-                                   .lbl     = lblGlobal(name),
-                                   .value   = constExprBuf(num),
-                                   .unit    = STATIC_UNIT,
-                                   .section = DEFINES_SECTION,
-                                   .pos     = {DEFINES_SECTION, 1, 1},
-                                   .flags   = SM_SYM_EQU,
-                               });
+            smViewBufAdd(&DEFINES,
+                         (SmView){(U8 *)argv[argi], strlen(argv[argi])});
             continue;
         }
         if (!strcmp(argv[argi], "-I") || !strcmp(argv[argi], "--include")) {
@@ -111,10 +157,34 @@ int main(int argc, char **argv) {
                          (SmView){(U8 *)argv[argi], strlen(argv[argi])});
             continue;
         }
+        if (!strcmp(argv[argi], "-j") || !strcmp(argv[argi], "--jobs")) {
+            ++argi;
+            if (argi == argc) {
+                smFatal("expected number of jobs\n");
+            }
+            jobs = smViewParse((SmView){(U8 *)argv[argi], strlen(argv[argi])});
+            if (jobs == 0) {
+                smFatal("expected at least one job\n");
+            }
+            continue;
+        }
         if (!strcmp(argv[argi], "-MD")) {
             makedepend = true;
             continue;
         }
+        if (!strcmp(argv[argi], "--stats")) {
+            stats = true;
+            continue;
+        }
+        if (!strcmp(argv[argi], "--blob-refs")) {
+            ++argi;
+            if (argi == argc) {
+                smFatal("expected size\n");
+            }
+            blob_refs =
+                smViewParse((SmView){(U8 *)argv[argi], strlen(argv[argi])});
+            continue;
+        }
         if (!strcmp(argv[argi], "-MF")) {
             ++argi;
             if (argi == argc) {
@@ -123,87 +193,420 @@ int main(int argc, char **argv) {
             depfile_name = argv[argi];
             continue;
         }
-        infile      = openFileCstr(argv[argi], "rb");
-        infile_name = argv[argi];
-        ++argi;
-        if (argi != argc) {
-            smFatal("unexpected option: %s\n", argv[argi]);
+        smViewBufAdd(&UNITS, (SmView){(U8 *)argv[argi], strlen(argv[argi])});
+    }
+    if (UNITS.view.len == 0) {
+        smFatal("expected source file\n");
+    }
+    if ((UNITS.view.len > 1) && output) {
+        smFatal("-o cannot be used with several sources\n");
+    }
+    if ((UNITS.view.len > 1) && depfile_name) {
+        smFatal("-MF cannot be used with several sources\n");
+    }
+
+    // workers take the next unit until there are none left, the main thread
+    // being one of them
+    UInt      nthreads = uIntMin(jobs, UNITS.view.len) - 1;
+    pthread_t threads[nthreads + 1];
+    for (UInt i = 0; i < nthreads; ++i) {
+        // the units are shared out among however many threads did start
+        if (pthread_create(threads + i, NULL, spawned, NULL)) {
+            nthreads = i;
+            break;
         }
     }
+    worker(NULL);
+    for (UInt i = 0; i < nthreads; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
 
-    pushFile(
-        smPathIntern(&STRS, (SmView){(U8 *)infile_name, strlen(infile_name)}));
-    pass();
-    rewindPass();
-    pass();
-    popStream();
+// Every worker assembles its units with an Asm of its own. An error only
+// ends the unit it happened in, the other workers finish theirs and then take
+// no more.
+static void *worker(void *arg) {
+    (void)arg;
+    Asm *as = calloc(1, sizeof(Asm));
+    if (!as) {
+        smFatal("out of memory\n");
+    }
+    jmp_buf  fail;
+    jmp_buf *outer = smFatalJmp;
+    smFatalJmp     = &fail;
+    if (setjmp(fail)) {
+        // the error was reported, drop what is left of the unit
+        dropTemp(&as->outfile, &as->outfile_temp);
+        dropTemp(&as->depfile, &as->depfile_temp);
+        unitFini(as);
+        free(as);
+        failed     = true;
+        smFatalJmp = outer;
+        return NULL;
+    }
+    while (!failed) {
+        UInt idx = next_unit++;
+        if (idx >= UNITS.view.len) {
+            break;
+        }
+        assemble(as, (char const *)UNITS.view.items[idx].bytes);
+    }
+    free(as);
+    smFatalJmp = outer;
+    return NULL;
+}
+
+// A thread started for the run frees what libsmasm keeps for it before it
+// exits, or a server would lose some with every run
+static void *spawned(void *arg) {
+    worker(arg);
+    smPathCacheFini();
+    smDeserializeFini();
+    smLblFullNameFini();
+    smTokNamesFini();
+    return NULL;
+}
+
+static void define(Asm *as, SmView def, SmPos pos) {
+    U8    *offset    = memchr(def.bytes, '=', def.len);
+    UInt   name_len  = offset - def.bytes;
+    SmAtom name      = atom(as, (SmView){def.bytes, name_len});
+    // TODO: should expose general-purpose expression parsing
+    // for use here and for expressions in the linker scripts
+    // Could even use a tok stream here.
+    UInt   num       = smViewParse(
+        (SmView){def.bytes + name_len + 1, def.len - name_len - 1});
+    smSymTabAdd(&as->syms, (SmSym){
+                               .lbl     = lblGlobal(name),
+                               .value   = constExprBuf(as, num),
+                               .unit    = as->static_unit,
+                               .section = atom(as, as->defines_section),
+                               .pos     = pos,
+                               .flags   = SM_SYM_EQU,
+                           });
+}
 
-    if (outfile_name) {
-        outfile = openFileCstr(outfile_name, "wb+");
+// A lone source goes to -o or stdout, several go next to their sources
+static void nameOutput(Asm *as) {
+    SmBuf *buf = &as->output_buf;
+    if (UNITS.view.len > 1) {
+        buf->view.len = 0;
+        catBaseName(buf, as->infile_name);
+        smBufCat(buf, SM_VIEW(".o\0"));
+        as->outfile_name = (char const *)buf->view.bytes;
+    } else if (output) {
+        as->outfile_name = output;
     } else {
-        outfile_name = "stdout";
+        as->outfile_name = NULL;
     }
+}
 
-    if (makedepend) {
-        writeDepend();
+static void assemble(Asm *as, char const *name) {
+    as->infile_name = name;
+    stateInit(as);
+    SmPos defines = smPosLineCol(
+        smPosTabAddName(&as->positions, as->defines_section), 1, 1);
+    for (UInt i = 0; i < DEFINES.view.len; ++i) {
+        define(as, DEFINES.view.items[i], defines);
     }
 
-    serialize();
-    closeFile(outfile);
-    return EXIT_SUCCESS;
-}
+    SmView root = smPathIntern(
+        &as->strs, (SmView){(U8 *)as->infile_name, strlen(as->infile_name)});
+    pushFile(as, root);
+    pass(as);
+    resolveFixups(as);
+    popStream(as);
 
-static void rewindPass() {
-    smTokStreamRewind(ts);
-    sectRewind();
-    macroTabFini();
-    smPathSetFini(&INCS);
-    scope     = SM_VIEW_NULL;
-    nonce     = 0;
-    emit      = true;
-    streamdef = false;
+    nameOutput(as);
+    if (makedepend) {
+        writeDepend(as);
+    }
+    if (as->outfile_name) {
+        as->outfile = openTemp(
+            &as->outfile_temp,
+            (SmView){(U8 *)as->outfile_name, strlen(as->outfile_name)});
+        serialize(as);
+        FILE *hnd   = as->outfile;
+        as->outfile = NULL;
+        commitTemp(hnd, &as->outfile_temp, as->outfile_name);
+    } else {
+        as->outfile_name = "stdout";
+        as->outfile      = stdout;
+        serialize(as);
+        // stdout stays open for the next unit
+        as->outfile = NULL;
+        if (fflush(stdout) == EOF) {
+            smFatal("failed to write file: %s\n", strerror(errno));
+        }
+    }
+    if (stats) {
+        flockfile(stderr);
+        if (UNITS.view.len > 1) {
+            fprintf(stderr, "%s:\n", as->infile_name);
+        }
+        fprintf(stderr,
+                "arena: %" UINT_FMT " allocations, %" UINT_FMT
+                " mallocs avoided\n",
+                as->pass.allocs, smArenaMallocsAvoided(&as->pass));
+        fprintf(stderr,
+                "include lookups: %" UINT_FMT " hits, %" UINT_FMT " misses\n",
+                as->include_hits, as->includes.len);
+        fprintf(stderr,
+                "source reads: %" UINT_FMT " hits, %" UINT_FMT " misses\n",
+                as->source_hits, as->source_misses);
+        fprintf(stderr, "token records: %" UINT_FMT " from other units\n",
+                as->record_hits);
+        funlockfile(stderr);
+    }
+    unitFini(as);
 }
 
-static void expectEOL() {
-    switch (peek()) {
+static void expectEOL(Asm *as) {
+    switch (peek(as)) {
     case SM_TOK_EOF:
     case '\n':
         return;
     default:
-        fatal("expected end of line\n");
+        fatal(as, "expected end of line\n");
     }
 }
 
-static void expectReprU8(SmPos pos, I32 num) {
+static void expectReprU8(Asm *as, SmPos pos, I32 num) {
     if (!exprCanReprU8(num)) {
-        fatalPos(pos, "expression does not fit in byte: $%08" U32_FMTX "\n",
+        fatalPos(as, pos, "expression does not fit in byte: $%08" U32_FMTX "\n",
                  (U32)num);
     }
 }
 
-static void expectReprU16(SmPos pos, I32 num) {
+static void expectReprU16(Asm *as, SmPos pos, I32 num) {
     if (!exprCanReprU16(num)) {
-        fatalPos(pos, "expression does not fit in word: $%08" U32_FMTX "\n",
+        fatalPos(as, pos, "expression does not fit in word: $%08" U32_FMTX "\n",
                  (U32)num);
     }
 }
 
-static void emitView(SmView view) { smBufCat(&sectGet()->data, view); }
-static void emit8(U8 byte) { emitView((SmView){&byte, 1}); }
-static void emit16(U16 word) {
-    U8 bytes[2] = {word & 0x00FF, word >> 8};
-    emitView((SmView){bytes, 2});
+// Hands out `len` bytes at the end of the current section to write directly.
+// Callers that know how much they are about to emit should emitReserve first
+// so the section grows at most once per instruction or directive.
+static U8 *emitCursor(Asm *as, UInt len) {
+    SmBuf *data = &sectGet(as)->data;
+    smBufReserve(data, len);
+    U8 *cursor = data->view.bytes + data->view.len;
+    data->view.len += len;
+    return cursor;
 }
 
-static void reloc(U16 offset, U8 width, SmExprView view, SmPos pos, U8 flags) {
-    smRelocBufAdd(&sectGet()->relocs, (SmReloc){
-                                          .offset = getPC() + offset,
-                                          .width  = width,
-                                          .value  = view,
-                                          .unit   = STATIC_UNIT,
-                                          .pos    = pos,
-                                          .flags  = flags,
-                                      });
+static void emitReserve(Asm *as, UInt len) {
+    smBufReserve(&sectGet(as)->data, len);
+}
+
+static void emitView(Asm *as, SmView view) {
+    memcpy(emitCursor(as, view.len), view.bytes, view.len);
+}
+
+static void emit8(Asm *as, U8 byte) { *emitCursor(as, 1) = byte; }
+
+static void emit16(Asm *as, U16 word) {
+    U8 *cursor = emitCursor(as, 2);
+    cursor[0]  = word & 0x00FF;
+    cursor[1]  = word >> 8;
+}
+
+static U8 branchOffset(Asm *as, SmPos pos, I32 num, U16 pc) {
+    I32 offset = num - ((I32)(U32)pc) - 2;
+    if (!exprCanReprI8(offset)) {
+        fatalPos(as, pos, "branch distance too far\n");
+    }
+    return offset;
+}
+
+static U8 bitNum(Asm *as, SmPos pos, I32 num) {
+    if ((num < 0) || (num > 7)) {
+        fatalPos(as, pos, "bit number must be between 0 and 7\n");
+    }
+    return num;
+}
+
+static U8 hramOffset(Asm *as, SmPos pos, I32 num) {
+    if ((num < 0xFF00) || (num > 0xFFFF)) {
+        fatalPos(as, pos, "address not in high memory: $%08" U32_FMTX "\n",
+                 (U32)num);
+    }
+    return num & 0x00FF;
+}
+
+static U8 rstOp(Asm *as, SmPos pos, I32 num) {
+    switch (num) {
+    case 0x00:
+    case 0x08:
+    case 0x10:
+    case 0x18:
+    case 0x20:
+    case 0x28:
+    case 0x30:
+    case 0x38:
+        return 0xC7 + num;
+    default:
+        fatalPos(as, pos, "illegal reset vector: $%08" U32_FMTX "\n", (U32)num);
+    }
+}
+
+static void fixupBufAdd(FixupBuf *buf, Fixup item) { SM_BUF_ADD_IMPL(); }
+
+static void fixupBufFini(FixupBuf *buf) { SM_BUF_FINI_IMPL(); }
+
+// Operands that will never be solved in this unit are left to the linker,
+// unless they had to be solved here
+static void fixupUnsolved(Asm *as, U8 kind, SmPos pos) {
+    switch (kind) {
+    case FIXUP_JR:
+        fatalPos(as, pos, "branch distance must be constant\n");
+    case FIXUP_BIT:
+        fatalPos(as, pos, "expression must be constant\n");
+    default:
+        break;
+    }
+}
+
+// Operands are emitted in a single pass. Those that could not be solved yet
+// only get another try at the end of the unit if they refer to symbols that
+// are not defined yet, which saves assembling everything twice
+static void fixup(Asm *as, U8 kind, U16 offset, U8 width, SmExprView view,
+                  SmPos pos, U8 flags) {
+    Bool later = !exprDefined(as, view);
+    if (!later) {
+        fixupUnsolved(as, kind, pos);
+    }
+    SmSect *sect = sectGet(as);
+    smRelocBufAdd(&sect->relocs, (SmReloc){
+                                     .offset = getPC(as) + offset,
+                                     .width  = width,
+                                     .value  = view,
+                                     .unit   = as->static_unit,
+                                     .pos    = pos,
+                                     .flags  = flags,
+                                 });
+    if (later) {
+        fixupBufAdd(&as->fixups, (Fixup){
+                                     .kind  = kind,
+                                     .sect  = sect - as->sects.view.items,
+                                     .reloc = sect->relocs.view.len - 1,
+                                     .at    = sect->data.view.len - width,
+                                 });
+    }
+}
+
+static void reloc(Asm *as, U16 offset, U8 width, SmExprView view, SmPos pos,
+                  U8 flags) {
+    fixup(as, FIXUP_RELOC, offset, width, view, pos, flags);
+}
+
+static _Noreturn void fatalRedefined(Asm *as, SmPos pos, SmSym const *sym) {
+    SmPosInfo at = posInfo(as, sym->pos);
+    fatalPos(as, pos,
+             "symbol already defined\n\t%" SM_VIEW_FMT ":%" UINT_FMT
+             ":%" UINT_FMT " : defined previously here\n",
+             SM_VIEW_FMT_ARG(at.file), at.line, at.col);
+}
+
+// Constants may refer to each other in any order, so keep defining the ones
+// that can be solved until none are left
+static void resolveEqus(Asm *as) {
+    Bool progress = true;
+    while (progress) {
+        progress  = false;
+        UInt kept = 0;
+        for (UInt i = 0; i < as->equs.view.len; ++i) {
+            Equ *equ = as->equs.view.items + i;
+            I32  num;
+            if (!exprSolve(as, equ->sym.value, &num)) {
+                as->equs.view.items[kept] = *equ;
+                ++kept;
+                continue;
+            }
+            SmSym *sym = smSymTabFind(&as->syms, equ->sym.lbl);
+            if (sym) {
+                fatalRedefined(as, equ->sym.pos, sym);
+            }
+            equ->sym.value = constExprBuf(as, num);
+            smSymTabAdd(&as->syms, equ->sym);
+            progress = true;
+        }
+        as->equs.view.len = kept;
+    }
+    if (as->equs.view.len > 0) {
+        fatalPos(as, as->equs.view.items[0].at,
+                 "expression must be constant\n");
+    }
+}
+
+static void fixupPatch(Asm *as, Fixup const *fix, SmReloc const *reloc,
+                       I32 num) {
+    U8 *bytes = as->sects.view.items[fix->sect].data.view.bytes + fix->at;
+    switch (fix->kind) {
+    case FIXUP_JR:
+        bytes[0] = branchOffset(as, reloc->pos, num, reloc->offset - 1);
+        return;
+    case FIXUP_BIT:
+        bytes[0] += bitNum(as, reloc->pos, num) * 8;
+        return;
+    default:
+        if (reloc->flags & SM_RELOC_RST) {
+            bytes[0] = rstOp(as, reloc->pos, num);
+        } else if (reloc->flags & SM_RELOC_HRAM) {
+            bytes[0] = hramOffset(as, reloc->pos, num);
+        } else if (reloc->width == 1) {
+            expectReprU8(as, reloc->pos, num);
+            bytes[0] = num;
+        } else {
+            expectReprU16(as, reloc->pos, num);
+            bytes[0] = num & 0x00FF;
+            bytes[1] = num >> 8;
+        }
+        return;
+    }
+}
+
+static void resolveFixups(Asm *as) {
+    resolveEqus(as);
+    Bool patched = false;
+    for (UInt i = 0; i < as->fixups.view.len; ++i) {
+        Fixup   *fix   = as->fixups.view.items + i;
+        SmSect  *sect  = as->sects.view.items + fix->sect;
+        SmReloc *reloc = sect->relocs.view.items + fix->reloc;
+        I32      num;
+        Bool     solved;
+        if (fix->kind == FIXUP_JR) {
+            // relative addresses are solved against the current section
+            sectSet(as, sect->name);
+            solved = exprSolveRelative(as, reloc->value, &num);
+        } else {
+            solved = exprSolve(as, reloc->value, &num);
+        }
+        if (!solved) {
+            fixupUnsolved(as, fix->kind, reloc->pos);
+            continue;
+        }
+        fixupPatch(as, fix, reloc, num);
+        // marks the relocation to be dropped
+        reloc->width = 0;
+        patched      = true;
+    }
+    if (!patched) {
+        return;
+    }
+    for (UInt i = 0; i < as->sects.view.len; ++i) {
+        SmRelocView *relocs = &as->sects.view.items[i].relocs.view;
+        UInt         kept   = 0;
+        for (UInt j = 0; j < relocs->len; ++j) {
+            if (relocs->items[j].width != 0) {
+                relocs->items[kept] = relocs->items[j];
+                ++kept;
+            }
+        }
+        relocs->len = kept;
+    }
 }
 
 static Bool loadIndirect(U32 tok, U8 *op) {
@@ -282,39 +685,35 @@ static Bool reg16OffsetSP(U32 tok, U8 base, U8 *op) {
     }
 }
 
-static void loadStoreIncDec(U8 load, U8 store) {
-    eat();
-    switch (peek()) {
+static void loadStoreIncDec(Asm *as, U8 load, U8 store) {
+    eat(as);
+    switch (peek(as)) {
     case 'A':
-        eat();
-        expect(',');
-        eat();
-        expect('[');
-        eat();
-        expect(SM_TOK_HL);
-        eat();
-        expect(']');
-        eat();
-        if (emit) {
-            emit8(load);
-        }
-        addPC(1);
+        eat(as);
+        expect(as, ',');
+        eat(as);
+        expect(as, '[');
+        eat(as);
+        expect(as, SM_TOK_HL);
+        eat(as);
+        expect(as, ']');
+        eat(as);
+        emit8(as, load);
+        addPC(as, 1);
         return;
     default:
-        expect('[');
-        eat();
-        expect(SM_TOK_HL);
-        eat();
-        expect(']');
-        eat();
-        expect(',');
-        eat();
-        expect('A');
-        eat();
-        if (emit) {
-            emit8(store);
-        }
-        addPC(1);
+        expect(as, '[');
+        eat(as);
+        expect(as, SM_TOK_HL);
+        eat(as);
+        expect(as, ']');
+        eat(as);
+        expect(as, ',');
+        eat(as);
+        expect(as, 'A');
+        eat(as);
+        emit8(as, store);
+        addPC(as, 1);
         return;
     }
 }
@@ -338,118 +737,101 @@ static Bool reg16OffsetAF(U32 tok, U8 base, U8 *op) {
     }
 }
 
-static void pushPop(U8 base) {
+static void pushPop(Asm *as, U8 base) {
     U8 op;
-    eat();
-    if (!reg16OffsetAF(peek(), base, &op)) {
-        fatal("illegal operand\n");
+    eat(as);
+    if (!reg16OffsetAF(peek(as), base, &op)) {
+        fatal(as, "illegal operand\n");
     }
-    eat();
-    if (emit) {
-        emit8(op);
-    }
-    addPC(1);
+    eat(as);
+    emit8(as, op);
+    addPC(as, 1);
 }
 
-static void aluReg8(U8 base, U8 imm) {
+static void aluReg8(Asm *as, U8 base, U8 imm) {
     U8         op;
     SmPos      pos;
     SmExprView view;
     I32        num;
-    eat();
-    expect(',');
-    eat();
-    if (reg8Offset(peek(), base, &op)) {
-        eat();
-        if (emit) {
-            emit8(op);
-        }
-        addPC(1);
+    eat(as);
+    expect(as, ',');
+    eat(as);
+    if (reg8Offset(peek(as), base, &op)) {
+        eat(as);
+        emit8(as, op);
+        addPC(as, 1);
         return;
     }
-    if (peek() == '[') {
-        eat();
-        expect(SM_TOK_HL);
-        eat();
-        expect(']');
-        eat();
-        if (emit) {
-            emit8(base + 6);
-        }
-        addPC(1);
+    if (peek(as) == '[') {
+        eat(as);
+        expect(as, SM_TOK_HL);
+        eat(as);
+        expect(as, ']');
+        eat(as);
+        emit8(as, base + 6);
+        addPC(as, 1);
         return;
     }
-    view = exprEatPos(&pos);
-    if (emit) {
-        emit8(imm);
-        if (exprSolve(view, &num)) {
-            expectReprU8(pos, num);
-            emit8(num);
-        } else {
-            emit8(0xFD);
-            reloc(1, 1, view, pos, 0);
-        }
+    view = exprEatPos(as, &pos);
+    emit8(as, imm);
+    if (exprSolve(as, view, &num)) {
+        expectReprU8(as, pos, num);
+        emit8(as, num);
+    } else {
+        emit8(as, 0xFD);
+        reloc(as, 1, 1, view, pos, 0);
     }
-    addPC(2);
+    addPC(as, 2);
 }
 
-static void doAluReg8Cb(U8 base) {
+static void doAluReg8Cb(Asm *as, U8 base) {
     U8 op;
-    eat();
-    if (emit) {
-        emit8(0xCB);
-    }
-    if (reg8Offset(peek(), base, &op)) {
-        eat();
-        if (emit) {
-            emit8(op);
-        }
-        addPC(2);
+    eat(as);
+    emit8(as, 0xCB);
+    if (reg8Offset(peek(as), base, &op)) {
+        eat(as);
+        emit8(as, op);
+        addPC(as, 2);
         return;
     }
-    expect('[');
-    eat();
-    expect(SM_TOK_HL);
-    eat();
-    expect(']');
-    eat();
-    if (emit) {
-        emit8(base + 6);
-    }
-    addPC(2);
+    expect(as, '[');
+    eat(as);
+    expect(as, SM_TOK_HL);
+    eat(as);
+    expect(as, ']');
+    eat(as);
+    emit8(as, base + 6);
+    addPC(as, 2);
 }
 
-static void doBitCb(U8 base) {
+static void doBitCb(Asm *as, U8 base) {
     U8         op;
     SmPos      pos;
     SmExprView view;
     I32        num;
-    eat();
-    view = exprEatPos(&pos);
-    expect(',');
-    eat();
-    if (reg8Offset(peek(), base, &op)) {
-        eat();
+    eat(as);
+    view = exprEatPos(as, &pos);
+    expect(as, ',');
+    eat(as);
+    if (reg8Offset(peek(as), base, &op)) {
+        eat(as);
     } else {
-        expect('[');
-        eat();
-        expect(SM_TOK_HL);
-        eat();
-        expect(']');
-        eat();
+        expect(as, '[');
+        eat(as);
+        expect(as, SM_TOK_HL);
+        eat(as);
+        expect(as, ']');
+        eat(as);
         op = base + 6;
     }
-    if (emit) {
-        emit8(0xCB);
-        if (!exprSolve(view, &num)) {
-            fatalPos(pos, "expression must be constant\n");
-        }
-        if ((num < 0) || (num > 7)) {
-            fatalPos(pos, "bit number must be between 0 and 7\n");
-        }
-        emit8(op + (((U8)num) * 8));
+    emit8(as, 0xCB);
+    if (exprSolve(as, view, &num)) {
+        emit8(as, op + (bitNum(as, pos, num) * 8));
+    } else {
+        emit8(as, op);
+        fixup(as, FIXUP_BIT, 1, 1, view, pos, 0);
     }
-    addPC(2);
+    addPC(as, 2);
 }
 
 static Bool flag(U32 tok, U8 base, U8 *op) {
@@ -471,352 +853,309 @@ static Bool flag(U32 tok, U8 base, U8 *op) {
     }
 }
 
-static void eatMne(U8 mne) {
+static void eatMne(Asm *as, U8 mne) {
     U8         op;
     SmPos      pos;
     SmExprView view;
     I32        num;
     switch (mne) {
     case MNE_LD:
-        eat();
-        switch (peek()) {
+        eat(as);
+        switch (peek(as)) {
         case 'A':
-            eat();
-            expect(',');
-            eat();
-            switch (peek()) {
+            eat(as);
+            expect(as, ',');
+            eat(as);
+            switch (peek(as)) {
             case '[':
-                eat();
-                if (loadIndirect(peek(), &op)) {
-                    eat();
-                    expect(']');
-                    eat();
-                    if (emit) {
-                        emit8(op);
-                    }
-                    addPC(1);
+                eat(as);
+                if (loadIndirect(peek(as), &op)) {
+                    eat(as);
+                    expect(as, ']');
+                    eat(as);
+                    emit8(as, op);
+                    addPC(as, 1);
                     return;
                 }
-                view = exprEatPos(&pos);
-                expect(']');
-                eat();
-                if (emit) {
-                    emit8(0xFA);
-                    if (exprSolve(view, &num)) {
-                        expectReprU16(pos, num);
-                        emit16(num);
-                    } else {
-                        emit16(0xFDFD);
-                        reloc(1, 2, view, pos, 0);
-                    }
+                view = exprEatPos(as, &pos);
+                expect(as, ']');
+                eat(as);
+                emit8(as, 0xFA);
+                if (exprSolve(as, view, &num)) {
+                    expectReprU16(as, pos, num);
+                    emit16(as, num);
+                } else {
+                    emit16(as, 0xFDFD);
+                    reloc(as, 1, 2, view, pos, 0);
                 }
-                addPC(3);
+                addPC(as, 3);
                 return;
             default:
-                if (reg8Offset(peek(), 0x78, &op)) {
-                    eat();
-                    if (emit) {
-                        emit8(op);
-                    }
-                    addPC(1);
+                if (reg8Offset(peek(as), 0x78, &op)) {
+                    eat(as);
+                    emit8(as, op);
+                    addPC(as, 1);
                     return;
                 }
-                view = exprEatPos(&pos);
-                if (emit) {
-                    emit8(0x3E);
-                    if (exprSolve(view, &num)) {
-                        expectReprU8(pos, num);
-                        emit8(num);
-                    } else {
-                        emit8(0xFD);
-                        reloc(1, 1, view, pos, 0);
-                    }
+                view = exprEatPos(as, &pos);
+                emit8(as, 0x3E);
+                if (exprSolve(as, view, &num)) {
+                    expectReprU8(as, pos, num);
+                    emit8(as, num);
+                } else {
+                    emit8(as, 0xFD);
+                    reloc(as, 1, 1, view, pos, 0);
                 }
-                addPC(2);
+                addPC(as, 2);
                 return;
             }
         case 'B':
-            aluReg8(0x40, 0x06);
+            aluReg8(as, 0x40, 0x06);
             return;
         case 'C':
-            aluReg8(0x48, 0x0E);
+            aluReg8(as, 0x48, 0x0E);
             return;
         case 'D':
-            aluReg8(0x50, 0x16);
+            aluReg8(as, 0x50, 0x16);
             return;
         case 'E':
-            aluReg8(0x58, 0x1E);
+            aluReg8(as, 0x58, 0x1E);
             return;
         case 'H':
-            aluReg8(0x60, 0x26);
+            aluReg8(as, 0x60, 0x26);
             return;
         case 'L':
-            aluReg8(0x68, 0x2E);
+            aluReg8(as, 0x68, 0x2E);
             return;
         case '[':
-            eat();
-            if (storeIndirect(peek(), &op)) {
-                eat();
-                expect(']');
-                eat();
-                expect(',');
-                eat();
-                expect('A');
-                eat();
-                if (emit) {
-                    emit8(op);
-                }
-                addPC(1);
+            eat(as);
+            if (storeIndirect(peek(as), &op)) {
+                eat(as);
+                expect(as, ']');
+                eat(as);
+                expect(as, ',');
+                eat(as);
+                expect(as, 'A');
+                eat(as);
+                emit8(as, op);
+                addPC(as, 1);
                 return;
             }
-            if (peek() == SM_TOK_HL) {
-                eat();
-                expect(']');
-                eat();
-                expect(',');
-                eat();
-                if (reg8Offset(peek(), 0x70, &op)) {
-                    eat();
-                    if (emit) {
-                        emit8(op);
-                    }
-                    addPC(1);
+            if (peek(as) == SM_TOK_HL) {
+                eat(as);
+                expect(as, ']');
+                eat(as);
+                expect(as, ',');
+                eat(as);
+                if (reg8Offset(peek(as), 0x70, &op)) {
+                    eat(as);
+                    emit8(as, op);
+                    addPC(as, 1);
                     return;
                 }
-                view = exprEatPos(&pos);
-                if (emit) {
-                    emit8(0x36);
-                    if (exprSolve(view, &num)) {
-                        expectReprU8(pos, num);
-                        emit8(num);
-                    } else {
-                        emit8(0xFD);
-                        reloc(1, 1, view, pos, 0);
-                    }
+                view = exprEatPos(as, &pos);
+                emit8(as, 0x36);
+                if (exprSolve(as, view, &num)) {
+                    expectReprU8(as, pos, num);
+                    emit8(as, num);
+                } else {
+                    emit8(as, 0xFD);
+                    reloc(as, 1, 1, view, pos, 0);
                 }
-                addPC(2);
+                addPC(as, 2);
                 return;
             }
-            view = exprEatPos(&pos);
-            expect(']');
-            eat();
-            expect(',');
-            eat();
-            if (peek() == SM_TOK_SP) {
-                eat();
+            view = exprEatPos(as, &pos);
+            expect(as, ']');
+            eat(as);
+            expect(as, ',');
+            eat(as);
+            if (peek(as) == SM_TOK_SP) {
+                eat(as);
                 op = 0x08;
             } else {
-                expect('A');
-                eat();
+                expect(as, 'A');
+                eat(as);
                 op = 0xEA;
             }
-            if (emit) {
-                emit8(op);
-                if (exprSolve(view, &num)) {
-                    expectReprU16(pos, num);
-                    emit16(num);
-                } else {
-                    emit16(0xFDFD);
-                    reloc(1, 2, view, pos, 0);
-                }
+            emit8(as, op);
+            if (exprSolve(as, view, &num)) {
+                expectReprU16(as, pos, num);
+                emit16(as, num);
+            } else {
+                emit16(as, 0xFDFD);
+                reloc(as, 1, 2, view, pos, 0);
             }
-            addPC(3);
+            addPC(as, 3);
             return;
         default:
-            if (reg16OffsetSP(peek(), 0x01, &op)) {
-                eat();
-                expect(',');
-                eat();
-                view = exprEatPos(&pos);
-                if (emit) {
-                    emit8(op);
-                    if (exprSolve(view, &num)) {
-                        expectReprU16(pos, num);
-                        emit16(num);
-                    } else {
-                        emit16(0xFDFD);
-                        reloc(1, 2, view, pos, 0);
-                    }
+            if (reg16OffsetSP(peek(as), 0x01, &op)) {
+                eat(as);
+                expect(as, ',');
+                eat(as);
+                view = exprEatPos(as, &pos);
+                emit8(as, op);
+                if (exprSolve(as, view, &num)) {
+                    expectReprU16(as, pos, num);
+                    emit16(as, num);
+                } else {
+                    emit16(as, 0xFDFD);
+                    reloc(as, 1, 2, view, pos, 0);
                 }
-                addPC(3);
+                addPC(as, 3);
                 return;
             }
-            fatal("illegal operand\n");
+            fatal(as, "illegal operand\n");
         }
     case MNE_LDD:
-        loadStoreIncDec(0x3A, 0x32);
+        loadStoreIncDec(as, 0x3A, 0x32);
         return;
     case MNE_LDI:
-        loadStoreIncDec(0x2A, 0x22);
+        loadStoreIncDec(as, 0x2A, 0x22);
         return;
     case MNE_LDH:
-        eat();
-        if (peek() == 'A') {
-            eat();
-            expect(',');
-            eat();
-            expect('[');
-            eat();
-            if (peek() == 'C') {
-                eat();
-                expect(']');
-                eat();
-                if (emit) {
-                    emit8(0xE2);
-                }
-                addPC(1);
+        eat(as);
+        if (peek(as) == 'A') {
+            eat(as);
+            expect(as, ',');
+            eat(as);
+            expect(as, '[');
+            eat(as);
+            if (peek(as) == 'C') {
+                eat(as);
+                expect(as, ']');
+                eat(as);
+                emit8(as, 0xE2);
+                addPC(as, 1);
                 return;
             }
-            view = exprEatPos(&pos);
-            expect(']');
-            eat();
-            if (emit) {
-                emit8(0xF0);
-                if (exprSolve(view, &num)) {
-                    if ((num < 0xFF00) || (num > 0xFFFF)) {
-                        fatalPos(pos,
-                                 "address not in high memory: $%08" U32_FMTX
-                                 "\n",
-                                 (U32)num);
-                    }
-                    emit8(num & 0x00FF);
-                } else {
-                    emit8(0xFD);
-                    reloc(1, 1, view, pos, SM_RELOC_HRAM);
-                }
+            view = exprEatPos(as, &pos);
+            expect(as, ']');
+            eat(as);
+            emit8(as, 0xF0);
+            if (exprSolve(as, view, &num)) {
+                emit8(as, hramOffset(as, pos, num));
+            } else {
+                emit8(as, 0xFD);
+                reloc(as, 1, 1, view, pos, SM_RELOC_HRAM);
             }
-            addPC(2);
+            addPC(as, 2);
             return;
         }
-        expect('[');
-        eat();
-        if (peek() == 'C') {
-            eat();
-            expect(']');
-            eat();
-            expect(',');
-            eat();
-            expect('A');
-            eat();
-            if (emit) {
-                emit8(0xF2);
-            }
-            addPC(1);
+        expect(as, '[');
+        eat(as);
+        if (peek(as) == 'C') {
+            eat(as);
+            expect(as, ']');
+            eat(as);
+            expect(as, ',');
+            eat(as);
+            expect(as, 'A');
+            eat(as);
+            emit8(as, 0xF2);
+            addPC(as, 1);
             return;
         }
-        view = exprEatPos(&pos);
-        expect(']');
-        eat();
-        expect(',');
-        eat();
-        expect('A');
-        eat();
-        if (emit) {
-            emit8(0xE0);
-            if (exprSolve(view, &num)) {
-                if ((num < 0xFF00) || (num > 0xFFFF)) {
-                    fatalPos(pos,
-                             "address not in high memory: $%08" U32_FMTX "\n",
-                             (U32)num);
-                }
-                emit8(num & 0x00FF);
-            } else {
-                emit8(0xFD);
-                reloc(1, 1, view, pos, SM_RELOC_HRAM);
-            }
+        view = exprEatPos(as, &pos);
+        expect(as, ']');
+        eat(as);
+        expect(as, ',');
+        eat(as);
+        expect(as, 'A');
+        eat(as);
+        emit8(as, 0xE0);
+        if (exprSolve(as, view, &num)) {
+            emit8(as, hramOffset(as, pos, num));
+        } else {
+            emit8(as, 0xFD);
+            reloc(as, 1, 1, view, pos, SM_RELOC_HRAM);
         }
-        addPC(2);
+        addPC(as, 2);
         return;
     case MNE_PUSH:
-        pushPop(0xC5);
+        pushPop(as, 0xC5);
         return;
     case MNE_POP:
-        pushPop(0xC1);
+        pushPop(as, 0xC1);
         return;
     case MNE_ADD:
-        eat();
-        switch (peek()) {
+        eat(as);
+        switch (peek(as)) {
         case SM_TOK_HL:
-            eat();
-            expect(',');
-            eat();
-            if (!reg16OffsetSP(peek(), 0x09, &op)) {
-                fatal("illegal operand\n");
+            eat(as);
+            expect(as, ',');
+            eat(as);
+            if (!reg16OffsetSP(peek(as), 0x09, &op)) {
+                fatal(as, "illegal operand\n");
             }
-            eat();
-            if (emit) {
-                emit8(op);
-            }
-            addPC(1);
+            eat(as);
+            emit8(as, op);
+            addPC(as, 1);
             return;
         case SM_TOK_SP:
-            eat();
-            expect(',');
-            eat();
-            view = exprEatPos(&pos);
-            if (emit) {
-                emit8(0xE8);
-                if (exprSolve(view, &num)) {
-                    expectReprU8(pos, num);
-                    emit8(num);
-                } else {
-                    emit8(0xFD);
-                    reloc(1, 1, view, pos, 0);
-                }
+            eat(as);
+            expect(as, ',');
+            eat(as);
+            view = exprEatPos(as, &pos);
+            emit8(as, 0xE8);
+            if (exprSolve(as, view, &num)) {
+                expectReprU8(as, pos, num);
+                emit8(as, num);
+            } else {
+                emit8(as, 0xFD);
+                reloc(as, 1, 1, view, pos, 0);
             }
-            addPC(2);
+            addPC(as, 2);
             return;
         default:
-            expect('A');
-            aluReg8(0x80, 0xC6);
+            expect(as, 'A');
+            aluReg8(as, 0x80, 0xC6);
             return;
         }
     case MNE_ADC:
-        eat();
-        expect('A');
-        aluReg8(0x88, 0xCE);
+        eat(as);
+        expect(as, 'A');
+        aluReg8(as, 0x88, 0xCE);
         return;
     case MNE_SUB:
-        eat();
-        expect('A');
-        aluReg8(0x90, 0xD6);
+        eat(as);
+        expect(as, 'A');
+        aluReg8(as, 0x90, 0xD6);
         return;
     case MNE_SBC:
-        eat();
-        expect('A');
-        aluReg8(0x98, 0xDE);
+        eat(as);
+        expect(as, 'A');
+        aluReg8(as, 0x98, 0xDE);
         return;
     case MNE_AND:
-        eat();
-        expect('A');
-        aluReg8(0xA0, 0xE6);
+        eat(as);
+        expect(as, 'A');
+        aluReg8(as, 0xA0, 0xE6);
         return;
     case MNE_XOR:
-        eat();
-        expect('A');
-        aluReg8(0xA8, 0xEE);
+        eat(as);
+        expect(as, 'A');
+        aluReg8(as, 0xA8, 0xEE);
         return;
     case MNE_OR:
-        eat();
-        expect('A');
-        aluReg8(0xB0, 0xF6);
+        eat(as);
+        expect(as, 'A');
+        aluReg8(as, 0xB0, 0xF6);
         return;
     case MNE_CP:
-        eat();
-        expect('A');
-        aluReg8(0xB8, 0xFE);
+        eat(as);
+        expect(as, 'A');
+        aluReg8(as, 0xB8, 0xFE);
         return;
     case MNE_INC:
-        eat();
-        if (reg16OffsetSP(peek(), 0x03, &op)) {
-            eat();
-            if (emit) {
-                emit8(op);
-            }
-            addPC(1);
+        eat(as);
+        if (reg16OffsetSP(peek(as), 0x03, &op)) {
+            eat(as);
+            emit8(as, op);
+            addPC(as, 1);
             return;
         }
-        switch (peek()) {
+        switch (peek(as)) {
         case 'B':
             op = 0x04;
             break;
@@ -836,35 +1175,31 @@ static void eatMne(U8 mne) {
             op = 0x2C;
             break;
         case '[':
-            eat();
-            expect(SM_TOK_HL);
-            eat();
-            expect(']');
+            eat(as);
+            expect(as, SM_TOK_HL);
+            eat(as);
+            expect(as, ']');
             op = 0x34;
             break;
         case 'A':
             op = 0x3C;
             break;
         default:
-            fatal("illegal operand\n");
-        }
-        eat();
-        if (emit) {
-            emit8(op);
+            fatal(as, "illegal operand\n");
         }
-        addPC(1);
+        eat(as);
+        emit8(as, op);
+        addPC(as, 1);
         return;
     case MNE_DEC:
-        eat();
-        if (reg16OffsetSP(peek(), 0x0B, &op)) {
-            eat();
-            if (emit) {
-                emit8(op);
-            }
-            addPC(1);
+        eat(as);
+        if (reg16OffsetSP(peek(as), 0x0B, &op)) {
+            eat(as);
+            emit8(as, op);
+            addPC(as, 1);
             return;
         }
-        switch (peek()) {
+        switch (peek(as)) {
         case 'B':
             op = 0x05;
             break;
@@ -884,539 +1219,472 @@ static void eatMne(U8 mne) {
             op = 0x2D;
             break;
         case '[':
-            eat();
-            expect(SM_TOK_HL);
-            eat();
-            expect(']');
+            eat(as);
+            expect(as, SM_TOK_HL);
+            eat(as);
+            expect(as, ']');
             op = 0x35;
             break;
         case 'A':
             op = 0x3D;
             break;
         default:
-            fatal("illegal operand\n");
+            fatal(as, "illegal operand\n");
         }
-        eat();
-        if (emit) {
-            emit8(op);
-        }
-        addPC(1);
+        eat(as);
+        emit8(as, op);
+        addPC(as, 1);
         return;
     case MNE_DAA:
-        eat();
-        if (emit) {
-            emit8(0x27);
-        }
-        addPC(1);
+        eat(as);
+        emit8(as, 0x27);
+        addPC(as, 1);
         return;
     case MNE_CPL:
-        eat();
-        if (emit) {
-            emit8(0x2F);
-        }
-        addPC(1);
+        eat(as);
+        emit8(as, 0x2F);
+        addPC(as, 1);
         return;
     case MNE_CCF:
-        eat();
-        if (emit) {
-            emit8(0x3F);
-        }
-        addPC(1);
+        eat(as);
+        emit8(as, 0x3F);
+        addPC(as, 1);
         return;
     case MNE_SCF:
-        eat();
-        if (emit) {
-            emit8(0x37);
-        }
-        addPC(1);
+        eat(as);
+        emit8(as, 0x37);
+        addPC(as, 1);
         return;
     case MNE_NOP:
-        eat();
-        if (emit) {
-            emit8(0x00);
-        }
-        addPC(1);
+        eat(as);
+        emit8(as, 0x00);
+        addPC(as, 1);
         return;
     case MNE_HALT:
-        eat();
-        if (emit) {
-            emit8(0x76);
-            emit8(0x00);
-        }
-        addPC(2);
+        eat(as);
+        emit8(as, 0x76);
+        emit8(as, 0x00);
+        addPC(as, 2);
         return;
     case MNE_STOP:
-        eat();
-        if (emit) {
-            emit8(0x10);
-            emit8(0x00);
-        }
-        addPC(2);
+        eat(as);
+        emit8(as, 0x10);
+        emit8(as, 0x00);
+        addPC(as, 2);
         return;
     case MNE_DI:
-        eat();
-        if (emit) {
-            emit8(0xF3);
-        }
-        addPC(1);
+        eat(as);
+        emit8(as, 0xF3);
+        addPC(as, 1);
         return;
     case MNE_EI:
-        eat();
-        if (emit) {
-            emit8(0xFB);
-        }
-        addPC(1);
+        eat(as);
+        emit8(as, 0xFB);
+        addPC(as, 1);
         return;
     case MNE_RETI:
-        eat();
-        if (emit) {
-            emit8(0xD9);
-        }
-        addPC(1);
+        eat(as);
+        emit8(as, 0xD9);
+        addPC(as, 1);
         return;
     case MNE_RLCA:
-        eat();
-        if (emit) {
-            emit8(0x07);
-        }
-        addPC(1);
+        eat(as);
+        emit8(as, 0x07);
+        addPC(as, 1);
         return;
     case MNE_RLA:
-        eat();
-        if (emit) {
-            emit8(0x17);
-        }
-        addPC(1);
+        eat(as);
+        emit8(as, 0x17);
+        addPC(as, 1);
         return;
     case MNE_RRCA:
-        eat();
-        if (emit) {
-            emit8(0x0F);
-        }
-        addPC(1);
+        eat(as);
+        emit8(as, 0x0F);
+        addPC(as, 1);
         return;
     case MNE_RRA:
-        eat();
-        if (emit) {
-            emit8(0x1F);
-        }
-        addPC(1);
+        eat(as);
+        emit8(as, 0x1F);
+        addPC(as, 1);
         return;
     case MNE_RLC:
-        doAluReg8Cb(0x00);
+        doAluReg8Cb(as, 0x00);
         return;
     case MNE_RRC:
-        doAluReg8Cb(0x08);
+        doAluReg8Cb(as, 0x08);
         return;
     case MNE_RL:
-        doAluReg8Cb(0x10);
+        doAluReg8Cb(as, 0x10);
         return;
     case MNE_RR:
-        doAluReg8Cb(0x18);
+        doAluReg8Cb(as, 0x18);
         return;
     case MNE_SLA:
-        doAluReg8Cb(0x20);
+        doAluReg8Cb(as, 0x20);
         return;
     case MNE_SRA:
-        doAluReg8Cb(0x28);
+        doAluReg8Cb(as, 0x28);
         return;
     case MNE_SWAP:
-        doAluReg8Cb(0x30);
+        doAluReg8Cb(as, 0x30);
         return;
     case MNE_SRL:
-        doAluReg8Cb(0x38);
+        doAluReg8Cb(as, 0x38);
         return;
     case MNE_BIT:
-        doBitCb(0x40);
+        doBitCb(as, 0x40);
         return;
     case MNE_RES:
-        doBitCb(0x80);
+        doBitCb(as, 0x80);
         return;
     case MNE_SET:
-        doBitCb(0xC0);
+        doBitCb(as, 0xC0);
         return;
     case MNE_JP:
-        eat();
-        if (flag(peek(), 0xC2, &op)) {
-            eat();
-            expect(',');
-            eat();
-            view = exprEatPos(&pos);
-            if (emit) {
-                emit8(op);
-                if (exprSolve(view, &num)) {
-                    expectReprU16(pos, num);
-                    emit16(num);
-                } else {
-                    emit16(0xFDFD);
-                    reloc(1, 2, view, pos, SM_RELOC_JP);
-                }
+        eat(as);
+        if (flag(peek(as), 0xC2, &op)) {
+            eat(as);
+            expect(as, ',');
+            eat(as);
+            view = exprEatPos(as, &pos);
+            emit8(as, op);
+            if (exprSolve(as, view, &num)) {
+                expectReprU16(as, pos, num);
+                emit16(as, num);
+            } else {
+                emit16(as, 0xFDFD);
+                reloc(as, 1, 2, view, pos, SM_RELOC_JP);
             }
-            addPC(3);
+            addPC(as, 3);
             return;
         }
-        if (peek() == SM_TOK_HL) {
-            eat();
-            if (emit) {
-                emit8(0xE9);
-            }
-            addPC(1);
+        if (peek(as) == SM_TOK_HL) {
+            eat(as);
+            emit8(as, 0xE9);
+            addPC(as, 1);
             return;
         }
-        view = exprEatPos(&pos);
-        if (emit) {
-            emit8(0xC3);
-            if (exprSolve(view, &num)) {
-                expectReprU16(pos, num);
-            } else {
-                emit16(0xFDFD);
-                reloc(1, 2, view, pos, SM_RELOC_JP);
-            }
+        view = exprEatPos(as, &pos);
+        emit8(as, 0xC3);
+        if (exprSolve(as, view, &num)) {
+            expectReprU16(as, pos, num);
+            emit16(as, num);
+        } else {
+            emit16(as, 0xFDFD);
+            reloc(as, 1, 2, view, pos, SM_RELOC_JP);
         }
-        addPC(3);
+        addPC(as, 3);
         return;
     case MNE_JR:
-        eat();
-        if (flag(peek(), 0x20, &op)) {
-            eat();
-            expect(',');
-            eat();
-            view = exprEatPos(&pos);
-            if (emit) {
-                emit8(op);
-                if (!exprSolveRelative(view, &num)) {
-                    fatalPos(pos, "branch distance must be constant\n");
-                }
-                I32 offset = num - ((I32)(U32)getPC()) - 2;
-                if (!exprCanReprI8(offset)) {
-                    fatalPos(pos, "branch distance too far\n");
-                }
-                emit8(offset);
+        eat(as);
+        if (flag(peek(as), 0x20, &op)) {
+            eat(as);
+            expect(as, ',');
+            eat(as);
+            view = exprEatPos(as, &pos);
+            emit8(as, op);
+            if (exprSolveRelative(as, view, &num)) {
+                emit8(as, branchOffset(as, pos, num, getPC(as)));
+            } else {
+                emit8(as, 0xFD);
+                fixup(as, FIXUP_JR, 1, 1, view, pos, 0);
             }
-            addPC(2);
+            addPC(as, 2);
             return;
         }
-        view = exprEatPos(&pos);
-        if (emit) {
-            emit8(0x18);
-            if (!exprSolveRelative(view, &num)) {
-                fatalPos(pos, "branch distance must be constant\n");
-            }
-            I32 offset = num - ((I32)(U32)getPC()) - 2;
-            if (!exprCanReprI8(offset)) {
-                fatalPos(pos, "branch distance too far\n");
-            }
-            emit8(offset);
+        view = exprEatPos(as, &pos);
+        emit8(as, 0x18);
+        if (exprSolveRelative(as, view, &num)) {
+            emit8(as, branchOffset(as, pos, num, getPC(as)));
+        } else {
+            emit8(as, 0xFD);
+            fixup(as, FIXUP_JR, 1, 1, view, pos, 0);
         }
-        addPC(2);
+        addPC(as, 2);
         return;
     case MNE_CALL:
-        eat();
-        if (flag(peek(), 0xC4, &op)) {
-            eat();
-            expect(',');
-            eat();
-            view = exprEatPos(&pos);
-            if (emit) {
-                emit8(op);
-                if (exprSolve(view, &num)) {
-                    expectReprU16(pos, num);
-                    emit16(num);
-                } else {
-                    emit16(0xFDFD);
-                    reloc(1, 2, view, pos, SM_RELOC_JP);
-                }
+        eat(as);
+        if (flag(peek(as), 0xC4, &op)) {
+            eat(as);
+            expect(as, ',');
+            eat(as);
+            view = exprEatPos(as, &pos);
+            emit8(as, op);
+            if (exprSolve(as, view, &num)) {
+                expectReprU16(as, pos, num);
+                emit16(as, num);
+            } else {
+                emit16(as, 0xFDFD);
+                reloc(as, 1, 2, view, pos, SM_RELOC_JP);
             }
-            addPC(3);
+            addPC(as, 3);
             return;
         }
-        view = exprEatPos(&pos);
-        if (emit) {
-            emit8(0xCD);
-            if (exprSolve(view, &num)) {
-                expectReprU16(pos, num);
-                emit16(num);
-            } else {
-                emit16(0xFDFD);
-                reloc(1, 2, view, pos, SM_RELOC_JP);
-            }
+        view = exprEatPos(as, &pos);
+        emit8(as, 0xCD);
+        if (exprSolve(as, view, &num)) {
+            expectReprU16(as, pos, num);
+            emit16(as, num);
+        } else {
+            emit16(as, 0xFDFD);
+            reloc(as, 1, 2, view, pos, SM_RELOC_JP);
         }
-        addPC(3);
+        addPC(as, 3);
         return;
     case MNE_RET:
-        eat();
-        if (flag(peek(), 0xC0, &op)) {
-            eat();
-            if (emit) {
-                emit8(op);
-            }
-            addPC(1);
+        eat(as);
+        if (flag(peek(as), 0xC0, &op)) {
+            eat(as);
+            emit8(as, op);
+            addPC(as, 1);
             return;
         }
-        if (emit) {
-            emit8(0xC9);
-        }
-        addPC(1);
+        emit8(as, 0xC9);
+        addPC(as, 1);
         return;
     case MNE_RST:
-        eat();
-        view = exprEatPos(&pos);
-        if (emit) {
-            if (exprSolve(view, &num)) {
-                switch (num) {
-                case 0x00:
-                    break;
-                case 0x08:
-                    break;
-                case 0x10:
-                    break;
-                case 0x18:
-                    break;
-                case 0x20:
-                    break;
-                case 0x28:
-                    break;
-                case 0x30:
-                    break;
-                case 0x38:
-                    break;
-                default:
-                    fatalPos(pos, "illegal reset vector: $%08" U32_FMTX "\n",
-                             (U32)num);
-                }
-                emit8(0xC7 + num);
-            } else {
-                emit8(0xFD);
-                reloc(0, 1, view, pos, SM_RELOC_RST);
-            }
+        eat(as);
+        view = exprEatPos(as, &pos);
+        if (exprSolve(as, view, &num)) {
+            emit8(as, rstOp(as, pos, num));
+        } else {
+            emit8(as, 0xFD);
+            reloc(as, 0, 1, view, pos, SM_RELOC_RST);
         }
-        addPC(1);
+        addPC(as, 1);
         return;
     default:
         SM_UNREACHABLE();
     }
 }
 
-static FILE *openFile(SmView path, char const *modes) {
-    static SmBuf buf = {};
-    buf.view.len     = 0;
-    smBufCat(&buf, path);
-    smBufCat(&buf, SM_VIEW("\0"));
-    return openFileCstr((char const *)buf.view.bytes, modes);
+static FILE *openFile(Asm *as, SmView path, char const *modes) {
+    SmBuf *buf    = &as->open_buf;
+    buf->view.len = 0;
+    smBufCat(buf, path);
+    smBufCat(buf, SM_VIEW("\0"));
+    return openFileCstr((char const *)buf->view.bytes, modes);
 }
 
-static Bool fileExists(SmView path) {
-    static SmBuf buf = {};
-    buf.view.len     = 0;
-    smBufCat(&buf, path);
-    smBufCat(&buf, SM_VIEW("\0"));
-    FILE *hnd = fopen((char const *)buf.view.bytes, "rb");
-    if (hnd) {
-        closeFile(hnd);
-        return true;
+// Where each spelling of an include was found, or SM_VIEW_NULL if nowhere
+typedef struct {
+    SmView name;
+    SmView path;
+} Include;
+
+static SmView searchInclude(Asm *as, SmView path) {
+    if (smPathExists(path)) {
+        return smPathIntern(&as->strs, path);
     }
-    return false;
-}
-
-static SmView findInclude(SmView path) {
-    static SmBuf buf      = {};
-    SmView       fullpath = smPathIntern(&STRS, path);
-    if (!fileExists(fullpath)) {
-        for (UInt i = 0; i < IPATHS.bufs.view.len; ++i) {
-            SmView inc   = IPATHS.bufs.view.items[i];
-            buf.view.len = 0;
-            smBufCat(&buf, inc);
-            smBufCat(&buf, SM_VIEW("/"));
-            smBufCat(&buf, path);
-            fullpath = smPathIntern(&STRS, buf.view);
-            if (fileExists(fullpath)) {
-                return fullpath;
-            }
+    SmBuf *buf = &as->search_buf;
+    for (UInt i = 0; i < IPATHS.bufs.view.len; ++i) {
+        SmView inc    = IPATHS.bufs.view.items[i];
+        buf->view.len = 0;
+        smBufCat(buf, inc);
+        smBufCat(buf, SM_VIEW("/"));
+        smBufCat(buf, path);
+        if (smPathExists(buf->view)) {
+            return smPathIntern(&as->strs, buf->view);
         }
     }
     return SM_VIEW_NULL;
 }
 
-static SmView expectInclude(SmView path) {
-    SmView fullpath = findInclude(path);
+// The search directories never change during a run, so every spelling is only
+// searched for once
+static SmView findInclude(Asm *as, SmView path) {
+    Include const *include = smMapFind(&as->includes, path);
+    if (include) {
+        ++as->include_hits;
+        return include->path;
+    }
+    SmView found = searchInclude(as, path);
+    smMapAdd(&as->includes, &(Include){intern(as, path), found},
+             sizeof(Include));
+    return found;
+}
+
+static SmView expectInclude(Asm *as, SmView path) {
+    SmView fullpath = findInclude(as, path);
     if (!smViewEqual(fullpath, SM_VIEW_NULL)) {
         return fullpath;
     }
-    fatal("could not find include file: %" SM_VIEW_FMT "\n",
+    fatal(as, "could not find include file: %" SM_VIEW_FMT "\n",
           SM_VIEW_FMT_ARG(path));
 }
 
-static SmExprView addrExprBuf(SmView section, U16 offset) {
+static SmExprView addrExprBuf(Asm *as, SmView section, U16 offset) {
     return smExprIntern(
-        &EXPRS,
+        &as->exprs,
         (SmExprView){&(SmExpr){.kind = SM_EXPR_ADDR, .addr = {section, offset}},
                      1});
 }
 
-static SmExprView constExprBuf(I32 num) {
+static SmExprView constExprBuf(Asm *as, I32 num) {
     return smExprIntern(
-        &EXPRS, (SmExprView){&(SmExpr){.kind = SM_EXPR_CONST, .num = num}, 1});
+        &as->exprs,
+        (SmExprView){&(SmExpr){.kind = SM_EXPR_CONST, .num = num}, 1});
 }
 
-static void eatDirective() {
+static void eatDirective(Asm *as) {
     SmPos      pos;
     SmExprView view;
     I32        num;
-    switch (peek()) {
+    switch (peek(as)) {
     case SM_TOK_DB:
-        eat();
+        eat(as);
         while (true) {
-            switch (peek()) {
+            switch (peek(as)) {
             case SM_TOK_STR:
-                if (emit) {
-                    emitView(tokView());
-                }
-                addPC(tokView().len);
-                eat();
+                emitView(as, tokView(as));
+                addPC(as, tokView(as).len);
+                eat(as);
                 break;
             default: {
-                view = exprEatPos(&pos);
-                if (emit) {
-                    if (exprSolve(view, &num)) {
-                        expectReprU8(pos, num);
-                        emit8(num);
-                    } else {
-                        emit8(0xFD);
-                        reloc(0, 1, view, pos, 0);
-                    }
+                view = exprEatPos(as, &pos);
+                if (exprSolve(as, view, &num)) {
+                    expectReprU8(as, pos, num);
+                    emit8(as, num);
+                } else {
+                    emit8(as, 0xFD);
+                    reloc(as, 0, 1, view, pos, 0);
                 }
-                addPC(1);
+                addPC(as, 1);
             }
             }
-            if (peek() != ',') {
+            if (peek(as) != ',') {
                 break;
             }
-            eat();
+            eat(as);
         }
-        expectEOL();
-        eat();
+        expectEOL(as);
+        eat(as);
         return;
     case SM_TOK_DW:
-        eat();
+        eat(as);
         while (true) {
-            view = exprEatPos(&pos);
-            if (emit) {
-                if (exprSolve(view, &num)) {
-                    expectReprU16(pos, num);
-                    emit16(num);
-                } else {
-                    emit16(0xFDFD);
-                    reloc(0, 2, view, pos, 0);
-                }
+            view = exprEatPos(as, &pos);
+            if (exprSolve(as, view, &num)) {
+                expectReprU16(as, pos, num);
+                emit16(as, num);
+            } else {
+                emit16(as, 0xFDFD);
+                reloc(as, 0, 2, view, pos, 0);
             }
-            addPC(2);
-            if (peek() != ',') {
+            addPC(as, 2);
+            if (peek(as) != ',') {
                 break;
             }
-            eat();
+            eat(as);
         }
-        expectEOL();
-        eat();
+        expectEOL(as);
+        eat(as);
         return;
     case SM_TOK_DS: {
-        eat();
-        U16 space = exprEatSolvedU16();
-        if (emit) {
-            for (UInt i = 0; i < space; ++i) {
-                emit8(0x00);
-            }
-        }
-        addPC(space);
-        expectEOL();
-        eat();
+        eat(as);
+        U16 space = exprEatSolvedU16(as);
+        memset(emitCursor(as, space), 0x00, space);
+        addPC(as, space);
+        expectEOL(as);
+        eat(as);
         return;
     }
     case SM_TOK_SECTION:
-        eat();
-        expect(SM_TOK_STR);
-        sectSet(intern(tokView()));
-        eat();
-        expectEOL();
-        eat();
+        eat(as);
+        expect(as, SM_TOK_STR);
+        sectSet(as, intern(as, tokView(as)));
+        eat(as);
+        expectEOL(as);
+        eat(as);
         return;
     case SM_TOK_SECTPUSH:
-        eat();
-        expect(SM_TOK_STR);
-        sectPush(intern(tokView()));
-        eat();
-        expectEOL();
-        eat();
+        eat(as);
+        expect(as, SM_TOK_STR);
+        sectPush(as, intern(as, tokView(as)));
+        eat(as);
+        expectEOL(as);
+        eat(as);
         return;
     case SM_TOK_SECTPOP:
-        eat();
-        sectPop();
-        expectEOL();
-        eat();
+        eat(as);
+        sectPop(as);
+        expectEOL(as);
+        eat(as);
         return;
     case SM_TOK_INCLUDE: {
-        eat();
-        expect(SM_TOK_STR);
-        SmView path = expectInclude(tokView());
-        eat();
-        expectEOL();
-        eat();
-        pushFile(path);
-        smPathSetAdd(&INCS, path);
+        eat(as);
+        expect(as, SM_TOK_STR);
+        SmView path = expectInclude(as, tokView(as));
+        eat(as);
+        expectEOL(as);
+        eat(as);
+        pushFile(as, path);
+        smPathSetAdd(&as->incs, path);
         return;
     }
     case SM_TOK_INCBIN: {
-        static SmBuf buf = {};
-        buf.view.len     = 0;
-        eat();
-        expect(SM_TOK_STR);
-        SmView path = expectInclude(tokView());
-        eat();
-        expectEOL();
-        eat();
-        FILE   *hnd = openFile(path, "rb");
-        SmSerde ser = {hnd, path};
-        smDeserializeToEnd(&ser, &buf);
-        if (emit) {
-            emitView(buf.view);
+        eat(as);
+        expect(as, SM_TOK_STR);
+        SmView path = expectInclude(as, tokView(as));
+        eat(as);
+        expectEOL(as);
+        eat(as);
+        SmView blob = loadBlob(as, path);
+        if (blob_refs && (blob.len >= blob_refs)) {
+            // only referenced from the object, the linker copies it
+            SmSect *sect = sectGet(as);
+            smBlobBufAdd(&sect->blobs, (SmBlob){
+                                           .offset = sect->data.view.len,
+                                           .len    = blob.len,
+                                           .path   = path,
+                                           .hash   = smViewDigest(blob),
+                                       });
+            emitCursor(as, blob.len);
+        } else {
+            emitView(as, blob);
         }
-        addPC(buf.view.len);
-        smPathSetAdd(&INCS, path);
+        addPC(as, blob.len);
+        smPathSetAdd(&as->incs, path);
         return;
     }
     case SM_TOK_ONCE: {
-        if (smPathSetContains(&INCS, findInclude(tokPos().file))) {
-            eat();
-            popStream();
+        if (smPathSetContains(&as->onces,
+                              smPosTabName(&as->positions, tokPos(as)))) {
+            eat(as);
+            popStream(as);
             return;
         }
-        eat();
-        expectEOL();
-        eat();
+        smPathSetAdd(&as->onces, smPosTabName(&as->positions, tokPos(as)));
+        eat(as);
+        expectEOL(as);
+        eat(as);
         return;
     }
     case SM_TOK_MACRO: {
-        pos                      = tokPos();
-        static SmMacroTokBuf buf = {};
-        buf.view.len             = 0;
-        eat();
-        expect(SM_TOK_ID);
-        SmLbl lbl = tokLbl();
+        pos                = tokPos(as);
+        SmMacroTokBuf *buf = &as->macro_buf;
+        buf->view.len      = 0;
+        eat(as);
+        expect(as, SM_TOK_ID);
+        SmLbl lbl = tokLbl(as);
         if (!smLblIsGlobal(lbl)) {
-            fatal("macro name must be global\n");
+            fatal(as, "macro name must be global\n");
         }
-        Macro *macro = macroFind(lbl.name);
+        SmView name  = atomView(as, lbl.name);
+        Macro *macro = macroFind(as, name);
         if (macro) {
-            fatal("macro %" SM_VIEW_FMT
+            SmPosInfo at = posInfo(as, macro->pos);
+            fatal(as, "macro %" SM_VIEW_FMT
                   " already defined\n\toriginally defined at %" SM_VIEW_FMT
                   ":%" UINT_FMT ":%" UINT_FMT "\n",
-                  SM_VIEW_FMT_ARG(lbl.name), SM_VIEW_FMT_ARG(macro->pos.file),
-                  macro->pos.line, macro->pos.col);
+                  SM_VIEW_FMT_ARG(name), SM_VIEW_FMT_ARG(at.file), at.line,
+                  at.col);
         }
-        eat();
-        UInt depth = 0;
-        streamdef  = true;
+        eat(as);
+        UInt depth    = 0;
+        as->streamdef = true;
         while (true) {
-            switch (peek()) {
+            switch (peek(as)) {
             case SM_TOK_IF:
             case SM_TOK_MACRO:
             case SM_TOK_REPEAT:
@@ -1426,7 +1694,7 @@ static void eatDirective() {
                 break;
             case SM_TOK_END:
                 if (depth == 0) {
-                    eat();
+                    eat(as);
                     goto macdone;
                 }
                 --depth;
@@ -1434,83 +1702,85 @@ static void eatDirective() {
             default:
                 break;
             }
-            switch (peek()) {
+            switch (peek(as)) {
             case SM_TOK_EOF:
-                fatal("unexpected end of file\n");
+                fatal(as, "unexpected end of file\n");
             case SM_TOK_ID:
-                smMacroTokBufAdd(&buf, (SmMacroTok){.kind = SM_MACRO_TOK_ID,
-                                                    .pos  = tokPos(),
-                                                    .view = intern(tokView())});
+                smMacroTokBufAdd(
+                    buf, (SmMacroTok){.kind = SM_MACRO_TOK_ID,
+                                      .pos  = tokPos(as),
+                                      .view = intern(as, tokView(as))});
                 break;
             case SM_TOK_NUM:
-                smMacroTokBufAdd(&buf, (SmMacroTok){.kind = SM_MACRO_TOK_NUM,
-                                                    .pos  = tokPos(),
-                                                    .num  = tokNum()});
+                smMacroTokBufAdd(buf, (SmMacroTok){.kind = SM_MACRO_TOK_NUM,
+                                                   .pos  = tokPos(as),
+                                                   .num  = tokNum(as)});
                 break;
             case SM_TOK_STR:
-                smMacroTokBufAdd(&buf, (SmMacroTok){.kind = SM_MACRO_TOK_STR,
-                                                    .pos  = tokPos(),
-                                                    .view = intern(tokView())});
+                smMacroTokBufAdd(
+                    buf, (SmMacroTok){.kind = SM_MACRO_TOK_STR,
+                                      .pos  = tokPos(as),
+                                      .view = intern(as, tokView(as))});
                 break;
             case SM_TOK_ARG:
-                smMacroTokBufAdd(&buf, (SmMacroTok){.kind = SM_MACRO_TOK_ARG,
-                                                    .pos  = tokPos(),
-                                                    .num  = tokNum()});
+                smMacroTokBufAdd(buf, (SmMacroTok){.kind = SM_MACRO_TOK_ARG,
+                                                   .pos  = tokPos(as),
+                                                   .num  = tokNum(as)});
                 break;
             case SM_TOK_NARG:
-                smMacroTokBufAdd(&buf, (SmMacroTok){
-                                           .kind = SM_MACRO_TOK_NARG,
-                                           .pos  = tokPos(),
-                                       });
+                smMacroTokBufAdd(buf, (SmMacroTok){
+                                          .kind = SM_MACRO_TOK_NARG,
+                                          .pos  = tokPos(as),
+                                      });
                 break;
             case SM_TOK_SHIFT:
-                smMacroTokBufAdd(&buf, (SmMacroTok){
-                                           .kind = SM_MACRO_TOK_SHIFT,
-                                           .pos  = tokPos(),
-                                       });
+                smMacroTokBufAdd(buf, (SmMacroTok){
+                                          .kind = SM_MACRO_TOK_SHIFT,
+                                          .pos  = tokPos(as),
+                                      });
                 break;
             case SM_TOK_UNIQUE:
-                smMacroTokBufAdd(&buf, (SmMacroTok){
-                                           .kind = SM_MACRO_TOK_UNIQUE,
-                                           .pos  = tokPos(),
-                                       });
+                smMacroTokBufAdd(buf, (SmMacroTok){
+                                          .kind = SM_MACRO_TOK_UNIQUE,
+                                          .pos  = tokPos(as),
+                                      });
                 break;
             default:
-                smMacroTokBufAdd(&buf, (SmMacroTok){.kind = SM_MACRO_TOK_TOK,
-                                                    .pos  = tokPos(),
-                                                    .tok  = peek()});
+                smMacroTokBufAdd(buf, (SmMacroTok){.kind = SM_MACRO_TOK_TOK,
+                                                   .pos  = tokPos(as),
+                                                   .tok  = peek(as)});
                 break;
             }
-            eat();
+            eat(as);
         }
     macdone:
-        streamdef = false;
-        macroAdd(lbl.name, pos, buf.view);
+        as->streamdef = false;
+        macroAdd(as, atomView(as, lbl.name), pos, buf->view);
         return;
     }
     case SM_TOK_REPEAT: {
-        SmPos start = tokPos();
-        eat();
-        num = exprEatSolvedPos(&pos);
+        SmPos start = tokPos(as);
+        eat(as);
+        num = exprEatSolvedPos(as, &pos);
         if (num < 0) {
-            fatalPos(pos, "repeat count must be positive\n");
+            fatalPos(as, pos, "repeat count must be positive\n");
         }
         SmLbl lbl = SM_LBL_NULL;
-        if (peek() == ',') {
-            eat();
-            expect(SM_TOK_ID);
-            lbl = tokLbl();
+        if (peek(as) == ',') {
+            eat(as);
+            expect(as, SM_TOK_ID);
+            lbl = tokLbl(as);
             if (!smLblIsGlobal(lbl)) {
-                fatal("variable name must be global\n");
+                fatal(as, "variable name must be global\n");
             }
             // TODO should I check if this shadows an existing label?
-            eat();
+            eat(as);
         }
         UInt           depth = 0;
         SmRepeatTokBuf buf   = {};
-        streamdef            = true;
+        as->streamdef        = true;
         while (true) {
-            switch (peek()) {
+            switch (peek(as)) {
             case SM_TOK_IF:
             case SM_TOK_MACRO:
             case SM_TOK_REPEAT:
@@ -1520,7 +1790,7 @@ static void eatDirective() {
                 break;
             case SM_TOK_END:
                 if (depth == 0) {
-                    eat();
+                    eat(as);
                     goto rptdone;
                 }
                 --depth;
@@ -1528,342 +1798,362 @@ static void eatDirective() {
             default:
                 break;
             }
-            switch (peek()) {
+            switch (peek(as)) {
             case SM_TOK_EOF:
-                fatal("unexpected end of file\n");
+                fatal(as, "unexpected end of file\n");
             case SM_TOK_ID:
                 // referencing the variable
-                if (smViewEqual(tokView(), lbl.name)) {
+                if (smViewEqual(tokView(as), atomView(as, lbl.name))) {
                     smRepeatTokBufAdd(&buf,
                                       (SmRepeatTok){.kind = SM_REPEAT_TOK_ITER,
-                                                    .pos  = tokPos()});
+                                                    .pos  = tokPos(as)});
                     break;
                 }
-                smRepeatTokBufAdd(&buf,
-                                  (SmRepeatTok){.kind = SM_REPEAT_TOK_ID,
-                                                .pos  = tokPos(),
-                                                .view = intern(tokView())});
+                smRepeatTokBufAdd(
+                    &buf, (SmRepeatTok){.kind = SM_REPEAT_TOK_ID,
+                                        .pos  = tokPos(as),
+                                        .view = intern(as, tokView(as))});
                 break;
             case SM_TOK_NUM:
                 smRepeatTokBufAdd(&buf, (SmRepeatTok){.kind = SM_REPEAT_TOK_NUM,
-                                                      .pos  = tokPos(),
-                                                      .num  = tokNum()});
+                                                      .pos  = tokPos(as),
+                                                      .num  = tokNum(as)});
                 break;
             case SM_TOK_STR:
-                smRepeatTokBufAdd(&buf,
-                                  (SmRepeatTok){.kind = SM_REPEAT_TOK_STR,
-                                                .pos  = tokPos(),
-                                                .view = intern(tokView())});
+                smRepeatTokBufAdd(
+                    &buf, (SmRepeatTok){.kind = SM_REPEAT_TOK_STR,
+                                        .pos  = tokPos(as),
+                                        .view = intern(as, tokView(as))});
                 break;
             default:
                 smRepeatTokBufAdd(&buf, (SmRepeatTok){.kind = SM_REPEAT_TOK_TOK,
-                                                      .pos  = tokPos(),
-                                                      .tok  = peek()});
+                                                      .pos  = tokPos(as),
+                                                      .tok  = peek(as)});
                 break;
             }
-            eat();
+            eat(as);
         }
     rptdone:
-        streamdef = false;
-        ++ts;
-        if (ts >= (STACK + STACK_SIZE)) {
+        as->streamdef = false;
+        ++as->ts;
+        if (as->ts >= (as->stack + STACK_SIZE)) {
             smFatal("too many open files\n");
         }
-        smTokStreamRepeatInit(ts, start, buf, num);
+        smTokStreamRepeatInit(as->ts, &as->positions, start, buf, num);
         return;
     }
     case SM_TOK_STRUCT: {
-        SmPos start = tokPos();
-        eat();
-        expect(SM_TOK_ID);
-        SmLbl lbl = tokLbl();
+        SmPos start = tokPos(as);
+        eat(as);
+        expect(as, SM_TOK_ID);
+        SmLbl lbl = tokLbl(as);
         if (!smLblIsGlobal(lbl)) {
-            fatal("structure name must be global\n");
+            fatal(as, "structure name must be global\n");
         }
         // TODO check if this struct is already defined
-        eat();
+        eat(as);
         UInt      size      = 0;
         SmViewBuf fields    = {};
         Bool      inunion   = false;
         UInt      unionsize = 0;
         while (true) {
-            switch (peek()) {
+            switch (peek(as)) {
             case '\n':
-                eat();
+                eat(as);
                 continue;
             case SM_TOK_UNION:
                 if (inunion) {
-                    fatal("a @UNION is already being defined\n");
+                    fatal(as, "a @UNION is already being defined\n");
                 }
                 inunion   = true;
                 unionsize = 0;
-                eat();
+                eat(as);
                 continue;
             case SM_TOK_END:
-                eat();
+                eat(as);
                 if (inunion) {
                     inunion = false;
                     size += unionsize;
-                    eat();
+                    eat(as);
                     continue;
                 }
                 goto structdone;
             default:
                 break;
             }
-            expect(SM_TOK_ID);
-            if (!smViewStartsWith(tokView(), SM_VIEW("."))) {
-                fatal("structure field name must be local\n");
+            expect(as, SM_TOK_ID);
+            if (!smViewStartsWith(tokView(as), SM_VIEW("."))) {
+                fatal(as, "structure field name must be local\n");
             }
-            SmLbl fieldlbl = tokLbl();
-            if (smViewEqual(fieldlbl.name, SM_VIEW("SIZE"))) {
-                fatal("structure field name cannot be `.SIZE`\n");
+            SmLbl fieldlbl = tokLbl(as);
+            if (smViewEqual(atomView(as, fieldlbl.name), SM_VIEW("SIZE"))) {
+                fatal(as, "structure field name cannot be `.SIZE`\n");
             }
-            pos = tokPos();
-            eat();
+            pos = tokPos(as);
+            eat(as);
             fieldlbl.scope = lbl.name;
-            expect(':');
-            eat();
-            num = exprEatSolvedU16();
-            if (!emit) {
-                // TODO should probably check for redefinition with different
-                // values
-                smViewBufAdd(&fields, fieldlbl.name);
-                smSymTabAdd(&SYMS, (SmSym){.lbl     = fieldlbl,
-                                           .value   = constExprBuf(size),
-                                           .unit    = STATIC_UNIT,
-                                           .section = DEFINES_SECTION,
-                                           .pos     = pos,
-                                           .flags   = SM_SYM_EQU});
-            }
+            expect(as, ':');
+            eat(as);
+            num = exprEatSolvedU16(as);
+            // TODO should probably check for redefinition with different
+            // values
+            smViewBufAdd(&fields, atomView(as, fieldlbl.name));
+            definedCheck(as, fieldlbl, pos);
+            smSymTabAdd(&as->syms,
+                        (SmSym){.lbl     = fieldlbl,
+                                .value   = constExprBuf(as, size),
+                                .unit    = as->static_unit,
+                                .section = atom(as, as->defines_section),
+                                .pos     = pos,
+                                .flags   = SM_SYM_EQU});
             if (!inunion) {
                 size += num;
             } else {
                 unionsize = uIntMax(unionsize, num);
             }
-            expectEOL();
-            eat();
+            expectEOL(as);
+            eat(as);
         }
     structdone:
-        if (!emit) {
-            SmLbl sizelbl = lblAbs(lbl.name, intern(SM_VIEW("SIZE")));
-            structAdd(lbl.name, pos, fields);
-            smSymTabAdd(&SYMS, (SmSym){.lbl     = sizelbl,
-                                       .value   = constExprBuf(size),
-                                       .unit    = STATIC_UNIT,
-                                       .section = DEFINES_SECTION,
+        SmLbl sizelbl = lblAbs(lbl.name, atom(as, SM_VIEW("SIZE")));
+        structAdd(as, atomView(as, lbl.name), pos, fields);
+        definedCheck(as, sizelbl, start);
+        smSymTabAdd(&as->syms, (SmSym){.lbl     = sizelbl,
+                                       .value   = constExprBuf(as, size),
+                                       .unit    = as->static_unit,
+                                       .section = atom(as, as->defines_section),
                                        .pos     = start,
                                        .flags   = SM_SYM_EQU});
-        }
-        expectEOL();
-        eat();
+        expectEOL(as);
+        eat(as);
         return;
     }
     case SM_TOK_ALLOC: {
-        pos = tokPos();
-        eat();
-        if (smViewEqual(scope, SM_VIEW_NULL)) {
-            fatal("@ALLOC must be used under a global label\n");
+        pos = tokPos(as);
+        eat(as);
+        if (as->scope == SM_ATOM_NULL) {
+            fatal(as, "@ALLOC must be used under a global label\n");
         }
-        SmSym *scopesym = smSymTabFind(&SYMS, lblGlobal(scope));
+        SmSym *scopesym = smSymTabFind(&as->syms, lblGlobal(as->scope));
         assert(scopesym);
         assert(scopesym->value.len == 1);
         SmExpr *scopeexpr = scopesym->value.items;
         assert(scopeexpr->kind == SM_EXPR_ADDR);
         I32 base = scopeexpr->addr.pc;
-        expect(SM_TOK_ID);
-        SmView  name  = intern(tokView());
-        Struct *strct = structFind(name);
+        expect(as, SM_TOK_ID);
+        SmView  name  = intern(as, tokView(as));
+        Struct *strct = structFind(as, name);
         if (!strct) {
-            fatal("structure %" SM_VIEW_FMT " not found\n",
+            fatal(as, "structure %" SM_VIEW_FMT " not found\n",
                   SM_VIEW_FMT_ARG(name));
         }
 
-        eat();
-        if (!emit) {
-            for (UInt i = 0; i < strct->fields.view.len; ++i) {
-                SmView field = strct->fields.view.items[i];
-                SmLbl  lbl   = lblAbs(name, field);
-                SmSym *sym   = smSymTabFind(&SYMS, lbl);
-                assert(sym);
-                assert(exprSolve(sym->value, &num));
-                smSymTabAdd(&SYMS, (SmSym){.lbl   = lblAbs(scope, field),
-                                           .value = addrExprBuf(
-                                               scopesym->section, base + num),
-                                           .unit    = scopesym->unit,
-                                           .section = scopesym->section,
-                                           .pos     = pos,
-                                           .flags   = 0});
-            }
-        }
-        SmView size = intern(SM_VIEW("SIZE"));
-        SmLbl  lbl  = lblAbs(name, size);
-        SmSym *sym  = smSymTabFind(&SYMS, lbl);
+        eat(as);
+        for (UInt i = 0; i < strct->fields.view.len; ++i) {
+            SmAtom field = atom(as, strct->fields.view.items[i]);
+            SmLbl  lbl   = lblAbs(atom(as, name), field);
+            SmSym *sym   = smSymTabFind(&as->syms, lbl);
+            assert(sym);
+            assert(exprSolve(as, sym->value, &num));
+            definedCheck(as, lblAbs(as->scope, field), pos);
+            smSymTabAdd(&as->syms,
+                        (SmSym){.lbl   = lblAbs(as->scope, field),
+                                .value = addrExprBuf(
+                                    as, atomView(as, scopesym->section),
+                                    base + num),
+                                .unit    = scopesym->unit,
+                                .section = scopesym->section,
+                                .pos     = pos,
+                                .flags   = 0});
+        }
+        SmAtom size = atom(as, SM_VIEW("SIZE"));
+        SmLbl  lbl  = lblAbs(atom(as, name), size);
+        SmSym *sym  = smSymTabFind(&as->syms, lbl);
         assert(sym);
-        assert(exprSolve(sym->value, &num));
-        addPC(num);
-        if (!emit) {
-            smSymTabAdd(&SYMS, (SmSym){.lbl     = lblAbs(scope, size),
+        assert(exprSolve(as, sym->value, &num));
+        addPC(as, num);
+        definedCheck(as, lblAbs(as->scope, size), pos);
+        smSymTabAdd(&as->syms, (SmSym){.lbl     = lblAbs(as->scope, size),
                                        .value   = sym->value,
                                        .unit    = scopesym->unit,
                                        .section = scopesym->section,
                                        .pos     = pos,
                                        .flags   = SM_SYM_EQU});
-        }
-        expectEOL();
-        eat();
+        expectEOL(as);
+        eat(as);
         return;
     }
     case SM_TOK_FATAL:
-        fmtInvoke(SM_TOK_STR);
-        expect(SM_TOK_STR);
-        fatal("explicit fatal error: %" SM_VIEW_FMT,
-              SM_VIEW_FMT_ARG(tokView()));
+        fmtInvoke(as, SM_TOK_STR);
+        expect(as, SM_TOK_STR);
+        fatal(as, "explicit fatal error: %" SM_VIEW_FMT,
+              SM_VIEW_FMT_ARG(tokView(as)));
     case SM_TOK_PRINT:
-        fmtInvoke(SM_TOK_STR);
-        expect(SM_TOK_STR);
-        if (emit) {
-            fprintf(stderr, "%" SM_VIEW_FMT, SM_VIEW_FMT_ARG(tokView()));
-        }
-        eat();
-        expectEOL();
-        eat();
+        fmtInvoke(as, SM_TOK_STR);
+        expect(as, SM_TOK_STR);
+        fprintf(stderr, "%" SM_VIEW_FMT, SM_VIEW_FMT_ARG(tokView(as)));
+        eat(as);
+        expectEOL(as);
+        eat(as);
         return;
     default: {
-        SmView name = smTokName(peek());
-        fatal("unexpected: %" SM_VIEW_FMT "\n", SM_VIEW_FMT_ARG(name));
+        SmView name = smTokName(peek(as));
+        fatal(as, "unexpected: %" SM_VIEW_FMT "\n", SM_VIEW_FMT_ARG(name));
     }
     }
 }
 
-static void pass() {
-    sectSet(CODE_SECTION);
-    while (peek() != SM_TOK_EOF) {
-        switch (peek()) {
+static void pass(Asm *as) {
+    sectSet(as, as->code_section);
+    while (peek(as) != SM_TOK_EOF) {
+        switch (peek(as)) {
         case '\n':
             // skip newlines
-            eat();
+            eat(as);
             continue;
         case '*':
             // setting the _relative_ PC: * = $1234
-            eat();
-            expect('=');
-            eat();
-            setPC(exprEatSolvedU16());
-            expectEOL();
-            eat();
+            eat(as);
+            expect(as, '=');
+            eat(as);
+            setPC(as, exprEatSolvedU16(as));
+            expectEOL(as);
+            eat(as);
             continue;
         case SM_TOK_ID: {
-            U8 const *mne = mneFind(tokView());
+            U32 const *mne = mneFind(tokView(as));
             if (mne) {
-                eatMne(*mne);
-                expectEOL();
-                eat();
+                // no instruction is longer than 3 bytes
+                emitReserve(as, 3);
+                eatMne(as, *mne);
+                expectEOL(as);
+                eat(as);
                 continue;
             }
-            SmPos pos = tokPos();
-            SmLbl lbl = tokLbl();
-            eat();
-            SmSym *sym = smSymTabFind(&SYMS, lbl);
+            SmPos pos = tokPos(as);
+            SmLbl lbl = tokLbl(as);
+            eat(as);
+            SmSym *sym = smSymTabFind(&as->syms, lbl);
             if (!sym) {
+                definedCheck(as, lbl, pos);
                 // create a placeholder symbol that we'll fill in soon
-                sym = smSymTabAdd(&SYMS, (SmSym){
-                                             .lbl     = lbl,
-                                             .value   = constExprBuf(0),
-                                             .unit    = STATIC_UNIT,
-                                             .section = sectGet()->name,
-                                             .pos     = pos,
-                                             .flags   = 0,
-                                         });
-            } else if (!emit) {
-                // we are allowed to redefine labels for the second
-                // pass.
-                // TODO: but we need to ensure the value of the label
-                // never changes.
+                sym = smSymTabAdd(&as->syms,
+                                  (SmSym){
+                                      .lbl     = lbl,
+                                      .value   = constExprBuf(as, 0),
+                                      .unit    = as->static_unit,
+                                      .section = atom(as, sectGet(as)->name),
+                                      .pos     = pos,
+                                      .flags   = 0,
+                                  });
+            } else {
                 // TODO: also we want to create weak/redefinable symbols
-                fatalPos(pos,
-                         "symbol already defined\n\t%" SM_VIEW_FMT ":%" UINT_FMT
-                         ":%" UINT_FMT " : defined previously here\n",
-                         SM_VIEW_FMT_ARG(sym->pos.file), sym->pos.line,
-                         sym->pos.col);
+                fatalRedefined(as, pos, sym);
             }
-            switch (peek()) {
+            switch (peek(as)) {
             case SM_TOK_DCOLON:
-                sym->unit = EXPORT_UNIT;
+                sym->unit = as->export_unit;
                 // fall through
             case ':':
-                eat();
+                eat(as);
                 break;
             case SM_TOK_EXPEQU:
-                sym->unit = EXPORT_UNIT;
+                sym->unit = as->export_unit;
                 // fall through
-            case '=':
-                eat();
-                I32 num;
-                if (emit) {
-                    sym->value = constExprBuf(exprEatSolvedPos(&pos));
-                    sym->flags = SM_SYM_EQU;
-                } else if (exprSolve(exprEat(), &num)) {
-                    sym->value = constExprBuf(num);
+            case '=': {
+                eat(as);
+                SmPos      at;
+                SmExprView view = exprEatPos(as, &at);
+                I32        num;
+                if (exprSolve(as, view, &num)) {
+                    sym->value = constExprBuf(as, num);
                     sym->flags = SM_SYM_EQU;
                 } else {
-                    sym->lbl = SM_LBL_NULL;
+                    SmSym equ = *sym;
+                    equ.value = view;
+                    equ.flags = SM_SYM_EQU;
+                    smSymTabRemove(&as->syms, lbl);
+                    equDefer(as, equ, at);
                 }
-                expectEOL();
-                eat();
+                expectEOL(as);
+                eat(as);
                 continue;
+            }
             default:
                 if (!smLblIsGlobal(lbl)) {
-                    fatal("expected `:` or `=`\n");
+                    fatal(as, "expected `:` or `=`\n");
                 }
-                fatalPos(pos, "unrecognized instruction\n");
+                fatalPos(as, pos, "unrecognized instruction\n");
             }
             // This just a new label then
             if (smLblIsGlobal(sym->lbl)) {
-                scope = sym->lbl.name;
+                as->scope = sym->lbl.name;
             }
-            sym->value = addrExprBuf(sectGet()->name, getPC());
+            sym->value = addrExprBuf(as, sectGet(as)->name, getPC(as));
             continue;
         }
         default:
-            eatDirective();
+            eatDirective(as);
         }
     }
 }
 
-static void writeDepend() {
-    static SmBuf buf = {};
-    buf.view.len     = 0;
+// The path without the extension of the file name
+static void catBaseName(SmBuf *buf, char const *path) {
+    UInt        len    = strlen(path);
+    char const *offset = strrchr(path, '.');
+    if (offset && !strchr(offset, '/')) {
+        len = offset - path;
+    }
+    smBufCat(buf, (SmView){(U8 *)path, len});
+}
+
+static void writeDepend(Asm *as) {
+    SmBuf *buf    = &as->depend_buf;
+    buf->view.len = 0;
     if (!depfile_name) {
-        UInt        len    = strlen(infile_name);
-        char const *offset = strchr(infile_name, '.');
-        if (offset) {
-            len -= (offset - infile_name);
-        }
-        smBufCat(&buf, (SmView){(U8 *)infile_name, len});
-        smBufCat(&buf, SM_VIEW(".d"));
+        catBaseName(buf, as->infile_name);
+        smBufCat(buf, SM_VIEW(".d"));
     } else {
-        smBufCat(&buf, (SmView){(U8 *)depfile_name, strlen(depfile_name)});
+        smBufCat(buf, (SmView){(U8 *)depfile_name, strlen(depfile_name)});
     }
-    FILE   *hnd = openFile(buf.view, "wb+");
-    SmSerde ser = {hnd, buf.view};
-    smSerializeView(&ser, (SmView){(U8 *)outfile_name, strlen(outfile_name)});
+    smBufCat(buf, SM_VIEW("\0"));
+    SmView name = {buf->view.bytes, buf->view.len - 1};
+    // the target of a unit written to stdout is still named after it
+    SmView target = SM_VIEW("stdout");
+    if (as->outfile_name) {
+        target = (SmView){(U8 *)as->outfile_name, strlen(as->outfile_name)};
+    }
+    as->depfile = openTemp(&as->depfile_temp, name);
+    SmSerde ser = {as->depfile, name, NULL, &as->positions, 0, 0};
+    smSerializeView(&ser, target);
     smSerializeView(&ser, SM_VIEW(": \\\n"));
-    for (UInt i = 0; i < INCS.bufs.view.len; ++i) {
+    for (UInt i = 0; i < as->incs.bufs.view.len; ++i) {
         smSerializeView(&ser, SM_VIEW("  "));
-        smSerializeView(&ser, INCS.bufs.view.items[i]);
+        smSerializeView(&ser, as->incs.bufs.view.items[i]);
         smSerializeView(&ser, SM_VIEW(" \\\n"));
     }
-    closeFile(hnd);
+    FILE *hnd   = as->depfile;
+    as->depfile = NULL;
+    commitTemp(hnd, &as->depfile_temp, (char const *)buf->view.bytes);
 }
 
-static void serialize() {
-    SmSerde ser = {outfile, {(U8 *)outfile_name, strlen(outfile_name)}};
-    smSerializeU32(&ser, *(U32 *)"SM00");
-    smSerializeViewIntern(&ser, &STRS);
-    smSerializeExprIntern(&ser, &EXPRS, &STRS);
-    smSerializeSymTab(&ser, &SYMS, &STRS, &EXPRS);
-    smSerializeSectView(&ser, SECTS.view, &STRS, &EXPRS);
+static void serialize(Asm *as) {
+    SmSerde ser = {
+        .hnd       = as->outfile,
+        .name      = {(U8 *)as->outfile_name, strlen(as->outfile_name)},
+        .positions = &as->positions,
+    };
+    smSerializeU32(&ser, *(U32 *)"SM02");
+    // the interner no longer shares bytes between strings on its own, so fold
+    // common suffixes together before writing out the string table
+    SmViewIntern strs = smViewInternCompact(&as->strs);
+    smSerializeViewIntern(&ser, &strs);
+    smSerializeExprIntern(&ser, &as->exprs, &strs);
+    smSerializePosTab(&ser);
+    smSerializeSymTab(&ser, &as->syms, &strs, &as->exprs);
+    smSerializeSectView(&ser, as->sects.view, &strs, &as->exprs);
+    smViewInternFini(&strs);
 }
 
 static FILE *openFileCstr(char const *name, char const *modes) {
@@ -1880,11 +2170,277 @@ static void closeFile(FILE *hnd) {
     }
 }
 
-static void pushFile(SmView path) {
-    FILE *hnd = openFile(path, "rb");
-    ++ts;
-    if (ts >= (STACK + STACK_SIZE)) {
+// Outputs are written under a temporary name next to where they go and only
+// renamed into place once complete, so that a failed or killed run never
+// leaves a partial file behind that looks up to date
+static FILE *openTemp(SmBuf *temp, SmView name) {
+    char suffix[64];
+    snprintf(suffix, sizeof(suffix), ".%ld.%" UINT_FMT ".tmp", (long)getpid(),
+             (UInt)next_temp++);
+    temp->view.len = 0;
+    smBufCat(temp, name);
+    smBufCat(temp, (SmView){(U8 *)suffix, strlen(suffix) + 1});
+    return openFileCstr((char const *)temp->view.bytes, "wb+");
+}
+
+static void commitTemp(FILE *hnd, SmBuf *temp, char const *name) {
+    char const *path = (char const *)temp->view.bytes;
+    if (fclose(hnd) == EOF) {
+        remove(path);
+        smFatal("failed to write file: %s: %s\n", name, strerror(errno));
+    }
+    if (rename(path, name) != 0) {
+        remove(path);
+        smFatal("could not rename file: %s: %s\n", name, strerror(errno));
+    }
+}
+
+// Stdout is not a temporary file and stays open
+static void dropTemp(FILE **hnd, SmBuf *temp) {
+    if (*hnd && (*hnd != stdout)) {
+        fclose(*hnd);
+        remove((char const *)temp->view.bytes);
+    }
+    *hnd = NULL;
+}
+
+// The tokens of a source along with the strings they refer to
+typedef struct {
+    SmTokRecord  record;
+    SmViewIntern strs;
+} Recording;
+
+static Recording *recordingNew() {
+    Recording *rec = calloc(1, sizeof(Recording));
+    if (!rec) {
+        smFatal("out of memory\n");
+    }
+    return rec;
+}
+
+static void recordingFree(Recording *rec) {
+    smTokRecordFini(&rec->record);
+    smViewInternFini(&rec->strs);
+    free(rec);
+}
+
+// The contents of every file read in the run, by path, shared by the units
+// so that the headers they all include are only read once. The first unit to
+// lex a file through to the end hands its tokens over to `record`, so that
+// the others replay them instead of lexing it again. A server keeps both from
+// one request to the next and reads a file again once it changed.
+typedef struct {
+    SmView          name;
+    SmView          bytes;
+    Bool            mapped;
+    Bool            loaded;
+    dev_t           dev;
+    ino_t           ino;
+    off_t           size;
+    struct timespec mtime;
+    Recording      *record;
+} File;
+
+static SmMap           FILES      = {};
+static pthread_mutex_t FILES_LOCK = PTHREAD_MUTEX_INITIALIZER;
+
+static void fileUnload(File *file) {
+    if (file->mapped) {
+        munmap(file->bytes.bytes, file->bytes.len);
+    } else {
+        free(file->bytes.bytes);
+    }
+    if (file->record) {
+        recordingFree(file->record);
+    }
+    file->bytes  = SM_VIEW_NULL;
+    file->loaded = false;
+    file->record = NULL;
+}
+
+static Bool fileChanged(File const *file, struct stat const *st) {
+    return (file->dev != st->st_dev) || (file->ino != st->st_ino) ||
+           (file->size != st->st_size) ||
+           (file->mtime.tv_sec != st->st_mtim.tv_sec) ||
+           (file->mtime.tv_nsec != st->st_mtim.tv_nsec);
+}
+
+// Only called between requests, when no unit is using the files
+void filesRefresh() {
+    for (UInt i = 0; i < FILES.len; ++i) {
+        File       *file = smMapAt(&FILES, i);
+        struct stat st;
+        if (file->loaded &&
+            ((stat((char const *)file->name.bytes, &st) != 0) ||
+             fileChanged(file, &st))) {
+            fileUnload(file);
+        }
+    }
+}
+
+// Files are read without holding the lock, so an error reading one cannot
+// leave it locked. Should two units read the same file at once, the first
+// one to finish is kept.
+static SmView fileGet(Asm *as, SmView path) {
+    pthread_mutex_lock(&FILES_LOCK);
+    File const *found = smMapFind(&FILES, path);
+    if (found && found->loaded) {
+        SmView bytes = found->bytes;
+        pthread_mutex_unlock(&FILES_LOCK);
+        return bytes;
+    }
+    pthread_mutex_unlock(&FILES_LOCK);
+    File        loaded = {.loaded = true};
+    struct stat st;
+    FILE       *hnd    = openFile(as, path, "rb");
+    SmSerde     ser    = {hnd, path, NULL, &as->positions, 0, 0};
+    if (fstat(fileno(hnd), &st) == 0) {
+        loaded.dev   = st.st_dev;
+        loaded.ino   = st.st_ino;
+        loaded.size  = st.st_size;
+        loaded.mtime = st.st_mtim;
+    }
+    loaded.bytes = smDeserializeMap(&ser, &loaded.mapped);
+    closeFile(hnd);
+    // names are kept NUL terminated for stat
+    U8 *name = malloc(path.len + 1);
+    if (!name) {
+        smFatal("out of memory\n");
+    }
+    memcpy(name, path.bytes, path.len);
+    name[path.len] = '\0';
+    pthread_mutex_lock(&FILES_LOCK);
+    File *file = smMapFind(&FILES, path);
+    if (file) {
+        free(name);
+    } else {
+        file = smMapAdd(&FILES, &(File){.name = {name, path.len}},
+                        sizeof(File));
+    }
+    if (file->loaded) {
+        fileUnload(&loaded);
+    } else {
+        loaded.name = file->name;
+        *file       = loaded;
+    }
+    SmView bytes = file->bytes;
+    pthread_mutex_unlock(&FILES_LOCK);
+    return bytes;
+}
+
+// The tokens another unit lexed the file into, if any. Records are never
+// changed once handed over, so they are read without the lock.
+static SmTokRecord const *fileRecord(SmView path, SmView *bytes) {
+    pthread_mutex_lock(&FILES_LOCK);
+    File const        *file   = smMapFind(&FILES, path);
+    SmTokRecord const *record = NULL;
+    if (file && file->loaded && file->record) {
+        record = &file->record->record;
+        *bytes = file->bytes;
+    }
+    pthread_mutex_unlock(&FILES_LOCK);
+    return record;
+}
+
+// Hands a finished recording over to the other units, returning whether it
+// was taken. The bytes it was lexed from are those of the file, since units
+// only ever get them from here.
+static Bool fileKeepRecord(SmView path, Recording *rec) {
+    pthread_mutex_lock(&FILES_LOCK);
+    File *file  = smMapFind(&FILES, path);
+    Bool  taken = file && file->loaded && !file->record;
+    if (taken) {
+        file->record = rec;
+    }
+    pthread_mutex_unlock(&FILES_LOCK);
+    return taken;
+}
+
+// Every file read in the unit, by path. A source is kept in `positions` as
+// `file` along with the tokens it was lexed into, either by this unit into
+// `own` or by another one.
+typedef struct {
+    SmView             name;
+    SmTokRecord const *record;
+    Recording         *own;
+    U32                file;
+    SmView             blob;
+    Bool               loaded;
+} Source;
+
+static Source *sourceGet(Asm *as, SmView path) {
+    Source *src = smMapFind(&as->sources, path);
+    if (src) {
+        return src;
+    }
+    return smMapAdd(&as->sources, &(Source){.name = path}, sizeof(Source));
+}
+
+static void pushFile(Asm *as, SmView path) {
+    Source *src   = sourceGet(as, path);
+    SmView  bytes = {};
+    if (src->record) {
+        ++as->source_hits;
+    } else if ((src->record = fileRecord(path, &bytes))) {
+        ++as->record_hits;
+        src->file = smPosTabAdd(&as->positions, path, bytes,
+                                SM_POS_SRC_BORROWED);
+    } else {
+        ++as->source_misses;
+        bytes = fileGet(as, path);
+    }
+    if ((as->ts + 1) >= (as->stack + STACK_SIZE)) {
         smFatal("too many open files\n");
     }
-    smTokStreamFileInit(ts, path, hnd);
+    ++as->ts;
+    if (!src->record) {
+        smTokStreamViewInit(as->ts, &as->positions, path, bytes);
+        src->own    = recordingNew();
+        src->record = &src->own->record;
+        src->file   = as->ts->pos.file;
+        smTokStreamRecord(as->ts, &src->own->record, &src->own->strs);
+        return;
+    }
+    if (src->record->done) {
+        smTokStreamReplayInit(as->ts, &as->positions, src->file, src->record);
+        return;
+    }
+    // one that is being recorded already (an include of itself) or that was
+    // cut short is lexed again
+    smTokStreamSrcInit(as->ts, &as->positions, src->file);
+}
+
+static SmView loadBlob(Asm *as, SmView path) {
+    Source *src = sourceGet(as, path);
+    if (src->loaded) {
+        ++as->source_hits;
+        return src->blob;
+    }
+    ++as->source_misses;
+    src->blob   = fileGet(as, path);
+    src->loaded = true;
+    return src->blob;
+}
+
+// Frees everything the unit left behind, `as` is ready for the next one.
+// Sources it lexed to the end are handed over to the units after it.
+static void unitFini(Asm *as) {
+    for (UInt i = 0; i < as->sources.len; ++i) {
+        Source *src = smMapAt(&as->sources, i);
+        if (src->own &&
+            !(src->own->record.done && fileKeepRecord(src->name, src->own))) {
+            recordingFree(src->own);
+        }
+    }
+    smMapFini(&as->sources);
+    smMapFini(&as->includes);
+    fixupBufFini(&as->fixups);
+    smBufFini(&as->open_buf);
+    smBufFini(&as->search_buf);
+    smBufFini(&as->output_buf);
+    smBufFini(&as->outfile_temp);
+    smBufFini(&as->depend_buf);
+    smBufFini(&as->depfile_temp);
+    smMacroTokBufFini(&as->macro_buf);
+    stateFini(as);
 }
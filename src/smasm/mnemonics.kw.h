@@ -0,0 +1,52 @@
+// generated by tools/kwgen from src/smasm/mnemonics.kw, do not edit
+
+static SmKw const MNEMONICS_SLOTS[128] = {
+    [0] = {"SRA", MNE_SRA},
+    [1] = {"LD", MNE_LD},
+    [4] = {"INC", MNE_INC},
+    [5] = {"STOP", MNE_STOP},
+    [6] = {"RRA", MNE_RRA},
+    [12] = {"SLA", MNE_SLA},
+    [16] = {"LDD", MNE_LDD},
+    [18] = {"RLA", MNE_RLA},
+    [22] = {"RR", MNE_RR},
+    [24] = {"LDI", MNE_LDI},
+    [27] = {"HALT", MNE_HALT},
+    [29] = {"SET", MNE_SET},
+    [30] = {"ADC", MNE_ADC},
+    [32] = {"CP", MNE_CP},
+    [34] = {"RL", MNE_RL},
+    [35] = {"RET", MNE_RET},
+    [39] = {"BIT", MNE_BIT},
+    [40] = {"OR", MNE_OR},
+    [43] = {"XOR", MNE_XOR},
+    [55] = {"EI", MNE_EI},
+    [61] = {"DI", MNE_DI},
+    [70] = {"SRL", MNE_SRL},
+    [71] = {"JR", MNE_JR},
+    [72] = {"CCF", MNE_CCF},
+    [75] = {"CALL", MNE_CALL},
+    [80] = {"RRCA", MNE_RRCA},
+    [83] = {"ADD", MNE_ADD},
+    [87] = {"CPL", MNE_CPL},
+    [90] = {"SWAP", MNE_SWAP},
+    [92] = {"RLCA", MNE_RLCA},
+    [93] = {"RST", MNE_RST},
+    [95] = {"SBC", MNE_SBC},
+    [100] = {"LDH", MNE_LDH},
+    [101] = {"PUSH", MNE_PUSH},
+    [102] = {"SCF", MNE_SCF},
+    [104] = {"DAA", MNE_DAA},
+    [106] = {"AND", MNE_AND},
+    [110] = {"RES", MNE_RES},
+    [111] = {"SUB", MNE_SUB},
+    [112] = {"RRC", MNE_RRC},
+    [113] = {"RETI", MNE_RETI},
+    [114] = {"POP", MNE_POP},
+    [116] = {"DEC", MNE_DEC},
+    [117] = {"JP", MNE_JP},
+    [124] = {"RLC", MNE_RLC},
+    [127] = {"NOP", MNE_NOP},
+};
+
+static SmKwTab const MNEMONICS = {MNEMONICS_SLOTS, 0xF3D169DB8ECA4C3Full, 7};
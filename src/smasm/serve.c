@@ -0,0 +1,266 @@
+#include "serve.h"
+
+#include <smasm/fatal.h>
+#include <smasm/path.h>
+#include <smasm/serde.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// A request is the client's stdout and stderr, passed along with the first
+// byte sent, then its working directory and command line as U32 length
+// prefixed strings. The reply is the exit status as a single byte.
+typedef struct {
+    int    fds[2];
+    FILE  *hnd;
+    char  *cwd;
+    char **argv;
+    int    argc;
+} Request;
+
+// Kept out of the stack frame that errors longjmp back to
+static Request req = {.fds = {-1, -1}};
+
+static void socketAddr(struct sockaddr_un *addr, char const *path) {
+    memset(addr, 0, sizeof(struct sockaddr_un));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        smFatal("socket path too long: %s\n", path);
+    }
+    strcpy(addr->sun_path, path);
+}
+
+typedef union {
+    struct cmsghdr hdr;
+    char           buf[CMSG_SPACE(sizeof(int) * 2)];
+} FdsMsg;
+
+static void sendFds(int sock) {
+    int            fds[2] = {STDOUT_FILENO, STDERR_FILENO};
+    FdsMsg         ctl    = {};
+    U8             byte   = 0;
+    struct iovec   iov    = {&byte, 1};
+    struct msghdr  msg    = {
+              .msg_iov        = &iov,
+              .msg_iovlen     = 1,
+              .msg_control    = ctl.buf,
+              .msg_controllen = sizeof(ctl.buf),
+    };
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level     = SOL_SOCKET;
+    cmsg->cmsg_type      = SCM_RIGHTS;
+    cmsg->cmsg_len       = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    if (sendmsg(sock, &msg, 0) != 1) {
+        smFatal("failed to send request: %s\n", strerror(errno));
+    }
+}
+
+static void recvFds(int sock, int fds[2]) {
+    FdsMsg        ctl  = {};
+    U8            byte = 0;
+    struct iovec  iov  = {&byte, 1};
+    struct msghdr msg  = {
+         .msg_iov        = &iov,
+         .msg_iovlen     = 1,
+         .msg_control    = ctl.buf,
+         .msg_controllen = sizeof(ctl.buf),
+    };
+    if (recvmsg(sock, &msg, 0) != 1) {
+        smFatal("failed to receive request: %s\n", strerror(errno));
+    }
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || (cmsg->cmsg_level != SOL_SOCKET) ||
+        (cmsg->cmsg_type != SCM_RIGHTS) ||
+        (cmsg->cmsg_len != CMSG_LEN(sizeof(int) * 2))) {
+        smFatal("bad request: expected stdout and stderr\n");
+    }
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * 2);
+}
+
+static void writeString(SmSerde *ser, char const *str) {
+    UInt len = strlen(str);
+    smSerializeU32(ser, len);
+    smSerializeView(ser, (SmView){(U8 *)str, len});
+}
+
+static char *readString(SmSerde *ser) {
+    UInt  len = smDeserializeU32(ser);
+    char *str = malloc(len + 1);
+    if (!str) {
+        smFatal("out of memory\n");
+    }
+    SmView view = {(U8 *)str, len};
+    smDeserializeView(ser, &view);
+    str[len] = '\0';
+    return str;
+}
+
+static void requestRead(int conn) {
+    recvFds(conn, req.fds);
+    int fd = dup(conn);
+    if (fd < 0) {
+        smFatal("failed to receive request: %s\n", strerror(errno));
+    }
+    req.hnd = fdopen(fd, "rb");
+    if (!req.hnd) {
+        close(fd);
+        smFatal("failed to receive request: %s\n", strerror(errno));
+    }
+    SmSerde ser = {req.hnd, SM_VIEW("request"), NULL, NULL, 0, 0};
+    req.cwd     = readString(&ser);
+    UInt argc   = smDeserializeU32(&ser);
+    if ((argc == 0) || (argc > I32_MAX)) {
+        smFatal("bad request: %" UINT_FMT " arguments\n", argc);
+    }
+    req.argv = calloc(argc + 1, sizeof(char *));
+    if (!req.argv) {
+        smFatal("out of memory\n");
+    }
+    for (UInt i = 0; i < argc; ++i) {
+        req.argv[i] = readString(&ser);
+        req.argc    = i + 1;
+    }
+}
+
+static void requestFini() {
+    for (UInt i = 0; i < 2; ++i) {
+        if (req.fds[i] >= 0) {
+            close(req.fds[i]);
+        }
+    }
+    if (req.hnd) {
+        fclose(req.hnd);
+    }
+    free(req.cwd);
+    for (int i = 0; i < req.argc; ++i) {
+        free(req.argv[i]);
+    }
+    free(req.argv);
+    req = (Request){.fds = {-1, -1}};
+}
+
+// Errors while reading the request are reported on the server's stderr, any
+// after that on the client's
+static int handle(int conn, int out, int err, int home) {
+    jmp_buf      fail;
+    volatile int status = EXIT_FAILURE;
+    smFatalJmp          = &fail;
+    if (setjmp(fail) == 0) {
+        requestRead(conn);
+        fflush(stdout);
+        fflush(stderr);
+        if ((dup2(req.fds[0], STDOUT_FILENO) < 0) ||
+            (dup2(req.fds[1], STDERR_FILENO) < 0)) {
+            smFatal("failed to redirect output: %s\n", strerror(errno));
+        }
+        if (chdir(req.cwd) != 0) {
+            smFatal("could not change directory: %s: %s\n", req.cwd,
+                    strerror(errno));
+        }
+        // the client may have changed anything since the last request
+        filesRefresh();
+        smPathCacheFini();
+        status = run(req.argc, req.argv);
+    }
+    smFatalJmp = NULL;
+    fflush(stdout);
+    fflush(stderr);
+    if ((dup2(out, STDOUT_FILENO) < 0) || (dup2(err, STDERR_FILENO) < 0) ||
+        (fchdir(home) != 0)) {
+        smFatal("failed to restore server: %s\n", strerror(errno));
+    }
+    requestFini();
+    return status;
+}
+
+int serve(char const *path) {
+    struct sockaddr_un addr;
+    socketAddr(&addr, path);
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) {
+        smFatal("failed to create socket: %s\n", strerror(errno));
+    }
+    // a socket left behind by an earlier server is replaced
+    struct stat st;
+    if ((stat(path, &st) == 0) && S_ISSOCK(st.st_mode)) {
+        unlink(path);
+    }
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        smFatal("could not bind socket: %s: %s\n", path, strerror(errno));
+    }
+    if (listen(sock, 16) != 0) {
+        smFatal("could not listen on socket: %s: %s\n", path,
+                strerror(errno));
+    }
+    // a client that goes away must not take the server with it
+    signal(SIGPIPE, SIG_IGN);
+    int out  = dup(STDOUT_FILENO);
+    int err  = dup(STDERR_FILENO);
+    int home = open(".", O_RDONLY | O_DIRECTORY);
+    if ((out < 0) || (err < 0) || (home < 0)) {
+        smFatal("failed to start server: %s\n", strerror(errno));
+    }
+    while (true) {
+        int conn = accept(sock, NULL, NULL);
+        if (conn < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            smFatal("failed to accept connection: %s\n", strerror(errno));
+        }
+        U8 status = handle(conn, out, err, home);
+        if (write(conn, &status, 1) != 1) {
+            // the client is gone, nobody is left to tell
+        }
+        close(conn);
+    }
+}
+
+int serveConnect(char const *path, int argc, char **argv) {
+    struct sockaddr_un addr;
+    socketAddr(&addr, path);
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) {
+        smFatal("failed to create socket: %s\n", strerror(errno));
+    }
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        smFatal("could not connect to server: %s: %s\n", path,
+                strerror(errno));
+    }
+    sendFds(sock);
+    int   fd  = dup(sock);
+    FILE *hnd = (fd < 0) ? NULL : fdopen(fd, "wb");
+    if (!hnd) {
+        smFatal("failed to send request: %s\n", strerror(errno));
+    }
+    char *cwd = getcwd(NULL, 0);
+    if (!cwd) {
+        smFatal("could not get working directory: %s\n", strerror(errno));
+    }
+    SmSerde ser = {hnd, SM_VIEW("request"), NULL, NULL, 0, 0};
+    writeString(&ser, cwd);
+    free(cwd);
+    // the command line without `--connect <SOCKET>`
+    smSerializeU32(&ser, argc - 2);
+    writeString(&ser, argv[0]);
+    for (int i = 3; i < argc; ++i) {
+        writeString(&ser, argv[i]);
+    }
+    if (fclose(hnd) == EOF) {
+        smFatal("failed to send request: %s\n", strerror(errno));
+    }
+    U8 status;
+    if (read(sock, &status, 1) != 1) {
+        smFatal("server closed the connection\n");
+    }
+    close(sock);
+    return status;
+}
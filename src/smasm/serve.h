@@ -0,0 +1,18 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+// Runs smasm as a server on a Unix socket, taking requests until killed.
+// Every request is the command line of one run of smasm, which is done with
+// the client's working directory, stdout and stderr. File contents are kept
+// warm between requests.
+int serve(char const *path);
+// Hands the command line after `--connect <SOCKET>` to a server instead of
+// running it here, and returns the exit status the server sent back
+int serveConnect(char const *path, int argc, char **argv);
+
+// From main.c: one whole run of smasm, and dropping the files that changed
+// since the last one
+int  run(int argc, char **argv);
+void filesRefresh();
+
+#endif // SERVE_H
@@ -2,182 +2,272 @@
 #include "fmt.h"
 #include "if.h"
 #include "macro.h"
+#include "struct.h"
 
 #include <assert.h>
 #include <stdarg.h>
+#include <stdlib.h>
 #include <string.h>
 
-SmViewIntern STRS   = {};
-SmSymTab     SYMS   = {};
-SmExprIntern EXPRS  = {};
-SmPathSet    IPATHS = {};
-SmPathSet    INCS   = {};
+SmPathSet IPATHS = {};
 
-SmView intern(SmView view) { return smViewIntern(&STRS, view); }
+SmView intern(Asm *as, SmView view) { return smViewIntern(&as->strs, view); }
+SmAtom atom(Asm *as, SmView view) { return smViewAtom(&as->strs, view); }
+SmView atomView(Asm *as, SmAtom atom) { return smAtomView(&as->strs, atom); }
 
-SmView DEFINES_SECTION;
-SmView CODE_SECTION;
-SmView STATIC_UNIT;
-SmView EXPORT_UNIT;
-
-SmView scope     = {};
-UInt   nonce     = 0;
-Bool   emit      = false;
-Bool   streamdef = false;
-
-SmLbl lblLocal(SmView name) { return (SmLbl){scope, name}; }
-SmLbl lblGlobal(SmView name) { return (SmLbl){{}, name}; }
-SmLbl lblAbs(SmView scope, SmView name) { return (SmLbl){scope, name}; }
+SmPosInfo posInfo(Asm *as, SmPos pos) {
+    return smPosTabInfo(&as->positions, pos);
+}
 
-SmTokStream  STACK[STACK_SIZE] = {};
-SmTokStream *ts                = STACK - 1;
+SmLbl lblLocal(Asm *as, SmAtom name) { return (SmLbl){as->scope, name}; }
+SmLbl lblGlobal(SmAtom name) { return (SmLbl){SM_ATOM_NULL, name}; }
+SmLbl lblAbs(SmAtom scope, SmAtom name) { return (SmLbl){scope, name}; }
 
-_Noreturn void fatal(char const *fmt, ...) {
+_Noreturn void fatal(Asm *as, char const *fmt, ...) {
     va_list args;
     va_start(args, fmt);
-    smTokStreamFatalV(ts, fmt, args);
+    smTokStreamFatalV(as->ts, fmt, args);
 }
 
-_Noreturn void fatalPos(SmPos pos, char const *fmt, ...) {
+_Noreturn void fatalPos(Asm *as, SmPos pos, char const *fmt, ...) {
     va_list args;
     va_start(args, fmt);
-    smTokStreamFatalPosV(ts, pos, fmt, args);
+    smTokStreamFatalPosV(as->ts, pos, fmt, args);
 }
 
-void popStream() {
-    assert(ts >= STACK);
-    smTokStreamFini(ts);
-    --ts;
+void popStream(Asm *as) {
+    assert(as->ts >= as->stack);
+    smTokStreamFini(as->ts);
+    as->owners[as->ts - as->stack] = 0;
+    --as->ts;
 }
 
-U32 peek() {
-    U32 tok = smTokStreamPeek(ts);
+U32 peek(Asm *as) {
+    U32 tok = smTokStreamPeek(as->ts);
     // pop if we reached EOF
-    if ((tok == SM_TOK_EOF) && (ts > STACK)) {
-        popStream();
-        return peek(); // yuck
+    if ((tok == SM_TOK_EOF) && (as->ts > as->stack)) {
+        popStream(as);
+        return peek(as); // yuck
     }
     // if we're in a macro/if definition, don't evaluate other meta-constructs
-    if (streamdef) {
+    if (as->streamdef) {
         return tok;
     }
     switch (tok) {
     case SM_TOK_ID: {
-        Macro *macro = macroFind(tokView());
+        Macro *macro = macroFind(as, tokView(as));
         if (macro) {
-            macroInvoke(*macro);
-            return peek(); // yuck
+            macroInvoke(as, *macro);
+            return peek(as); // yuck
         }
         return tok;
     }
     case SM_TOK_IF:
-        ifInvoke();
-        return peek(); // yuck
+        ifInvoke(as);
+        return peek(as); // yuck
     case SM_TOK_STRFMT:
-        fmtInvoke(SM_TOK_STR);
-        return peek(); // yuck
+        fmtInvoke(as, SM_TOK_STR);
+        return peek(as); // yuck
     case SM_TOK_IDFMT:
-        fmtInvoke(SM_TOK_ID);
-        return peek(); // yuck
+        fmtInvoke(as, SM_TOK_ID);
+        return peek(as); // yuck
     default:
         return tok;
     }
 }
 
-void eat() { smTokStreamEat(ts); }
+void eat(Asm *as) { smTokStreamEat(as->ts); }
 
-void expect(U32 tok) {
-    U32 peeked = peek();
+void expect(Asm *as, U32 tok) {
+    U32 peeked = peek(as);
     if (peeked != tok) {
         SmView expected = smTokName(tok);
         SmView found    = smTokName(peeked);
-        fatal("expected %" SM_VIEW_FMT ", got %" SM_VIEW_FMT "\n",
+        fatal(as, "expected %" SM_VIEW_FMT ", got %" SM_VIEW_FMT "\n",
               SM_VIEW_FMT_ARG(expected), SM_VIEW_FMT_ARG(found));
     }
 }
 
-SmView tokView() { return smTokStreamView(ts); }
-I32    tokNum() { return smTokStreamNum(ts); }
-SmPos  tokPos() { return smTokStreamPos(ts); }
+SmView tokView(Asm *as) { return smTokStreamView(as->ts); }
+I32    tokNum(Asm *as) { return smTokStreamNum(as->ts); }
+SmPos  tokPos(Asm *as) { return smTokStreamPos(as->ts); }
 
-SmLbl tokLbl() {
-    SmView view   = tokView();
+SmLbl tokLbl(Asm *as) {
+    SmView view   = tokView(as);
     U8    *offset = memchr(view.bytes, '.', view.len);
     if (!offset) {
-        return lblGlobal(intern(view));
+        return lblGlobal(atom(as, view));
     }
     UInt scope_len = offset - view.bytes;
     UInt name_len  = view.len - scope_len - 1;
     if (name_len == 0) {
-        fatal("label is malformed: %" SM_VIEW_FMT "\n", SM_VIEW_FMT_ARG(view));
+        fatal(as, "label is malformed: %" SM_VIEW_FMT "\n",
+              SM_VIEW_FMT_ARG(view));
     }
     SmView name = {view.bytes + scope_len + 1, name_len};
     if (scope_len > 0) {
-        return lblAbs(intern((SmView){view.bytes, scope_len}), intern(name));
+        return lblAbs(atom(as, (SmView){view.bytes, scope_len}),
+                      atom(as, name));
     }
-    return lblLocal(intern(name));
+    return lblLocal(as, atom(as, name));
 }
 
-SmSectBuf SECTS                  = {};
-UInt      SECT_STACK[STACK_SIZE] = {};
-UInt     *sect                   = SECT_STACK - 1;
-
-static UInt sectFind(SmView name) {
-    for (UInt i = 0; i < SECTS.view.len; ++i) {
-        if (smViewEqual(SECTS.view.items[i].name, name)) {
+static UInt sectFind(Asm *as, SmView name) {
+    for (UInt i = 0; i < as->sects.view.len; ++i) {
+        if (smViewEqual(as->sects.view.items[i].name, name)) {
             return i;
         }
     }
     return UINT_MAX;
 }
 
-SmSect *sectGet() { return SECTS.view.items + *sect; }
+SmSect *sectGet(Asm *as) { return as->sects.view.items + *as->sect; }
 
-void sectSet(SmView name) {
-    UInt idx = sectFind(name);
+void sectSet(Asm *as, SmView name) {
+    UInt idx = sectFind(as, name);
     if (idx == UINT_MAX) {
-        smSectBufAdd(&SECTS, (SmSect){
-                                 .name   = name,
-                                 .pc     = 0,
-                                 .data   = {},
-                                 .relocs = {},
-                             });
-        idx = SECTS.view.len - 1;
+        smSectBufAdd(&as->sects, (SmSect){
+                                     .name   = name,
+                                     .pc     = 0,
+                                     .data   = {},
+                                     .relocs = {},
+                                 });
+        idx = as->sects.view.len - 1;
     }
-    *sect = idx;
+    *as->sect = idx;
 }
 
-void sectPush(SmView name) {
-    ++sect;
-    if (sect >= (SECT_STACK + STACK_SIZE)) {
-        fatal("@SECTION stack overflow\n");
+void sectPush(Asm *as, SmView name) {
+    ++as->sect;
+    if (as->sect >= (as->sect_stack + STACK_SIZE)) {
+        fatal(as, "@SECTION stack overflow\n");
     }
-    sectSet(name);
+    sectSet(as, name);
 }
 
-void sectPop() {
-    if (sect <= SECT_STACK) {
-        fatal("@SECTION stack underflow\n");
+void sectPop(Asm *as) {
+    if (as->sect <= as->sect_stack) {
+        fatal(as, "@SECTION stack underflow\n");
     }
-    --sect;
+    --as->sect;
 }
 
-void sectRewind() {
-    for (UInt i = 0; i < SECTS.view.len; ++i) {
-        SmSect *sect = SECTS.view.items + i;
-        sect->pc     = 0;
+void setPC(Asm *as, U16 num) { as->sects.view.items[*as->sect].pc = num; }
+U16  getPC(Asm *as) { return as->sects.view.items[*as->sect].pc; }
+
+void addPC(Asm *as, U16 offset) {
+    I32 cur = (U32)getPC(as);
+    I32 new = cur + offset;
+    if (new > ((I32)(U32)U16_MAX)) {
+        fatal(as, "pc overflow: $%08X\n", new);
     }
-    sect = SECT_STACK - 1;
+    setPC(as, new);
 }
 
-void setPC(U16 num) { SECTS.view.items[*sect].pc = num; }
-U16  getPC() { return SECTS.view.items[*sect].pc; }
+static void equBufAdd(EquBuf *buf, Equ item) { SM_BUF_ADD_IMPL(); }
 
-void addPC(U16 offset) {
-    I32 cur = (U32)getPC();
-    I32 new = cur + offset;
-    if (new > ((I32)(U32)U16_MAX)) {
-        fatal("pc overflow: $%08X\n", new);
+static void equBufFini(EquBuf *buf) { SM_BUF_FINI_IMPL(); }
+
+void equDefer(Asm *as, SmSym sym, SmPos at) {
+    equBufAdd(&as->equs, (Equ){sym, at});
+}
+
+static void askedBufAdd(AskedBuf *buf, Asked item) { SM_BUF_ADD_IMPL(); }
+
+static void askedBufFini(AskedBuf *buf) { SM_BUF_FINI_IMPL(); }
+
+Bool definedAsk(Asm *as, SmLbl lbl, SmPos pos) {
+    if (smSymTabFind(&as->syms, lbl)) {
+        return true;
+    }
+    for (UInt i = 0; i < as->equs.view.len; ++i) {
+        if (smLblEqual(as->equs.view.items[i].sym.lbl, lbl)) {
+            return true;
+        }
+    }
+    for (UInt i = 0; i < as->asked.view.len; ++i) {
+        Asked *asked = as->asked.view.items + i;
+        if (smLblEqual(asked->lbl, lbl) && (asked->owner == as->asking)) {
+            return false;
+        }
+    }
+    askedBufAdd(&as->asked, (Asked){lbl, pos, as->asking});
+    return false;
+}
+
+static Bool ownerOpen(Asm *as, UInt owner) {
+    if (owner == 0) {
+        return false;
+    }
+    for (SmTokStream *it = as->stack; it <= as->ts; ++it) {
+        if (as->owners[it - as->stack] == owner) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void definedCheck(Asm *as, SmLbl lbl, SmPos pos) {
+    for (UInt i = 0; i < as->asked.view.len; ++i) {
+        Asked *asked = as->asked.view.items + i;
+        if (!smLblEqual(asked->lbl, lbl) || ownerOpen(as, asked->owner)) {
+            continue;
+        }
+        SmPosInfo at = posInfo(as, asked->pos);
+        fatalPos(as, pos,
+                 "symbol defined after @DEFINED said it was not\n\t%"
+                 SM_VIEW_FMT ":%" UINT_FMT ":%" UINT_FMT " : asked here\n",
+                 SM_VIEW_FMT_ARG(at.file), at.line, at.col);
+    }
+}
+
+UInt definedIfBegin(Asm *as) {
+    as->asking = ++as->ifs;
+    return as->asking;
+}
+
+void definedIfEnd(Asm *as) { as->asking = 0; }
+
+void definedIfPush(Asm *as, UInt owner) {
+    as->owners[as->ts - as->stack] = owner;
+}
+
+void stateInit(Asm *as) {
+    as->defines_section = intern(as, SM_VIEW("@DEFINES"));
+    as->code_section    = intern(as, SM_VIEW("CODE"));
+    as->static_unit     = atom(as, SM_VIEW("@STATIC"));
+    as->export_unit     = atom(as, SM_VIEW("@EXPORT"));
+    as->ts              = as->stack - 1;
+    as->sect            = as->sect_stack;
+}
+
+void stateFini(Asm *as) {
+    // a stream that overflowed the stack never made it onto it
+    if (as->ts >= (as->stack + STACK_SIZE)) {
+        as->ts = as->stack + STACK_SIZE - 1;
+    }
+    while (as->ts >= as->stack) {
+        popStream(as);
+    }
+    for (UInt i = 0; i < as->sects.view.len; ++i) {
+        SmSect *section = as->sects.view.items + i;
+        smBufFini(&section->data);
+        smRelocBufFini(&section->relocs);
+        smBlobBufFini(&section->blobs);
     }
-    setPC(new);
+    smSectBufFini(&as->sects);
+    equBufFini(&as->equs);
+    askedBufFini(&as->asked);
+    macroTabFini(as);
+    structTabFini(as);
+    smSymTabFini(&as->syms);
+    smExprInternFini(&as->exprs);
+    smPathSetFini(&as->incs);
+    smPathSetFini(&as->onces);
+    smArenaFini(&as->pass);
+    smPosTabFini(&as->positions);
+    smViewInternFini(&as->strs);
+    smExprBufFini(&as->expr_stack);
+    smOpBufFini(&as->op_stack);
+    memset(as, 0, sizeof(Asm));
 }
@@ -1,58 +1,199 @@
 #ifndef STATE_H
 #define STATE_H
 
+#include <smasm/map.h>
 #include <smasm/path.h>
 #include <smasm/sect.h>
+#include <smasm/tok.h>
 
-extern SmViewIntern STRS;
-extern SmSymTab     SYMS;
-extern SmExprIntern EXPRS;
-extern SmPathSet    IPATHS;
-extern SmPathSet    INCS;
+// The search directories are the only state shared by the units, they are
+// set up once before any unit
+extern SmPathSet IPATHS;
 
-SmView intern(SmView view);
+#define STACK_SIZE 64
 
-extern SmView DEFINES_SECTION;
-extern SmView CODE_SECTION;
-extern SmView STATIC_UNIT;
-extern SmView EXPORT_UNIT;
+// A constant whose value refers to symbols further on. `at` is where its
+// expression starts
+typedef struct {
+    SmSym sym;
+    SmPos at;
+} Equ;
 
-extern SmView scope;
-extern UInt   nonce;
-extern Bool   emit;
-extern Bool   streamdef;
+typedef struct {
+    Equ *items;
+    UInt len;
+} EquView;
 
-SmLbl lblGlobal(SmView name);
-SmLbl lblLocal(SmView name);
-SmLbl lblAbs(SmView scope, SmView name);
+typedef struct {
+    EquView view;
+    UInt    cap;
+} EquBuf;
 
-#define STACK_SIZE 64
-extern SmTokStream  STACK[STACK_SIZE];
-extern SmTokStream *ts;
+enum FixupKind {
+    FIXUP_RELOC,
+    FIXUP_JR,
+    FIXUP_BIT,
+};
+
+// An operand that refers to symbols further on. It goes into the relocations
+// of its section straight away and is taken out again if it can be solved
+// once the unit ends. `at` is where its placeholder bytes are in the data.
+typedef struct {
+    U8  kind;
+    U32 sect;
+    U32 reloc;
+    U32 at;
+} Fixup;
+
+typedef struct {
+    Fixup *items;
+    UInt   len;
+} FixupView;
+
+typedef struct {
+    FixupView view;
+    UInt      cap;
+} FixupBuf;
+
+// A @DEFINED that answered no. `owner` is the @IF whose condition asked
+typedef struct {
+    SmLbl lbl;
+    SmPos pos;
+    UInt  owner;
+} Asked;
+
+typedef struct {
+    Asked *items;
+    UInt   len;
+} AskedView;
+
+typedef struct {
+    AskedView view;
+    UInt      cap;
+} AskedBuf;
+
+// Everything about assembling one unit. Each worker owns one and hands it to
+// whatever needs it, so that units can be assembled side by side.
+typedef struct {
+    SmViewIntern strs;
+    SmSymTab     syms;
+    SmExprIntern exprs;
+    SmPathSet    incs;
+    // files that already went through their @ONCE
+    SmPathSet    onces;
+    // scratch memory that lives until the end of the pass
+    SmArena      pass;
+    // every source read in the unit, which positions point into
+    SmPosTab     positions;
+
+    SmView defines_section;
+    SmView code_section;
+    SmAtom static_unit;
+    SmAtom export_unit;
+
+    SmAtom scope;
+    UInt   nonce;
+    Bool   streamdef;
+
+    SmTokStream  stack[STACK_SIZE];
+    SmTokStream *ts;
+    // the @IF whose body each open stream is, if any
+    UInt         owners[STACK_SIZE];
+
+    SmSectBuf sects;
+    UInt      sect_stack[STACK_SIZE];
+    UInt     *sect;
+
+    // constants and operands waiting for the symbols they refer to
+    EquBuf   equs;
+    FixupBuf fixups;
+
+    // what @DEFINED said no to, the @IFs seen so far and the one whose
+    // condition is being solved
+    AskedBuf asked;
+    UInt     ifs;
+    UInt     asking;
+
+    SmMap            macs;
+    SmMacroTokIntern mtoks;
+    SmMap            structs;
+
+    // the operands and operators of the expression being parsed
+    SmExprBuf expr_stack;
+    SmOpBuf   op_stack;
+
+    char const *infile_name;
+    char const *outfile_name;
+    // the object and dependency files while they are written out, under the
+    // temporary names in `outfile_temp` and `depfile_temp`
+    FILE       *outfile;
+    FILE       *depfile;
+
+    // every file read in the unit, by path
+    SmMap sources;
+
+    // includes found and how often files were served from memory, for --stats
+    SmMap includes;
+    UInt  include_hits;
+    UInt  source_hits;
+    UInt  source_misses;
+    UInt  record_hits;
+
+    // scratch space for file names and macro bodies
+    SmBuf         open_buf;
+    SmBuf         search_buf;
+    SmBuf         output_buf;
+    SmBuf         outfile_temp;
+    SmBuf         depend_buf;
+    SmBuf         depfile_temp;
+    SmMacroTokBuf macro_buf;
+} Asm;
+
+// Sets up for a new unit. Finishing one frees everything and leaves `as` as
+// good as new.
+void stateInit(Asm *as);
+void stateFini(Asm *as);
+
+SmView    intern(Asm *as, SmView view);
+SmAtom    atom(Asm *as, SmView view);
+SmView    atomView(Asm *as, SmAtom atom);
+SmPosInfo posInfo(Asm *as, SmPos pos);
+
+SmLbl lblGlobal(SmAtom name);
+SmLbl lblLocal(Asm *as, SmAtom name);
+SmLbl lblAbs(SmAtom scope, SmAtom name);
+
+SM_FORMAT(2) _Noreturn void fatal(Asm *as, char const *fmt, ...);
+SM_FORMAT(3) _Noreturn void fatalPos(Asm *as, SmPos pos, char const *fmt, ...);
 
-SM_FORMAT(1) _Noreturn void fatal(char const *fmt, ...);
-SM_FORMAT(2) _Noreturn void fatalPos(SmPos pos, char const *fmt, ...);
+void popStream(Asm *as);
+U32  peek(Asm *as);
+void eat(Asm *as);
+void expect(Asm *as, U32 tok);
 
-void popStream();
-U32  peek();
-void eat();
-void expect(U32 tok);
+SmView tokView(Asm *as);
+I32    tokNum(Asm *as);
+SmPos  tokPos(Asm *as);
+SmLbl  tokLbl(Asm *as);
 
-SmView tokView();
-I32    tokNum();
-SmPos  tokPos();
-SmLbl  tokLbl();
+void equDefer(Asm *as, SmSym sym, SmPos at);
 
-extern SmSectBuf SECTS;
+// @DEFINED only sees what is defined so far, so defining a name after it said
+// no is an error. The exception is the body of the @IF that asked, which is
+// how a default value is given to a symbol.
+Bool definedAsk(Asm *as, SmLbl lbl, SmPos pos);
+void definedCheck(Asm *as, SmLbl lbl, SmPos pos);
+UInt definedIfBegin(Asm *as);
+void definedIfEnd(Asm *as);
+void definedIfPush(Asm *as, UInt owner);
 
-SmSect *sectGet();
-void    sectSet(SmView name);
-void    sectPush(SmView name);
-void    sectPop();
-void    sectRewind();
+SmSect *sectGet(Asm *as);
+void    sectSet(Asm *as, SmView name);
+void    sectPush(Asm *as, SmView name);
+void    sectPop(Asm *as);
 
-void setPC(U16 num);
-U16  getPC();
-void addPC(U16 offset);
+void setPC(Asm *as, U16 num);
+U16  getPC(Asm *as);
+void addPC(Asm *as, U16 offset);
 
 #endif // STATE_H
@@ -1,26 +1,25 @@
 #include "struct.h"
 
-#include <smasm/tab.h>
+#include <smasm/map.h>
 
-#include <stdlib.h>
-
-SM_TAB_WHENCE_IMPL(StructTab, Struct);
-SM_TAB_TRYGROW_IMPL(StructTab, Struct);
-
-static StructTab STRUCTS = {};
+void structTabFini(Asm *as) {
+    for (UInt i = 0; i < as->structs.len; ++i) {
+        Struct *strct = smMapAt(&as->structs, i);
+        smViewBufFini(&strct->fields);
+    }
+    smMapFini(&as->structs);
+}
 
-Struct *structFind(SmView name) {
-    StructTab *tab = &STRUCTS;
-    SM_TAB_FIND_IMPL(StructTab, Struct);
+Struct *structFind(Asm *as, SmView name) {
+    return smMapFind(&as->structs, name);
 }
 
-static Struct *add(Struct entry) {
-    StructTab *tab = &STRUCTS;
-    SM_TAB_ADD_IMPL(StructTab, Struct);
+static Struct *add(Asm *as, Struct entry) {
+    return smMapAdd(&as->structs, &entry, sizeof(Struct));
 }
 
-void structAdd(SmView name, SmPos pos, SmViewBuf fields) {
-    add((Struct){
+void structAdd(Asm *as, SmView name, SmPos pos, SmViewBuf fields) {
+    add(as, (Struct){
         name,
         pos,
         fields,
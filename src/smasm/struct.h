@@ -1,7 +1,7 @@
 #ifndef STRUCT_H
 #define STRUCT_H
 
-#include <smasm/tok.h>
+#include "state.h"
 
 typedef struct {
     SmView    name;
@@ -9,13 +9,8 @@ typedef struct {
     SmViewBuf fields;
 } Struct;
 
-typedef struct {
-    Struct *entries;
-    UInt    len;
-    UInt    cap;
-} StructTab;
-
-Struct *structFind(SmView name);
-void    structAdd(SmView name, SmPos pos, SmViewBuf fields);
+void    structTabFini(Asm *as);
+Struct *structFind(Asm *as, SmView name);
+void    structAdd(Asm *as, SmView name, SmPos pos, SmViewBuf fields);
 
 #endif // STRUCT_H
@@ -57,7 +57,10 @@ int main(int argc, char **argv) {
         }
     }
     SmBuf   buf   = {};
-    SmSerde serin = {infile, {(U8 *)infile_name, strlen(infile_name)}};
+    SmSerde serin = {
+        .hnd  = infile,
+        .name = {(U8 *)infile_name, strlen(infile_name)},
+    };
     smDeserializeToEnd(&serin, &buf);
 
     if (buf.view.len < 0x014E) {
@@ -76,7 +79,10 @@ int main(int argc, char **argv) {
     } else {
         outfile_name = "stdout";
     }
-    SmSerde serout = {outfile, {(U8 *)outfile_name, strlen(outfile_name)}};
+    SmSerde serout = {
+        .hnd  = outfile,
+        .name = {(U8 *)outfile_name, strlen(outfile_name)},
+    };
     smSerializeView(&serout, buf.view);
 
     UInt romsize = buf.view.bytes[0x0148];
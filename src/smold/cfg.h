@@ -1,3 +1,4 @@
+#include <smasm/map.h>
 #include <smasm/sym.h>
 
 typedef struct {
@@ -5,11 +6,8 @@ typedef struct {
     I32    num;
 } CfgI32Entry;
 
-typedef struct {
-    CfgI32Entry *entries;
-    UInt         len;
-    UInt         cap;
-} CfgI32Tab;
+// maps names to CfgI32Entry
+typedef SmMap CfgI32Tab;
 
 CfgI32Entry *cfgI32TabAdd(CfgI32Tab *tab, CfgI32Entry entry);
 CfgI32Entry *cfgI32TabFind(CfgI32Tab *tab, SmView name);
@@ -9,6 +9,7 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 
 static void help(char const *name) {
     fprintf(
@@ -26,15 +27,18 @@ static void help(char const *name) {
         "  -g, --debug <DEBUG>          Output file for `SYM` debug symbols\n"
         "      --tags <TAGS>            Output file for ctags\n"
         "  -D, --define <KEY1=val>      Pre-defined symbols (repeatable)\n"
+        "      --stats                  Print allocator statistics\n"
         "  -h, --help                   Print help\n",
         name);
 }
 
 static FILE      *openFileCstr(char const *path, char const *modes);
 static void       closeFile(FILE *hnd);
-static SmLbl      globalLbl(SmView name);
+static SmLbl      globalLbl(SmAtom name);
 static SmExprView constExprBuf(I32 num);
 static SmView     intern(SmView view);
+static SmAtom     atom(SmView view);
+static SmPosInfo  posInfo(SmPos pos);
 static void       parseCfg();
 static void       loadObj(SmView path);
 static void       allocate(SmSect *sect);
@@ -50,18 +54,27 @@ static FILE *outfile      = NULL;
 static char *outfile_name = NULL;
 static char *symfile_name = NULL;
 static char *tagfile_name = NULL;
+static Bool  stats        = false;
 
 static SmViewIntern STRS  = {};
 static SmSymTab     SYMS  = {};
 static SmExprIntern EXPRS = {};
+static SmLblNames   NAMES = {};
 static SmPathSet    OBJS  = {};
 static SmSectBuf    SECTS = {};
+// the config and the files positions in objects point into
+static SmPosTab     POSITIONS = {};
 
 static CfgOutBuf CFGS     = {};
 
+// per-object scratch, reset after each object is merged
+static SmArena OBJ_ARENA   = {};
+// expression evaluation stacks, released as each evaluation returns
+static SmArena SOLVE_ARENA = {};
+
 static SmView DEFINES_SECTION;
-static SmView STATIC_UNIT;
-static SmView EXPORT_UNIT;
+static SmAtom STATIC_UNIT;
+static SmAtom EXPORT_UNIT;
 
 int main(int argc, char **argv) {
     outfile = stdout;
@@ -70,8 +83,10 @@ int main(int argc, char **argv) {
         return 0;
     }
     DEFINES_SECTION = intern(SM_VIEW("@DEFINES"));
-    STATIC_UNIT     = intern(SM_VIEW("@STATIC"));
-    EXPORT_UNIT     = intern(SM_VIEW("@EXPORT"));
+    STATIC_UNIT     = atom(SM_VIEW("@STATIC"));
+    EXPORT_UNIT     = atom(SM_VIEW("@EXPORT"));
+    SmPos defines   =
+        smPosLineCol(smPosTabAddName(&POSITIONS, DEFINES_SECTION), 1, 1);
     for (int argi = 1; argi < argc; ++argi) {
         if (!strcmp(argv[argi], "-h") || !strcmp(argv[argi], "--help")) {
             help(argv[0]);
@@ -110,6 +125,10 @@ int main(int argc, char **argv) {
             tagfile_name = argv[argi];
             continue;
         }
+        if (!strcmp(argv[argi], "--stats")) {
+            stats = true;
+            continue;
+        }
         if (!strcmp(argv[argi], "-D") || !strcmp(argv[argi], "--define")) {
             ++argi;
             if (argi == argc) {
@@ -120,7 +139,7 @@ int main(int argc, char **argv) {
                 smFatal("expected `=` in %s\n", argv[argi]);
             }
             UInt   name_len  = offset - argv[argi];
-            SmView name      = intern((SmView){(U8 *)argv[argi], name_len});
+            SmAtom name      = atom((SmView){(U8 *)argv[argi], name_len});
             UInt   value_len = strlen(argv[argi]) - name_len - 1;
             // TODO: should expose general-purpose expression parsing
             // for use here and for expressions in the linker scripts
@@ -131,8 +150,8 @@ int main(int argc, char **argv) {
                                    .lbl     = globalLbl(name),
                                    .value   = constExprBuf(num),
                                    .unit    = EXPORT_UNIT,
-                                   .section = DEFINES_SECTION,
-                                   .pos     = {DEFINES_SECTION, 1, 1},
+                                   .section = atom(DEFINES_SECTION),
+                                   .pos     = defines,
                                    .flags   = SM_SYM_EQU,
                                });
             continue;
@@ -176,10 +195,20 @@ int main(int argc, char **argv) {
 
     serialize();
     closeFile(outfile);
+    if (stats) {
+        fprintf(stderr,
+                "arena: %" UINT_FMT " allocations, %" UINT_FMT
+                " mallocs avoided\n",
+                OBJ_ARENA.allocs + SOLVE_ARENA.allocs,
+                smArenaMallocsAvoided(&OBJ_ARENA) +
+                    smArenaMallocsAvoided(&SOLVE_ARENA));
+    }
     return EXIT_SUCCESS;
 }
 
-static SmView intern(SmView view) { return smViewIntern(&STRS, view); }
+static SmView    intern(SmView view) { return smViewIntern(&STRS, view); }
+static SmAtom    atom(SmView view) { return smViewAtom(&STRS, view); }
+static SmPosInfo posInfo(SmPos pos) { return smPosTabInfo(&POSITIONS, pos); }
 
 static FILE *openFile(SmView path, char const *modes) {
     static SmBuf buf = {};
@@ -200,15 +229,10 @@ static _Noreturn void objFatal(SmView path, char const *fmt, ...) {
     objFatalV(path, fmt, args);
 }
 
-static SmLbl internLbl(SmLbl lbl) {
-    if (smViewEqual(lbl.scope, SM_VIEW_NULL)) {
-        return globalLbl(intern(lbl.name));
-    }
-    return (SmLbl){intern(lbl.scope), intern(lbl.name)};
+static SmView fullLblName(SmLbl lbl) {
+    return smAtomView(&STRS, smLblNamesGet(&NAMES, lbl, &STRS));
 }
 
-static SmView fullLblName(SmLbl lbl) { return smLblFullName(lbl, &STRS); }
-
 static SmSect *findSect(SmView name) {
     for (UInt i = 0; i < SECTS.view.len; ++i) {
         SmSect *sect = SECTS.view.items + i;
@@ -227,14 +251,8 @@ static SmExprView internExpr(SmExprView view) {
             expr->addr.sect = intern(expr->addr.sect);
             break;
         case SM_EXPR_TAG:
-            expr->tag.lbl  = internLbl(expr->tag.lbl);
             expr->tag.name = intern(expr->tag.name);
             break;
-        case SM_EXPR_LABEL:
-        case SM_EXPR_REL: {
-            expr->lbl = internLbl(expr->lbl);
-            break;
-        }
         default:
             break;
         }
@@ -242,15 +260,36 @@ static SmExprView internExpr(SmExprView view) {
     return smExprIntern(&EXPRS, view);
 }
 
+// Copies a blob of object `path` straight from its file onto the end of
+// `data`, after checking the file is still the one that was assembled
+static void catBlob(SmView path, SmBuf *data, SmBlob const *blob) {
+    Bool    mapped;
+    FILE   *hnd   = openFile(blob->path, "rb");
+    SmSerde ser   = {hnd, blob->path, NULL, &POSITIONS, 0, 0};
+    SmView  bytes = smDeserializeMap(&ser, &mapped);
+    closeFile(hnd);
+    if ((bytes.len != blob->len) || (smViewDigest(bytes) != blob->hash)) {
+        objFatal(path, "%" SM_VIEW_FMT " changed since it was assembled\n",
+                 SM_VIEW_FMT_ARG(blob->path));
+    }
+    smBufCat(data, bytes);
+    if (mapped) {
+        munmap(bytes.bytes, bytes.len);
+    } else {
+        free(bytes.bytes);
+    }
+}
+
 static void loadObj(SmView path) {
     FILE   *hnd   = openFile(path, "rb");
-    SmSerde ser   = {hnd, path};
+    SmSerde ser   = {hnd, path, &OBJ_ARENA, &POSITIONS, 0, 0};
     U32     magic = smDeserializeU32(&ser);
-    if (magic != *(U32 *)"SM00") {
+    if (magic != *(U32 *)"SM02") {
         objFatal(path, "bad magic: $%04" U32_FMTX "\n", magic);
     }
+    // labels, units and section names are read straight into our own atoms
     SmViewIntern tmpstrs  = smDeserializeViewIntern(&ser);
-    SmExprIntern tmpexprs = smDeserializeExprIntern(&ser, &tmpstrs);
+    SmExprIntern tmpexprs = smDeserializeExprIntern(&ser, &tmpstrs, &STRS);
     // Fixup addresses to be absolute
     for (UInt i = 0; i < tmpexprs.len; ++i) {
         SmExprBuf *buf = tmpexprs.bufs + i;
@@ -270,47 +309,44 @@ static void loadObj(SmView path) {
             expr->addr.pc += sect->pc;
         }
     }
-    SmSymTab tmpsyms = smDeserializeSymTab(&ser, &tmpstrs, &tmpexprs);
+    // positions are read straight into our own table as well
+    smDeserializePosTab(&ser, &STRS);
+    SmSymTab tmpsyms = smDeserializeSymTab(&ser, &tmpstrs, &STRS, &tmpexprs);
+    SmAtom   objunit = atom(path);
     // Merge into main symtab
-    for (UInt i = 0; i < tmpsyms.cap; ++i) {
+    for (UInt i = 0; i < tmpsyms.len; ++i) {
         SmSym *sym = tmpsyms.syms + i;
-        if (smLblEqual(sym->lbl, SM_LBL_NULL)) {
-            continue;
-        }
         // Hide static symbols under file-specific unit
-        SmView unit;
-        if (smViewEqual(sym->unit, STATIC_UNIT)) {
-            unit = path;
+        SmAtom unit;
+        if (sym->unit == STATIC_UNIT) {
+            unit = objunit;
         } else {
             unit = sym->unit;
         }
         SmSym *whence = smSymTabFind(&SYMS, sym->lbl);
-        if (whence && smViewEqual(whence->unit, unit)) {
-            SmView name = fullLblName(sym->lbl);
+        if (whence && (whence->unit == unit)) {
+            SmView    name  = fullLblName(sym->lbl);
+            SmPosInfo first = posInfo(whence->pos);
+            SmPosInfo again = posInfo(sym->pos);
             objFatal(
                 path,
                 "duplicate exported symbol: %" SM_VIEW_FMT
                 "\n\tdefined at %" SM_VIEW_FMT ":%" UINT_FMT ":%" UINT_FMT
                 "\n\tagain at %" SM_VIEW_FMT ":%" UINT_FMT ":%" UINT_FMT "\n",
-                SM_VIEW_FMT_ARG(name), SM_VIEW_FMT_ARG(whence->pos.file),
-                whence->pos.line, whence->pos.col,
-                SM_VIEW_FMT_ARG(sym->pos.file), sym->pos.line, sym->pos.col);
+                SM_VIEW_FMT_ARG(name), SM_VIEW_FMT_ARG(first.file), first.line,
+                first.col, SM_VIEW_FMT_ARG(again.file), again.line, again.col);
         }
         smSymTabAdd(&SYMS, (SmSym){
-                               .lbl     = internLbl(sym->lbl),
+                               .lbl     = sym->lbl,
                                .value   = internExpr(sym->value),
-                               .unit    = intern(unit),
-                               .section = intern(sym->section),
-                               .pos =
-                                   {
-                                       intern(sym->pos.file),
-                                       sym->pos.line,
-                                       sym->pos.col,
-                                   },
-                               .flags = sym->flags,
+                               .unit    = unit,
+                               .section = sym->section,
+                               .pos     = sym->pos,
+                               .flags   = sym->flags,
                            });
     }
-    SmSectBuf tmpsects = smDeserializeSectBuf(&ser, &tmpstrs, &tmpexprs);
+    SmSectBuf tmpsects =
+        smDeserializeSectBuf(&ser, &tmpstrs, &STRS, &tmpexprs);
     closeFile(hnd);
     for (UInt i = 0; i < tmpsects.view.len; ++i) {
         SmSect *sect    = tmpsects.view.items + i;
@@ -324,10 +360,10 @@ static void loadObj(SmView path) {
         // copy relocations
         for (UInt j = 0; j < sect->relocs.view.len; ++j) {
             SmReloc *reloc = sect->relocs.view.items + j;
-            SmView   unit;
+            SmAtom   unit;
             // fixup relocation units
-            if (smViewEqual(reloc->unit, STATIC_UNIT)) {
-                unit = path;
+            if (reloc->unit == STATIC_UNIT) {
+                unit = objunit;
             } else {
                 unit = EXPORT_UNIT;
             }
@@ -338,24 +374,26 @@ static void loadObj(SmView path) {
                     .offset = dstsect->pc + reloc->offset,
                     .width  = reloc->width,
                     .value  = internExpr(reloc->value),
-                    .unit   = intern(unit),
-                    .pos =
-                        {
-                            intern(reloc->pos.file),
-                            reloc->pos.line,
-                            reloc->pos.col,
-                        },
-                    .flags = reloc->flags,
+                    .unit   = unit,
+                    .pos    = reloc->pos,
+                    .flags  = reloc->flags,
                 });
         }
-        // extend destination section
-        smBufCat(&dstsect->data, sect->data.view);
+        // extend destination section, blobs come from their own files
+        UInt at = 0;
+        for (UInt j = 0; j < sect->blobs.view.len; ++j) {
+            SmBlob *blob = sect->blobs.view.items + j;
+            smBufCat(&dstsect->data, (SmView){sect->data.view.bytes + at,
+                                              blob->offset - at});
+            catBlob(path, &dstsect->data, blob);
+            at = blob->offset + blob->len;
+        }
+        smBufCat(&dstsect->data, (SmView){sect->data.view.bytes + at,
+                                          sect->data.view.len - at});
         dstsect->pc += sect->data.view.len;
-        // free up
-        smRelocBufFini(&sect->relocs);
-        smBufFini(&sect->data);
     }
-    smSectBufFini(&tmpsects);
+    // sections live in the object arena, drop them all at once
+    smArenaReset(&OBJ_ARENA);
     smSymTabFini(&tmpsyms);
     smExprInternFini(&tmpexprs);
     smViewInternFini(&tmpstrs);
@@ -419,7 +457,7 @@ static void allocate(SmSect *sect) {
     for (UInt i = 0; i < in->files.len; ++i) {
         SmView  path = in->files.items[i];
         FILE   *hnd  = openFile(path, "rb");
-        SmSerde ser  = {hnd, path};
+        SmSerde ser  = {hnd, path, NULL, NULL, 0, 0};
         smDeserializeToEnd(&ser, &sect->data);
     }
     if (in->size) {
@@ -431,9 +469,11 @@ static void allocate(SmSect *sect) {
                     (UInt)in->sizeval);
         }
         if (in->fill) {
-            while (sect->data.view.len < in->sizeval) {
-                smBufCat(&sect->data, (SmView){&in->fillval, 1});
-            }
+            UInt fill = in->sizeval - sect->data.view.len;
+            smBufReserve(&sect->data, fill);
+            memset(sect->data.view.bytes + sect->data.view.len, in->fillval,
+                   fill);
+            sect->data.view.len += fill;
         }
     }
     out->pc = sect->pc + sect->data.view.len;
@@ -447,45 +487,49 @@ static void allocate(SmSect *sect) {
         buf.view.len     = 0;
         smBufCat(&buf, in->define);
         smBufCat(&buf, SM_VIEW("_START"));
-        SmView start = intern(buf.view);
+        SmAtom start = atom(buf.view);
         smSymTabAdd(&SYMS, (SmSym){
                                .lbl     = globalLbl(start),
                                .value   = constExprBuf(sect->pc),
                                .unit    = EXPORT_UNIT,
-                               .section = DEFINES_SECTION,
+                               .section = atom(DEFINES_SECTION),
                                .pos     = in->defpos,
                                .flags   = SM_SYM_EQU,
                            });
         buf.view.len = 0;
         smBufCat(&buf, in->define);
         smBufCat(&buf, SM_VIEW("_SIZE"));
-        SmView size = intern(buf.view);
+        SmAtom size = atom(buf.view);
         smSymTabAdd(&SYMS, (SmSym){
                                .lbl     = globalLbl(size),
                                .value   = constExprBuf(sect->data.view.len),
                                .unit    = EXPORT_UNIT,
-                               .section = DEFINES_SECTION,
+                               .section = atom(DEFINES_SECTION),
                                .pos     = in->defpos,
                                .flags   = SM_SYM_EQU,
                            });
     }
 }
 
-static Bool solve(SmExprView view, SmView unit, I32 *num) {
-    SmI32Buf stack = {};
+static void pushNum(SmI32Buf *stack, I32 num) {
+    smI32BufArenaAdd(stack, &SOLVE_ARENA, num);
+}
+
+static Bool solve(SmExprView view, SmAtom unit, I32 *num) {
+    SmArenaMark mark  = smArenaMark(&SOLVE_ARENA);
+    SmI32Buf    stack = {};
     for (UInt i = 0; i < view.len; ++i) {
         SmExpr *expr = view.items + i;
         switch (expr->kind) {
         case SM_EXPR_CONST:
-            smI32BufAdd(&stack, expr->num);
+            pushNum(&stack, expr->num);
             break;
         case SM_EXPR_LABEL: {
             SmSym *sym = smSymTabFind(&SYMS, expr->lbl);
             if (!sym) {
                 goto fail;
             }
-            if (!smViewEqual(sym->unit, unit) &&
-                !smViewEqual(sym->unit, EXPORT_UNIT)) {
+            if ((sym->unit != unit) && (sym->unit != EXPORT_UNIT)) {
                 goto fail;
             }
             I32 num;
@@ -493,7 +537,7 @@ static Bool solve(SmExprView view, SmView unit, I32 *num) {
             if (!solve(sym->value, unit, &num)) {
                 goto fail;
             }
-            smI32BufAdd(&stack, num);
+            pushNum(&stack, num);
             break;
         }
         case SM_EXPR_TAG: {
@@ -501,12 +545,12 @@ static Bool solve(SmExprView view, SmView unit, I32 *num) {
             if (!sym) {
                 goto fail;
             }
-            if (!smViewEqual(sym->unit, unit) &&
-                !smViewEqual(sym->unit, EXPORT_UNIT)) {
+            if ((sym->unit != unit) && (sym->unit != EXPORT_UNIT)) {
                 goto fail;
             }
-            CfgOut *cfgout = NULL;
-            CfgIn  *in     = findCfgIn(sym->section, &cfgout);
+            SmView  section = smAtomView(&STRS, sym->section);
+            CfgOut *cfgout  = NULL;
+            CfgIn  *in      = findCfgIn(section, &cfgout);
             assert(cfgout);
             assert(in);
             // find the tag in the section
@@ -514,7 +558,7 @@ static Bool solve(SmExprView view, SmView unit, I32 *num) {
             if (!tag) {
                 goto fail;
             }
-            smI32BufAdd(&stack, tag->num);
+            pushNum(&stack, tag->num);
             break;
         }
         case SM_EXPR_OP:
@@ -523,25 +567,25 @@ static Bool solve(SmExprView view, SmView unit, I32 *num) {
             if (expr->op.unary) {
                 switch (expr->op.tok) {
                 case '+':
-                    smI32BufAdd(&stack, rhs);
+                    pushNum(&stack, rhs);
                     break;
                 case '-':
-                    smI32BufAdd(&stack, -rhs);
+                    pushNum(&stack, -rhs);
                     break;
                 case '~':
-                    smI32BufAdd(&stack, ~rhs);
+                    pushNum(&stack, ~rhs);
                     break;
                 case '!':
-                    smI32BufAdd(&stack, !rhs);
+                    pushNum(&stack, !rhs);
                     break;
                 case '<':
-                    smI32BufAdd(&stack, ((U32)rhs) & 0xFF);
+                    pushNum(&stack, ((U32)rhs) & 0xFF);
                     break;
                 case '>':
-                    smI32BufAdd(&stack, ((U32)rhs & 0xFF00) >> 8);
+                    pushNum(&stack, ((U32)rhs & 0xFF00) >> 8);
                     break;
                 case '^':
-                    smI32BufAdd(&stack, ((U32)rhs & 0xFF0000) >> 16);
+                    pushNum(&stack, ((U32)rhs & 0xFF0000) >> 16);
                     break;
                 default:
                     SM_UNREACHABLE();
@@ -551,61 +595,61 @@ static Bool solve(SmExprView view, SmView unit, I32 *num) {
                 I32 lhs = stack.view.items[stack.view.len];
                 switch (expr->op.tok) {
                 case '+':
-                    smI32BufAdd(&stack, lhs + rhs);
+                    pushNum(&stack, lhs + rhs);
                     break;
                 case '-':
-                    smI32BufAdd(&stack, lhs - rhs);
+                    pushNum(&stack, lhs - rhs);
                     break;
                 case '*':
-                    smI32BufAdd(&stack, lhs * rhs);
+                    pushNum(&stack, lhs * rhs);
                     break;
                 case '/':
-                    smI32BufAdd(&stack, lhs / rhs);
+                    pushNum(&stack, lhs / rhs);
                     break;
                 case '%':
-                    smI32BufAdd(&stack, lhs % rhs);
+                    pushNum(&stack, lhs % rhs);
                     break;
                 case SM_TOK_ASL:
-                    smI32BufAdd(&stack, lhs << rhs);
+                    pushNum(&stack, lhs << rhs);
                     break;
                 case SM_TOK_ASR:
-                    smI32BufAdd(&stack, lhs >> rhs);
+                    pushNum(&stack, lhs >> rhs);
                     break;
                 case SM_TOK_LSR:
-                    smI32BufAdd(&stack, ((U32)lhs) >> ((U32)rhs));
+                    pushNum(&stack, ((U32)lhs) >> ((U32)rhs));
                     break;
                 case '<':
-                    smI32BufAdd(&stack, lhs < rhs);
+                    pushNum(&stack, lhs < rhs);
                     break;
                 case SM_TOK_LTE:
-                    smI32BufAdd(&stack, lhs <= rhs);
+                    pushNum(&stack, lhs <= rhs);
                     break;
                 case '>':
-                    smI32BufAdd(&stack, lhs > rhs);
+                    pushNum(&stack, lhs > rhs);
                     break;
                 case SM_TOK_GTE:
-                    smI32BufAdd(&stack, lhs >= rhs);
+                    pushNum(&stack, lhs >= rhs);
                     break;
                 case SM_TOK_DEQ:
-                    smI32BufAdd(&stack, lhs == rhs);
+                    pushNum(&stack, lhs == rhs);
                     break;
                 case SM_TOK_NEQ:
-                    smI32BufAdd(&stack, lhs != rhs);
+                    pushNum(&stack, lhs != rhs);
                     break;
                 case '&':
-                    smI32BufAdd(&stack, lhs & rhs);
+                    pushNum(&stack, lhs & rhs);
                     break;
                 case '|':
-                    smI32BufAdd(&stack, lhs | rhs);
+                    pushNum(&stack, lhs | rhs);
                     break;
                 case '^':
-                    smI32BufAdd(&stack, lhs ^ rhs);
+                    pushNum(&stack, lhs ^ rhs);
                     break;
                 case SM_TOK_AND:
-                    smI32BufAdd(&stack, lhs && rhs);
+                    pushNum(&stack, lhs && rhs);
                     break;
                 case SM_TOK_OR:
-                    smI32BufAdd(&stack, lhs || rhs);
+                    pushNum(&stack, lhs || rhs);
                     break;
                 default:
                     SM_UNREACHABLE();
@@ -617,7 +661,7 @@ static Bool solve(SmExprView view, SmView unit, I32 *num) {
             if (!sect) {
                 goto fail;
             }
-            smI32BufAdd(&stack, sect->pc + expr->addr.pc);
+            pushNum(&stack, sect->pc + expr->addr.pc);
             break;
         }
         default:
@@ -626,21 +670,18 @@ static Bool solve(SmExprView view, SmView unit, I32 *num) {
     }
     assert(stack.view.len == 1);
     *num = *stack.view.items;
-    smI32BufFini(&stack);
+    smArenaRelease(&SOLVE_ARENA, mark);
     return true;
 fail:
-    smI32BufFini(&stack);
+    smArenaRelease(&SOLVE_ARENA, mark);
     return false;
 }
 
 static void solveSyms() {
     // 2 passes over symbol table should be enough to solve all
     for (UInt i = 0; i < 2; ++i) {
-        for (UInt j = 0; j < SYMS.cap; ++j) {
+        for (UInt j = 0; j < SYMS.len; ++j) {
             SmSym *sym = SYMS.syms + j;
-            if (smLblEqual(sym->lbl, SM_LBL_NULL)) {
-                continue;
-            }
             if ((sym->value.len == 1) &&
                 (sym->value.items[0].kind == SM_EXPR_CONST)) {
                 continue;
@@ -651,21 +692,19 @@ static void solveSyms() {
             }
         }
     }
-    for (UInt i = 0; i < SYMS.cap; ++i) {
+    for (UInt i = 0; i < SYMS.len; ++i) {
         SmSym *sym = SYMS.syms + i;
-        if (smLblEqual(sym->lbl, SM_LBL_NULL)) {
-            continue;
-        }
         if ((sym->value.len == 1) &&
             (sym->value.items[0].kind == SM_EXPR_CONST)) {
             continue;
         }
-        SmView name = fullLblName(sym->lbl);
+        SmView    name = fullLblName(sym->lbl);
+        SmPosInfo at   = posInfo(sym->pos);
         smFatal("undefined symbol: %" SM_VIEW_FMT
                 "\n\treferenced at %" SM_VIEW_FMT ":%" UINT_FMT ":%" UINT_FMT
                 "\n",
-                SM_VIEW_FMT_ARG(name), SM_VIEW_FMT_ARG(sym->pos.file),
-                sym->pos.line, sym->pos.col);
+                SM_VIEW_FMT_ARG(name), SM_VIEW_FMT_ARG(at.file), at.line,
+                at.col);
     }
 }
 
@@ -677,10 +716,10 @@ static void link(SmSect *sect) {
         SmReloc *reloc = sect->relocs.view.items + i;
         I32      num;
         if (!solve(reloc->value, reloc->unit, &num)) {
+            SmPosInfo at = posInfo(reloc->pos);
             smFatal("expression cannot be solved\n\treferenced at %" SM_VIEW_FMT
                     ":%" UINT_FMT ":%" UINT_FMT "\n",
-                    SM_VIEW_FMT_ARG(reloc->pos.file), reloc->pos.line,
-                    reloc->pos.col);
+                    SM_VIEW_FMT_ARG(at.file), at.line, at.col);
         }
         switch (reloc->width) {
         case 1:
@@ -704,11 +743,12 @@ static void link(SmSect *sect) {
                     }
                 }
                 if (!legal) {
+                    SmPosInfo at = posInfo(reloc->pos);
                     smFatal("expression does not fit in a byte: "
                             "$%08" U32_FMTX "\n\treferenced at %" SM_VIEW_FMT
                             ":%" UINT_FMT ":%" UINT_FMT "\n",
-                            (U32)num, SM_VIEW_FMT_ARG(reloc->pos.file),
-                            reloc->pos.line, reloc->pos.col);
+                            (U32)num, SM_VIEW_FMT_ARG(at.file), at.line,
+                            at.col);
                 }
             }
             if (reloc->flags & SM_RELOC_RST) {
@@ -738,12 +778,14 @@ static void link(SmSect *sect) {
                 case 0x38:
                     op = 0xFF;
                     break;
-                default:
+                default: {
+                    SmPosInfo at = posInfo(reloc->pos);
                     smFatal("illegal reset vector: $%08" U32_FMTX
                             "\n\treferenced "
                             "at %" SM_VIEW_FMT ":%" UINT_FMT ":%" UINT_FMT "\n",
-                            (U32)num, SM_VIEW_FMT_ARG(reloc->pos.file),
-                            reloc->pos.line, reloc->pos.col);
+                            (U32)num, SM_VIEW_FMT_ARG(at.file), at.line,
+                            at.col);
+                }
                 }
                 sect->data.view.bytes[reloc->offset] = op;
                 continue;
@@ -754,11 +796,11 @@ static void link(SmSect *sect) {
             // TODO check if src and dst banks are the same
             // also a JP within bank0 is always legal for GB
             if (!canReprU16(num)) {
+                SmPosInfo at = posInfo(reloc->pos);
                 smFatal("expression does not fit in a word: "
                         "$%08" U32_FMTX "\n\treferenced at %" SM_VIEW_FMT
                         ":%" UINT_FMT ":%" UINT_FMT "\n",
-                        (U32)num, SM_VIEW_FMT_ARG(reloc->pos.file),
-                        reloc->pos.line, reloc->pos.col);
+                        (U32)num, SM_VIEW_FMT_ARG(at.file), at.line, at.col);
             }
             sect->data.view.bytes[reloc->offset]     = (U8)(num & 0xFF);
             sect->data.view.bytes[reloc->offset + 1] = (U8)((num >> 8) & 0xFF);
@@ -982,16 +1024,12 @@ static CfgInView parseInSects(CfgOut const *out) {
                 CfgI32Tab oldtags = in.tags;
                 in.tags           = parseTags();
                 // copy base tags
-                for (UInt i = 0; i < oldtags.cap; ++i) {
-                    CfgI32Entry *oldtag = oldtags.entries + i;
-                    if (smViewEqual(oldtag->name, SM_VIEW_NULL)) {
-                        continue;
-                    }
+                for (UInt i = 0; i < oldtags.len; ++i) {
+                    CfgI32Entry *oldtag = smMapAt(&oldtags, i);
                     // only apply tag if the output section does not already
                     // have it
-                    CfgI32Entry *newtag = cfgI32TabFind(&in.tags, oldtag->name);
-                    if (smViewEqual(newtag->name, SM_VIEW_NULL)) {
-                        *newtag = *oldtag;
+                    if (!cfgI32TabFind(&in.tags, oldtag->name)) {
+                        cfgI32TabAdd(&in.tags, *oldtag);
                     }
                 }
                 expect(']');
@@ -1173,7 +1211,7 @@ endsects:
 static void parseCfg() {
     SmView cfgname =
         smPathIntern(&STRS, (SmView){(U8 *)cfgfile_name, strlen(cfgfile_name)});
-    smTokStreamFileInit(&TS, cfgname, cfgfile);
+    smTokStreamFileInit(&TS, &POSITIONS, cfgname, cfgfile);
     Bool sections = false;
     while (peek() != SM_TOK_EOF) {
         switch (peek()) {
@@ -1215,24 +1253,24 @@ static void parseCfg() {
             buf.view.len     = 0;
             smBufCat(&buf, out->define);
             smBufCat(&buf, SM_VIEW("_START"));
-            SmView start = intern(buf.view);
+            SmAtom start = atom(buf.view);
             smSymTabAdd(&SYMS, (SmSym){
                                    .lbl     = globalLbl(start),
                                    .value   = constExprBuf(out->start),
                                    .unit    = EXPORT_UNIT,
-                                   .section = DEFINES_SECTION,
+                                   .section = atom(DEFINES_SECTION),
                                    .pos     = out->defpos,
                                    .flags   = SM_SYM_EQU,
                                });
             buf.view.len = 0;
             smBufCat(&buf, out->define);
             smBufCat(&buf, SM_VIEW("_SIZE"));
-            SmView size = intern(buf.view);
+            SmAtom size = atom(buf.view);
             smSymTabAdd(&SYMS, (SmSym){
                                    .lbl     = globalLbl(size),
                                    .value   = constExprBuf(out->size),
                                    .unit    = EXPORT_UNIT,
-                                   .section = DEFINES_SECTION,
+                                   .section = atom(DEFINES_SECTION),
                                    .pos     = out->defpos,
                                    .flags   = SM_SYM_EQU,
                                });
@@ -1265,7 +1303,10 @@ static void parseCfg() {
 }
 
 static void serialize() {
-    SmSerde ser = {outfile, {(U8 *)outfile_name, strlen(outfile_name)}};
+    SmSerde ser = {
+        .hnd  = outfile,
+        .name = {(U8 *)outfile_name, strlen(outfile_name)},
+    };
     for (UInt i = 0; i < CFGS.view.len; ++i) {
         CfgOut *cfgout = CFGS.view.items + i;
         for (UInt j = 0; j < cfgout->ins.len; ++j) {
@@ -1287,7 +1328,7 @@ static void serialize() {
     }
 }
 
-static SmLbl globalLbl(SmView name) { return (SmLbl){{}, name}; }
+static SmLbl globalLbl(SmAtom name) { return (SmLbl){SM_ATOM_NULL, name}; }
 
 static SmExprView constExprBuf(I32 num) {
     return smExprIntern(
@@ -1309,44 +1350,65 @@ static void closeFile(FILE *hnd) {
     }
 }
 
-static int cmpSym(SmSym const *lhs, SmSym const *rhs) {
-    if (smLblEqual(lhs->lbl, SM_LBL_NULL)) {
-        return 1;
+// The first 8 bytes of the name, big-endian and zero padded, so that keys
+// compare as integers in the same order as the names would under memcmp
+static U64 namePrefix(SmView name) {
+    U64 prefix = 0;
+    for (UInt i = 0; i < 8; ++i) {
+        prefix <<= 8;
+        if (i < name.len) {
+            prefix |= name.bytes[i];
+        }
     }
-    if (smLblEqual(rhs->lbl, SM_LBL_NULL)) {
-        return -1;
+    return prefix;
+}
+
+typedef struct {
+    U64    prefix;
+    SmView name;
+    SmSym *sym;
+} SymKey;
+
+typedef struct {
+    SymKey *items;
+    UInt    len;
+} SymKeyView;
+
+static int cmpSymKey(SymKey const *lhs, SymKey const *rhs) {
+    if (lhs->prefix != rhs->prefix) {
+        return (lhs->prefix < rhs->prefix) ? -1 : 1;
     }
-    SmView lname = fullLblName(lhs->lbl);
-    SmView rname = fullLblName(rhs->lbl);
+    SmView lname = lhs->name;
+    SmView rname = rhs->name;
     int cmp = memcmp(lname.bytes, rname.bytes, uIntMin(lname.len, rname.len));
     if (!cmp) {
-        return lname.len - rname.len;
+        return (lname.len > rname.len) - (lname.len < rname.len);
     }
     return cmp;
 }
 
-static SmSymTab sortSyms() {
-    // Clone and sort the symbol table
-    SmSymTab tab = {};
-    for (UInt i = 0; i < SYMS.cap; ++i) {
-        SmSym *sym = SYMS.syms + i;
-        if (smLblEqual(sym->lbl, SM_LBL_NULL)) {
-            continue;
-        }
-        smSymTabAdd(&tab, *sym);
+static SymKeyView sortSyms() {
+    // Sort keys pointing at the symbols rather than the symbols themselves.
+    // Each full name is looked up once here instead of on every comparison
+    SymKeyView keys = {malloc(sizeof(SymKey) * uIntMax(SYMS.len, 1)), 0};
+    if (!keys.items) {
+        smFatal("out of memory\n");
     }
-    qsort(tab.syms, tab.cap, sizeof(SmSym), (void *)cmpSym);
-    return tab;
+    for (UInt i = 0; i < SYMS.len; ++i) {
+        SmSym *sym    = SYMS.syms + i;
+        SmView name   = fullLblName(sym->lbl);
+        keys.items[i] = (SymKey){namePrefix(name), name, sym};
+    }
+    keys.len = SYMS.len;
+    qsort(keys.items, keys.len, sizeof(SymKey), (void *)cmpSymKey);
+    return keys;
 }
 
 static void writeSyms() {
-    FILE    *hnd = openFileCstr(symfile_name, "wb+");
-    SmSymTab tab = sortSyms();
-    for (UInt i = 0; i < tab.cap; ++i) {
-        SmSym *sym = tab.syms + i;
-        if (smLblEqual(sym->lbl, SM_LBL_NULL)) {
-            continue;
-        }
+    FILE      *hnd  = openFileCstr(symfile_name, "wb+");
+    SymKeyView keys = sortSyms();
+    for (UInt i = 0; i < keys.len; ++i) {
+        SmSym *sym = keys.items[i].sym;
         if (sym->flags & SM_SYM_EQU) {
             continue;
         }
@@ -1354,9 +1416,9 @@ static void writeSyms() {
             (sym->value.items[0].kind != SM_EXPR_CONST)) {
             continue;
         }
-        SmView  name   = fullLblName(sym->lbl);
+        SmView  name   = keys.items[i].name;
         CfgOut *cfgout = NULL;
-        CfgIn  *in     = findCfgIn(sym->section, &cfgout);
+        CfgIn  *in     = findCfgIn(smAtomView(&STRS, sym->section), &cfgout);
         assert(in);
         I32          bank = 0;
         CfgI32Entry *tag  = cfgI32TabFind(&in->tags, SM_VIEW("bank"));
@@ -1373,26 +1435,24 @@ static void writeSyms() {
                     strerror(errno));
         }
     }
-    smSymTabFini(&tab);
+    free(keys.items);
     closeFile(hnd);
 }
 
 static void writeTags() {
-    FILE    *hnd = openFileCstr(tagfile_name, "wb+");
-    SmSymTab tab = sortSyms();
-    for (UInt i = 0; i < tab.cap; ++i) {
-        SmSym *sym = tab.syms + i;
-        if (smLblEqual(sym->lbl, SM_LBL_NULL)) {
-            continue;
-        }
-        SmView name = fullLblName(sym->lbl);
+    FILE      *hnd  = openFileCstr(tagfile_name, "wb+");
+    SymKeyView keys = sortSyms();
+    for (UInt i = 0; i < keys.len; ++i) {
+        SmSym    *sym  = keys.items[i].sym;
+        SmView    name = keys.items[i].name;
+        SmPosInfo at   = posInfo(sym->pos);
         if (fprintf(hnd, "%" SM_VIEW_FMT "\t%" SM_VIEW_FMT "\t%" UINT_FMT " \n",
-                    SM_VIEW_FMT_ARG(name), SM_VIEW_FMT_ARG(sym->pos.file),
-                    sym->pos.line) < 0) {
+                    SM_VIEW_FMT_ARG(name), SM_VIEW_FMT_ARG(at.file),
+                    at.line) < 0) {
             smFatal("%s: failed to write file: %s\n", symfile_name,
                     strerror(errno));
         }
     }
-    smSymTabFini(&tab);
+    free(keys.items);
     closeFile(hnd);
 }
@@ -0,0 +1,177 @@
+#include <smasm/fatal.h>
+#include <smasm/kw.h>
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void help(char const *name) {
+    fprintf(stderr,
+            "Keyword perfect hash table generator\n"
+            "\n"
+            "Usage: %s <INPUT> <OUTPUT>\n"
+            "\n"
+            "Arguments:\n"
+            "  <INPUT>   Keyword list, one `NAME TOKEN` per line, `#` starts "
+            "a comment\n"
+            "  <OUTPUT>  C header defining the SmKwTab, named after INPUT\n",
+            name);
+}
+
+#define MAX_KWS   256
+#define MAX_BITS  12
+#define MAX_TRIES (1 << 20)
+
+typedef struct {
+    char name[9];
+    char tok[64];
+    U64  key;
+} Kw;
+
+static Kw   kws[MAX_KWS];
+static UInt nkws = 0;
+
+static void readList(char const *path) {
+    FILE *hnd = fopen(path, "rb");
+    if (!hnd) {
+        smFatal("could not open file: %s: %s\n", path, strerror(errno));
+    }
+    char line[256];
+    for (UInt lineno = 1; fgets(line, sizeof(line), hnd); ++lineno) {
+        char *hash = strchr(line, '#');
+        if (hash) {
+            *hash = '\0';
+        }
+        char name[16];
+        char tok[64];
+        int  fields = sscanf(line, "%15s %63s", name, tok);
+        if (fields <= 0) {
+            continue;
+        }
+        UInt len = strlen(name);
+        if ((fields != 2) || (len > 8)) {
+            smFatal("%s:%" UINT_FMT ": expected a name of up to 8 bytes "
+                    "and a token\n",
+                    path, lineno);
+        }
+        if (nkws == MAX_KWS) {
+            smFatal("%s: too many keywords\n", path);
+        }
+        Kw *kw = kws + nkws;
+        for (UInt i = 0; i <= len; ++i) {
+            kw->name[i] = toupper((U8)name[i]);
+        }
+        strcpy(kw->tok, tok);
+        kw->key = smKwKey((SmView){(U8 *)name, len});
+        for (UInt i = 0; i < nkws; ++i) {
+            if (kws[i].key == kw->key) {
+                smFatal("%s:%" UINT_FMT ": duplicate keyword: %s\n", path,
+                        lineno, kw->name);
+            }
+        }
+        ++nkws;
+    }
+    fclose(hnd);
+    if (nkws == 0) {
+        smFatal("%s: no keywords\n", path);
+    }
+}
+
+static U64 rng = 0x9E3779B97F4A7C15ull;
+
+static U64 rnd() {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+// Whether every keyword lands in a slot of its own
+static Bool perfect(U64 mul, UInt bits, U8 *used) {
+    memset(used, 0, 1 << bits);
+    for (UInt i = 0; i < nkws; ++i) {
+        UInt slot = (kws[i].key * mul) >> (64 - bits);
+        if (used[slot]) {
+            return false;
+        }
+        used[slot] = 1;
+    }
+    return true;
+}
+
+// Tries the smallest tables first. The generator is seeded the same way
+// every time, so the same list always gives the same table.
+static void search(U64 *mul, UInt *bits) {
+    static U8 used[1 << MAX_BITS];
+    *bits = 1;
+    while ((1u << *bits) < nkws) {
+        ++*bits;
+    }
+    for (; *bits <= MAX_BITS; ++*bits) {
+        for (UInt i = 0; i < MAX_TRIES; ++i) {
+            *mul = rnd() | 1;
+            if (perfect(*mul, *bits, used)) {
+                return;
+            }
+        }
+    }
+    smFatal("no perfect hash found for %" UINT_FMT " keywords\n", nkws);
+}
+
+// DIRECTIVES for src/libsmasm/directives.kw
+static void tabName(char *name, UInt cap, char const *path) {
+    char const *base = strrchr(path, '/');
+    base             = base ? (base + 1) : path;
+    UInt len         = 0;
+    for (; base[len] && (base[len] != '.'); ++len) {
+        if ((len + 1) >= cap) {
+            smFatal("keyword list name too long: %s\n", path);
+        }
+        name[len] = toupper((U8)base[len]);
+    }
+    name[len] = '\0';
+}
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        help(argv[0]);
+        return EXIT_FAILURE;
+    }
+    readList(argv[1]);
+    U64  mul;
+    UInt bits;
+    search(&mul, &bits);
+    char name[64];
+    tabName(name, sizeof(name), argv[1]);
+
+    Kw *slots[1 << MAX_BITS] = {};
+    for (UInt i = 0; i < nkws; ++i) {
+        slots[(kws[i].key * mul) >> (64 - bits)] = kws + i;
+    }
+
+    FILE *hnd = fopen(argv[2], "wb");
+    if (!hnd) {
+        smFatal("could not open file: %s: %s\n", argv[2], strerror(errno));
+    }
+    fprintf(hnd, "// generated by tools/kwgen from %s, do not edit\n\n",
+            argv[1]);
+    fprintf(hnd, "static SmKw const %s_SLOTS[%u] = {\n", name, 1u << bits);
+    for (UInt i = 0; i < (1u << bits); ++i) {
+        if (slots[i]) {
+            fprintf(hnd, "    [%" UINT_FMT "] = {\"%s\", %s},\n", i,
+                    slots[i]->name, slots[i]->tok);
+        }
+    }
+    fprintf(hnd, "};\n\n");
+    fprintf(hnd,
+            "static SmKwTab const %s = {%s_SLOTS, 0x%016llXull, %" UINT_FMT
+            "};\n",
+            name, name, (unsigned long long)mul, bits);
+    if (fclose(hnd) == EOF) {
+        remove(argv[2]);
+        smFatal("failed to write file: %s: %s\n", argv[2], strerror(errno));
+    }
+    return EXIT_SUCCESS;
+}
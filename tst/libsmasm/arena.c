@@ -0,0 +1,35 @@
+#include <smasm/arena.h>
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+int main() {
+    SmArena arena = {};
+
+    U8 *a = smArenaAlloc(&arena, 3);
+    U8 *b = smArenaAlloc(&arena, 5);
+    assert(a != b);
+    memset(a, 0xAA, 3);
+    memset(b, 0xBB, 5);
+    assert(a[2] == 0xAA);
+
+    // the last allocation grows in place
+    U8 *c = smArenaRealloc(&arena, b, 5, 64);
+    assert(c == b);
+    assert(c[4] == 0xBB);
+
+    SmArenaMark mark = smArenaMark(&arena);
+    U8         *d    = smArenaAlloc(&arena, 128);
+    smArenaAlloc(&arena, 1024 * 1024);
+    smArenaRelease(&arena, mark);
+    assert(smArenaAlloc(&arena, 128) == d);
+
+    smArenaReset(&arena);
+    assert(smArenaAlloc(&arena, 3) == a);
+    assert(arena.mallocs == 2);
+    assert(smArenaMallocsAvoided(&arena) == (arena.allocs - 2));
+    smArenaFini(&arena);
+
+    return EXIT_SUCCESS;
+}
@@ -1,13 +1,22 @@
 #include <smasm/buf.h>
 
 #include <assert.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 int main() {
     assert(smViewEqual(SM_VIEW("hello"), SM_VIEW("hello")));
     assert(smViewEqualIgnoreAsciiCase(SM_VIEW("Hello"), SM_VIEW("hELLo")));
     assert(smViewStartsWith(SM_VIEW("smasm"), SM_VIEW("sm")));
     assert(smViewHash(SM_VIEW("test")) == smViewHash(SM_VIEW("test")));
+    // digests cover every byte, including the ones smViewHash skips
+    assert(smViewDigest(SM_VIEW("abcdefghijklm")) ==
+           smViewDigest(SM_VIEW("abcdefghijklm")));
+    assert(smViewDigest(SM_VIEW("abcdefghijklm")) !=
+           smViewDigest(SM_VIEW("abcdefghijkLm")));
+    assert(smViewDigest(SM_VIEW("abc")) != smViewDigest(SM_VIEW("aBc")));
+    assert(smViewDigest(SM_VIEW("")) != smViewDigest(SM_VIEW("\0")));
 
     assert(smViewParse(SM_VIEW("255")) == 255);
     assert(smViewParse(SM_VIEW("$FF")) == 255);
@@ -21,5 +30,47 @@ int main() {
     assert(smViewParse(SM_VIEW("$10")) == 16);
     assert(smViewParse(SM_VIEW("%10000")) == 16);
 
+    SmBuf buf = {};
+    smBufReserve(&buf, 100);
+    assert(buf.cap >= 100);
+    assert(buf.view.len == 0);
+    for (UInt i = 0; i < 1000; ++i) {
+        smBufCat(&buf, SM_VIEW("x"));
+    }
+    assert(buf.view.len == 1000);
+    assert(buf.cap < 4000);
+    smBufFini(&buf);
+
+    SmViewIntern in    = {};
+    SmView       hello = smViewIntern(&in, SM_VIEW("hello"));
+    SmView       lo    = smViewIntern(&in, SM_VIEW("lo"));
+    SmView       world = smViewIntern(&in, SM_VIEW("world"));
+    assert(smViewEqual(hello, SM_VIEW("hello")));
+    assert(smViewIntern(&in, SM_VIEW("hello")).bytes == hello.bytes);
+    assert(smViewIntern(&in, SM_VIEW("world")).bytes == world.bytes);
+    assert(smViewInternOffset(&in, SM_VIEW("hello")) == 0);
+    assert(smViewInternOffset(&in, SM_VIEW("lo")) == 5);
+    assert(smViewInternOffset(&in, SM_VIEW("world")) == 7);
+    for (UInt i = 0; i < 1000; ++i) {
+        char name[16];
+        sprintf(name, "sym%u", (unsigned)i);
+        smViewIntern(&in, (SmView){(U8 *)name, strlen(name)});
+    }
+    assert(smViewIntern(&in, SM_VIEW("hello")).bytes == hello.bytes);
+    assert(smViewIntern(&in, SM_VIEW("sym999")).bytes ==
+           smViewIntern(&in, SM_VIEW("sym999")).bytes);
+
+    SmViewIntern compact = smViewInternCompact(&in);
+    assert(compact.len == 1);
+    SmView chello = smViewIntern(&compact, SM_VIEW("hello"));
+    SmView clo    = smViewIntern(&compact, SM_VIEW("lo"));
+    assert(smViewEqual(chello, hello));
+    assert(smViewEqual(clo, lo));
+    assert(clo.bytes == (chello.bytes + 3));
+    assert(smViewInternOffset(&compact, SM_VIEW("lo")) ==
+           (smViewInternOffset(&compact, SM_VIEW("hello")) + 3));
+    smViewInternFini(&compact);
+    smViewInternFini(&in);
+
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,24 @@
+#include <smasm/fatal.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+int main() {
+    // keep the expected message out of the test output
+    FILE *null = freopen("/dev/null", "w", stderr);
+    assert(null);
+
+    // errors can be caught instead of exiting
+    jmp_buf      fail;
+    volatile int caught = 0;
+    smFatalJmp          = &fail;
+    if (setjmp(fail) == 0) {
+        smFatal("expected error: %d\n", 42);
+    }
+    ++caught;
+    assert(caught == 1);
+    smFatalJmp = NULL;
+
+    return EXIT_SUCCESS;
+}
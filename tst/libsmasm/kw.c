@@ -0,0 +1,177 @@
+#include <smasm/kw.h>
+#include <smasm/tok.h>
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../src/libsmasm/directives.kw.h"
+#include "../../src/libsmasm/pairs.kw.h"
+#include "../../src/libsmasm/singles.kw.h"
+#include "../../src/smasm/mne.h"
+#include "../../src/smasm/mnemonics.kw.h"
+
+// Written out by hand rather than read from the lists, so a mistake in a list
+// or in what the generator makes of it does not go unnoticed
+typedef struct {
+    char const *name;
+    U32         tok;
+} Expected;
+
+static Expected const DIRECTIVE_KWS[] = {
+    {"ALLOC", SM_TOK_ALLOC},
+    {"ARG", SM_TOK_ARG},
+    {"DB", SM_TOK_DB},
+    {"DEFINED", SM_TOK_DEFINED},
+    {"DS", SM_TOK_DS},
+    {"DW", SM_TOK_DW},
+    {"ELSE", SM_TOK_ELSE},
+    {"END", SM_TOK_END},
+    {"FATAL", SM_TOK_FATAL},
+    {"IDFMT", SM_TOK_IDFMT},
+    {"IF", SM_TOK_IF},
+    {"INCBIN", SM_TOK_INCBIN},
+    {"INCLUDE", SM_TOK_INCLUDE},
+    {"MACRO", SM_TOK_MACRO},
+    {"NARG", SM_TOK_NARG},
+    {"ONCE", SM_TOK_ONCE},
+    {"PRINT", SM_TOK_PRINT},
+    {"REL", SM_TOK_REL},
+    {"REPEAT", SM_TOK_REPEAT},
+    {"SECTION", SM_TOK_SECTION},
+    {"SECTPOP", SM_TOK_SECTPOP},
+    {"SECTPUSH", SM_TOK_SECTPUSH},
+    {"SHIFT", SM_TOK_SHIFT},
+    {"STRFMT", SM_TOK_STRFMT},
+    {"STRLEN", SM_TOK_STRLEN},
+    {"STRUCT", SM_TOK_STRUCT},
+    {"TAG", SM_TOK_TAG},
+    {"UNION", SM_TOK_UNION},
+    {"UNIQUE", SM_TOK_UNIQUE},
+};
+
+static Expected const PAIR_KWS[] = {
+    {"AF", SM_TOK_AF},
+    {"BC", SM_TOK_BC},
+    {"DE", SM_TOK_DE},
+    {"HL", SM_TOK_HL},
+    {"NC", SM_TOK_NC},
+    {"NZ", SM_TOK_NZ},
+    {"SP", SM_TOK_SP},
+};
+
+static Expected const SINGLE_KWS[] = {
+    {"A", 'A'},
+    {"B", 'B'},
+    {"C", 'C'},
+    {"D", 'D'},
+    {"E", 'E'},
+    {"H", 'H'},
+    {"L", 'L'},
+    {"Z", 'Z'},
+};
+
+static Expected const MNEMONIC_KWS[] = {
+    {"ADC", MNE_ADC},
+    {"ADD", MNE_ADD},
+    {"AND", MNE_AND},
+    {"BIT", MNE_BIT},
+    {"CALL", MNE_CALL},
+    {"CCF", MNE_CCF},
+    {"CP", MNE_CP},
+    {"CPL", MNE_CPL},
+    {"DAA", MNE_DAA},
+    {"DEC", MNE_DEC},
+    {"DI", MNE_DI},
+    {"EI", MNE_EI},
+    {"HALT", MNE_HALT},
+    {"INC", MNE_INC},
+    {"JP", MNE_JP},
+    {"JR", MNE_JR},
+    {"LD", MNE_LD},
+    {"LDD", MNE_LDD},
+    {"LDH", MNE_LDH},
+    {"LDI", MNE_LDI},
+    {"NOP", MNE_NOP},
+    {"OR", MNE_OR},
+    {"POP", MNE_POP},
+    {"PUSH", MNE_PUSH},
+    {"RES", MNE_RES},
+    {"RET", MNE_RET},
+    {"RETI", MNE_RETI},
+    {"RL", MNE_RL},
+    {"RLA", MNE_RLA},
+    {"RLC", MNE_RLC},
+    {"RLCA", MNE_RLCA},
+    {"RR", MNE_RR},
+    {"RRA", MNE_RRA},
+    {"RRC", MNE_RRC},
+    {"RRCA", MNE_RRCA},
+    {"RST", MNE_RST},
+    {"SBC", MNE_SBC},
+    {"SCF", MNE_SCF},
+    {"SET", MNE_SET},
+    {"SLA", MNE_SLA},
+    {"SRA", MNE_SRA},
+    {"SRL", MNE_SRL},
+    {"STOP", MNE_STOP},
+    {"SUB", MNE_SUB},
+    {"SWAP", MNE_SWAP},
+    {"XOR", MNE_XOR},
+};
+
+// Every keyword of the class is found in either case, and nothing else is in
+// the table
+static void checkClass(SmKwTab const *tab, Expected const *kws, UInt len) {
+    UInt used = 0;
+    for (UInt i = 0; i < (1u << tab->bits); ++i) {
+        if (tab->slots[i].name[0]) {
+            ++used;
+        }
+    }
+    assert(used == len);
+    for (UInt i = 0; i < len; ++i) {
+        SmView      name = {(U8 *)kws[i].name, strlen(kws[i].name)};
+        SmKw const *kw   = smKwFind(tab, name);
+        assert(kw && (kw->tok == kws[i].tok));
+        char lower[8];
+        for (UInt j = 0; j < name.len; ++j) {
+            lower[j] = tolower((U8)kws[i].name[j]);
+        }
+        kw = smKwFind(tab, (SmView){(U8 *)lower, name.len});
+        assert(kw && (kw->tok == kws[i].tok));
+    }
+}
+
+#define CHECK_CLASS(tab, kws)                                                  \
+    checkClass(&(tab), kws, sizeof(kws) / sizeof((kws)[0]))
+
+int main() {
+    // BAR would share slot 3 with FOO under this multiplier
+    SmKw const slots[4] = {
+        [1] = {"FOOBARBA", 3},
+        [2] = {"BAZ", 2},
+        [3] = {"FOO", 1},
+    };
+    SmKwTab const tab = {slots, 0x9E3779B97F4A7C15ull, 2};
+
+    assert(smKwFind(&tab, SM_VIEW("FOO"))->tok == 1);
+    assert(smKwFind(&tab, SM_VIEW("foo"))->tok == 1);
+    assert(smKwFind(&tab, SM_VIEW("bAz"))->tok == 2);
+    assert(smKwFind(&tab, SM_VIEW("FooBarBa"))->tok == 3);
+    assert(!smKwFind(&tab, SM_VIEW("BAR")));
+    assert(!smKwFind(&tab, SM_VIEW("FO")));
+    assert(!smKwFind(&tab, SM_VIEW("FOOBARBAZ")));
+    assert(!smKwFind(&tab, SM_VIEW_NULL));
+    // only ASCII letters fold
+    assert(!smKwFind(&tab, SM_VIEW("F\xCF\xCF")));
+
+    // the generated tables
+    CHECK_CLASS(DIRECTIVES, DIRECTIVE_KWS);
+    CHECK_CLASS(PAIRS, PAIR_KWS);
+    CHECK_CLASS(SINGLES, SINGLE_KWS);
+    CHECK_CLASS(MNEMONICS, MNEMONIC_KWS);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,47 @@
+#include <smasm/map.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    SmView name;
+    I32    num;
+} Entry;
+
+int main() {
+    SmMap map = {};
+    assert(!smMapFind(&map, SM_VIEW("missing")));
+
+    char names[1000][8];
+    for (I32 i = 0; i < 1000; ++i) {
+        int len = sprintf(names[i], "n%d", (int)i);
+        smMapAdd(&map, &(Entry){{(U8 *)names[i], len}, i}, sizeof(Entry));
+    }
+    assert(map.len == 1000);
+    // the load factor is bounded, so misses terminate
+    assert((map.len * 4) <= (map.slots_cap * 3));
+    assert(!smMapFind(&map, SM_VIEW("missing")));
+    for (I32 i = 0; i < 1000; ++i) {
+        Entry *entry = smMapFind(&map, (SmView){(U8 *)names[i],
+                                                strlen(names[i])});
+        assert(entry && (entry->num == i));
+        // entries are kept in insertion order
+        assert(smMapAt(&map, i) == entry);
+    }
+
+    // adding an existing name replaces its entry
+    smMapAdd(&map, &(Entry){SM_VIEW("n7"), 42}, sizeof(Entry));
+    assert(map.len == 1000);
+    assert(((Entry *)smMapFind(&map, SM_VIEW("n7")))->num == 42);
+    smMapFini(&map);
+
+    // names longer than a word hash the same regardless of where they live
+    char lhs[] = "a_rather_long_macro_name";
+    char rhs[] = "a_rather_long_macro_name";
+    assert(smViewHash(SM_VIEW(lhs)) == smViewHash(SM_VIEW(rhs)));
+    assert(smViewHash(SM_VIEW("abcdefgh")) != smViewHash(SM_VIEW("abcdefgi")));
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,55 @@
+#include <smasm/num.h>
+
+#include <assert.h>
+#include <stdlib.h>
+
+int main() {
+    U32 num = 0;
+    assert(smNumParse(SM_VIEW("255"), &num) == SM_NUM_OK);
+    assert(num == 255);
+    assert(smNumParse(SM_VIEW("$fF"), &num) == SM_NUM_OK);
+    assert(num == 255);
+    assert(smNumParse(SM_VIEW("%1111_1111"), &num) == SM_NUM_OK);
+    assert(num == 255);
+    assert(smNumParse(SM_VIEW("1_000_000"), &num) == SM_NUM_OK);
+    assert(num == 1000000);
+
+    // the full 32 bits are usable, one more digit overflows
+    assert(smNumParse(SM_VIEW("$FFFFFFFF"), &num) == SM_NUM_OK);
+    assert(num == 0xFFFFFFFF);
+    assert(smNumParse(SM_VIEW("4294967295"), &num) == SM_NUM_OK);
+    assert(num == 0xFFFFFFFF);
+    assert(smNumParse(SM_VIEW("4294967296"), &num) == SM_NUM_OVERFLOW);
+    assert(smNumParse(SM_VIEW("$1_0000_0000"), &num) == SM_NUM_OVERFLOW);
+    assert(smNumParse(SM_VIEW("%1_00000000_00000000_00000000_00000000"),
+                      &num) == SM_NUM_OVERFLOW);
+
+    assert(smNumParse(SM_VIEW("'a'"), &num) == SM_NUM_OK);
+    assert(num == 'a');
+    assert(smNumParse(SM_VIEW("'\\n'"), &num) == SM_NUM_OK);
+    assert(num == '\n');
+    assert(smNumParse(SM_VIEW("'\xC3\xA9'"), &num) == SM_NUM_OK);
+    assert(num == 0xE9);
+
+    assert(smNumParse(SM_VIEW_NULL, &num) == SM_NUM_EMPTY);
+    assert(smNumParse(SM_VIEW("$"), &num) == SM_NUM_EMPTY);
+    assert(smNumParse(SM_VIEW("$_"), &num) == SM_NUM_INVALID);
+    assert(smNumParse(SM_VIEW("12a"), &num) == SM_NUM_INVALID);
+    assert(smNumParse(SM_VIEW("%102"), &num) == SM_NUM_INVALID);
+    assert(smNumParse(SM_VIEW("$G"), &num) == SM_NUM_INVALID);
+    assert(smNumParse(SM_VIEW("''"), &num) == SM_NUM_INVALID);
+    assert(smNumParse(SM_VIEW("'ab'"), &num) == SM_NUM_INVALID);
+    assert(smNumParse(SM_VIEW("'\\q'"), &num) == SM_NUM_INVALID);
+    assert(smNumParse(SM_VIEW("'\\\"'"), &num) == SM_NUM_INVALID);
+
+    // only the literal's own quote can be escaped
+    assert(smNumEscape('\'', '\'', &num));
+    assert(num == '\'');
+    assert(smNumEscape('"', '"', &num));
+    assert(num == '"');
+    assert(!smNumEscape('"', '\'', &num));
+    assert(smNumEscape('0', '"', &num));
+    assert(num == '\0');
+
+    return EXIT_SUCCESS;
+}
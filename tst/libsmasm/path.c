@@ -0,0 +1,49 @@
+#include <smasm/path.h>
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+int main() {
+    // resolving the same spelling twice hands back the memoized entry
+    SmPathEntry const *entry = smPathResolve(SM_VIEW("Makefile"));
+    assert(entry->exists);
+    assert(smPathResolve(SM_VIEW("Makefile")) == entry);
+    assert(smPathExists(SM_VIEW("./include/../Makefile")));
+    assert(!smPathExists(SM_VIEW("does/not/exist.ssm")));
+
+    SmViewIntern in = {};
+    assert(smViewEqual(smPathIntern(&in, SM_VIEW("does/not/exist.ssm")),
+                       SM_VIEW("does/not/exist.ssm")));
+
+    // different spellings of one file are only added once
+    SmPathSet set = {};
+    SmView    a   = smPathSetAdd(&set, SM_VIEW("Makefile"));
+    SmView    b   = smPathSetAdd(&set, SM_VIEW("./include/../Makefile"));
+    assert(smViewEqual(a, b));
+    assert(set.bufs.view.len == 1);
+    assert(smPathSetContains(&set, SM_VIEW("./Makefile")));
+    assert(!smPathSetContains(&set, SM_VIEW("README.md")));
+    assert(!smPathSetContains(&set, SM_VIEW("does/not/exist.ssm")));
+    smPathSetAdd(&set, SM_VIEW("does/not/exist.ssm"));
+    assert(smPathSetContains(&set, SM_VIEW("does/not/exist.ssm")));
+    assert(set.bufs.view.len == 2);
+    smPathSetFini(&set);
+    smViewInternFini(&in);
+
+    // a removed file is only noticed once the cache is dropped
+    char tmp[] = "/tmp/smpathXXXXXX";
+    int  fd    = mkstemp(tmp);
+    assert(fd >= 0);
+    close(fd);
+    SmView name = {(U8 *)tmp, strlen(tmp)};
+    assert(smPathExists(name));
+    unlink(tmp);
+    assert(smPathExists(name));
+    smPathCacheFini();
+    assert(!smPathExists(name));
+    smPathCacheFini();
+
+    return EXIT_SUCCESS;
+}
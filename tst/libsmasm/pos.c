@@ -0,0 +1,41 @@
+#include <smasm/pos.h>
+
+#include <assert.h>
+#include <stdlib.h>
+
+int main() {
+    SmPosTab tab  = {};
+    SmView   src  = SM_VIEW("one\n\ttwo\ncaf\xC3\xA9 x\n");
+    U32      file = smPosTabAdd(&tab, SM_VIEW("src"), src, SM_POS_SRC_BORROWED);
+    assert(sizeof(SmPos) == 8);
+
+    SmPosInfo at = smPosTabInfo(&tab, (SmPos){file, 0});
+    assert(smViewEqual(at.file, SM_VIEW("src")));
+    assert((at.line == 1) && (at.col == 1));
+    // columns count characters, not bytes
+    at = smPosTabInfo(&tab, (SmPos){file, 15});
+    assert((at.line == 3) && (at.col == 6));
+    // out of order lookups go back to searching the index
+    at = smPosTabInfo(&tab, (SmPos){file, 5});
+    assert((at.line == 2) && (at.col == 2));
+    at = smPosTabInfo(&tab, (SmPos){file, src.len});
+    assert((at.line == 4) && (at.col == 1));
+
+    // files known only by name keep the line and column in the handle
+    U32 named = smPosTabAddName(&tab, SM_VIEW("obj"));
+    assert(named != file);
+    at = smPosTabInfo(&tab, smPosLineCol(named, 1234, 56));
+    assert(smViewEqual(at.file, SM_VIEW("obj")));
+    assert((at.line == 1234) && (at.col == 56));
+    assert(smViewEqual(smPosTabName(&tab, smPosLineCol(named, 1, 1)),
+                       SM_VIEW("obj")));
+    // and saturate past what fits
+    at = smPosTabInfo(&tab, smPosLineCol(named, 1 << 24, 1 << 16));
+    assert(at.line == ((1 << SM_POS_LINE_BITS) - 1));
+    assert(at.col == ((1 << SM_POS_COL_BITS) - 1));
+
+    smPosTabFini(&tab);
+    assert(tab.len == 0);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,113 @@
+#include <smasm/sym.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static SmAtom cstrAtom(SmViewIntern *in, char const *name) {
+    return smViewAtom(in, (SmView){(U8 *)name, strlen(name)});
+}
+
+int main() {
+    SmViewIntern strs     = {};
+    SmAtom       lbl_main = smViewAtom(&strs, SM_VIEW("Main"));
+    SmAtom       scope    = smViewAtom(&strs, SM_VIEW("Scope"));
+    assert(smViewAtom(&strs, SM_VIEW_NULL) == SM_ATOM_NULL);
+    assert(lbl_main != SM_ATOM_NULL);
+    assert(lbl_main != scope);
+    assert(smViewAtom(&strs, SM_VIEW("Main")) == lbl_main);
+    assert(smViewEqual(smAtomView(&strs, lbl_main), SM_VIEW("Main")));
+
+    SmExprIntern in = {};
+
+    // the bytes in the unused part of the union should not matter
+    SmExpr lhs[2];
+    SmExpr rhs[2];
+    memset(lhs, 0x00, sizeof(lhs));
+    memset(rhs, 0xAA, sizeof(rhs));
+    lhs[0].kind = SM_EXPR_CONST;
+    lhs[0].num  = 42;
+    lhs[1].kind = SM_EXPR_LABEL;
+    lhs[1].lbl  = (SmLbl){SM_ATOM_NULL, lbl_main};
+    rhs[0].kind = SM_EXPR_CONST;
+    rhs[0].num  = 42;
+    rhs[1].kind = SM_EXPR_LABEL;
+    rhs[1].lbl  = (SmLbl){SM_ATOM_NULL, lbl_main};
+
+    SmExprView view = smExprIntern(&in, (SmExprView){lhs, 2});
+    assert(view.items != lhs);
+    assert(smExprViewEqual(view, (SmExprView){rhs, 2}));
+    assert(smExprViewHash(view) == smExprViewHash((SmExprView){rhs, 2}));
+    assert(smExprIntern(&in, (SmExprView){rhs, 2}).items == view.items);
+
+    rhs[0].num = 43;
+    assert(!smExprViewEqual(view, (SmExprView){rhs, 2}));
+    assert(smExprIntern(&in, (SmExprView){rhs, 2}).items != view.items);
+    assert(smExprInternOffset(&in, view) == 0);
+    assert(smExprInternOffset(&in, (SmExprView){rhs, 2}) == 2);
+
+    for (I32 i = 0; i < 1000; ++i) {
+        SmExpr expr = {.kind = SM_EXPR_CONST, .num = i};
+        smExprIntern(&in, (SmExprView){&expr, 1});
+    }
+    assert(smExprIntern(&in, (SmExprView){lhs, 2}).items == view.items);
+    SmExpr last = {.kind = SM_EXPR_CONST, .num = 999};
+    assert(smExprInternOffset(&in, (SmExprView){&last, 1}) == 1003);
+    smExprInternFini(&in);
+
+    SmSymTab tab = {};
+    char     names[1000][8];
+    for (UInt i = 0; i < 1000; ++i) {
+        sprintf(names[i], "l%u", (unsigned)i);
+        SmSym sym = {.lbl = {scope, cstrAtom(&strs, names[i])}};
+        smSymTabAdd(&tab, sym);
+    }
+    assert(tab.len == 1000);
+    // remove every other symbol, the rest must still be found past the holes
+    for (UInt i = 0; i < 1000; i += 2) {
+        SmLbl lbl = {scope, cstrAtom(&strs, names[i])};
+        assert(smSymTabRemove(&tab, lbl));
+        assert(!smSymTabRemove(&tab, lbl));
+    }
+    assert(tab.len == 500);
+    for (UInt i = 0; i < 1000; ++i) {
+        SmLbl  lbl = {scope, cstrAtom(&strs, names[i])};
+        SmSym *sym = smSymTabFind(&tab, lbl);
+        assert((sym != NULL) == (i % 2 == 1));
+        assert(!sym || smLblEqual(sym->lbl, lbl));
+    }
+    // adding back reuses tombstones instead of growing without bound
+    UInt slots_cap = tab.slots_cap;
+    for (UInt j = 0; j < 100; ++j) {
+        SmLbl lbl = {scope, cstrAtom(&strs, names[0])};
+        smSymTabAdd(&tab, (SmSym){.lbl = lbl});
+        assert(smSymTabRemove(&tab, lbl));
+    }
+    assert(tab.slots_cap == slots_cap);
+    smSymTabFini(&tab);
+
+    // full names are built once and global labels are their own full name
+    SmLblNames lblnames = {};
+    SmLbl      local    = {scope, cstrAtom(&strs, "l1")};
+    SmAtom     fullname = smLblNamesGet(&lblnames, local, &strs);
+    assert(smViewEqual(smAtomView(&strs, fullname), SM_VIEW("Scope.l1")));
+    assert(smLblNamesGet(&lblnames, local, &strs) == fullname);
+    assert(smViewEqual(smLblFullName(local, &strs), SM_VIEW("Scope.l1")));
+    smLblFullNameFini();
+    assert(smViewEqual(smLblFullName(local, &strs), SM_VIEW("Scope.l1")));
+    smLblFullNameFini();
+    SmLbl global = {SM_ATOM_NULL, lbl_main};
+    assert(smLblNamesGet(&lblnames, global, &strs) == lbl_main);
+    assert(lblnames.len == 1);
+    smLblNamesFini(&lblnames);
+
+    // atoms survive compaction, only the table offsets move
+    SmViewIntern compact = smViewInternCompact(&strs);
+    assert(smViewEqual(smAtomView(&compact, lbl_main), SM_VIEW("Main")));
+    assert(smViewAtom(&compact, SM_VIEW("Scope")) == scope);
+    smViewInternFini(&compact);
+    smViewInternFini(&strs);
+
+    return EXIT_SUCCESS;
+}
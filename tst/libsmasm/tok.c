@@ -1,11 +1,18 @@
 #include <smasm/tok.h>
 
 #include <assert.h>
+#include <stdio.h>
 #include <stdlib.h>
 
+static SmPosTab positions = {};
+
+static SmPosInfo posInfo(SmTokStream *ts) {
+    return smPosTabInfo(&positions, smTokStreamPos(ts));
+}
+
 int main() {
     SmTokStream ts;
-    smTokStreamViewInit(&ts, SM_VIEW("test"),
+    smTokStreamViewInit(&ts, &positions, SM_VIEW("test"),
                         SM_VIEW("example"
                                 " "
                                 "1234"
@@ -33,5 +40,167 @@ int main() {
     assert(smTokStreamPeek(&ts) == SM_TOK_EOF);
     smTokStreamFini(&ts);
 
+    // keywords are recognized in any case, near misses are identifiers
+    smTokStreamViewInit(&ts, &positions, SM_VIEW("test"),
+                        SM_VIEW("@SectPush @unique hl Sp nz z Hx abc"));
+    U32 kws[] = {SM_TOK_SECTPUSH, SM_TOK_UNIQUE, SM_TOK_HL, SM_TOK_SP,
+                 SM_TOK_NZ,       'Z',           SM_TOK_ID, SM_TOK_ID};
+    for (UInt i = 0; i < (sizeof(kws) / sizeof(kws[0])); ++i) {
+        assert(smTokStreamPeek(&ts) == kws[i]);
+        smTokStreamEat(&ts);
+    }
+    assert(smTokStreamPeek(&ts) == SM_TOK_EOF);
+    smTokStreamFini(&ts);
+
+    // comments are skipped up to the newline, continuations join lines
+    smTokStreamViewInit(&ts, &positions, SM_VIEW("test"),
+                        SM_VIEW("a ; caf\xC3\xA9 \\\n\tb \\\n  c"));
+    assert(smTokStreamPeek(&ts) == 'A');
+    smTokStreamEat(&ts);
+    assert(smTokStreamPeek(&ts) == '\n');
+    assert(posInfo(&ts).line == 1);
+    assert(posInfo(&ts).col == 11);
+    smTokStreamEat(&ts);
+    assert(smTokStreamPeek(&ts) == 'B');
+    smTokStreamEat(&ts);
+    assert(smTokStreamPeek(&ts) == 'C');
+    assert(posInfo(&ts).line == 3);
+    assert(posInfo(&ts).col == 3);
+    smTokStreamEat(&ts);
+    assert(smTokStreamPeek(&ts) == SM_TOK_EOF);
+    smTokStreamFini(&ts);
+
+    // tokens point into the source unless they had to be rewritten
+    SmView zsrc = SM_VIEW("caf\xC3\xA9 \"a\nb\" \"c\\td\" 1_000 $FF");
+    smTokStreamViewInit(&ts, &positions, SM_VIEW("test"), zsrc);
+    assert(smTokStreamPeek(&ts) == SM_TOK_ID);
+    assert(smTokStreamView(&ts).bytes == zsrc.bytes);
+    assert(smTokStreamView(&ts).len == 5);
+    smTokStreamEat(&ts);
+    assert(smTokStreamPeek(&ts) == SM_TOK_STR);
+    assert(smTokStreamView(&ts).bytes == (zsrc.bytes + 7));
+    assert(smViewEqual(smTokStreamView(&ts), SM_VIEW("a\nb")));
+    smTokStreamEat(&ts);
+    assert(smTokStreamPeek(&ts) == SM_TOK_STR);
+    assert(posInfo(&ts).line == 2);
+    assert(posInfo(&ts).col == 4);
+    assert(smViewEqual(smTokStreamView(&ts), SM_VIEW("c\td")));
+    smTokStreamEat(&ts);
+    assert(smTokStreamPeek(&ts) == SM_TOK_NUM);
+    assert(smTokStreamNum(&ts) == 1000);
+    smTokStreamEat(&ts);
+    assert(smTokStreamPeek(&ts) == SM_TOK_NUM);
+    assert(smTokStreamNum(&ts) == 0xFF);
+    smTokStreamEat(&ts);
+    assert(smTokStreamPeek(&ts) == SM_TOK_EOF);
+    smTokStreamFini(&ts);
+
+    // positions come from byte offsets and may be asked for in any order
+    smTokStreamViewInit(&ts, &positions, SM_VIEW("test"),
+                        SM_VIEW("x\n\n  caf\xC3\xA9 y\nz"));
+    for (UInt i = 0; i < 4; ++i) {
+        smTokStreamPeek(&ts);
+        smTokStreamEat(&ts);
+    }
+    assert(smTokStreamPeek(&ts) == SM_TOK_ID);
+    assert(posInfo(&ts).line == 3);
+    assert(posInfo(&ts).col == 8);
+    smTokStreamRewind(&ts);
+    assert(smTokStreamPeek(&ts) == SM_TOK_ID);
+    assert(posInfo(&ts).line == 1);
+    assert(posInfo(&ts).col == 1);
+    smTokStreamFini(&ts);
+
+    // files are lexed from memory and rewind to the start
+    FILE *hnd = tmpfile();
+    assert(hnd);
+    fputs("name \"caf\xC3\xA9\"\n", hnd);
+    fflush(hnd);
+    smTokStreamFileInit(&ts, &positions, SM_VIEW("file"), hnd);
+    U32 file = smTokStreamPos(&ts).file;
+    for (UInt i = 0; i < 2; ++i) {
+        assert(smTokStreamPeek(&ts) == SM_TOK_ID);
+        assert(smViewEqual(smTokStreamView(&ts), SM_VIEW("name")));
+        smTokStreamEat(&ts);
+        assert(smTokStreamPeek(&ts) == SM_TOK_STR);
+        assert(smViewEqual(smTokStreamView(&ts), SM_VIEW("caf\xC3\xA9")));
+        smTokStreamEat(&ts);
+        assert(smTokStreamPeek(&ts) == '\n');
+        assert(posInfo(&ts).line == 1);
+        smTokStreamEat(&ts);
+        assert(smTokStreamPeek(&ts) == SM_TOK_EOF);
+        smTokStreamRewind(&ts);
+    }
+    smTokStreamFini(&ts);
+    // and lexed again from the table without reading them
+    smTokStreamSrcInit(&ts, &positions, file);
+    assert(smTokStreamPeek(&ts) == SM_TOK_ID);
+    assert(smViewEqual(smTokStreamView(&ts), SM_VIEW("name")));
+    assert(smTokStreamPos(&ts).file == file);
+    smTokStreamEat(&ts);
+    assert(smTokStreamPeek(&ts) == SM_TOK_STR);
+    assert(posInfo(&ts).col == 6);
+    smTokStreamFini(&ts);
+
+    // a recorded stream replays the same tokens, views and positions
+    SmViewIntern in     = {};
+    SmTokRecord  record = {};
+    SmView       src    = SM_VIEW("ld a, $42\n  @db \"hi\", Label\n");
+    U32          toks[] = {SM_TOK_ID, 'A', ',', SM_TOK_NUM, '\n',
+                           SM_TOK_DB, SM_TOK_STR, ',', SM_TOK_ID, '\n'};
+    UInt         ntoks  = sizeof(toks) / sizeof(toks[0]);
+    smTokStreamViewInit(&ts, &positions, SM_VIEW("src"), src);
+    smTokStreamRecord(&ts, &record, &in);
+    for (UInt i = 0; i < ntoks; ++i) {
+        assert(smTokStreamPeek(&ts) == toks[i]);
+        smTokStreamEat(&ts);
+    }
+    assert(!record.done);
+    assert(smTokStreamPeek(&ts) == SM_TOK_EOF);
+    assert(record.done);
+    smTokStreamFini(&ts);
+    smTokStreamReplayInit(&ts, &positions, record.file, &record);
+    for (UInt i = 0; i < ntoks; ++i) {
+        assert(smTokStreamPeek(&ts) == toks[i]);
+        if (i == 3) {
+            assert(smTokStreamNum(&ts) == 0x42);
+        }
+        if (i == 6) {
+            assert(smViewEqual(smTokStreamView(&ts), SM_VIEW("hi")));
+            assert(smViewEqual(posInfo(&ts).file, SM_VIEW("src")));
+            assert(posInfo(&ts).line == 2);
+            assert(posInfo(&ts).col == 7);
+        }
+        smTokStreamEat(&ts);
+    }
+    assert(smTokStreamPeek(&ts) == SM_TOK_EOF);
+    smTokStreamEat(&ts);
+    assert(smTokStreamPeek(&ts) == SM_TOK_EOF);
+    smTokStreamFini(&ts);
+    // as well as into another table, which knows the source by another ID
+    SmPosTab other = {};
+    smPosTabAddName(&other, SM_VIEW("first"));
+    U32 copy = smPosTabAdd(&other, SM_VIEW("copy"), src, SM_POS_SRC_BORROWED);
+    smTokStreamReplayInit(&ts, &other, copy, &record);
+    for (UInt i = 0; i < 6; ++i) {
+        smTokStreamEat(&ts);
+    }
+    assert(smTokStreamPeek(&ts) == SM_TOK_STR);
+    assert(smTokStreamPos(&ts).file == copy);
+    SmPosInfo info = smPosTabInfo(&other, smTokStreamPos(&ts));
+    assert(smViewEqual(info.file, SM_VIEW("copy")));
+    assert((info.line == 2) && (info.col == 7));
+    smTokStreamFini(&ts);
+    smPosTabFini(&other);
+    smTokRecordFini(&record);
+    smViewInternFini(&in);
+    smPosTabFini(&positions);
+
+    // names of characters can be freed and built again
+    assert(smViewEqual(smTokName('+'), SM_VIEW("`+`")));
+    smTokNamesFini();
+    assert(smViewEqual(smTokName('+'), SM_VIEW("`+`")));
+    smTokNamesFini();
+
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,58 @@
+#include <smasm/utf8.h>
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+static UInt slowLen(SmView view) {
+    UInt len = 0;
+    for (UInt i = 0; i < view.len; ++i) {
+        if ((view.bytes[i] & 0xC0) != 0x80) {
+            ++len;
+        }
+    }
+    return len;
+}
+
+int main() {
+    assert(smUtf8Valid(SM_VIEW("")) == 0);
+    assert(smUtf8Valid(SM_VIEW("plain ascii")) == 11);
+    assert(smUtf8Valid(SM_VIEW("caf\xC3\xA9 \xE2\x86\x92 \xF0\x9F\x98\x80")) ==
+           14);
+    // continuation without a lead, overlong, surrogate, past U+10FFFF
+    assert(smUtf8Valid(SM_VIEW("ab\x80")) == 2);
+    assert(smUtf8Valid(SM_VIEW("ab\xC0\xAF")) == 2);
+    assert(smUtf8Valid(SM_VIEW("ab\xED\xA0\x80")) == 2);
+    assert(smUtf8Valid(SM_VIEW("ab\xF4\x90\x80\x80")) == 2);
+    // truncated at the end
+    assert(smUtf8Valid(SM_VIEW("ab\xE2\x86")) == 2);
+
+    // the block-at-a-time paths must agree with the byte-at-a-time ones at
+    // every length and alignment
+    U8 bytes[300];
+    for (UInt i = 0; i < sizeof(bytes); ++i) {
+        bytes[i] = 'a' + (i % 26);
+    }
+    for (UInt i = 0; i < sizeof(bytes); i += 7) {
+        memcpy(bytes + i, "\xC3\xA9", 2);
+    }
+    for (UInt start = 0; start < 16; ++start) {
+        for (UInt len = 0; (start + len) <= sizeof(bytes); ++len) {
+            SmView view = {bytes + start, len};
+            assert(smUtf8Len(view) == slowLen(view));
+        }
+    }
+    // long enough for the vector byte counters to have to be flushed
+    static U8 big[10000];
+    for (UInt i = 0; i < sizeof(big); i += 2) {
+        memcpy(big + i, "\xC3\xA9", 2);
+    }
+    assert(smUtf8Len((SmView){big, sizeof(big)}) == (sizeof(big) / 2));
+
+    SmView all = {bytes, sizeof(bytes)};
+    assert(smUtf8Valid(all) == sizeof(bytes));
+    bytes[200] = 0xFF;
+    assert(smUtf8Valid(all) == 200);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,93 @@
+#include <smasm/serde.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static char src[] = "/tmp/smforwardXXXXXX";
+static char obj[] = "/tmp/smforwardXXXXXX";
+
+// Assembles `text` with bin/smasm, returning its exit status
+static int assemble(char const *text) {
+    FILE *hnd = fopen(src, "wb");
+    assert(hnd);
+    fputs(text, hnd);
+    fclose(hnd);
+    char cmd[256];
+    snprintf(cmd, sizeof(cmd), "bin/smasm %s -o %s 2>/dev/null", src, obj);
+    return system(cmd);
+}
+
+// Whether the first section of the object holds exactly `bytes`
+static Bool sectIs(SmView bytes) {
+    FILE *hnd = fopen(obj, "rb");
+    assert(hnd);
+    SmArena      arena     = {};
+    SmPosTab     positions = {};
+    SmViewIntern atoms     = {};
+
+    SmSerde ser = {hnd, SM_VIEW("forward"), &arena, &positions, 0, 0};
+    assert(smDeserializeU32(&ser) == *(U32 *)"SM02");
+    SmViewIntern strs  = smDeserializeViewIntern(&ser);
+    SmExprIntern exprs = smDeserializeExprIntern(&ser, &strs, &atoms);
+    smDeserializePosTab(&ser, &atoms);
+    SmSymTab  syms  = smDeserializeSymTab(&ser, &strs, &atoms, &exprs);
+    SmSectBuf sects = smDeserializeSectBuf(&ser, &strs, &atoms, &exprs);
+    fclose(hnd);
+    assert(sects.view.len > 0);
+    Bool same = smViewEqual(sects.view.items[0].data.view, bytes);
+    smSymTabFini(&syms);
+    smExprInternFini(&exprs);
+    smViewInternFini(&strs);
+    smViewInternFini(&atoms);
+    smPosTabFini(&positions);
+    smArenaFini(&arena);
+    return same;
+}
+
+int main() {
+    close(mkstemp(src));
+    close(mkstemp(obj));
+
+    // high memory constants may be defined after the `ldh` using them
+    assert(assemble("@SECTION \"CODE\"\n"
+                    "    ldh a, [hvar]\n"
+                    "    ldh [hvar], a\n"
+                    "hvar = $FF80\n") == 0);
+    assert(sectIs(SM_VIEW("\xF0\x80\xE0\x80")));
+    assert(assemble("@SECTION \"CODE\"\n"
+                    "    ldh a, [hvar]\n"
+                    "hvar = $FE80\n") != 0);
+
+    // @DEFINED cannot know about a symbol defined after it...
+    assert(assemble("@SECTION \"CODE\"\n"
+                    "    ld a, @DEFINED later\n"
+                    "later = 1\n") != 0);
+    // ...only about those before it, even if they wait on later ones
+    assert(assemble("@SECTION \"CODE\"\n"
+                    "early = later + 1\n"
+                    "    ld a, @DEFINED early\n"
+                    "later = 1\n") == 0);
+    assert(sectIs(SM_VIEW("\x3E\x01")));
+    // ...unless the definition is what the @IF that asked is for
+    assert(assemble("@SECTION \"CODE\"\n"
+                    "@IF !@DEFINED SIZE\n"
+                    "SIZE = 3\n"
+                    "@END\n"
+                    "@IF @DEFINED OTHER\n"
+                    "@ELSE\n"
+                    "OTHER = 4\n"
+                    "@END\n"
+                    "    ld a, SIZE + OTHER\n") == 0);
+    assert(sectIs(SM_VIEW("\x3E\x07")));
+    assert(assemble("@SECTION \"CODE\"\n"
+                    "@IF !@DEFINED SIZE\n"
+                    "@END\n"
+                    "SIZE = 3\n") != 0);
+
+    remove(src);
+    remove(obj);
+    return EXIT_SUCCESS;
+}
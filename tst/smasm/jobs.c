@@ -0,0 +1,171 @@
+#include <smasm/buf.h>
+
+#include <assert.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static char dir[] = "/tmp/smjobsXXXXXX";
+static char bin[4096];
+
+static void path(char *buf, UInt cap, char const *name) {
+    snprintf(buf, cap, "%s/%s", dir, name);
+}
+
+// Writes `text` to `name` in the test directory
+static void put(char const *name, char const *text) {
+    char full[4096];
+    path(full, sizeof(full), name);
+    FILE *hnd = fopen(full, "wb");
+    assert(hnd);
+    fputs(text, hnd);
+    fclose(hnd);
+}
+
+// A unit with enough symbols that writing it out takes a while, then `tail`
+static void putBig(char const *name, char const *prefix, char const *tail) {
+    char full[4096];
+    path(full, sizeof(full), name);
+    FILE *hnd = fopen(full, "wb");
+    assert(hnd);
+    fputs("@INCLUDE \"shared.ssi\"\n@SECTION \"CODE\"\n", hnd);
+    for (UInt i = 0; i < 20000; ++i) {
+        fprintf(hnd, "%s_label_%" UINT_FMT ":\n    ld a, SHARED\n", prefix, i);
+    }
+    fputs(tail, hnd);
+    fclose(hnd);
+}
+
+// Runs bin/smasm in the test directory, returning its exit status
+static int smasm(char const *args) {
+    char cmd[8192];
+    snprintf(cmd, sizeof(cmd), "cd %s && %s %s 2>/dev/null", dir, bin, args);
+    return system(cmd);
+}
+
+static Bool exists(char const *name) {
+    char full[4096];
+    path(full, sizeof(full), name);
+    return access(full, F_OK) == 0;
+}
+
+static SmBuf slurp(char const *name) {
+    char full[4096];
+    path(full, sizeof(full), name);
+    FILE *hnd = fopen(full, "rb");
+    assert(hnd);
+    SmBuf buf = {};
+    U8    chunk[4096];
+    UInt  len;
+    while ((len = fread(chunk, 1, sizeof(chunk), hnd)) > 0) {
+        smBufCat(&buf, (SmView){chunk, len});
+    }
+    fclose(hnd);
+    return buf;
+}
+
+// Whether two files of the test directory hold the same bytes
+static Bool same(char const *lhs, char const *rhs) {
+    SmBuf l    = slurp(lhs);
+    SmBuf r    = slurp(rhs);
+    Bool  same = smViewEqual(l.view, r.view);
+    smBufFini(&l);
+    smBufFini(&r);
+    return same;
+}
+
+// Whether a run left any of its temporary files behind
+static Bool tempsLeft() {
+    DIR *hnd = opendir(dir);
+    assert(hnd);
+    Bool           left = false;
+    struct dirent *ent;
+    while ((ent = readdir(hnd))) {
+        UInt len = strlen(ent->d_name);
+        if ((len > 4) && !strcmp(ent->d_name + len - 4, ".tmp")) {
+            left = true;
+        }
+    }
+    closedir(hnd);
+    return left;
+}
+
+int main() {
+    char *cwd = getcwd(bin, sizeof(bin) - 16);
+    assert(cwd);
+    strcat(bin, "/bin/smasm");
+    char *tmp = mkdtemp(dir);
+    assert(tmp);
+
+    put("shared.ssi", "SHARED = 7\n");
+    put("a.ssm", "@INCLUDE \"shared.ssi\"\n"
+                 "@SECTION \"CODE\"\n"
+                 "First::\n"
+                 "    ld a, SHARED\n");
+    put("b.ssm", "@INCLUDE \"shared.ssi\"\n"
+                 "@SECTION \"CODE\"\n"
+                 "Second::\n"
+                 "    ld b, SHARED + 1\n");
+    assert(smasm("a.ssm -o a1.o") == 0);
+    assert(smasm("b.ssm -o b1.o") == 0);
+
+    // several sources each go to <SOURCE>.o, whether on threads or not
+    assert(smasm("a.ssm b.ssm") == 0);
+    assert(same("a.o", "a1.o"));
+    assert(same("b.o", "b1.o"));
+    assert(smasm("-j 2 a.ssm b.ssm") == 0);
+    assert(same("a.o", "a1.o"));
+    assert(same("b.o", "b1.o"));
+    assert(smasm("-j 8 -MD a.ssm b.ssm") == 0);
+    SmBuf dep = slurp("a.d");
+    assert(smViewStartsWith(dep.view, SM_VIEW("a.o: \\\n")));
+    smBufFini(&dep);
+    assert(exists("b.d"));
+
+    // a single output name cannot be shared by several sources
+    assert(smasm("a.ssm b.ssm -o x.o") != 0);
+    assert(smasm("-MD -MF x.d a.ssm b.ssm") != 0);
+    assert(!exists("x.o"));
+    assert(!exists("x.d"));
+
+    // an error only fails its own unit, the others are either written out
+    // whole or not at all. The error comes late, while they are being written
+    putBig("g1.ssm", "g1", "");
+    putBig("g2.ssm", "g2", "");
+    putBig("g3.ssm", "g3", "");
+    putBig("bad.ssm", "bad", "    ld a, nope nope\n");
+    assert(smasm("g1.ssm -o g1.one") == 0);
+    assert(smasm("g2.ssm -o g2.one") == 0);
+    assert(smasm("g3.ssm -o g3.one") == 0);
+    char const *runs[] = {
+        "-j 4 bad.ssm g1.ssm g2.ssm g3.ssm",
+        "-j 4 g1.ssm g2.ssm g3.ssm bad.ssm",
+        "-j 2 -MD g1.ssm bad.ssm g2.ssm g3.ssm",
+    };
+    for (UInt i = 0; i < 6; ++i) {
+        for (UInt j = 0; j < 3; ++j) {
+            char obj[] = "g0.o";
+            obj[1]     = '1' + j;
+            char full[4096];
+            path(full, sizeof(full), obj);
+            remove(full);
+        }
+        assert(smasm(runs[i % 3]) != 0);
+        assert(!tempsLeft());
+        for (UInt j = 0; j < 3; ++j) {
+            char obj[] = "g0.o";
+            char one[] = "g0.one";
+            obj[1]     = '1' + j;
+            one[1]     = '1' + j;
+            assert(!exists(obj) || same(obj, one));
+        }
+    }
+    assert(!exists("bad.o"));
+
+    char cmd[64];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    assert(system(cmd) == 0);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,176 @@
+#include <smasm/buf.h>
+
+#include <assert.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static char  dir[] = "/tmp/smserveXXXXXX";
+static char  bin[4096];
+static char  sock[4096];
+static pid_t server = -1;
+
+static void path(char *buf, UInt cap, char const *name) {
+    snprintf(buf, cap, "%s/%s", dir, name);
+}
+
+// Writes `text` to `name` in the test directory
+static void put(char const *name, char const *text) {
+    char full[4096];
+    path(full, sizeof(full), name);
+    FILE *hnd = fopen(full, "wb");
+    assert(hnd);
+    fputs(text, hnd);
+    fclose(hnd);
+}
+
+// Runs bin/smasm in the test directory, returning its exit status
+static int smasm(char const *args) {
+    char cmd[8192];
+    snprintf(cmd, sizeof(cmd), "cd %s && %s %s 2>/dev/null", dir, bin, args);
+    int status = system(cmd);
+    assert(WIFEXITED(status));
+    return WEXITSTATUS(status);
+}
+
+// Has the server do a run in the test directory, its stderr going to `err`
+static int request(char const *args, char const *err) {
+    char cmd[16384];
+    snprintf(cmd, sizeof(cmd), "cd %s && %s --connect %s %s 2>%s", dir, bin,
+             sock, args, err);
+    int status = system(cmd);
+    assert(WIFEXITED(status));
+    return WEXITSTATUS(status);
+}
+
+static Bool exists(char const *name) {
+    char full[4096];
+    path(full, sizeof(full), name);
+    return access(full, F_OK) == 0;
+}
+
+static SmBuf slurp(char const *name) {
+    char full[4096];
+    path(full, sizeof(full), name);
+    FILE *hnd = fopen(full, "rb");
+    assert(hnd);
+    SmBuf buf = {};
+    U8    chunk[4096];
+    UInt  len;
+    while ((len = fread(chunk, 1, sizeof(chunk), hnd)) > 0) {
+        smBufCat(&buf, (SmView){chunk, len});
+    }
+    fclose(hnd);
+    return buf;
+}
+
+// Whether two files of the test directory hold the same bytes
+static Bool same(char const *lhs, char const *rhs) {
+    SmBuf l    = slurp(lhs);
+    SmBuf r    = slurp(rhs);
+    Bool  same = smViewEqual(l.view, r.view);
+    smBufFini(&l);
+    smBufFini(&r);
+    return same;
+}
+
+// Whether the file `name` of the test directory contains `text`
+static Bool contains(char const *name, char const *text) {
+    SmBuf buf = slurp(name);
+    smBufCat(&buf, SM_VIEW("\0"));
+    Bool found = strstr((char const *)buf.view.bytes, text) != NULL;
+    smBufFini(&buf);
+    return found;
+}
+
+static void stop() {
+    if (server > 0) {
+        kill(server, SIGTERM);
+        waitpid(server, NULL, 0);
+        server = -1;
+    }
+}
+
+// A failed assert must not leave the server running
+static void aborted(int sig) {
+    (void)sig;
+    stop();
+    signal(SIGABRT, SIG_DFL);
+    abort();
+}
+
+int main() {
+    char *cwd = getcwd(bin, sizeof(bin) - 16);
+    assert(cwd);
+    strcat(bin, "/bin/smasm");
+    char *tmp = mkdtemp(dir);
+    assert(tmp);
+    path(sock, sizeof(sock), "smasm.sock");
+
+    server = fork();
+    assert(server >= 0);
+    if (server == 0) {
+        if (!freopen("/dev/null", "w", stderr)) {
+            _exit(EXIT_FAILURE);
+        }
+        execl(bin, bin, "--serve", sock, (char *)NULL);
+        _exit(EXIT_FAILURE);
+    }
+    signal(SIGABRT, aborted);
+    for (UInt i = 0; access(sock, F_OK) != 0; ++i) {
+        assert(i < 500);
+        usleep(10000);
+    }
+
+    put("shared.ssi", "SHARED = 7\n");
+    put("a.ssm", "@INCLUDE \"shared.ssi\"\n"
+                 "@SECTION \"CODE\"\n"
+                 "First::\n"
+                 "    ld a, SHARED\n");
+    put("b.ssm", "@INCLUDE \"shared.ssi\"\n"
+                 "@SECTION \"CODE\"\n"
+                 "Second::\n"
+                 "    ld b, SHARED + 1\n");
+    put("bad.ssm", "@INCLUDE \"shared.ssi\"\n"
+                   "@SECTION \"CODE\"\n"
+                   "    ld a, nope nope\n");
+    assert(smasm("a.ssm -o a1.o") == 0);
+    assert(smasm("b.ssm -o b1.o") == 0);
+
+    // a request writes the same object a direct run does
+    assert(request("a.ssm -o a.o", "/dev/null") == 0);
+    assert(same("a.o", "a1.o"));
+
+    // the tokens of the header are kept from the last request
+    assert(request("--stats b.ssm -o b.o", "stats.txt") == 0);
+    assert(same("b.o", "b1.o"));
+    assert(contains("stats.txt", "token records: 1 from other units"));
+
+    // an edited header is read again on the next request
+    put("shared.ssi", "SHARED = 12\n");
+    assert(smasm("a.ssm -o a2.o") == 0);
+    assert(!same("a2.o", "a1.o"));
+    assert(request("a.ssm -o a.o", "/dev/null") == 0);
+    assert(same("a.o", "a2.o"));
+
+    // a failing request is reported to its client, the server keeps serving
+    assert(request("bad.ssm -o bad.o", "err.txt") == 1);
+    assert(contains("err.txt", "bad.ssm"));
+    assert(!exists("bad.o"));
+    assert(request("b.ssm -o b.o", "/dev/null") == 0);
+
+    // several sources on threads
+    assert(smasm("b.ssm -o b2.o") == 0);
+    assert(request("-j 2 a.ssm b.ssm", "/dev/null") == 0);
+    assert(same("a.o", "a2.o"));
+    assert(same("b.o", "b2.o"));
+
+    stop();
+    char cmd[64];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    assert(system(cmd) == 0);
+    return EXIT_SUCCESS;
+}